@@ -157,11 +157,15 @@ extern StatusType  CoAwakeTask(OS_TID taskID);
 extern StatusType  CoSuspendTask(OS_TID taskID);
 extern StatusType  CoSetPriority(OS_TID taskID,U8 priority);
 extern OS_TID      CreateTask(FUNCPtr task,void *argv,U32 parameter,OS_STK *stk);
+#if CFG_CPU_STATS_EN > 0
+extern StatusType  CoGetTaskCycles(OS_TID taskID,U64* cycles,U32* maxCycles);
+#endif
 
 /* Implement in file "time.c"      */
 extern U64         CoGetOSTime(void);
 extern U32         CoGetOSTime32(void);
 extern StatusType  CoTickDelay(U32 ticks);
+extern StatusType  CoUsDelay(U32 us);
 extern StatusType  CoResetTaskDelayTick(OS_TID taskID,U32 ticks);
 extern StatusType  CoTimeDelay(U8 hour,U8 minute,U8 sec,U16 millsec);
 
@@ -172,6 +176,7 @@ extern StatusType  CoStopTmr(OS_TCID tmrID);
 extern StatusType  CoStartTmr(OS_TCID tmrID);
 extern U32         CoGetCurTmrCnt(OS_TCID tmrID,StatusType* perr);
 extern StatusType  CoSetTmrCnt(OS_TCID tmrID,U32 tmrCnt,U32 tmrReload);
+extern StatusType  CoSetTmrCntUs(OS_TCID tmrID,U32 tmrCnt,U32 tmrReload);
 extern OS_TCID     CoCreateTmr(U8 tmrType, U32 tmrCnt, U32 tmrReload, vFUNCPtr func);
 
 
@@ -218,6 +223,7 @@ extern StatusType  isr_PostQueueMail(OS_EventID id,void* pmail);
 extern void*       CoAcceptQueueMail(OS_EventID id,StatusType* perr);
 extern OS_EventID  CoCreateQueue(void **qStart, U16 size ,U8 sortType);
 extern void*       CoPendQueueMail(OS_EventID id,U32 timeout,StatusType* perr);
+extern U16         CoPendQueueMailN(OS_EventID id,void** pmails,U16 max,U32 timeout,StatusType* perr);
 
 
 
@@ -233,6 +239,16 @@ extern U32         CoAcceptMultipleFlags (U32 flags,U8 waitType,StatusType *perr
 extern U32         CoWaitForMultipleFlags (U32 flags,U8 waitType,U32 timeout,StatusType *perr);
 
 
+/* Implement in file "notify.c"    */
+extern StatusType  isr_NotifyTask (OS_TID taskID,U32 bits);
+extern U32         CoWaitNotify (void);
+
+
+/* Implement in file "serviceReq.c"*/
+extern U32         CoGetSRQOverflows (void);
+extern U32         CoGetSRQHighWater (void);
+
+
 /* Implement in file "utility.c"   */
 extern StatusType  CoTimeToTick(U8 hour,U8 minute,U8 sec,U16 millsec,U32* ticks);
 extern void        CoTickToTime(U32 ticks,U8* hour,U8* minute,U8* sec,U16* millsec);
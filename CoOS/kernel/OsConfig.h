@@ -60,7 +60,9 @@ Defines the lowest priority that be assigned.
 /*!<
 Max number of tasks that can be running.
 */
+#ifndef CFG_MAX_USER_TASKS
 #define CFG_MAX_USER_TASKS      (6)
+#endif
 
 /*!<
 Idle task stack size(word).
@@ -84,15 +86,54 @@ systick frequency (Hz).
 #define MSTOTICKS(ms)			(ms/MSPERTICK)
 
 /*!<
-max system api call num in ISR.
+Enable(1) or disable(0) tickless timing.
+If enable(1), SysTick doesn't interrupt every tick. Delays, timeouts and
+timers are kept in microseconds, counted by TIM2, which the main input timer
+runs as a free running 32 bit counter at 1MHz. A compare on TIM2 channel 2
+interrupts when the next delay or timer ends. Ticks passed to the tick APIs
+are still 1/CFG_SYSTICK_FREQ s. A single delay or timeout is limited to
+MAX_DELAY_US, about 18 minutes.
+*/
+#ifndef CFG_TICKLESS_EN
+#define CFG_TICKLESS_EN         (1)
+#endif
+
+/*!<
+Enable(1) or disable(0) counting the CPU cycles each task runs.
+If enable(1), the DWT cycle counter is started, and each context switch
+charges the cycles since the one before to the task switched out, less the
+cycles spent in ISRs that add theirs to OSIsrCycles. Cortex-M3/M4 only.
+*/
+#ifndef CFG_CPU_STATS_EN
+#define CFG_CPU_STATS_EN        (1)
+#endif
+
+/*!<
+max system api call num in ISR waiting to be handled at once.
+(must be a power of 2) Flags set in ISR don't take any room.
+*/
+#ifndef CFG_MAX_SERVICE_REQUEST
+#define CFG_MAX_SERVICE_REQUEST (16)
+#endif
+
+/*!<
+Enable(1) or disable(0) bitmap schedule.
+If enable(1), the READY list is still kept in order, but a bitmap of the
+priorities that have ready tasks and the last ready task of each priority
+give the place to insert a task without walking the list, so inserting,
+removing and finding the highest priority ready task take constant time
+whatever the number of tasks (see tools/sched_bench.c). The
+Binary-Scheduling Algorithm is then not used.
 */
-#define CFG_MAX_SERVICE_REQUEST (15)
+#ifndef CFG_BITMAP_SCHEDULE_EN
+#define CFG_BITMAP_SCHEDULE_EN      (1)
+#endif
 
 /*!<
 Enable(1) or disable(0) order list schedule.
 If disable(0),CoOS use Binary-Scheduling Algorithm.
 */
-#if (CFG_MAX_USER_TASKS) <15
+#if (CFG_MAX_USER_TASKS) <15 || CFG_BITMAP_SCHEDULE_EN > 0
 #define CFG_ORDER_LIST_SCHEDULE_EN  (1)
 #else
 #define CFG_ORDER_LIST_SCHEDULE_EN  (0)
@@ -270,6 +311,17 @@ Max number of flag is 32.
 #endif
 
 
+/*------------------- Task Notification Management Config -------------------*/
+/*!<
+Enable(1) or disable(0) task notifications. Each task has a notification word
+that an ISR can set bits in to wake the task, without the service request
+queue.
+*/
+#if CFG_TASK_WAITTING_EN > 0
+#define  CFG_NOTIFY_EN         (1)
+#endif
+
+
 /*---------------------- Mutex Management Config ----------------------------*/
 /*!<
 Enable(1) or disable(0) mutex management.
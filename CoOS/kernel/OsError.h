@@ -64,6 +64,21 @@
     #endif
 #endif
 
+#if CFG_TICKLESS_EN > 0
+    #if CFG_ROBIN_EN > 0
+    #error " OsConfig.h, CFG_ROBIN_EN needs a periodic tick, CFG_TICKLESS_EN must be 0! "
+    #endif
+    #if CFG_TASK_WAITTING_EN == 0
+    #error " OsConfig.h, CFG_TICKLESS_EN needs CFG_TASK_WAITTING_EN! "
+    #endif
+#endif
+
+#if CFG_CPU_STATS_EN > 0
+    #if CFG_CHIP_TYPE == 2
+    #error " OsConfig.h, Cortex-M0 has no cycle counter, CFG_CPU_STATS_EN must be 0! "
+    #endif
+#endif
+
 #if CFG_TMR_EN > 0
     #if CFG_MAX_TMR > 32
     #error " OsConfig.h, CFG_MAX_TMR must be <= 32! "
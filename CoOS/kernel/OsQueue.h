@@ -52,11 +52,16 @@ typedef struct Queue
 {
     void    **qStart;                   /*!<                                  */
     U8      id;                         /*!<                                  */
-    U16     head;                       /*!< The header of queue              */
-    U16     tail;                       /*!< The end of queue                 */
+    U8      eventID;                    /*!< Event the queue belongs to       */
     U16     qMaxSize;                   /*!< The max size of queue            */
-    U16     qSize;                      /*!< Current size of queue            */
+    U32     head;                       /*!< Position of the oldest mail      */
+    U32     tail;                       /*!< Position for the next mail       */
+    U32     qLimit;                     /*!< Positions wrap here              */
 }QCB,*P_QCB;
 
 
+extern U32  QueueReq;
+extern void QueueDispose(void);
+
+
 #endif
@@ -46,12 +46,11 @@
 #if CFG_MAX_SERVICE_REQUEST > 0
 #define   SEM_REQ       (U8)0x1
 #define   MBOX_REQ      (U8)0x2
-#define   FLAG_REQ      (U8)0x3
-#define   QUEUE_REQ     (U8)0x4
 
 
 typedef struct ServiceReqCell
 {
+    U32     seq;        /*!< Whether the cell is free or filled, and for when */
     U8      type;
     U8      id;
     void*   arg;
@@ -59,14 +58,18 @@ typedef struct ServiceReqCell
 
 typedef struct ServiceReqQueue
 {
-    U8    cnt;
-    U8    head;    
+    U32   tail;         /*!< Next position for an ISR to claim.               */
+    U32   head;         /*!< Next position for RespondSRQ() to take.          */
+    U32   flagReq;      /*!< Flags set in ISR, one bit per flag id.           */
+    U32   overflows;    /*!< Requests lost because the queue was full.        */
+    U32   highWater;    /*!< Most requests waiting at once.                   */
     SQC   cell[CFG_MAX_SERVICE_REQUEST];
 }SRQ,*P_SRQ;
 
 
 extern SRQ  ServiceReq;
 extern BOOL InsertInSRQ(U8 type,U8 id,void* arg);
+extern void InsertFlagInSRQ(U8 id);
 #endif
 
 extern void RespondSRQ(void);
@@ -66,6 +66,10 @@ typedef  struct TCB
     U8          state;                  /*!< TaSk status.                     */
     OS_TID      taskID;                 /*!< Task ID.                         */
 
+#if CFG_BITMAP_SCHEDULE_EN > 0
+    U8          rdyPrio;                /*!< PRI of READY list task is in.    */
+#endif
+
 #if CFG_MUTEX_EN > 0
     OS_MutexID  mutexID;                /*!< Mutex ID.                        */
 #endif
@@ -100,7 +104,17 @@ typedef  struct TCB
 
 #if CFG_TASK_WAITTING_EN >0
     U32         delayTick;              /*!< The number of ticks which delay. */
+#endif
+
+#if CFG_NOTIFY_EN > 0
+    U32         notifyBits;             /*!< Notifications not yet taken.     */
+    BOOL        notifyWait;             /*!< Waiting for a notification.      */
 #endif    
+
+#if CFG_CPU_STATS_EN > 0
+    U64         runCycles;              /*!< Cycles run,less counted ISRs.    */
+    U32         maxRunCycles;           /*!< Longest run between switches.    */
+#endif
     struct TCB  *TCBnext;               /*!< The pointer to next TCB.         */
     struct TCB  *TCBprev;               /*!< The pointer to prev TCB.         */
 
@@ -127,6 +141,11 @@ void  IdleTask(void* pdata);  /*!< IDLE task code                             */
 void  InsertToTCBRdyList  (P_OSTCB tcbInser);	
 void  RemoveFromTCBRdyList(P_OSTCB ptcb);
 void  CreateTCBList(void);
+#if CFG_NOTIFY_EN > 0
+#define NOTIFY_REQ_WORDS  ((CFG_MAX_USER_TASKS+SYS_TASK_NUM+31)/32)
+extern U32 NotifyReq[NOTIFY_REQ_WORDS];
+void  NotifyDispose(void);
+#endif
 #if CFG_ORDER_LIST_SCHEDULE_EN ==0
 void  ActiveTaskPri(U8 pri);
 void  DeleteTaskPri(U8 pri);
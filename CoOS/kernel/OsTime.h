@@ -40,12 +40,35 @@
 #ifndef _TIME_H
 #define _TIME_H
 
+#define US_PER_TICK     (1000000/CFG_SYSTICK_FREQ)
+
+#if CFG_TICKLESS_EN > 0
+/*!< Longest single delay or timeout, about 18 minutes. The compare is never
+     set further ahead, so OSTimeHigh sees every wrap of the count.           */
+#define MAX_DELAY_US    (0x40000000)
+#define MAX_DELAY_TICKS (MAX_DELAY_US/US_PER_TICK)
+
+/*!< Delays in the DELAY and timer lists are in microseconds                 */
+#define TICKS_TO_DELAY(ticks)   (((ticks) < MAX_DELAY_TICKS) ? (ticks)*US_PER_TICK : MAX_DELAY_US)
+#define US_TO_DELAY(us)         (((us) < MAX_DELAY_US) ? (us) : MAX_DELAY_US)
+#else
+/*!< Delays in the DELAY and timer lists are in ticks, rounded up            */
+#define TICKS_TO_DELAY(ticks)   (ticks)
+#define US_TO_DELAY(us)         ((us)/US_PER_TICK + (((us)%US_PER_TICK) != 0))
+#endif
+
 /*---------------------------- Variable declare ------------------------------*/
 extern P_OSTCB  DlyList;            /*!< A pointer to ther delay list.        */
+#if CFG_TICKLESS_EN > 0
+extern U32      DlyBase;            /*!< When the delay list head counts from */
+#endif
 
 /*---------------------------- Function declare ------------------------------*/
 extern void  TimeDispose(void);     /*!< Time dispose function.               */
 extern void  isr_TimeDispose(void);
 extern void  RemoveDelayList(P_OSTCB ptcb);
 extern void  InsertDelayList(P_OSTCB ptcb,U32 ticks);
+#if CFG_TICKLESS_EN > 0
+extern void  TicklessSchedule(void);/*!< Set the compare for the next end.    */
+#endif
 #endif
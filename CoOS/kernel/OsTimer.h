@@ -66,6 +66,9 @@ typedef struct tmrCtrl                  /* Timer Control Block Define.        */
 /*---------------------------- Variable declare ------------------------------*/
 extern P_TmrCtrl  TmrList;              /*!< A pointer to the timer list.     */ 
 extern U32        TmrIDVessel;
+#if CFG_TICKLESS_EN > 0
+extern U32        TmrBase;              /*!< When the list head counts from.  */
+#endif
 /*---------------------------- Function declare ------------------------------*/
 extern void  TmrDispose(void);          /*!< Timer counter function.          */
 extern void  isr_TmrDispose(void);
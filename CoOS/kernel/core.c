@@ -84,6 +84,16 @@ void CoExitISR(void)
     Dec8(&OSIntNesting);                /* OSIntNesting decrease              */
     if( OSIntNesting == 0)              /* Is OSIntNesting == 0?              */
     {
+#if CFG_TASK_WAITTING_EN > 0
+        /* A request left by an ISR that found the scheduler locked, too late
+           for the task unlocking it to respond. Don't leave it any longer.   */
+        if((IsrReq == Co_TRUE) && (OSSchedLock == 0))
+        {
+            OSSchedLock++;
+            RespondSRQ();
+            OSSchedLock--;
+        }
+#endif
         if(TaskSchedReq == Co_TRUE)
         {
 			OSSchedLock++;
@@ -124,6 +134,15 @@ void OsSchedUnlock(void)
             Schedule();                 /* Call task schedule                 */
         }
 		OSSchedLock = 0;
+#if CFG_TASK_WAITTING_EN > 0
+        /* An ISR may have found the scheduler still locked after
+           RespondSRQ() looked                                                */
+        if(IsrReq == Co_TRUE)
+        {
+            OSSchedLock = 1;
+            OsSchedUnlock();
+        }
+#endif
     }
 	else
 	{
@@ -196,6 +215,9 @@ void CoSchedUnlock(void)
 void CoInitOS(void)
 {
     InitSysTick();                /* Initialize system tick.                  */
+#if CFG_CPU_STATS_EN > 0
+    InitCpuStats();               /* Start counting cycles per task           */
+#endif
     InitInt();                    /* Initialize PendSV,SVC,SysTick interrupt  */	
     CreateTCBList();              /* Create TCB list.                         */   
 #if CFG_EVENT_EN > 0				    
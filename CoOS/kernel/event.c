@@ -326,9 +326,6 @@ void EventTaskToWait(P_ECB pecb,P_OSTCB ptcb)
 void EventTaskToRdy(P_ECB pecb)
 {
     P_OSTCB ptcb;
-#if CFG_QUEUE_EN >0
-    P_QCB   pqcb;
-#endif
     ptcb = pecb->eventTCBList;
     if(ptcb == Co_NULL)
         return;
@@ -357,14 +354,8 @@ void EventTaskToRdy(P_ECB pecb)
 #if CFG_QUEUE_EN >0
     else if(pecb->eventType == EVENT_TYPE_QUEUE)  /* Is it a queue event?     */
     {										   
-        pqcb        = (P_QCB)pecb->eventPtr;      /* Yes,get queue pointer    */
-        ptcb->pmail = *(pqcb->qStart + pqcb->head);   /* Send mail to task    */
-        //pqcb->head++;                             /* Clear event sign         */
-        //pqcb->qSize--;
-        //if(pqcb->head == pqcb->qMaxSize)
-        //{
-        //    pqcb->head = 0;	
-        //}
+        /* The task takes the mail itself, so it gets the oldest          */
+        ptcb->pmail = (void*)0xffffffff;      /* Indicate task woke by event  */
     }
 #endif
 
@@ -600,15 +600,16 @@ StatusType isr_SetFlag(OS_FlagID id)
 {
     if(OSSchedLock > 0)         /* If scheduler is locked,(the caller is ISR) */
     {
-        /* Insert the request into service request queue                      */
-        if(InsertInSRQ(FLAG_REQ,id,Co_NULL) == Co_FALSE)
-        {
-            return E_SEV_REQ_FULL;      /* The service requst queue is full   */
-        }
-        else
+#if CFG_PAR_CHECKOUT_EN >0
+        if(id >= FLAG_MAX_NUM)          /* Flag is valid or not               */
         {
-            return E_OK;
+            return E_INVALID_ID;        /* Invalid flag id                    */
         }
+#endif
+        /* Leave the flag to be set by RespondSRQ(). Setting it again before
+           then is the same as setting it once.                               */
+        InsertFlagInSRQ(id);
+        return E_OK;
     }
     else
     {
@@ -61,6 +61,12 @@ void CoIdleTask(void* pdata)
     {
         /* Add your codes here */
         OSIdleCtr++;
+#if CFG_CPU_STATS_EN > 0
+        /* Nothing may switch for longer than the cycle counter takes to wrap */
+        IRQ_DISABLE_SAVE();
+        CpuStatsSwitch();
+        IRQ_ENABLE_RESTORE();
+#endif
     }
 }
 
@@ -0,0 +1,218 @@
+/**
+ *******************************************************************************
+ * @file       notify.c
+ * @version    V1.1.6
+ * @date       2014.05.23
+ * @brief      Task notification implementation code of CooCox CoOS kernel.
+ * @details    Each task has a notification word. An ISR or a task sets bits in
+ *             it and the task takes the whole word when it waits, so one task
+ *             can wait on many sources without a flag for each of them.
+ *******************************************************************************
+ * @copy
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *      * Neither the name of the <ORGANIZATION> nor the names of its
+ *  contributors may be used to endorse or promote products derived
+ *  from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ *  THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * <h2><center>&copy; COPYRIGHT 2014 CooCox </center></h2>
+ *******************************************************************************
+ */
+
+
+
+/*---------------------------- Include ---------------------------------------*/
+#include <coocox.h>
+
+#if CFG_NOTIFY_EN > 0
+/*---------------------------- Variable Define -------------------------------*/
+/*!< Tasks an ISR notified while the scheduler was locked. One bit per task ID,
+     task n in bit n%32 of word n/32. Handled by RespondSRQ().                */
+U32     NotifyReq[NOTIFY_REQ_WORDS] = {0};
+
+
+/**
+ *******************************************************************************
+ * @brief      Make a task waiting for a notification ready
+ * @param[in]  ptcb     Task to wake.
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details    This function is called with the scheduler locked, once bits
+ *             have been set in the task's notification word.
+ * @note
+ *******************************************************************************
+ */
+static void NotifyWake(P_OSTCB ptcb)
+{
+    if(ptcb->notifyWait == Co_TRUE)     /* Is the task waiting?               */
+    {
+        ptcb->notifyWait = Co_FALSE;
+        InsertToTCBRdyList(ptcb);       /* Yes,make it ready                  */
+    }
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Respond to the notifications made while the scheduler was locked
+ * @param[in]  None
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details    This function is called by RespondSRQ() to wake the tasks
+ *             isr_NotifyTask() couldn't wake itself.
+ * @note
+ *******************************************************************************
+ */
+void NotifyDispose(void)
+{
+    U32 pending;
+    U8  word;
+    U8  bit;
+
+    for(word=0;word<NOTIFY_REQ_WORDS;word++)
+    {
+        /* Take the requests for these tasks                                  */
+        pending = __atomic_exchange_n(&NotifyReq[word],0,__ATOMIC_ACQUIRE);
+
+        while(pending != 0)             /* Only visit the tasks notified      */
+        {
+            bit = (U8)__builtin_ctz(pending);
+            pending &= pending - 1;
+            NotifyWake(&TCBTbl[word*32 + bit]);
+        }
+    }
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Notify a task in ISR
+ * @param[in]  taskID   ID of the task to notify.
+ * @param[in]  bits     Bits to set in the task's notification word.
+ * @param[out] None
+ * @retval     E_INVALID_ID   Invalid task ID.
+ * @retval     E_OK           Task notified successful.
+ *
+ * @par Description
+ * @details    This function is called in ISR or task to set bits in a task's
+ *             notification word, and wake the task if it is waiting for them.
+ *             Unlike isr_SetFlag() it never uses the service request queue, so
+ *             it can't fail because the queue is full, and it doesn't search
+ *             any waiting lists.
+ * @note
+ *******************************************************************************
+ */
+StatusType isr_NotifyTask(OS_TID taskID,U32 bits)
+{
+    P_OSTCB ptcb;
+
+#if CFG_PAR_CHECKOUT_EN >0              /* Check validity of parameter        */
+    if(taskID >= CFG_MAX_USER_TASKS + SYS_TASK_NUM)
+    {
+        return E_INVALID_ID;
+    }
+#endif
+    ptcb = &TCBTbl[taskID];
+#if CFG_PAR_CHECKOUT_EN >0
+    if(ptcb->state == TASK_DORMANT)
+    {
+        return E_INVALID_ID;
+    }
+#endif
+
+    if(OSSchedLock > 0)         /* If scheduler is locked,(the caller is ISR) */
+    {
+        /* Leave the task to be woken when the scheduler is unlocked          */
+        __atomic_fetch_or(&ptcb->notifyBits,bits,__ATOMIC_RELAXED);
+        __atomic_fetch_or(&NotifyReq[taskID/32],(U32)1<<(taskID%32),__ATOMIC_RELEASE);
+        __atomic_store_n(&IsrReq,Co_TRUE,__ATOMIC_SEQ_CST);
+        return E_OK;
+    }
+
+    OsSchedLock();
+    __atomic_fetch_or(&ptcb->notifyBits,bits,__ATOMIC_RELAXED);
+    NotifyWake(ptcb);
+    OsSchedUnlock();
+    return E_OK;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Wait for notifications
+ * @param[in]  None
+ * @param[out] None
+ * @retval     The notification bits set since the last call, never 0.
+ *
+ * @par Description
+ * @details    This function is called to wait until any bit is set in the
+ *             calling task's notification word. All the bits set are returned
+ *             and cleared together, so none set by an ISR in the meantime can
+ *             be lost.
+ * @note       There is no time-out.
+ *******************************************************************************
+ */
+U32 CoWaitNotify(void)
+{
+    P_OSTCB curTCB;
+    U32     bits;
+
+    if(OSIntNesting > 0)                /* If the caller is ISR               */
+    {
+        return 0;
+    }
+    if(OSSchedLock != 0)                /* Schedule is lock?                  */
+    {
+        return 0;                       /* Yes,error return                   */
+    }
+
+    curTCB = TCBRunning;
+    OsSchedLock();
+    while(1)
+    {
+        /* Take all the bits at once. An ISR that sets more before the task
+           is marked waiting finds the scheduler locked, so RespondSRQ()
+           wakes the task as it waits.                                        */
+        bits = __atomic_exchange_n(&curTCB->notifyBits,0,__ATOMIC_ACQUIRE);
+        curTCB->notifyWait = (bits == 0) ? Co_TRUE : Co_FALSE;
+
+        if(bits != 0)
+        {
+            break;
+        }
+
+        /* Block task until it is notified                                  */
+        curTCB->state = TASK_WAITING;
+        TaskSchedReq  = Co_TRUE;
+        OsSchedUnlock();
+        OsSchedLock();
+    }
+    OsSchedUnlock();
+    return bits;
+}
+
+#endif
@@ -45,6 +45,142 @@
 QCB   QueueTbl[CFG_MAX_QUEUE] = {{0}};    /*!< Queue control block table        */
 U32   QueueIDVessel = 0;                /*!< Queue list mask                  */
 
+/*!< Queues an ISR posted to while the scheduler was locked. One bit per queue,
+     queue n in bit n. Handled by RespondSRQ().                               */
+U32   QueueReq = 0;
+
+/*!< Marks a cell with no mail in it. Nothing else points here, so it can't
+     be a mail.                                                               */
+static U8 QueueEmptyCell;
+#define QUEUE_CELL_EMPTY  ((void*)&QueueEmptyCell)
+
+
+/**
+ *******************************************************************************
+ * @brief      Get the position after a position in a queue
+ * @param[in]  pqcb     Pointer to queue control block.
+ * @param[in]  pos      Position.
+ * @param[out] None
+ * @retval     The next position.
+ *
+ * @par Description
+ * @details    Positions count up to qLimit, a multiple of the queue size, and
+ *             then start again at 0, so the cell for a position is always the
+ *             position modulo the size.
+ * @note
+ *******************************************************************************
+ */
+static U32 QueueNext(P_QCB pqcb,U32 pos)
+{
+    pos++;
+    return (pos == pqcb->qLimit) ? 0 : pos;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Get the number of positions between head and tail
+ * @param[in]  pqcb     Pointer to queue control block.
+ * @param[in]  head     Position of the oldest mail.
+ * @param[in]  tail     Position for the next mail.
+ * @param[out] None
+ * @retval     The number of mails posted and not yet taken.
+ *
+ * @par Description
+ * @details    This function is called to find out how full a queue is.
+ * @note
+ *******************************************************************************
+ */
+static U32 QueueCount(P_QCB pqcb,U32 head,U32 tail)
+{
+    return (tail >= head) ? (tail - head) : (tail + pqcb->qLimit - head);
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Put a mail at the end of a queue
+ * @param[in]  pqcb     Pointer to queue control block.
+ * @param[in]  pmail    Pointer to mail.
+ * @param[out] None
+ * @retval     Co_FALSE    The queue is full.
+ * @retval     Co_TRUE     The mail was put in the queue.
+ *
+ * @par Description
+ * @details    This function is called by tasks and ISRs to post a mail. It
+ *             doesn't disable interrupts or lock the scheduler, so an ISR
+ *             can post while a task is part way through posting or taking.
+ *             The poster claims a position by moving the tail on, and then
+ *             fills the cell, which is how a task taking mails knows it can
+ *             take it. Mails are taken in the order they were claimed, so
+ *             they always arrive in the order they were posted.
+ * @note
+ *******************************************************************************
+ */
+static BOOL QueueInsert(P_QCB pqcb,void* pmail)
+{
+    U32 head;
+    U32 tail;
+
+    do
+    {
+        /* The head first, so it is never past the tail read               */
+        head = __atomic_load_n(&pqcb->head,__ATOMIC_ACQUIRE);
+        tail = __atomic_load_n(&pqcb->tail,__ATOMIC_RELAXED);
+        if(QueueCount(pqcb,head,tail) >= pqcb->qMaxSize)
+        {
+            return Co_FALSE;            /* The queue is full                  */
+        }
+    }
+    while(!__atomic_compare_exchange_n(&pqcb->tail,&tail,QueueNext(pqcb,tail),Co_FALSE,
+                                       __ATOMIC_RELAXED,__ATOMIC_RELAXED));
+
+    __atomic_store_n(&pqcb->qStart[tail % pqcb->qMaxSize],pmail,__ATOMIC_RELEASE);
+    return Co_TRUE;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Take mails from the front of a queue
+ * @param[in]  pqcb     Pointer to queue control block.
+ * @param[in]  max      The most mails to take.
+ * @param[out] pmails   The mails taken, oldest first.
+ * @retval     The number of mails taken.
+ *
+ * @par Description
+ * @details    This function is called by tasks with the scheduler locked, so
+ *             only one takes mails at a time. It stops at a cell that hasn't
+ *             been filled yet, even if later cells have been, as when an ISR
+ *             posts while a lower priority ISR is part way through posting.
+ * @note
+ *******************************************************************************
+ */
+static U16 QueueTake(P_QCB pqcb,void** pmails,U16 max)
+{
+    void**  pcell;
+    void*   pmail;
+    U32     head;
+    U16     count;
+
+    head = pqcb->head;
+    for(count = 0; count < max; count++)
+    {
+        pcell = &pqcb->qStart[head % pqcb->qMaxSize];
+        pmail = __atomic_load_n(pcell,__ATOMIC_ACQUIRE);
+        if(pmail == QUEUE_CELL_EMPTY)
+        {
+            break;                      /* Empty, or still being filled       */
+        }
+        pmails[count] = pmail;
+        __atomic_store_n(pcell,QUEUE_CELL_EMPTY,__ATOMIC_RELAXED);
+        head = QueueNext(pqcb,head);
+    }
+
+    /* Give the cells back to the posters                                     */
+    __atomic_store_n(&pqcb->head,head,__ATOMIC_RELEASE);
+    return count;
+}
 
  
 /**
@@ -65,6 +201,7 @@ U32   QueueIDVessel = 0;                /*!< Queue list mask                  */
 OS_EventID CoCreateQueue(void **qStart, U16 size ,U8 sortType)
 {
     U8    i;  
+    U16   j;
     P_ECB pecb;
 
 #if CFG_PAR_CHECKOUT_EN >0	
@@ -83,12 +220,16 @@ OS_EventID CoCreateQueue(void **qStart, U16 size ,U8 sortType)
             QueueIDVessel |= (1<<i);		
             OsSchedUnlock();
             
+            for(j = 0; j < size; j++)   /* No mail in any cell                */
+            {
+                qStart[j] = QUEUE_CELL_EMPTY;
+            }
             QueueTbl[i].qStart   = qStart;  /* Initialize the queue           */
             QueueTbl[i].id       = i;
             QueueTbl[i].head     = 0;
             QueueTbl[i].tail     = 0;
             QueueTbl[i].qMaxSize = size; 
-            QueueTbl[i].qSize    = 0;
+            QueueTbl[i].qLimit   = (0xFFFFFFFF / size) * size;
             
             /* Get a event control block and initial the event content        */
             pecb = CreatEvent(EVENT_TYPE_QUEUE,sortType,&QueueTbl[i]);
@@ -97,6 +238,7 @@ OS_EventID CoCreateQueue(void **qStart, U16 size ,U8 sortType)
             {
                 return E_CREATE_FAIL;
             }
+            QueueTbl[i].eventID  = pecb->id;
             return (pecb->id);		
         }
     }
@@ -148,10 +290,11 @@ StatusType CoDelQueue(OS_EventID id,U8 opt)
         QueueIDVessel &= ~((U32)(1<<(pqcb->id)));   /* Update free queue list             */
         pqcb->qStart   = Co_NULL;
 		    pqcb->id       = 0;
+        pqcb->eventID  = 0;
         pqcb->head     = 0;
         pqcb->tail     = 0;
         pqcb->qMaxSize = 0;
-        pqcb->qSize    = 0;
+        pqcb->qLimit   = 0;
     }
     return err;	
 }
@@ -168,7 +311,8 @@ StatusType CoDelQueue(OS_EventID id,U8 opt)
  *
  * @par Description
  * @details    This function is called to accept a mail from queue.
- * @note 
+ * @note       Not in ISR. Mails are taken with the scheduler locked, which
+ *             doesn't keep an ISR from taking them at the same time.
  *******************************************************************************
  */
 void* CoAcceptQueueMail(OS_EventID id,StatusType* perr)
@@ -176,6 +320,11 @@ void* CoAcceptQueueMail(OS_EventID id,StatusType* perr)
   P_ECB pecb;
   P_QCB pqcb;
   void* pmail;
+    if(OSIntNesting > 0)                /* If the caller is ISR               */
+    {
+        *perr = E_CALL;
+        return Co_NULL;
+    }
 #if CFG_PAR_CHECKOUT_EN >0
     if(id >= CFG_MAX_EVENT)             
     {
@@ -194,16 +343,8 @@ void* CoAcceptQueueMail(OS_EventID id,StatusType* perr)
 #endif	
     pqcb = (P_QCB)pecb->eventPtr;       /* Point at queue control block       */
 	OsSchedLock();
-    if(pqcb->qSize != 0)            /* If there are any messages in the queue */
+    if(QueueTake(pqcb,&pmail,1) != 0)   /* Take the oldest mail, if any       */
     {
-        /* Extract oldest message from the queue */
-        pmail = *(pqcb->qStart + pqcb->head);  
-        pqcb->head++;                   /* Update the queue head              */ 
-        pqcb->qSize--;          /* Update the number of messages in the queue */  
-        if(pqcb->head == pqcb->qMaxSize)
-        {
-            pqcb->head = 0;	
-        }
 		OsSchedUnlock();
         *perr = E_OK;
         return pmail;                   /* Return message received            */
@@ -233,21 +374,55 @@ void* CoAcceptQueueMail(OS_EventID id,StatusType* perr)
  *******************************************************************************
  */
 void* CoPendQueueMail(OS_EventID id,U32 timeout,StatusType* perr)
+{
+    void*   pmail;
+
+    if(CoPendQueueMailN(id,&pmail,1,timeout,perr) == 0)
+    {
+        return Co_NULL;                 /* Error, or timed out                */
+    }
+    return pmail;                       /* Return message received            */
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Pend for mails
+ * @param[in]  id       Event ID.
+ * @param[in]  max      The most mails to take.
+ * @param[in]  timeout  The longest time for writting mail.
+ * @param[out] pmails   The mails received, oldest first.
+ * @param[out] perr     A pointer to error code.
+ * @retval     The number of mails received, 0 on error or time-out.
+ *
+ * @par Description
+ * @details    This function is called to wait until there is a mail in the
+ *             queue and then take all the mails there, up to max. A task
+ *             that falls behind a burst of posts catches up in one call.
+ * @note       A queue deleted while the task waits returns E_TIMEOUT.
+ *******************************************************************************
+ */
+U16 CoPendQueueMailN(OS_EventID id,void** pmails,U16 max,U32 timeout,StatusType* perr)
 {
     P_ECB   pecb;
     P_QCB   pqcb;
     P_OSTCB curTCB;
-    void*   pmail;
+    U16     count;
     if(OSIntNesting > 0)                /* If the caller is ISR               */
     {
         *perr = E_CALL;
-        return Co_NULL;
+        return 0;
     }
 #if CFG_PAR_CHECKOUT_EN >0
     if(id >= CFG_MAX_EVENT)	         
     {
         *perr = E_INVALID_ID;           /* Invalid event id,return error      */
-        return Co_NULL;
+        return 0;
+    }
+    if((pmails == Co_NULL) || (max == 0))
+    {
+        *perr = E_INVALID_PARAMETER;
+        return 0;
     }
 #endif
 
@@ -256,83 +431,46 @@ void* CoPendQueueMail(OS_EventID id,U32 timeout,StatusType* perr)
     if(pecb->eventType != EVENT_TYPE_QUEUE) /* The event type is not queue    */
     {
         *perr = E_INVALID_ID;
-        return Co_NULL;
+        return 0;
     }
 #endif	
     if(OSSchedLock != 0)                /* Judge schedule is locked or not?   */
     {	
         *perr = E_OS_IN_LOCK;           /* Schedule is locked,return error    */								 
-        return Co_NULL;
+        return 0;
     }	
-    pqcb = (P_QCB)pecb->eventPtr;       /* Point at queue control block       */
+    pqcb   = (P_QCB)pecb->eventPtr;     /* Point at queue control block       */
+    curTCB = TCBRunning;
+    *perr  = E_OK;
     OsSchedLock();
-    if(pqcb->qSize != 0)            /* If there are any messages in the queue */
+    count = QueueTake(pqcb,pmails,max);
+    while(count == 0)                   /* If there is no message in the queue*/
     {
-        /* Extract oldest message from the queue                              */
-        pmail = *(pqcb->qStart + pqcb->head);   
-        pqcb->head++;                   /* Update the queue head              */ 
-        pqcb->qSize--;          /* Update the number of messages in the queue */  
-        if(pqcb->head == pqcb->qMaxSize)/* Check queue head                   */
+        /* Block task until a mail is posted or timeout occurs. A post made
+           before the task is switched out finds the scheduler locked, and
+           leaves waking the task to RespondSRQ().                            */
+        curTCB->pmail = Co_NULL;
+        EventTaskToWait(pecb,curTCB);
+        if(timeout != 0)                /* If time-out is configured          */
         {
-            pqcb->head = 0;	
+            InsertDelayList(curTCB,timeout);
         }
         OsSchedUnlock();
-        *perr = E_OK;
-        return pmail;                   /* Return message received            */
-    }
-    else                                /* If there is no message in the queue*/
-    {
-    	OsSchedUnlock();
-        curTCB = TCBRunning;
-        if(timeout == 0)                /* If time-out is not configured      */
+        OsSchedLock();
+        if(curTCB->pmail == Co_NULL)    /* If time-out occurred               */
         {
-            /* Block current task until the event occur                       */
-            EventTaskToWait(pecb,curTCB); 
-            
-            /* Have recived message or the queue have been deleted            */
-            OsSchedLock(); 
-            pmail = curTCB->pmail;              
-            curTCB->pmail = Co_NULL;
-            pqcb->head++;                             /* Clear event sign         */
-            pqcb->qSize--;
-            if(pqcb->head == pqcb->qMaxSize)
-            {
-                pqcb->head = 0;	
-            }
-            OsSchedUnlock();
-            *perr = E_OK;
-            return pmail;               /* Return message received or Co_NULL    */
+            *perr = E_TIMEOUT;
+            break;
         }
-        else                            /* If time-out is configured          */
-        {
-            OsSchedLock(); 
-            
-            /* Block current task until event or timeout occurs               */           
-            EventTaskToWait(pecb,curTCB);       
-            InsertDelayList(curTCB,timeout);
-            OsSchedUnlock();
-            if(curTCB->pmail == Co_NULL)   /* If time-out occurred               */
-            {
-                *perr = E_TIMEOUT;
-                return Co_NULL;
-            }
-            else                        /* If event occured                   */
-            {
-                OsSchedLock();
-                pmail = curTCB->pmail;              
-                curTCB->pmail = Co_NULL;
-                pqcb->head++;                             /* Clear event sign         */
-                pqcb->qSize--;
-                if(pqcb->head == pqcb->qMaxSize)
-                {
-                    pqcb->head = 0;	
-                }
-                OsSchedUnlock();
-                *perr = E_OK;
-                return pmail;           /* Return message received or Co_NULL    */
-            }				
-        }	
+
+        /* Woken by a post. The mail may have gone to another waiting task,
+           or its cell not be filled yet, so this can find nothing and wait
+           again, for the whole time-out.                                     */
+        count = QueueTake(pqcb,pmails,max);
     }
+    curTCB->pmail = Co_NULL;
+    OsSchedUnlock();
+    return count;
 }
 
 
@@ -349,7 +487,10 @@ void* CoPendQueueMail(OS_EventID id,U32 timeout,StatusType* perr)
  *
  * @par Description
  * @details    This function is called to post a mail to queue.
- * @note 
+ * @note       The scheduler is locked while the mail is put in, so only ISRs
+ *             can post or take at the same time, and they can't take. The
+ *             tail can't come all the way round to where it was, then, and
+ *             fool QueueInsert().
  *******************************************************************************
  */
 StatusType CoPostQueueMail(OS_EventID id,void* pmail)
@@ -371,24 +512,15 @@ StatusType CoPostQueueMail(OS_EventID id,void* pmail)
     }	
 #endif
     pqcb = (P_QCB)pecb->eventPtr;	
-    if(pqcb->qSize == pqcb->qMaxSize)   /* If queue is full                   */
-    {
-        return E_QUEUE_FULL;
-    }
-    else                                /* If queue is not full               */
+    OsSchedLock();
+    if(QueueInsert(pqcb,pmail) == Co_FALSE) /* If queue is full               */
     {
-        OsSchedLock();
-        *(pqcb->qStart + pqcb->tail) = pmail;   /* Insert message into queue  */
-        pqcb->tail++;                           /* Update queue tail          */
-        pqcb->qSize++;          /* Update the number of messages in the queue */
-        if(pqcb->tail == pqcb->qMaxSize)        /* Check queue tail           */   
-        {
-            pqcb->tail = 0;	
-        }
-        EventTaskToRdy(pecb);           /* Check the event waiting list       */
         OsSchedUnlock();
-        return E_OK;
+        return E_QUEUE_FULL;
     }
+    EventTaskToRdy(pecb);               /* Check the event waiting list       */
+    OsSchedUnlock();
+    return E_OK;
 }
 
 
@@ -403,30 +535,95 @@ StatusType CoPostQueueMail(OS_EventID id,void* pmail)
  * @retval     E_QUEUE_FULL		 
  *
  * @par Description
- * @details    This function is called in ISR to post a mail to queue.
+ * @details    This function is called in ISR to post a mail to queue. The mail
+ *             goes straight into the queue, never through the service request
+ *             queue, so it can't be overtaken by a later post. If the
+ *             scheduler is locked a task may be about to wait, so waking it
+ *             is left to RespondSRQ(), which only has to note the queue.
  * @note 				   
  *******************************************************************************
  */
-#if CFG_MAX_SERVICE_REQUEST > 0
 StatusType isr_PostQueueMail(OS_EventID id,void* pmail)
 {
+    P_ECB pecb;
+    P_QCB pqcb;
+#if CFG_PAR_CHECKOUT_EN >0                     
+    if(id >= CFG_MAX_EVENT)	
+    {
+        return E_INVALID_ID;          
+    }
+#endif
+
+    pecb = &EventTbl[id];
+#if CFG_PAR_CHECKOUT_EN >0
+    if(pecb->eventType != EVENT_TYPE_QUEUE)   
+    {
+        return E_INVALID_ID;            /* The event type isn't queue,return  */	
+    }	
+#endif
+    pqcb = (P_QCB)pecb->eventPtr;	
+    if(QueueInsert(pqcb,pmail) == Co_FALSE) /* If queue is full               */
+    {
+        return E_QUEUE_FULL;
+    }
+
     if(OSSchedLock > 0)         /* If scheduler is locked,(the caller is ISR) */
     {
-        /* Insert the request into service request queue                      */
-        if(InsertInSRQ(QUEUE_REQ,id,pmail) == Co_FALSE)
+        /* Leave the waiting task to be woken when the scheduler is unlocked  */
+        __atomic_fetch_or(&QueueReq,(U32)1<<pqcb->id,__ATOMIC_RELEASE);
+        __atomic_store_n(&IsrReq,Co_TRUE,__ATOMIC_SEQ_CST);
+    }
+    else if(pecb->eventTCBList != Co_NULL)  /* Is a task waiting?             */
+    {
+        OsSchedLock();
+        EventTaskToRdy(pecb);           /* Yes,wake it                        */
+        OsSchedUnlock();
+    }
+    return E_OK;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Respond to the posts made while the scheduler was locked
+ * @param[in]  None
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details    This function is called by RespondSRQ() to wake the tasks
+ *             waiting on the queues isr_PostQueueMail() posted to. A task is
+ *             woken for each mail in the queue, while any are waiting.
+ * @note
+ *******************************************************************************
+ */
+void QueueDispose(void)
+{
+    P_QCB   pqcb;
+    P_ECB   pecb;
+    U32     pending;
+    U32     count;
+    U8      i;
+
+    /* Take the requests for these queues                                     */
+    pending = __atomic_exchange_n(&QueueReq,0,__ATOMIC_ACQUIRE);
+    while(pending != 0)                 /* Only visit the queues posted to    */
+    {
+        i        = (U8)__builtin_ctz(pending);
+        pending &= pending - 1;
+        if((QueueIDVessel & (1 << i)) == 0)
         {
-            return E_SEV_REQ_FULL;      /* If service request queue is full   */          
-        }			
-        else  /* If the request have been inserted into service request queue */
+            continue;                   /* Deleted since                      */
+        }
+        pqcb  = &QueueTbl[i];
+        pecb  = &EventTbl[pqcb->eventID];
+        count = QueueCount(pqcb,pqcb->head,__atomic_load_n(&pqcb->tail,__ATOMIC_RELAXED));
+        while((count > 0) && (pecb->eventTCBList != Co_NULL))
         {
-            return E_OK;
+            EventTaskToRdy(pecb);
+            count--;
         }
     }
-    else                                /* The scheduler is unlocked          */
-    {
-        return(CoPostQueueMail(id,pmail));    /* Send the message to the queue*/ 
-    }
 }
-#endif
 							   	 
-#endif
\ No newline at end of file
+#endif
@@ -44,6 +44,11 @@
 #if (CFG_TASK_WAITTING_EN > 0) || (CFG_TMR_EN >0)
 
 #if CFG_MAX_SERVICE_REQUEST > 0
+#if (CFG_MAX_SERVICE_REQUEST & (CFG_MAX_SERVICE_REQUEST - 1)) != 0
+#error "CFG_MAX_SERVICE_REQUEST must be a power of 2"
+#endif
+#define SRQ_MASK      (CFG_MAX_SERVICE_REQUEST - 1)
+
 /*---------------------------- Variable Define -------------------------------*/
 SRQ   ServiceReq;             /*!< ISR server request queue         */
 #endif
@@ -64,39 +69,170 @@ BOOL  TimerReq = Co_FALSE;                 /*!< Timer dispose request
  * @param[in]  arg      Service request argument.
  * @param[out] None
  *
- * @retval     Co_FALSE    Successfully insert into service request queue.
- * @retval     Co_TRUE     Failure to insert into service request queue.
+ * @retval     Co_FALSE    Failure to insert into service request queue.
+ * @retval     Co_TRUE     Successfully insert into service request queue.
  *
  * @par Description
  * @details    This function be called to insert a requst into service request
- *             queue.
- * @note
+ *             queue. It doesn't disable interrupts, so ISRs of any priority
+ *             can insert requests while it runs. Each one claims a position
+ *             by moving the tail on, fills the cell at that position and then
+ *             marks the cell filled with its sequence number, which is how
+ *             RespondSRQ() knows it can take it.
+ *             A cell's sequence number is its position less its index while
+ *             it is free for that position, and one more once filled.
+ * @note       A request that doesn't fit is counted, see CoGetSRQOverflows().
  *******************************************************************************
  */
 #if (CFG_MAX_SERVICE_REQUEST > 0)
 BOOL InsertInSRQ(U8 type,U8 id,void* arg)
 {
     P_SQC   pcell;
-	U8 cnt;
-	U8 heed;
-    IRQ_DISABLE_SAVE();
-    if (ServiceReq.cnt >= CFG_MAX_SERVICE_REQUEST)
-    {
-        IRQ_ENABLE_RESTORE ();
+    U32     pos;
+    U32     base;
+    U32     used;
+    U32     highWater;
+    S32     diff;
 
-        return Co_FALSE;                   /* Error return                       */
+    pos = __atomic_load_n(&ServiceReq.tail,__ATOMIC_RELAXED);
+    while(1)
+    {
+        pcell = &ServiceReq.cell[pos & SRQ_MASK];
+        base  = pos & ~(U32)SRQ_MASK;
+        diff  = (S32)(__atomic_load_n(&pcell->seq,__ATOMIC_ACQUIRE) - base);
+        if(diff == 0)                   /* Free for this position, claim it   */
+        {
+            if(__atomic_compare_exchange_n(&ServiceReq.tail,&pos,pos + 1,Co_FALSE,
+                                           __ATOMIC_RELAXED,__ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if(diff < 0)               /* Still filled from the last lap     */
+        {
+            __atomic_fetch_add(&ServiceReq.overflows,1,__ATOMIC_RELAXED);
+            return Co_FALSE;            /* Error return                       */
+        }
+        else                            /* Claimed by a higher priority ISR   */
+        {
+            pos = __atomic_load_n(&ServiceReq.tail,__ATOMIC_RELAXED);
+        }
     }
-	cnt = Inc8(&ServiceReq.cnt);
-	heed = ServiceReq.head;
-    IsrReq = Co_TRUE;
-    pcell = &ServiceReq.cell[((cnt+heed)%CFG_MAX_SERVICE_REQUEST)];/*the tail */
+
     pcell->type = type;                 /* Save service request type,         */
     pcell->id   = id;                   /* event id                           */
     pcell->arg  = arg;                  /* and parameter                      */
-    IRQ_ENABLE_RESTORE ();
+    __atomic_store_n(&pcell->seq,base + 1,__ATOMIC_RELEASE);
 
+    /* Requests waiting, including this one                                 */
+    used      = pos + 1 - __atomic_load_n(&ServiceReq.head,__ATOMIC_RELAXED);
+    highWater = __atomic_load_n(&ServiceReq.highWater,__ATOMIC_RELAXED);
+    while((used > highWater) &&
+          !__atomic_compare_exchange_n(&ServiceReq.highWater,&highWater,used,Co_FALSE,
+                                       __ATOMIC_RELAXED,__ATOMIC_RELAXED))
+    {
+    }
+
+    __atomic_store_n(&IsrReq,Co_TRUE,__ATOMIC_SEQ_CST);
     return Co_TRUE;                        /* Return OK                          */
 }
+
+
+/**
+ *******************************************************************************
+ * @brief      Set a flag through the service request queue
+ * @param[in]  id       Flag id.
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details    This function be called in ISR to set a flag while the scheduler
+ *             is locked. Flags are kept in a bitmask rather than the queue, so
+ *             setting the same flag again before RespondSRQ() runs takes no
+ *             more room, and setting a flag can't fail.
+ * @note
+ *******************************************************************************
+ */
+void InsertFlagInSRQ(U8 id)
+{
+    __atomic_fetch_or(&ServiceReq.flagReq,(U32)1<<id,__ATOMIC_RELEASE);
+    __atomic_store_n(&IsrReq,Co_TRUE,__ATOMIC_SEQ_CST);
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Take the oldest request from service requst queue
+ * @param[in]  None
+ * @param[out] pcell    The request.
+ * @retval     Co_FALSE    The queue is empty.
+ * @retval     Co_TRUE     A request was taken.
+ *
+ * @par Description
+ * @details    This function be called by RespondSRQ(), the only consumer.
+ * @note
+ *******************************************************************************
+ */
+static BOOL TakeFromSRQ(P_SQC pcell)
+{
+    P_SQC   pqcell;
+    U32     pos;
+    U32     base;
+
+    pos    = ServiceReq.head;
+    pqcell = &ServiceReq.cell[pos & SRQ_MASK];
+    base   = pos & ~(U32)SRQ_MASK;
+    if(__atomic_load_n(&pqcell->seq,__ATOMIC_ACQUIRE) != base + 1)
+    {
+        return Co_FALSE;                /* Empty, or the ISR is filling it    */
+    }
+
+    pcell->type = pqcell->type;
+    pcell->id   = pqcell->id;
+    pcell->arg  = pqcell->arg;
+    /* Free the cell for the next lap                                         */
+    __atomic_store_n(&pqcell->seq,base + CFG_MAX_SERVICE_REQUEST,__ATOMIC_RELEASE);
+    __atomic_store_n(&ServiceReq.head,pos + 1,__ATOMIC_RELAXED);
+    return Co_TRUE;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Get the number of requests lost because the queue was full
+ * @param[in]  None
+ * @param[out] None
+ * @retval     Requests lost since startup.
+ *
+ * @par Description
+ * @details    This function is called to find out if CFG_MAX_SERVICE_REQUEST
+ *             is too small.
+ * @note
+ *******************************************************************************
+ */
+U32 CoGetSRQOverflows(void)
+{
+    return __atomic_load_n(&ServiceReq.overflows,__ATOMIC_RELAXED);
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Get the most requests that have been waiting at once
+ * @param[in]  None
+ * @param[out] None
+ * @retval     The service request queue's high-water mark.
+ *
+ * @par Description
+ * @details    This function is called to find out how close the service
+ *             request queue has come to overflowing.
+ * @note
+ *******************************************************************************
+ */
+U32 CoGetSRQHighWater(void)
+{
+    return __atomic_load_n(&ServiceReq.highWater,__ATOMIC_RELAXED);
+}
 #endif
 
 
@@ -111,7 +247,8 @@ BOOL InsertInSRQ(U8 type,U8 id,void* arg)
  * @par Description
  * @details    This function be called to respond the request in the service
  *             request queue.
- * @note
+ * @note       IsrReq is cleared before anything is looked at, so a request
+ *             made while this runs either gets handled or sets IsrReq again.
  *******************************************************************************
  */
 void RespondSRQ(void)
@@ -119,35 +256,51 @@ void RespondSRQ(void)
 
 #if CFG_MAX_SERVICE_REQUEST > 0
     SQC cell;
+#if CFG_FLAG_EN > 0
+    U32 flags;
+#endif
 
 #endif
 
+    __atomic_store_n(&IsrReq,Co_FALSE,__ATOMIC_SEQ_CST);
+
 #if (CFG_TASK_WAITTING_EN > 0)
     if(TimeReq == Co_TRUE)                 /* Time delay request?                */
     {
-        TimeDispose();                  /* Yes,call handler                   */
         TimeReq = Co_FALSE;                /* Reset time delay request Co_FALSE     */
+        TimeDispose();                  /* Yes,call handler                   */
     }
 #endif
 #if CFG_TMR_EN  > 0
     if(TimerReq == Co_TRUE)                /* Timer request?                     */
     {
-        TmrDispose();                   /* Yes,call handler                   */
         TimerReq = Co_FALSE;               /* Reset timer request Co_FALSE          */
+        TmrDispose();                   /* Yes,call handler                   */
     }
 #endif
 
+#if CFG_NOTIFY_EN > 0
+    NotifyDispose();                    /* Wake the tasks notified in ISR     */
+#endif
+
+#if CFG_QUEUE_EN > 0
+    QueueDispose();                     /* Wake tasks waiting on queues       */
+#endif
+
 #if CFG_MAX_SERVICE_REQUEST > 0
 
-    while (ServiceReq.cnt != 0)
+#if CFG_FLAG_EN > 0
+    /* Flag set requests, each flag once however often it was set            */
+    flags = __atomic_exchange_n(&ServiceReq.flagReq,0,__ATOMIC_ACQUIRE);
+    while (flags != 0)
     {
-        IRQ_DISABLE_SAVE ();            /* need to protect the following      */
-        cell = ServiceReq.cell[ServiceReq.head];  /* extract one cell         */
-        ServiceReq.head = (ServiceReq.head + 1) % /* move head (pop)          */
-                     CFG_MAX_SERVICE_REQUEST;
-        ServiceReq.cnt--;
-        IRQ_ENABLE_RESTORE ();          /* now use the cell copy              */
+        CoSetFlag((OS_FlagID)__builtin_ctz(flags));
+        flags &= flags - 1;
+    }
+#endif
 
+    while (TakeFromSRQ(&cell) == Co_TRUE)
+    {
         switch(cell.type)               /* Judge service request type         */
         {
 #if CFG_SEM_EN > 0
@@ -159,29 +312,12 @@ void RespondSRQ(void)
         case MBOX_REQ:                  /* Mailbox post request,call handler  */
             CoPostMail(cell.id, cell.arg);
             break;
-#endif
-#if CFG_FLAG_EN > 0
-        case FLAG_REQ:                  /* Flag set request,call handler      */
-            CoSetFlag(cell.id);
-            break;
-#endif
-#if CFG_QUEUE_EN > 0
-        case QUEUE_REQ:                 /* Queue post request,call handler    */
-            CoPostQueueMail(cell.id, cell.arg);
-            break;
 #endif
         default:                        /* Others,break                       */
             break;
         }
     }
 #endif
-    IRQ_DISABLE_SAVE ();                /* need to protect the following      */
-
-    if (ServiceReq.cnt == 0)            /* another item in the queue already? */
-    {
-        IsrReq = Co_FALSE;                 /* queue still empty here             */
-    }
-    IRQ_ENABLE_RESTORE ();              /* now it is done and return          */
 }
 
 #endif
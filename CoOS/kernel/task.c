@@ -62,6 +62,17 @@ OS_TID   RdyTaskPri[CFG_MAX_USER_TASKS+SYS_TASK_NUM] = {0};
 U32      RdyTaskPriInfo[(CFG_MAX_USER_TASKS+SYS_TASK_NUM+31)/32];
 #endif
 
+#if CFG_BITMAP_SCHEDULE_EN > 0
+#define  RDY_PRIO_WORDS  ((CFG_LOWEST_PRIO+1+31)/32)
+
+/*!< Priority n is bit n%32 of RdyPrioBitmap[n/32]. The bit is set while
+     RdyListTail[n], the last ready task of priority n, is not Co_NULL.      */
+U32      RdyPrioBitmap[RDY_PRIO_WORDS] = {0};
+P_OSTCB  RdyListTail[CFG_LOWEST_PRIO+1] = {Co_NULL};
+
+#define  PRIO_BIT(n)     ((U32)1 << ((n)%32))
+#endif
+
 
 /**
  *******************************************************************************
@@ -377,6 +388,171 @@ void DeleteTaskPri(U8 pri)
 #endif
 
 
+#if CFG_BITMAP_SCHEDULE_EN > 0
+
+/**
+ *******************************************************************************
+ * @brief      Get the last task of the next higher ready priority
+ * @param[in]  prio     A priority with no ready tasks.
+ * @param[out] None
+ * @retval     The last ready task of the lowest ready priority that is
+ *             higher than prio.
+ *
+ * @par Description
+ * @details    This function is called in Bitmap-Scheduling Algorithm to find
+ *             where in the READY list a task of priority prio goes, with a
+ *             CLZ instruction. There must be a ready task of higher priority.
+ *             Only the words of the bitmap between the two priorities are
+ *             read, at most RDY_PRIO_WORDS.
+ *******************************************************************************
+ */
+static P_OSTCB GetPrevRdyTCB(U32 prio)
+{
+    U32 word;
+    U32 bits;
+
+    word = prio/32;
+    bits = RdyPrioBitmap[word] & (PRIO_BIT(prio) - 1);
+    while(bits == 0)                    /* No higher PRI ready in this word?  */
+    {                                   /* Yes,try the word above             */
+        word--;
+        bits = RdyPrioBitmap[word];
+    }
+
+    return RdyListTail[word*32 + 31 - (U32)__builtin_clz(bits)];
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Insert a task to the ready list
+ * @param[in]  tcbInsert    A pointer to task will be inserted.
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details   This function is called to insert a task to the READY list.
+ *            The READY list is kept in order of priority as without the
+ *            bitmap, and the task goes after any ready tasks of the same
+ *            priority, but the place is found from RdyListTail and the
+ *            bitmap instead of by walking the list.
+ *******************************************************************************
+ */
+void InsertToTCBRdyList(P_OSTCB tcbInsert)
+{
+    P_OSTCB ptcb,ptcbNext;
+    U32 prio;
+#if CFG_ROBIN_EN >0
+    P_OSTCB ptcbRun;
+#endif
+
+    prio = tcbInsert->prio;             /* Get PRI of inserted task           */
+    tcbInsert->state     = TASK_READY;  /* Set task as TASK_READY             */
+    tcbInsert->rdyPrio   = (U8)prio;    /* Remember where it is in the list   */
+
+#if CFG_ROBIN_EN >0
+	ptcbRun = TCBRunning;
+    /* Set schedule time for the same PRI task as TCBRunning.                 */
+    if(prio == ptcbRun->prio)  /* Is PRI of inserted task equal to running task? */
+    {
+        if(ptcbRun != tcbInsert) /* Yes,is inserted task equal to running task?  */
+        {
+            if(ptcbRun != Co_NULL)            /* No,TCBRunning == Co_NULL?             */
+            {                           /* N0,OSCheckTime < OSTickCnt?        */
+                if(OSCheckTime < OSTickCnt)
+                {                       /* Yes,set OSCheckTime for task robin */
+                    OSCheckTime = OSTickCnt + ptcbRun->timeSlice;
+                }
+            }
+        }
+    }
+#endif
+
+    ptcb = RdyListTail[prio];
+    RdyListTail[prio] = tcbInsert;
+    if(ptcb == Co_NULL)                 /* Is no other task of this PRI ready?*/
+    {                                   /* Yes,find its place from the bitmap */
+        ptcb = TCBRdy;
+        if((ptcb == Co_NULL) || (prio < ptcb->rdyPrio))
+        {                               /* Higher PRI than TCBRdy,new head    */
+            RdyPrioBitmap[prio/32] |= PRIO_BIT(prio);
+            TaskSchedReq = Co_TRUE;
+            tcbInsert->TCBprev = Co_NULL;
+            tcbInsert->TCBnext = ptcb;
+            if(ptcb != Co_NULL)
+            {
+                ptcb->TCBprev = tcbInsert;
+            }
+            TCBRdy = tcbInsert;
+            return;
+        }
+        ptcb = GetPrevRdyTCB(prio);
+        RdyPrioBitmap[prio/32] |= PRIO_BIT(prio);
+    }
+
+    ptcbNext = ptcb->TCBnext;           /* Insert after ptcb                  */
+    tcbInsert->TCBprev = ptcb;
+    tcbInsert->TCBnext = ptcbNext;
+    ptcb->TCBnext      = tcbInsert;
+    if(ptcbNext != Co_NULL)
+    {
+        ptcbNext->TCBprev = tcbInsert;
+    }
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Remove a task from the READY list
+ * @param[in]  ptcb     A pointer to task which be removed.
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details    This function is called to remove a task from the READY list.
+ *             The priority of the task may have been changed since it was
+ *             inserted, so its place is found from rdyPrio.
+ *******************************************************************************
+ */
+void RemoveFromTCBRdyList(P_OSTCB ptcb)
+{
+    P_OSTCB ptcbNext,ptcbPrev;
+    U32 prio;
+
+    prio     = ptcb->rdyPrio;
+    ptcbNext = ptcb->TCBnext;
+    ptcbPrev = ptcb->TCBprev;
+    ptcb->TCBnext = Co_NULL;
+    ptcb->TCBprev = Co_NULL;
+    if(ptcbPrev == Co_NULL)             /* Is the first item in READY list?   */
+    {
+        TCBRdy = ptcbNext;              /* Yes,the next one is the new head   */
+    }
+    else
+    {
+        ptcbPrev->TCBnext = ptcbNext;
+    }
+    if(ptcbNext != Co_NULL)
+    {
+        ptcbNext->TCBprev = ptcbPrev;
+    }
+
+    if(RdyListTail[prio] != ptcb)       /* Is it the last task of its PRI?    */
+    {
+        return;
+    }
+    if((ptcbPrev != Co_NULL) && (ptcbPrev->rdyPrio == prio))
+    {                                   /* Yes,but not the only one           */
+        RdyListTail[prio] = ptcbPrev;
+        return;
+    }
+
+    RdyListTail[prio] = Co_NULL;        /* The PRI is no longer ready         */
+    RdyPrioBitmap[prio/32] &= ~PRIO_BIT(prio);
+}
+
+#else
+
 /**
  *******************************************************************************
  * @brief      Insert a task to the ready list
@@ -576,6 +752,8 @@ void RemoveFromTCBRdyList(P_OSTCB ptcb)
 #endif
 }
 
+#endif /* CFG_BITMAP_SCHEDULE_EN */
+
 
 #if CFG_MUTEX_EN > 0
 #define CFG_PRIORITY_SET_EN       (1)
@@ -718,6 +896,65 @@ StatusType CoSetPriority(OS_TID taskID,U8 priority)
 }
 #endif
 
+/**
+ *******************************************************************************
+ * @brief      Put the running task in the READY list in place of its head
+ * @param[in]  pCurTcb  The running task.
+ * @param[in]  pRdyTcb  The head of the READY list, which is to run next.
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details    This function is called by Schedule() when the head of the
+ *             READY list takes over from the running task. With the bitmap
+ *             the head is removed first, as the running task then usually
+ *             goes straight in as the new head, without a bitmap search.
+ *******************************************************************************
+ */
+static void ReadyListSwap(P_OSTCB pCurTcb,P_OSTCB pRdyTcb)
+{
+#if CFG_BITMAP_SCHEDULE_EN > 0
+    P_OSTCB ptcbNext;
+    U32 curPrio;
+    U32 rdyPrio;
+
+    curPrio  = pCurTcb->prio;
+    rdyPrio  = pRdyTcb->rdyPrio;
+    ptcbNext = pRdyTcb->TCBnext;
+    if((ptcbNext != Co_NULL) && (ptcbNext->rdyPrio <= curPrio))
+    {                                   /* Running task goes behind others    */
+        RemoveFromTCBRdyList(pRdyTcb);
+        InsertToTCBRdyList(pCurTcb);
+        TaskSchedReq = Co_FALSE;        /* Schedule() is already under way    */
+        return;
+    }
+
+    /* No other task of either PRI is ready, so the running task simply
+       takes the place of the head.                                          */
+    pRdyTcb->TCBnext = Co_NULL;
+    pCurTcb->state   = TASK_READY;
+    pCurTcb->rdyPrio = (U8)curPrio;
+    pCurTcb->TCBprev = Co_NULL;
+    pCurTcb->TCBnext = ptcbNext;
+    if(ptcbNext != Co_NULL)
+    {
+        ptcbNext->TCBprev = pCurTcb;
+    }
+    TCBRdy = pCurTcb;
+    RdyListTail[rdyPrio] = Co_NULL;
+    RdyListTail[curPrio] = pCurTcb;
+    if(curPrio != rdyPrio)
+    {
+        RdyPrioBitmap[rdyPrio/32] &= ~PRIO_BIT(rdyPrio);
+        RdyPrioBitmap[curPrio/32] |= PRIO_BIT(curPrio);
+    }
+#else
+    InsertToTCBRdyList(pCurTcb);
+    RemoveFromTCBRdyList(pRdyTcb);
+#endif
+}
+
+
 /**
  *******************************************************************************
  * @brief      Schedule function
@@ -759,8 +996,7 @@ void Schedule(void)
     else if(RdyPrio < RunPrio )     /* Is higher PRI task coming in?          */
     {
         TCBNext        = pRdyTcb;   /* Yes,set TCBNext and reorder READY list */
-        InsertToTCBRdyList(pCurTcb);
-		RemoveFromTCBRdyList(pRdyTcb);
+        ReadyListSwap(pCurTcb,pRdyTcb);
         pRdyTcb->state = TASK_RUNNING;
     }
 
@@ -768,8 +1004,7 @@ void Schedule(void)
     else if((RunPrio == RdyPrio) && (OSCheckTime == OSTickCnt))
     {
         TCBNext        = pRdyTcb;   /* Yes,set TCBNext and reorder READY list */
-        InsertToTCBRdyList(pCurTcb);
-		RemoveFromTCBRdyList(pRdyTcb);
+        ReadyListSwap(pCurTcb,pRdyTcb);
         pRdyTcb->state = TASK_RUNNING;
     }
 #endif
@@ -934,6 +1169,16 @@ OS_TID CreateTask(FUNCPtr task,void *argv,U32 parameter,OS_STK *stk)
     ptcb->pnode = Co_NULL;                 /* Initialize task as no flag waiting */
 #endif
 
+#if CFG_NOTIFY_EN > 0
+    ptcb->notifyBits = 0;                  /* Initialize task as not notified    */
+    ptcb->notifyWait = Co_FALSE;
+#endif
+
+#if CFG_CPU_STATS_EN > 0
+    ptcb->runCycles    = 0;                /* Initialize task as not yet run     */
+    ptcb->maxRunCycles = 0;
+#endif
+
 #if CFG_EVENT_EN > 0
     ptcb->eventID  = INVALID_ID;      	/* Initialize task as no event waiting*/
     ptcb->pmail    = Co_NULL;
@@ -1152,6 +1397,59 @@ OS_TID CoGetCurTaskID(void)
     return (TCBRunning->taskID);        /* Return running task ID             */
 }
 
+#if CFG_CPU_STATS_EN > 0
+/**
+ *******************************************************************************
+ * @brief      Get the CPU cycles a task has run
+ * @param[in]  taskID     ID of the task.
+ * @param[out] cycles     Cycles the task has run since it was created.
+ * @param[out] maxCycles  Most cycles it has run between two switches.
+ * @retval     E_INVALID_ID  Invalid task ID.
+ * @retval     E_OK          Cycles got successful.
+ *
+ * @par Description
+ * @details    This function is called to see how much of the CPU a task
+ *             uses. Cycles in the ISRs that count their own are not
+ *             included. The running task's cycles are counted up to now.
+ *******************************************************************************
+ */
+StatusType CoGetTaskCycles(OS_TID taskID,U64* cycles,U32* maxCycles)
+{
+    P_OSTCB ptcb;
+    U32     run;
+
+#if CFG_PAR_CHECKOUT_EN >0              /* Check validity of parameter        */
+    if(taskID >= CFG_MAX_USER_TASKS + SYS_TASK_NUM)
+    {
+        return E_INVALID_ID;
+    }
+#endif
+    ptcb = &TCBTbl[taskID];
+#if CFG_PAR_CHECKOUT_EN >0
+    if(ptcb->state == TASK_DORMANT)
+    {
+        return E_INVALID_ID;
+    }
+#endif
+
+    /* Read the counts whole,without a switch or ISR changing them           */
+    IRQ_DISABLE_SAVE();
+    *cycles    = ptcb->runCycles;
+    *maxCycles = ptcb->maxRunCycles;
+    if(ptcb == TCBRunning)
+    {
+        run      = CpuStatsRun();       /* Add the run so far                 */
+        *cycles += run;
+        if(run > *maxCycles)
+        {
+            *maxCycles = run;
+        }
+    }
+    IRQ_ENABLE_RESTORE();
+    return E_OK;
+}
+#endif
+
 #if CFG_TASK_SUSPEND_EN >0
 /**
  *******************************************************************************
@@ -1283,6 +1581,13 @@ StatusType CoAwakeTask(OS_TID taskID)
     }
 #endif
 
+#if CFG_NOTIFY_EN > 0
+    if(ptcb->notifyWait == Co_TRUE)     /* Is task waiting for notification   */
+    {
+        return E_TASK_WAIT_OTHER;       /* Yes,error return                   */
+    }
+#endif
+
 #endif	  //CFG_TASK_WAITTING_EN
 
     /* All no,so WAITING state was set by CoSuspendTask()                     */
@@ -45,6 +45,109 @@
 
 /*---------------------------- Variable Define -------------------------------*/
 P_OSTCB DlyList   = Co_NULL;               /*!< Header pointer to the DELAY list.*/
+#if CFG_TICKLESS_EN > 0
+U32     DlyBase   = 0;     /*!< When the delay of the DELAY list head counts from*/
+#endif
+
+#if CFG_TICKLESS_EN > 0
+/**
+ *******************************************************************************
+ * @brief      Get how long a delay in the DELAY list has to be made longer
+ * @param[in]  None
+ * @param[out] None
+ * @retval     Microseconds from DlyBase to now.
+ *
+ * @par Description
+ * @details    This function is called with the scheduler locked, before a
+ *             delay from now is inserted. If no delay in the list has ended,
+ *             the list is made to count from now, so 0 is returned. Otherwise
+ *             DlyBase is when the last delay ended, and stays there until
+ *             TimeDispose() has handled it.
+ *******************************************************************************
+ */
+static U32 DlyListLag(void)
+{
+    U32 now;
+    U32 lag;
+
+    now = TicklessNow();
+    lag = now - DlyBase;
+    if((DlyList != Co_NULL) && (DlyList->delayTick <= lag))
+    {
+        return lag;                     /* A delay has ended,keep its end     */
+    }
+    if(DlyList != Co_NULL)
+    {
+        DlyList->delayTick -= lag;      /* Count the head from now            */
+    }
+    DlyBase = now;
+    return 0;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Get how long until a list head's delay ends
+ * @param[in]  base     When the delay counts from.
+ * @param[in]  delay    Delay of the head of the list.
+ * @param[in]  now      Current microsecond count.
+ * @param[out] None
+ * @retval     Microseconds until the delay ends, 0 if it has.
+ *******************************************************************************
+ */
+static U32 TicklessWait(U32 base,U32 delay,U32 now)
+{
+    U32 elapsed;
+
+    elapsed = now - base;
+    return (delay > elapsed) ? (delay - elapsed) : 0;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Set the compare for the next delay or timer to end
+ * @param[in]  None
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details    This function is called with the scheduler locked, after a new
+ *             delay or timer went to the head of its list, and after the
+ *             ended ones have been handled. It is never set more than
+ *             MAX_DELAY_US ahead, even with nothing waiting.
+ *******************************************************************************
+ */
+void TicklessSchedule(void)
+{
+    U32 now;
+    U32 wait;
+    U32 headWait;
+
+    now  = TicklessNow();
+    wait = MAX_DELAY_US;
+    if(DlyList != Co_NULL)
+    {
+        headWait = TicklessWait(DlyBase,DlyList->delayTick,now);
+        if(headWait < wait)
+        {
+            wait = headWait;
+        }
+    }
+#if CFG_TMR_EN > 0
+    if(TmrList != Co_NULL)
+    {
+        headWait = TicklessWait(TmrBase,TmrList->tmrCnt,now);
+        if(headWait < wait)
+        {
+            wait = headWait;
+        }
+    }
+#endif
+    TicklessCompareSet(now + wait);
+}
+#endif
+
 
 
 /**
@@ -52,7 +155,7 @@ P_OSTCB DlyList   = Co_NULL;               /*!< Header pointer to the DELAY list
  * @brief      Insert into DELAY list
  *
  * @param[in]  ptcb    Task that want to insert into DELAY list.
- * @param[in]  ticks   Delay system ticks.
+ * @param[in]  ticks   Delay,in microseconds if CFG_TICKLESS_EN,else ticks.
  * @param[out] None
  * @retval     None.
  *
@@ -60,13 +163,16 @@ P_OSTCB DlyList   = Co_NULL;               /*!< Header pointer to the DELAY list
  * @details    This function is called to insert task into DELAY list.
  *******************************************************************************
  */
-void InsertDelayList(P_OSTCB ptcb,U32 ticks)
+static void InsertDelay(P_OSTCB ptcb,U32 ticks)
 {
     S32 deltaTicks;
     P_OSTCB dlyNext;
 
     if(ticks == 0)                      /* Is delay tick == 0?                */
         return;                         /* Yes,do nothing,return              */
+#if CFG_TICKLESS_EN > 0
+    ticks += DlyListLag();              /* Count from DlyBase                 */
+#endif
     if(DlyList == Co_NULL)                 /* Is no item in DELAY list?          */
     {
         ptcb->delayTick = ticks;        /* Yes,set this as first item         */
@@ -117,6 +223,30 @@ void InsertDelayList(P_OSTCB ptcb,U32 ticks)
 
     ptcb->state  = TASK_WAITING;        /* Set task status as TASK_WAITING    */
     TaskSchedReq = Co_TRUE;
+#if CFG_TICKLESS_EN > 0
+    if(DlyList == ptcb)                 /* Does it end before the others?     */
+    {
+        TicklessSchedule();
+    }
+#endif
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Insert into DELAY list for a number of ticks
+ * @param[in]  ptcb    Task that want to insert into DELAY list.
+ * @param[in]  ticks   Delay system ticks.
+ * @param[out] None
+ * @retval     None.
+ *
+ * @par Description
+ * @details    This function is called to insert task into DELAY list.
+ *******************************************************************************
+ */
+void InsertDelayList(P_OSTCB ptcb,U32 ticks)
+{
+    InsertDelay(ptcb,TICKS_TO_DELAY(ticks));
 }
 
 
@@ -177,12 +307,36 @@ void RemoveDelayList(P_OSTCB ptcb)
  */
 U64 CoGetOSTime(void)
 {
+#if CFG_TICKLESS_EN > 0
+    U32 high;
+    U32 last;
+    U32 now;
+
+    /* SysTick_Handler() keeps count of the wraps                             */
+    do
+    {
+        high = OSTimeHigh;
+        last = OSTimeLast;
+        now  = TicklessNow();
+    }
+    while(high != OSTimeHigh);
+    if(now < last)                      /* Wrapped since?                     */
+    {
+        high++;
+    }
+    return ((((U64)high) << 32) | now) / US_PER_TICK;
+#else
     return OSTickCnt;                   /* Get system time(tick)              */
+#endif
 }
 
 U32 __attribute__ ((noinline)) CoGetOSTime32(void)
 {
+#if CFG_TICKLESS_EN > 0
+    return (U32)CoGetOSTime();          /* Get system time(tick)              */
+#else
     return OSTickCnt2;                   /* Get system time(tick)              */
+#endif
 }
 
 /**
@@ -225,6 +379,42 @@ StatusType CoTickDelay(U32 ticks)
 }
 
 
+/**
+ *******************************************************************************
+ * @brief      Delay current task for a number of microseconds
+ * @param[in]  us       Microseconds to delay.
+ * @param[out] None
+ * @retval     E_CALL   Error call in ISR.
+ * @retval     E_OK     The current task was insert to DELAY list successful,it
+ *                      will delay specify time.
+ * @par Description
+ * @details    This function delay specify microseconds for current task. If
+ *             CFG_TICKLESS_EN is 0,the delay is rounded up to whole ticks.
+ *
+ * @note       This function be called in ISR,do nothing and return immediately.
+ *******************************************************************************
+ */
+StatusType CoUsDelay(U32 us)
+{
+    if(OSIntNesting >0)	                /* Is call in ISR?                    */
+    {
+        return E_CALL;                  /* Yes,error return                   */
+    }
+    if(us == 0)                         /* Is us==0?                          */
+    {
+        return E_OK;                    /* Yes,do nothing ,return OK          */
+    }
+    if(OSSchedLock != 0)                /* Is OS lock?                        */
+    {
+        return E_OS_IN_LOCK;            /* Yes,error return                   */
+    }
+    OsSchedLock();                      /* Lock schedule                      */
+    InsertDelay(TCBRunning,US_TO_DELAY(us)); /* Insert task in DELAY list     */
+    OsSchedUnlock();                /* Unlock schedule,and call task schedule */
+    return E_OK;                        /* Return OK                          */
+}
+
+
 /**
  *******************************************************************************
  * @brief      Reset task delay ticks
@@ -315,6 +505,15 @@ StatusType  CoTimeDelay(U8 hour,U8 minute,U8 sec,U16 millsec)
         return E_OS_IN_LOCK;            /* Yes,error return                   */
     }
 
+#if CFG_TICKLESS_EN > 0
+    /* To the millisecond, if it isn't too long for one delay                */
+    if((hour == 0) && (minute*60000U + sec*1000U + millsec < MAX_DELAY_US/1000))
+    {
+        CoUsDelay((minute*60000U + sec*1000U + millsec) * 1000U);
+        return E_OK;
+    }
+#endif
+
     /* Get tick counter from time */
     ticks = ((hour*3600) + (minute*60) + (sec)) * (CFG_SYSTICK_FREQ)\
             + (millsec*CFG_SYSTICK_FREQ + 500)/1000;
@@ -343,8 +542,16 @@ void TimeDispose(void)
     P_OSTCB	dlyList;
 
     dlyList = DlyList;                  /* Get first item of DELAY list       */
+#if CFG_TICKLESS_EN > 0
+    /* One at a time,as DlyBase has to move to when each delay ended          */
+    while((dlyList != Co_NULL) && (dlyList->delayTick <= TicklessNow() - DlyBase))
+    {
+        DlyBase           += dlyList->delayTick;
+        dlyList->delayTick = 0;
+#else
     while((dlyList != Co_NULL) && (dlyList->delayTick == 0) )
     {
+#endif
 
 #if CFG_EVENT_EN > 0
         if(dlyList->eventID != INVALID_ID) /* Is task in event waiting list?  */
@@ -371,6 +578,11 @@ void TimeDispose(void)
             dlyList->TCBprev = Co_NULL;        /* No,initialize the first item   */
         }
     }
+#if (CFG_TICKLESS_EN > 0) && (CFG_TMR_EN == 0)
+    /* Else TmrDispose(),which always follows,sets it. Setting it here would
+       find the ended timers not yet handled and pend SysTick again.          */
+    TicklessSchedule();                 /* Set the compare for the next end   */
+#endif
 }
 
 
@@ -40,13 +40,75 @@
 
 /*---------------------------- Include ---------------------------------------*/
 #include <coocox.h>
-#include "stm32f4xx_gpio.h"
 /*---------------------------- Variable Define -------------------------------*/
 #if CFG_TMR_EN > 0
 
 TmrCtrl    TmrTbl[CFG_MAX_TMR]= {{0}};/*!< Table which save timer control block.*/
 P_TmrCtrl  TmrList     = Co_NULL;      /*!< The header of the TmrCtrl list.      */
 U32        TmrIDVessel = 0;         /*!< Timer ID container.                  */
+#if CFG_TICKLESS_EN > 0
+U32        TmrBase     = 0;         /*!< When the list head counts from.      */
+#endif
+
+#if CFG_TICKLESS_EN > 0
+/**
+ *******************************************************************************
+ * @brief      Get how long a timer in the timer list has to be made longer
+ * @param[in]  None
+ * @param[out] None
+ * @retval     Microseconds from TmrBase to now.
+ *
+ * @par Description
+ * @details    This function is called with the scheduler locked, before a
+ *             timer counting from now is inserted. If no timer in the list
+ *             has ended, the list is made to count from now, so 0 is
+ *             returned. Otherwise TmrBase is when the last timer ended, and
+ *             stays there until TmrDispose() has handled it.
+ *******************************************************************************
+ */
+static U32 TmrListLag(void)
+{
+    U32 now;
+    U32 lag;
+
+    now = TicklessNow();
+    lag = now - TmrBase;
+    if((TmrList != Co_NULL) && (TmrList->tmrCnt <= lag))
+    {
+        return lag;                     /* A timer has ended,keep its end     */
+    }
+    if(TmrList != Co_NULL)
+    {
+        TmrList->tmrCnt -= lag;         /* Count the head from now            */
+    }
+    TmrBase = now;
+    return 0;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Get the time left until a periodic timer next ends
+ * @param[in]  tmrReload    Period of the timer.
+ * @param[out] None
+ * @retval     Microseconds from now.
+ *
+ * @par Description
+ * @details    This function is called by TmrDispose(), with TmrBase when the
+ *             timer ended. The period counts from then rather than now, so
+ *             the timer doesn't drift however late it was handled. Periods
+ *             missed altogether are skipped.
+ *******************************************************************************
+ */
+static U32 TmrPeriodLeft(U32 tmrReload)
+{
+    if(tmrReload == 0)
+    {
+        return 0;
+    }
+    return tmrReload - (TicklessNow() - TmrBase) % tmrReload;
+}
+#endif
 
 
 /**
@@ -74,6 +136,9 @@ static void InsertTmrList(OS_TCID tmrID)
     }
 
     OsSchedLock();                      /* Lock schedule                      */
+#if CFG_TICKLESS_EN > 0
+    tmrCnt += TmrListLag();             /* Count from TmrBase                 */
+#endif
     if(TmrList == Co_NULL)                 /* Is no item in timer list?          */
     {
         TmrList = &TmrTbl[tmrID];       /* Yes,set this as first item         */
@@ -120,6 +185,12 @@ static void InsertTmrList(OS_TCID tmrID)
             pTmr = pTmr->tmrNext;       /* Get the next item in timer list    */
       	}
     }
+#if CFG_TICKLESS_EN > 0
+    if(TmrList == &TmrTbl[tmrID])       /* Does it end before the others?     */
+    {
+        TicklessSchedule();
+    }
+#endif
     OsSchedUnlock();                    /* Unlock schedule                    */
 }
 
@@ -211,8 +282,8 @@ OS_TCID CoCreateTmr(U8 tmrType, U32 tmrCnt, U32 tmrReload, vFUNCPtr func)
             TmrTbl[i].tmrID     = i;      /* Initialize timer as user set     */
             TmrTbl[i].tmrType   = tmrType;
             TmrTbl[i].tmrState  = TMR_STATE_STOPPED;
-            TmrTbl[i].tmrCnt    = tmrCnt;
-            TmrTbl[i].tmrReload	= tmrReload;
+            TmrTbl[i].tmrCnt    = TICKS_TO_DELAY(tmrCnt);
+            TmrTbl[i].tmrReload	= TICKS_TO_DELAY(tmrReload);
             TmrTbl[i].tmrCallBack = func;
             TmrTbl[i].tmrPrev   = Co_NULL;
             TmrTbl[i].tmrNext   = Co_NULL;
@@ -362,7 +433,11 @@ U32 CoGetCurTmrCnt(OS_TCID tmrID,StatusType* perr)
     }
 #endif
     *perr = E_OK;
+#if CFG_TICKLESS_EN > 0
+    return TmrTbl[tmrID].tmrCnt / US_PER_TICK;  /* Return timer counter       */
+#else
     return TmrTbl[tmrID].tmrCnt;        /* Return timer counter               */
+#endif
 }
 
 
@@ -370,8 +445,8 @@ U32 CoGetCurTmrCnt(OS_TCID tmrID,StatusType* perr)
  *******************************************************************************
  * @brief      Setting for a specify timer
  * @param[in]  tmrID       Specify timer by ID.
- * @param[in]  tmrCnt      Specify timer counter which need to be set.
- * @param[in]  tmrReload   Specify timer reload value which need to be set.
+ * @param[in]  tmrCnt      Counter,in microseconds if CFG_TICKLESS_EN,else ticks.
+ * @param[in]  tmrReload   Reload value,in the same units.
  * @param[out] None
  * @retval     E_INVALID_ID  The ID passed was invalid,set fail.
  * @retval     E_OK          Set timer counter successful.
@@ -380,7 +455,7 @@ U32 CoGetCurTmrCnt(OS_TCID tmrID,StatusType* perr)
  * @details    This function is called to set timer counter and reload value.
  *******************************************************************************
  */
-StatusType CoSetTmrCnt(OS_TCID tmrID,U32 tmrCnt,U32 tmrReload)
+static StatusType SetTmrCnt(OS_TCID tmrID,U32 tmrCnt,U32 tmrReload)
 {
 #if CFG_PAR_CHECKOUT_EN >0              /* Check validity of parameter        */
     if(tmrID >= CFG_MAX_TMR)
@@ -408,6 +483,47 @@ StatusType CoSetTmrCnt(OS_TCID tmrID,U32 tmrCnt,U32 tmrReload)
 }
 
 
+/**
+ *******************************************************************************
+ * @brief      Setting for a specify timer
+ * @param[in]  tmrID       Specify timer by ID.
+ * @param[in]  tmrCnt      Specify timer counter which need to be set.
+ * @param[in]  tmrReload   Specify timer reload value which need to be set.
+ * @param[out] None
+ * @retval     E_INVALID_ID  The ID passed was invalid,set fail.
+ * @retval     E_OK          Set timer counter successful.
+ *
+ * @par Description
+ * @details    This function is called to set timer counter and reload value.
+ *******************************************************************************
+ */
+StatusType CoSetTmrCnt(OS_TCID tmrID,U32 tmrCnt,U32 tmrReload)
+{
+    return SetTmrCnt(tmrID,TICKS_TO_DELAY(tmrCnt),TICKS_TO_DELAY(tmrReload));
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Setting for a specify timer in microseconds
+ * @param[in]  tmrID       Specify timer by ID.
+ * @param[in]  tmrCnt      Microseconds until the timer first ends.
+ * @param[in]  tmrReload   Microseconds between the ends of a periodic timer.
+ * @param[out] None
+ * @retval     E_INVALID_ID  The ID passed was invalid,set fail.
+ * @retval     E_OK          Set timer counter successful.
+ *
+ * @par Description
+ * @details    This function is called to set timer counter and reload value.
+ *             If CFG_TICKLESS_EN is 0,they are rounded up to whole ticks.
+ *******************************************************************************
+ */
+StatusType CoSetTmrCntUs(OS_TCID tmrID,U32 tmrCnt,U32 tmrReload)
+{
+    return SetTmrCnt(tmrID,US_TO_DELAY(tmrCnt),US_TO_DELAY(tmrReload));
+}
+
+
 /**
  *******************************************************************************
  * @brief      Timer counter dispose
@@ -424,8 +540,16 @@ void TmrDispose(void)
     P_TmrCtrl	pTmr;
 
     pTmr = TmrList;                     /* Get first item of timer list       */
+#if CFG_TICKLESS_EN > 0
+    /* One at a time,as TmrBase has to move to when each timer ended          */
+    while((pTmr != Co_NULL) && (pTmr->tmrCnt <= TicklessNow() - TmrBase))
+    {
+        TmrBase     += pTmr->tmrCnt;
+        pTmr->tmrCnt = 0;
+#else
     while((pTmr != Co_NULL) && (pTmr->tmrCnt == 0) )
     {
+#endif
         if(pTmr->tmrType == TMR_TYPE_ONE_SHOT)    /* Is a One-shot timer?     */
         {
             /* Yes,remove this timer from timer list                          */
@@ -439,12 +563,19 @@ void TmrDispose(void)
         {
             /* Yes,remove this timer from timer list                          */
             RemoveTmrList(pTmr->tmrID);
+#if CFG_TICKLESS_EN > 0
+            pTmr->tmrCnt = TmrPeriodLeft(pTmr->tmrReload);
+#else
             pTmr->tmrCnt = pTmr->tmrReload;   /* Reset timer tick             */
+#endif
             InsertTmrList(pTmr->tmrID);       /* Insert timer into timer list */
             (pTmr->tmrCallBack)();            /* Call timer callback function */
         }
         pTmr = TmrList;	                      /* Get first item of timer list */
     }
+#if CFG_TICKLESS_EN > 0
+    TicklessSchedule();                 /* Set the compare for the next end   */
+#endif
 }
 
 
@@ -300,6 +300,14 @@ void PendSV_Handler(void)
     " CMP    R1,R2          \n"
     " BEQ    exitPendSV     \n"
 
+#if CFG_CPU_STATS_EN > 0
+    " CPSID  I              \n"    // Charge the cycles run to TCBRunning
+    " PUSH   {R1-R3,LR}     \n"    // 16 bytes keeps MSP 8 byte aligned
+    " BL     CpuStatsSwitch \n"
+    " POP    {R1-R3,LR}     \n"
+    " CPSIE  I              \n"
+#endif
+
     " MRS    R0, PSP        \n"    // Get PSP point (can not use PUSH,in ISR,SP is MSP )
     " STMDB  R0!,{R4-R11}   \n"    // Store r4-r11,r0 -= regCnt * 4,r0 is new stack
                                    // top point (addr h->l r11,r10,...,r5,r4)
@@ -47,9 +47,15 @@
 #define NVIC_ST_RELOAD  (*((volatile U32 *)0xE000E014))
 #define RELOAD_VAL      ((U32)(( (U32)CFG_CPU_FREQ) / (U32)CFG_SYSTICK_FREQ) -1)
 
+#if CFG_TICKLESS_EN > 0
+/*!< SysTick doesn't count, TicklessCompareISR() pends it when a delay or
+     timer ends.                                                              */
+#define InitSysTick()   InitTickless()
+#else
 /*!< Initial System tick.	*/
 #define InitSysTick()   NVIC_ST_RELOAD =  RELOAD_VAL; \
                         NVIC_ST_CTRL   =  0x0007
+#endif
 
 #define NVIC_SYS_PRI2   (*((volatile U32 *)0xE000ED1C))
 #define NVIC_SYS_PRI3   (*((volatile U32 *)0xE000ED20))
@@ -58,10 +64,29 @@
 #define InitInt()       NVIC_SYS_PRI2 |=  0xFF000000;\
                         NVIC_SYS_PRI3 |=  0xFFFF0000
 
+#if CFG_CPU_STATS_EN > 0
+/*!< Named apart from CMSIS, which has CoreDebug->DEMCR but no DWT here.    */
+#define OS_DEMCR        (*((volatile U32 *)0xE000EDFC))
+#define OS_DEMCR_TRCENA (0x01000000)
+#define OS_DWT_CTRL     (*((volatile U32 *)0xE0001000))
+#define OS_DWT_CYCCNTENA (0x00000001)
+#define OS_DWT_CYCCNT   (*((volatile U32 *)0xE0001004))
+
+/*!< CPU cycle count,wraps every 2^32/CFG_CPU_FREQ seconds.                  */
+#define CpuCycles()     (OS_DWT_CYCCNT)
+#endif
+
 
 /*---------------------------- Variable declare ------------------------------*/
 extern U64      OSTickCnt;          /*!< Counter for current system ticks.    */
 extern volatile U32      OSTickCnt2;          /*!< Counter for current system ticks.    */
+#if CFG_TICKLESS_EN > 0
+extern volatile U32 OSTimeHigh;     /*!< Times the microsecond count wrapped  */
+extern volatile U32 OSTimeLast;     /*!< Count when OSTimeHigh was updated    */
+#endif
+#if CFG_CPU_STATS_EN > 0
+extern volatile U32 OSIsrCycles;    /*!< Cycles in the ISRs that count theirs */
+#endif
 
 /*!< Initial context of task being created	*/
 extern OS_STK  *InitTaskContext(FUNCPtr task,void *param,OS_STK *pstk);
@@ -72,5 +97,18 @@ extern U8      Dec8 (volatile U8 *data);
 extern void    IRQ_ENABLE_RESTORE(void);
 extern void    IRQ_DISABLE_SAVE(void);
 
+#if CFG_TICKLESS_EN > 0
+extern void    InitTickless(void);          /*!< Start the tickless compare       */
+extern U32     TicklessNow(void);           /*!< Free running microsecond count   */
+extern void    TicklessCompareSet(U32 due); /*!< Run SysTick_Handler() at due     */
+extern void    TicklessCompareISR(void);    /*!< Called on a TIM2 CC2 interrupt   */
+#endif
+
+#if CFG_CPU_STATS_EN > 0
+extern void    InitCpuStats(void);          /*!< Start the cycle counter          */
+extern void    CpuStatsSwitch(void);        /*!< Charge the run to TCBRunning     */
+extern U32     CpuStatsRun(void);           /*!< Cycles run since the last switch */
+#endif
+
 
 #endif /* _CPU_H */
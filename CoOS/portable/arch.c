@@ -4,6 +4,7 @@
  * @version    V1.1.6
  * @date       2014.05.23
  * @brief     This file provides InitTaskContext() and SysTick_Handler().
+ *            If CFG_TICKLESS_EN,it also provides the tickless compare on TIM2.
  *******************************************************************************
  * @copy
  *  Redistribution and use in source and binary forms, with or without
@@ -37,8 +38,23 @@
 
 /*---------------------------- Include ---------------------------------------*/
 #include <coocox.h>
+#if CFG_TICKLESS_EN > 0
+#include "stm32f4xx.h"
+#endif
 U64     OSTickCnt = 0;                  /*!< Current system tick counter      */
 volatile U32     OSTickCnt2;                  /*!< Current system tick counter      */
+#if CFG_TICKLESS_EN > 0
+volatile U32     OSTimeHigh = 0;        /*!< Times TicklessNow() wrapped      */
+volatile U32     OSTimeLast = 0;        /*!< TicklessNow() when last checked  */
+
+/*!< Counts microseconds. main_input_timer_init() starts it before CoInitOS() */
+#define TICKLESS_TIM    TIM2
+#endif
+#if CFG_CPU_STATS_EN > 0
+volatile U32     OSIsrCycles = 0;       /*!< Cycles in the ISRs that count    */
+static U32       SwitchCycles;          /*!< CpuCycles() at the last switch   */
+static U32       SwitchIsrCycles;       /*!< OSIsrCycles at the last switch   */
+#endif
 
 /**
  ******************************************************************************
@@ -77,6 +93,125 @@ OS_STK *InitTaskContext(FUNCPtr task,void *param,OS_STK *pstk)
 
 
 
+#if CFG_TICKLESS_EN > 0
+/**
+ *******************************************************************************
+ * @brief      Start the tickless compare
+ * @param[in]  None
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details    This function is called by CoInitOS() in place of starting
+ *             SysTick. SysTick is left stopped, only pended by
+ *             TicklessCompareISR(). The compare is set MAX_DELAY_US ahead
+ *             until there is a delay or timer.
+ *******************************************************************************
+ */
+void InitTickless(void)
+{
+    NVIC_ST_CTRL        = 0;
+    OSTimeLast          = TICKLESS_TIM->CNT;
+    TICKLESS_TIM->CCR2  = OSTimeLast + MAX_DELAY_US;
+    TICKLESS_TIM->SR    = (U16)~TIM_SR_CC2IF;
+    TICKLESS_TIM->DIER |= TIM_DIER_CC2IE;
+    NVIC_EnableIRQ(TIM2_IRQn);
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Get the free running microsecond count
+ * @param[in]  None
+ * @param[out] None
+ * @retval     Microsecond count, which wraps every 71 minutes or so.
+ *******************************************************************************
+ */
+U32 TicklessNow(void)
+{
+    return TICKLESS_TIM->CNT;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Set when SysTick_Handler() next runs
+ * @param[in]  due     Microsecond count to run it at.
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details    This function is called with the scheduler locked. The compare
+ *             only matches when the count reaches it, so if due has already
+ *             gone by SysTick is pended straight away.
+ *******************************************************************************
+ */
+void TicklessCompareSet(U32 due)
+{
+    TICKLESS_TIM->CCR2 = due;
+    if((S32)(due - TICKLESS_TIM->CNT) <= 0)
+    {
+        SCB->ICSR = SCB_ICSR_PENDSTSET_Msk;
+    }
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Tickless compare interrupt handler
+ * @param[in]  None
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details    This function is called by TIM2_IRQHandler() once it has
+ *             cleared the channel 2 interrupt. TIM2 also timestamps the crank
+ *             at the highest priority, so the ended delays and timers are
+ *             left to SysTick_Handler(),at the lowest.
+ *******************************************************************************
+ */
+void TicklessCompareISR(void)
+{
+    SCB->ICSR = SCB_ICSR_PENDSTSET_Msk;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      System tick interrupt handler.
+ * @param[in]  None
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details    This is system tick interrupt headler. It runs when a delay or
+ *             timer ends, rather than every tick.
+ * @note       CoOS may schedule when exiting this ISR.
+ *******************************************************************************
+ */
+void SysTick_Handler(void)
+{
+    U32 now;
+
+    OSSchedLock++;                  /* Lock scheduler.                        */
+
+    /* Count the wraps for CoGetOSTime(). This runs at least every
+       MAX_DELAY_US,so it can't miss one.                                     */
+    now = TicklessNow();
+    if(now < OSTimeLast)
+    {
+        OSTimeHigh++;
+    }
+    OSTimeLast = now;
+
+    isr_TimeDispose();              /* Handle the delays that ended           */
+#if CFG_TMR_EN > 0
+    isr_TmrDispose();               /* Handle the timers that ended           */
+#endif
+	TaskSchedReq = Co_TRUE;
+    OsSchedUnlock();
+}
+#else
 /**
  *******************************************************************************
  * @brief      System tick interrupt handler.
@@ -126,4 +261,82 @@ void SysTick_Handler(void)
 	TaskSchedReq = Co_TRUE;
     OsSchedUnlock();
 }
+#endif
+
+
+#if CFG_CPU_STATS_EN > 0
+/**
+ *******************************************************************************
+ * @brief      Start the cycle counter
+ * @param[in]  None
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details    This function is called by CoInitOS(). The DWT cycle counter
+ *             runs without a debugger once trace is enabled.
+ *******************************************************************************
+ */
+void InitCpuStats(void)
+{
+    OS_DEMCR       |= OS_DEMCR_TRCENA;
+    OS_DWT_CYCCNT   = 0;
+    OS_DWT_CTRL    |= OS_DWT_CYCCNTENA;
+    SwitchCycles    = CpuCycles();
+    SwitchIsrCycles = OSIsrCycles;
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Get the cycles run since the last context switch
+ * @param[in]  None
+ * @param[out] None
+ * @retval     Cycles TCBRunning has run,less those in counted ISRs.
+ *
+ * @par Description
+ * @details    This function is called with interrupts disabled.
+ *******************************************************************************
+ */
+U32 CpuStatsRun(void)
+{
+    return (CpuCycles() - SwitchCycles) - (OSIsrCycles - SwitchIsrCycles);
+}
+
+
+/**
+ *******************************************************************************
+ * @brief      Charge the cycles run to the running task
+ * @param[in]  None
+ * @param[out] None
+ * @retval     None
+ *
+ * @par Description
+ * @details    This function is called with interrupts disabled, by
+ *             PendSV_Handler() before TCBRunning changes, and by the idle
+ *             task as it loops. ISRs that count their cycles add them to
+ *             OSIsrCycles,so they are taken off. The counts are 32 bits,so
+ *             other tasks must not run for more than 2^32 cycles without a
+ *             switch, 25s at 168MHz.
+ *******************************************************************************
+ */
+void CpuStatsSwitch(void)
+{
+    U32 now;
+    U32 isr;
+    U32 run;
+
+    now = CpuCycles();
+    isr = OSIsrCycles;
+    run = (now - SwitchCycles) - (isr - SwitchIsrCycles);
+    SwitchCycles    = now;
+    SwitchIsrCycles = isr;
+
+    TCBRunning->runCycles += run;
+    if(run > TCBRunning->maxRunCycles)
+    {
+        TCBRunning->maxRunCycles = run;
+    }
+}
+#endif
 
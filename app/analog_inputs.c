@@ -0,0 +1,209 @@
+#include "analog_inputs.h"
+#include "adc.h"
+#include "main_input_timer.h"
+#include "utils.h"
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+/* The ADC scans all inputs continuously into a circular DMA 
+ * buffer. Each half of the buffer holds a block of scans. When 
+ * a block is complete the samples for each input are summed 
+ * (oversampling and decimation in one go), then passed through 
+ * a first order low pass filter with a per input time constant. 
+ * The results are published for the tasks to read. 
+ */
+
+/* 16 x 12 bit samples sum to a 16 bit value. */
+#define ADC_SCANS_PER_BLOCK 16
+#define ADC_SAMPLE_BUFFER_SIZE (2 * ADC_SCANS_PER_BLOCK * analog_input_COUNT)
+
+/* Fractional bits kept in the filter state. */
+#define FILTER_FRACTION_BITS 8
+
+/* Prevents the compiler from moving memory accesses across the 
+ * sequence counter updates. Only a single core and the 
+ * interrupt are involved, so no hardware barrier is needed. 
+ */
+#define COMPILER_BARRIER() __asm volatile ("" ::: "memory")
+
+typedef struct analog_input_config_st
+{
+    uint8_t adc_channel;
+    /* Filter time constant is 2^filter_shift blocks. 0 disables 
+     * the filter. 
+     */
+    uint8_t filter_shift;
+} analog_input_config_st;
+
+typedef struct analog_inputs_context_st
+{
+    int32_t filter_states[analog_input_COUNT];
+
+    /* The published values are protected by a sequence counter. 
+     * It is odd while the values are being updated. Readers 
+     * retry if it changed while they were copying the values. 
+     */
+    volatile uint32_t sequence;
+    volatile uint16_t values[analog_input_COUNT];
+
+    bool have_initial_values;
+
+    uint32_t blocks_processed;
+    uint32_t last_process_time_us;
+    uint32_t max_process_time_us;
+} analog_inputs_context_st;
+
+/* ADC channel assignments assume the STM32F4 discovery board. */
+static analog_input_config_st const analog_input_configs[analog_input_COUNT] =
+{
+    [analog_input_map] = { .adc_channel = 11, .filter_shift = 0 },     /* PC1 */
+    [analog_input_tps] = { .adc_channel = 12, .filter_shift = 1 },     /* PC2 */
+    [analog_input_clt] = { .adc_channel = 14, .filter_shift = 5 },     /* PC4 */
+    [analog_input_iat] = { .adc_channel = 15, .filter_shift = 5 },     /* PC5 */
+    [analog_input_o2] = { .adc_channel = 8, .filter_shift = 1 },       /* PB0 */
+    [analog_input_battery] = { .adc_channel = 9, .filter_shift = 3 }   /* PB1 */
+};
+
+static uint16_t adc_sample_buffer[ADC_SAMPLE_BUFFER_SIZE];
+static analog_inputs_context_st analog_inputs_context;
+
+static void analog_inputs_samples_ready(void * pv, uint16_t const * samples, size_t num_scans)
+{
+    UNUSED(pv);
+
+    analog_inputs_samples_process(samples, num_scans);
+}
+
+void analog_inputs_samples_process(uint16_t const * const samples, size_t const num_scans)
+{
+    analog_inputs_context_st * const analog_inputs = &analog_inputs_context;
+    uint32_t const start_time = main_input_timer_count_get();
+    uint32_t sums[analog_input_COUNT] = { 0 };
+    uint16_t new_values[analog_input_COUNT];
+    uint16_t const * sample = samples;
+    size_t scan;
+    size_t input;
+
+    for (scan = 0; scan < num_scans; scan++)
+    {
+        for (input = 0; input < analog_input_COUNT; input++)
+        {
+            sums[input] += *sample++;
+        }
+    }
+
+    for (input = 0; input < analog_input_COUNT; input++)
+    {
+        /* Scale the sum to 16 bits in case the block size isn't the 
+         * nominal one. 
+         */
+        int32_t const block_value = (num_scans == ADC_SCANS_PER_BLOCK) 
+            ? (int32_t)sums[input] 
+            : (int32_t)((sums[input] * ADC_SCANS_PER_BLOCK) / num_scans);
+        int32_t * const state = &analog_inputs->filter_states[input];
+
+        if (!analog_inputs->have_initial_values)
+        {
+            *state = block_value << FILTER_FRACTION_BITS;
+        }
+        else
+        {
+            *state += ((block_value << FILTER_FRACTION_BITS) - *state) >> analog_input_configs[input].filter_shift;
+        }
+        new_values[input] = *state >> FILTER_FRACTION_BITS;
+    }
+    analog_inputs->have_initial_values = true;
+
+    analog_inputs->sequence++;
+    COMPILER_BARRIER();
+    for (input = 0; input < analog_input_COUNT; input++)
+    {
+        analog_inputs->values[input] = new_values[input];
+    }
+    COMPILER_BARRIER();
+    analog_inputs->sequence++;
+
+    analog_inputs->blocks_processed++;
+    analog_inputs->last_process_time_us = main_input_timer_count_get() - start_time;
+    if (analog_inputs->last_process_time_us > analog_inputs->max_process_time_us)
+    {
+        analog_inputs->max_process_time_us = analog_inputs->last_process_time_us;
+    }
+}
+
+uint16_t analog_input_value_get(analog_input_t const input)
+{
+    return analog_inputs_context.values[input];
+}
+
+uint32_t analog_input_millivolts_get(analog_input_t const input)
+{
+    return (analog_input_value_get(input) * ANALOG_INPUT_REFERENCE_MV) / ANALOG_INPUT_FULL_SCALE;
+}
+
+void analog_inputs_snapshot_get(analog_inputs_snapshot_st * const snapshot)
+{
+    analog_inputs_context_st * const analog_inputs = &analog_inputs_context;
+    uint32_t sequence;
+    size_t input;
+
+    do
+    {
+        /* The writer is an interrupt, so a task will never see an 
+         * odd count, but if the values are updated while they are 
+         * being copied the count will have changed. 
+         */
+        sequence = analog_inputs->sequence;
+        COMPILER_BARRIER();
+        for (input = 0; input < analog_input_COUNT; input++)
+        {
+            snapshot->values[input] = analog_inputs->values[input];
+        }
+        COMPILER_BARRIER();
+    }
+    while ((sequence & 1) != 0 || sequence != analog_inputs->sequence);
+}
+
+void print_analog_inputs_debug(void)
+{
+    analog_inputs_context_st * const analog_inputs = &analog_inputs_context;
+    analog_inputs_snapshot_st snapshot;
+    size_t input;
+
+    analog_inputs_snapshot_get(&snapshot);
+
+    printf("analog blocks %"PRIu32" time last %"PRIu32" max %"PRIu32"\r\n",
+           analog_inputs->blocks_processed,
+           analog_inputs->last_process_time_us,
+           analog_inputs->max_process_time_us);
+    for (input = 0; input < analog_input_COUNT; input++)
+    {
+        printf("%u: %u\r\n", (unsigned)input, (unsigned)snapshot.values[input]);
+    }
+}
+
+void analog_inputs_init(void)
+{
+    static uint8_t adc_channels[analog_input_COUNT];
+    adc_init_st cfg;
+    size_t input;
+
+    for (input = 0; input < analog_input_COUNT; input++)
+    {
+        adc_channels[input] = analog_input_configs[input].adc_channel;
+    }
+
+    cfg.channels = adc_channels;
+    cfg.num_channels = analog_input_COUNT;
+    cfg.sample_buffer = adc_sample_buffer;
+    cfg.scans_per_block = ADC_SCANS_PER_BLOCK;
+    cfg.callback.pv = &analog_inputs_context;
+    cfg.callback.samplesReady = analog_inputs_samples_ready;
+
+    if (stm32_adc_scan_init(&cfg) == NULL)
+    {
+        printf("ADC init failed\r\n");
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef __ANALOG_INPUTS_H__
+#define __ANALOG_INPUTS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum analog_input_t
+{
+    analog_input_map,
+    analog_input_tps,
+    analog_input_clt,
+    analog_input_iat,
+    analog_input_o2,
+    analog_input_battery,
+    analog_input_COUNT
+} analog_input_t;
+
+/* Filtered values are 16 bit, with full scale (65535) 
+ * corresponding to the ADC reference voltage. 
+ */
+#define ANALOG_INPUT_FULL_SCALE 65535UL
+#define ANALOG_INPUT_REFERENCE_MV 3300UL
+
+typedef struct analog_inputs_snapshot_st
+{
+    uint16_t values[analog_input_COUNT];
+} analog_inputs_snapshot_st;
+
+void analog_inputs_init(void);
+
+/* Latest filtered value of a single input. */
+uint16_t analog_input_value_get(analog_input_t const input);
+uint32_t analog_input_millivolts_get(analog_input_t const input);
+
+/* A consistent copy of all inputs, all from the same block of 
+ * samples. 
+ */
+void analog_inputs_snapshot_get(analog_inputs_snapshot_st * const snapshot);
+
+/* Process a block of scans laid out as [scan][input]. Normally 
+ * called by the ADC driver from interrupt context. 
+ */
+void analog_inputs_samples_process(uint16_t const * const samples, size_t const num_scans);
+
+void print_analog_inputs_debug(void);
+
+#endif /* __ANALOG_INPUTS_H__ */
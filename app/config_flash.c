@@ -0,0 +1,45 @@
+#include "config_flash.h"
+#include "flash.h"
+#include "utils.h"
+
+/* The last two 128k sectors. They are kept out of the program 
+ * area in memory.ld. 
+ */
+#define CONFIG_FLASH_SECTOR_SIZE 0x20000
+#define CONFIG_FLASH_SECTOR_A_ADDRESS 0x080C0000UL
+#define CONFIG_FLASH_SECTOR_B_ADDRESS 0x080E0000UL
+
+static unsigned int const config_flash_sector_numbers[] =
+{
+    10, 11
+};
+
+static bool config_flash_erase(void * const ctx, unsigned int const sector)
+{
+    UNUSED(ctx);
+
+    return stm32_flash_sector_erase(config_flash_sector_numbers[sector]);
+}
+
+static bool config_flash_program(void * const ctx,
+                                 uint8_t const * const address,
+                                 void const * const data,
+                                 size_t const len)
+{
+    UNUSED(ctx);
+
+    return stm32_flash_program((uint32_t)(uintptr_t)address, data, len);
+}
+
+config_flash_st const config_flash =
+{
+    .sectors =
+    {
+        (uint8_t const *)CONFIG_FLASH_SECTOR_A_ADDRESS,
+        (uint8_t const *)CONFIG_FLASH_SECTOR_B_ADDRESS
+    },
+    .sector_size = CONFIG_FLASH_SECTOR_SIZE,
+    .erase = config_flash_erase,
+    .program = config_flash_program,
+    .ctx = NULL
+};
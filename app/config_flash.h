@@ -0,0 +1,9 @@
+#ifndef __CONFIG_FLASH_H__
+#define __CONFIG_FLASH_H__
+
+#include "config_store.h"
+
+/* The internal flash sectors that hold the configuration. */
+extern config_flash_st const config_flash;
+
+#endif /* __CONFIG_FLASH_H__ */
@@ -0,0 +1,449 @@
+#include "config_store.h"
+#include "crc.h"
+#include "utils.h"
+
+#include <string.h>
+
+#define CONFIG_STORE_MAGIC 0x31474643UL /* "CFG1" */
+#define FLASH_WORD_SIZE 4
+#define ERASED_WORD 0xffffffffUL
+
+#define RECORD_HEADER_SIZE 4
+#define RUN_HEADER_SIZE 4
+/* Unchanged gaps shorter than a run header are included in the
+ * surrounding run rather than starting a new one.
+ */
+#define RUN_MERGE_GAP RUN_HEADER_SIZE
+
+typedef struct config_store_header_st
+{
+    uint32_t magic;
+    uint32_t sequence; /* The sector with the highest sequence is the active one. */
+    uint16_t layout_version;
+    uint16_t image_size;
+    uint16_t image_crc;
+    uint16_t header_crc; /* crc16_ccitt over the preceding fields. */
+} config_store_header_st;
+
+static size_t word_align(size_t const len)
+{
+    return (len + FLASH_WORD_SIZE - 1) & ~(size_t)(FLASH_WORD_SIZE - 1);
+}
+
+static uint16_t get_le16(uint8_t const * const p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static void put_le16(uint8_t * const p, uint16_t const value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static size_t journal_start(config_store_st const * const store)
+{
+    return word_align(sizeof(config_store_header_st) + store->image_size);
+}
+
+static uint16_t header_crc_calculate(config_store_header_st const * const header)
+{
+    return crc16_ccitt_update(CRC16_CCITT_INITIAL, header, offsetof(config_store_header_st, header_crc));
+}
+
+static bool header_valid(config_store_st const * const store, config_store_header_st const * const header)
+{
+    return header->magic == CONFIG_STORE_MAGIC
+        && header->header_crc == header_crc_calculate(header)
+        && header->layout_version == store->layout_version
+        && header->image_size == store->image_size;
+}
+
+static bool sector_image_valid(config_store_st const * const store, unsigned int const sector)
+{
+    uint8_t const * const base = store->flash->sectors[sector];
+    config_store_header_st header;
+
+    memcpy(&header, base, sizeof header);
+
+    return header_valid(store, &header)
+        && crc16_ccitt_update(CRC16_CCITT_INITIAL, &base[sizeof header], store->image_size) == header.image_crc;
+}
+
+static uint32_t sector_sequence_get(config_store_st const * const store, unsigned int const sector)
+{
+    config_store_header_st header;
+
+    memcpy(&header, store->flash->sectors[sector], sizeof header);
+
+    return header.sequence;
+}
+
+/* Checks that every run in a record lies within the image. */
+static bool record_runs_valid(config_store_st const * const store, uint8_t const * const runs, size_t const len)
+{
+    size_t position = 0;
+    bool valid = true;
+
+    while (position < len)
+    {
+        size_t run_offset;
+        size_t run_len;
+
+        if (len - position < RUN_HEADER_SIZE)
+        {
+            valid = false;
+            break;
+        }
+        run_offset = get_le16(&runs[position]);
+        run_len = get_le16(&runs[position + 2]);
+        position += RUN_HEADER_SIZE;
+        if (run_len == 0
+            || run_len > len - position
+            || run_offset > store->image_size
+            || run_len > store->image_size - run_offset)
+        {
+            valid = false;
+            break;
+        }
+        position += run_len;
+    }
+
+    return valid;
+}
+
+static void record_runs_apply(uint8_t * const image, uint8_t const * const runs, size_t const len)
+{
+    size_t position = 0;
+
+    while (position < len)
+    {
+        size_t const run_offset = get_le16(&runs[position]);
+        size_t const run_len = get_le16(&runs[position + 2]);
+
+        position += RUN_HEADER_SIZE;
+        memcpy(&image[run_offset], &runs[position], run_len);
+        position += run_len;
+    }
+}
+
+/* Applies the journal records in the active sector to the stored
+ * image and finds where the next record goes.
+ */
+static void journal_replay(config_store_st * const store)
+{
+    uint8_t const * const base = store->flash->sectors[store->active_sector];
+    size_t const sector_size = store->flash->sector_size;
+    size_t offset = journal_start(store);
+
+    store->journal_damaged = false;
+
+    while (sector_size - offset >= RECORD_HEADER_SIZE)
+    {
+        uint32_t record_header;
+        size_t runs_len;
+        uint8_t const * runs;
+
+        memcpy(&record_header, &base[offset], sizeof record_header);
+        if (record_header == ERASED_WORD)
+        {
+            break;
+        }
+
+        runs_len = get_le16(&base[offset]);
+        runs = &base[offset + RECORD_HEADER_SIZE];
+        if (runs_len == 0
+            || runs_len > CONFIG_STORE_MAXIMUM_RECORD_SIZE
+            || word_align(runs_len) > sector_size - offset - RECORD_HEADER_SIZE
+            || crc16_ccitt_update(CRC16_CCITT_INITIAL, runs, runs_len) != get_le16(&base[offset + 2])
+            || !record_runs_valid(store, runs, runs_len))
+        {
+            /* Most likely power was lost while it was being written. */
+            store->journal_damaged = true;
+            break;
+        }
+
+        record_runs_apply(store->stored_image, runs, runs_len);
+        offset += RECORD_HEADER_SIZE + word_align(runs_len);
+    }
+
+    store->journal_end = offset;
+}
+
+bool config_store_load(config_store_st * const store,
+                       config_flash_st const * const flash,
+                       uint8_t * const stored_image,
+                       size_t const image_size,
+                       uint16_t const layout_version)
+{
+    bool sector_valid[ARRAY_SIZE(flash->sectors)];
+    unsigned int sector;
+
+    memset(store, 0, sizeof *store);
+    store->flash = flash;
+    store->stored_image = stored_image;
+    store->image_size = image_size;
+    store->layout_version = layout_version;
+
+    for (sector = 0; sector < ARRAY_SIZE(flash->sectors); sector++)
+    {
+        sector_valid[sector] = sector_image_valid(store, sector);
+    }
+
+    if (sector_valid[0] && sector_valid[1])
+    {
+        store->active_sector = (sector_sequence_get(store, 1) > sector_sequence_get(store, 0)) ? 1 : 0;
+    }
+    else if (sector_valid[0] || sector_valid[1])
+    {
+        store->active_sector = sector_valid[1] ? 1 : 0;
+    }
+    else
+    {
+        goto done;
+    }
+
+    store->sequence = sector_sequence_get(store, store->active_sector);
+    memcpy(store->stored_image,
+           &flash->sectors[store->active_sector][sizeof(config_store_header_st)],
+           image_size);
+    journal_replay(store);
+    store->valid = true;
+
+done:
+    return store->valid;
+}
+
+/* Programs len bytes, padding the last word with 0xff. */
+static bool flash_program(config_store_st const * const store,
+                          uint8_t const * const address,
+                          void const * const data,
+                          size_t const len)
+{
+    config_flash_st const * const flash = store->flash;
+    size_t const whole_words_len = len & ~(size_t)(FLASH_WORD_SIZE - 1);
+    bool programmed = true;
+
+    if (whole_words_len > 0)
+    {
+        programmed = flash->program(flash->ctx, address, data, whole_words_len);
+    }
+    if (programmed && whole_words_len < len)
+    {
+        uint8_t last_word[FLASH_WORD_SIZE];
+
+        memset(last_word, 0xff, sizeof last_word);
+        memcpy(last_word, (uint8_t const *)data + whole_words_len, len - whole_words_len);
+        programmed = flash->program(flash->ctx, &address[whole_words_len], last_word, sizeof last_word);
+    }
+
+    return programmed;
+}
+
+static bool sector_blank(config_store_st const * const store, unsigned int const sector)
+{
+    uint8_t const * const base = store->flash->sectors[sector];
+    size_t offset;
+    bool blank = true;
+
+    for (offset = 0; offset < store->flash->sector_size; offset += FLASH_WORD_SIZE)
+    {
+        uint32_t word;
+
+        memcpy(&word, &base[offset], sizeof word);
+        if (word != ERASED_WORD)
+        {
+            blank = false;
+            break;
+        }
+    }
+
+    return blank;
+}
+
+/* Builds a journal record holding the differences between the
+ * stored image and the new one. Returns the record length,
+ * including padding, or 0 if there are too many differences to
+ * fit in a record.
+ */
+static size_t record_build(config_store_st const * const store,
+                           uint8_t const * const image,
+                           uint8_t * const record)
+{
+    uint8_t const * const stored_image = store->stored_image;
+    uint8_t * const runs = &record[RECORD_HEADER_SIZE];
+    size_t runs_len = 0;
+    size_t offset = 0;
+    size_t record_len = 0;
+
+    while (offset < store->image_size)
+    {
+        size_t run_start;
+        size_t run_end;
+        size_t unchanged;
+
+        if (image[offset] == stored_image[offset])
+        {
+            offset++;
+            continue;
+        }
+
+        /* Extend the run until there's a long enough stretch of
+         * unchanged bytes.
+         */
+        run_start = offset;
+        run_end = offset + 1;
+        unchanged = 0;
+        for (offset = run_end; offset < store->image_size && unchanged <= RUN_MERGE_GAP; offset++)
+        {
+            if (image[offset] != stored_image[offset])
+            {
+                run_end = offset + 1;
+                unchanged = 0;
+            }
+            else
+            {
+                unchanged++;
+            }
+        }
+        offset = run_end;
+
+        if (runs_len + RUN_HEADER_SIZE + (run_end - run_start) > CONFIG_STORE_MAXIMUM_RECORD_SIZE)
+        {
+            goto done;
+        }
+        put_le16(&runs[runs_len], run_start);
+        put_le16(&runs[runs_len + 2], run_end - run_start);
+        runs_len += RUN_HEADER_SIZE;
+        memcpy(&runs[runs_len], &image[run_start], run_end - run_start);
+        runs_len += run_end - run_start;
+    }
+
+    if (runs_len > 0)
+    {
+        put_le16(&record[0], runs_len);
+        put_le16(&record[2], crc16_ccitt_update(CRC16_CCITT_INITIAL, runs, runs_len));
+        record_len = RECORD_HEADER_SIZE + runs_len;
+        memset(&record[record_len], 0xff, word_align(record_len) - record_len);
+        record_len = word_align(record_len);
+    }
+
+done:
+    return record_len;
+}
+
+static bool journal_append(config_store_st * const store, uint8_t const * const record, size_t const record_len)
+{
+    uint8_t const * const base = store->flash->sectors[store->active_sector];
+    bool appended = false;
+
+    if (store->journal_damaged || record_len > store->flash->sector_size - store->journal_end)
+    {
+        goto done;
+    }
+
+    /* The length and CRC go in first, so a record cut short by a
+     * power loss never checks out.
+     */
+    if (!flash_program(store, &base[store->journal_end], record, record_len)
+        || memcmp(&base[store->journal_end], record, record_len) != 0)
+    {
+        store->journal_damaged = true;
+        goto done;
+    }
+
+    record_runs_apply(store->stored_image, &record[RECORD_HEADER_SIZE], get_le16(&record[0]));
+    store->journal_end += record_len;
+    store->journal_records++;
+    appended = true;
+
+done:
+    return appended;
+}
+
+static bool sector_write(config_store_st * const store,
+                         unsigned int const sector,
+                         uint8_t const * const image,
+                         bool const allow_erase)
+{
+    config_flash_st const * const flash = store->flash;
+    uint8_t const * const base = flash->sectors[sector];
+    config_store_header_st header;
+    bool written = false;
+
+    if (!sector_blank(store, sector))
+    {
+        if (!allow_erase || !flash->erase(flash->ctx, sector))
+        {
+            goto done;
+        }
+        store->erases++;
+    }
+
+    header.magic = CONFIG_STORE_MAGIC;
+    header.sequence = store->sequence + 1;
+    header.layout_version = store->layout_version;
+    header.image_size = store->image_size;
+    header.image_crc = crc16_ccitt_update(CRC16_CCITT_INITIAL, image, store->image_size);
+    header.header_crc = header_crc_calculate(&header);
+
+    /* The header goes in last. Until then the sector isn't valid
+     * and the current active sector is still used.
+     */
+    if (!flash_program(store, &base[sizeof header], image, store->image_size)
+        || !flash_program(store, base, &header, sizeof header)
+        || !sector_image_valid(store, sector)
+        || memcmp(&base[sizeof header], image, store->image_size) != 0)
+    {
+        goto done;
+    }
+
+    memcpy(store->stored_image, image, store->image_size);
+    store->active_sector = sector;
+    store->sequence = header.sequence;
+    store->journal_end = journal_start(store);
+    store->journal_damaged = false;
+    store->valid = true;
+    store->rotations++;
+    written = true;
+
+done:
+    return written;
+}
+
+bool config_store_save(config_store_st * const store,
+                       void const * const image,
+                       bool const allow_erase)
+{
+    uint8_t record[CONFIG_STORE_MAXIMUM_RECORD_SIZE + RECORD_HEADER_SIZE + FLASH_WORD_SIZE];
+    bool saved = false;
+
+    if (store->valid)
+    {
+        size_t const record_len = record_build(store, image, record);
+
+        if (record_len == 0 && memcmp(image, store->stored_image, store->image_size) == 0)
+        {
+            saved = true;
+            goto done;
+        }
+        if (record_len > 0 && journal_append(store, record, record_len))
+        {
+            saved = true;
+            goto done;
+        }
+        saved = sector_write(store, !store->active_sector, image, allow_erase);
+    }
+    else
+    {
+        /* Nothing valid in either sector. Prefer one that doesn't
+         * need erasing.
+         */
+        saved = sector_write(store, 0, image, false)
+            || sector_write(store, 1, image, false)
+            || sector_write(store, 0, image, allow_erase);
+    }
+
+done:
+    return saved;
+}
@@ -0,0 +1,96 @@
+#ifndef __CONFIG_STORE_H__
+#define __CONFIG_STORE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Keeps a configuration image in a pair of flash sectors.
+ *
+ * The active sector starts with a header and a complete copy of
+ * the image. Small changes are appended to a journal following
+ * the image, so most saves only program a few words. When the
+ * journal is full a fresh image is written to the other sector,
+ * which then becomes the active one. The old sector is left alone
+ * until the next rotation, so there is always a complete copy to
+ * fall back on if power is lost part way through a write.
+ *
+ * sector:
+ *   header       config_store_header_st. Written after the image.
+ *   image        image_size bytes
+ *   journal      records, each one holding every change from a
+ *                single save:
+ *     length     2 bytes  number of run bytes that follow
+ *     crc        2 bytes  crc16_ccitt over the runs
+ *     runs       offset (2 bytes), length (2 bytes), data
+ *                padded with 0xff to a multiple of 4 bytes
+ * A record that doesn't check out ends the journal, and the next
+ * save writes a fresh image rather than appending after it.
+ *
+ * Images are stored as laid out in memory, so loading is a block
+ * copy once the CRCs have been checked.
+ */
+
+#define CONFIG_STORE_MAXIMUM_RECORD_SIZE 256
+
+typedef struct config_flash_st
+{
+    /* The sectors are memory mapped and are read directly. Erased
+     * bytes read as 0xff. Programming can only clear bits.
+     */
+    uint8_t const * sectors[2];
+    size_t sector_size;
+    bool (*erase)(void * const ctx, unsigned int const sector);
+    /* address and len are multiples of 4. */
+    bool (*program)(void * const ctx, uint8_t const * const address, void const * const data, size_t const len);
+    void * ctx;
+} config_flash_st;
+
+typedef struct config_store_st
+{
+    config_flash_st const * flash;
+    size_t image_size;
+    uint16_t layout_version;
+
+    /* What's currently in flash, so that saves only write the
+     * differences.
+     */
+    uint8_t * stored_image;
+
+    bool valid; /* False until an image has been loaded or saved. */
+    unsigned int active_sector;
+    uint32_t sequence;
+    size_t journal_end; /* Offset in the active sector of the next record. */
+    bool journal_damaged;
+
+    /* Debug */
+    uint32_t journal_records;
+    uint32_t rotations;
+    uint32_t erases;
+} config_store_st;
+
+/* Finds the newest valid image and applies its journal. The
+ * stored_image buffer must be image_size bytes and is filled in
+ * with the loaded image. Returns false if there is no valid image
+ * with the right layout version and size, in which case the
+ * caller should fill stored_image with its defaults. Nothing is
+ * written to flash.
+ */
+bool config_store_load(config_store_st * const store,
+                       config_flash_st const * const flash,
+                       uint8_t * const stored_image,
+                       size_t const image_size,
+                       uint16_t const layout_version);
+
+/* Saves the image. Appends a journal record if the changes fit,
+ * otherwise writes a fresh image to the other sector. That sector
+ * is only erased if allow_erase is set. Erasing a sector stalls
+ * instruction fetches from flash for a long time (seconds), so it
+ * must not be allowed while the engine is running. Returns false
+ * if the image wasn't saved.
+ */
+bool config_store_save(config_store_st * const store,
+                       void const * const image,
+                       bool const allow_erase);
+
+#endif /* __CONFIG_STORE_H__ */
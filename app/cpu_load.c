@@ -0,0 +1,175 @@
+#include "cpu_load.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#define CYCLES_PER_US (CFG_CPU_FREQ / 1000000)
+
+typedef struct cpu_load_context_st
+{
+    char const * task_names[CPU_LOAD_MAX_TASKS];
+    cpu_load_sample_st last_report;
+} cpu_load_context_st;
+
+static char const * const isr_names[cpu_load_isr_COUNT] =
+{
+    [cpu_load_isr_tim2] = "tim2",
+    [cpu_load_isr_tim1_cc] = "tim1_cc",
+    [cpu_load_isr_tim3] = "tim3",
+    [cpu_load_isr_tim4] = "tim4",
+    [cpu_load_isr_tim8_cc] = "tim8_cc",
+    [cpu_load_isr_exti0] = "exti0",
+    [cpu_load_isr_exti9_5] = "exti9_5",
+    [cpu_load_isr_usart1] = "usart1",
+    [cpu_load_isr_usart1_tx_dma] = "usart1_tx_dma",
+    [cpu_load_isr_usart1_rx_dma] = "usart1_rx_dma",
+    [cpu_load_isr_adc_dma] = "adc_dma"
+};
+
+cpu_load_isr_stats_st cpu_load_isr_stats[cpu_load_isr_COUNT];
+
+static cpu_load_context_st cpu_load_context =
+{
+    .task_names = { [0] = "idle" }
+};
+
+/* Counts taken from a sample that is older. A task deleted and
+ * created again starts from 0.
+ */
+static uint64_t cycles_since(uint64_t const now, uint64_t const then)
+{
+    return (now >= then) ? now - then : now;
+}
+
+static uint64_t sample_total(cpu_load_sample_st const * const now, cpu_load_sample_st const * const then)
+{
+    uint64_t total = 0;
+    size_t index;
+
+    for (index = 0; index < CPU_LOAD_MAX_TASKS; index++)
+    {
+        total += cycles_since(now->task_cycles[index], then->task_cycles[index]);
+    }
+    for (index = 0; index < cpu_load_isr_COUNT; index++)
+    {
+        total += cycles_since(now->isr_cycles[index], then->isr_cycles[index]);
+    }
+
+    return total;
+}
+
+static uint32_t permille(uint64_t const cycles, uint64_t const total)
+{
+    return (total > 0) ? (uint32_t)((cycles * 1000 + total / 2) / total) : 0;
+}
+
+static float cycles_to_us(uint64_t const cycles)
+{
+    return (float)cycles / CYCLES_PER_US;
+}
+
+void cpu_load_task_name_set(OS_TID const task_id, char const * const name)
+{
+    if (task_id < CPU_LOAD_MAX_TASKS)
+    {
+        cpu_load_context.task_names[task_id] = name;
+    }
+}
+
+void cpu_load_sample(cpu_load_sample_st * const sample)
+{
+#if CFG_CPU_STATS_EN > 0
+    size_t index;
+
+    for (index = 0; index < CPU_LOAD_MAX_TASKS; index++)
+    {
+        U64 cycles;
+        U32 max_cycles;
+
+        if (CoGetTaskCycles(index, &cycles, &max_cycles) != E_OK)
+        {
+            cycles = 0;
+        }
+        sample->task_cycles[index] = cycles;
+    }
+    for (index = 0; index < cpu_load_isr_COUNT; index++)
+    {
+        /* The ISR could change it part way through. */
+        __disable_irq();
+        sample->isr_cycles[index] = cpu_load_isr_stats[index].cycles;
+        __enable_irq();
+    }
+#else
+    *sample = (cpu_load_sample_st){ .task_cycles = { 0 } };
+#endif
+}
+
+uint32_t cpu_load_permille_get(cpu_load_sample_st * const since)
+{
+    cpu_load_sample_st now;
+    uint64_t idle;
+    uint64_t total;
+
+    cpu_load_sample(&now);
+    idle = cycles_since(now.task_cycles[0], since->task_cycles[0]);
+    total = sample_total(&now, since);
+    *since = now;
+
+    return (total > 0) ? 1000 - permille(idle, total) : 0;
+}
+
+void print_cpu_load_debug(void)
+{
+#if CFG_CPU_STATS_EN > 0
+    cpu_load_context_st * const cpu_load = &cpu_load_context;
+    cpu_load_sample_st now;
+    uint64_t total;
+    size_t index;
+
+    cpu_load_sample(&now);
+    total = sample_total(&now, &cpu_load->last_report);
+
+    printf("cpu load %"PRIu32" permille over %.3f s\r\n",
+           1000 - permille(cycles_since(now.task_cycles[0], cpu_load->last_report.task_cycles[0]), total),
+           cycles_to_us(total) / 1000000.0f);
+
+    printf("task name       permille  max run us\r\n");
+    for (index = 0; index < CPU_LOAD_MAX_TASKS; index++)
+    {
+        U64 cycles;
+        U32 max_cycles;
+        char const * const name = cpu_load->task_names[index];
+
+        if (CoGetTaskCycles(index, &cycles, &max_cycles) != E_OK)
+        {
+            continue;
+        }
+        printf("%4u %-10s %8"PRIu32" %11.1f\r\n",
+               (unsigned)index,
+               (name != NULL) ? name : "-",
+               permille(cycles_since(now.task_cycles[index], cpu_load->last_report.task_cycles[index]), total),
+               cycles_to_us(max_cycles));
+    }
+
+    printf("isr           count permille  max us  max latency us\r\n");
+    for (index = 0; index < cpu_load_isr_COUNT; index++)
+    {
+        cpu_load_isr_stats_st stats;
+
+        __disable_irq();
+        stats = cpu_load_isr_stats[index];
+        __enable_irq();
+
+        printf("%-13s %5"PRIu32" %8"PRIu32" %7.2f %15"PRIu32"\r\n",
+               isr_names[index],
+               stats.count,
+               permille(cycles_since(now.isr_cycles[index], cpu_load->last_report.isr_cycles[index]), total),
+               cycles_to_us(stats.max_cycles),
+               stats.max_latency_us);
+    }
+
+    cpu_load->last_report = now;
+#else
+    printf("cpu load isn't counted, CFG_CPU_STATS_EN is 0\r\n");
+#endif
+}
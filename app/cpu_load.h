@@ -0,0 +1,141 @@
+#ifndef __CPU_LOAD_H__
+#define __CPU_LOAD_H__
+
+#include "utils.h"
+
+#include "stm32f4xx.h"
+
+#include "CoOS.h"
+#include "OsArch.h"
+
+#include <stdint.h>
+
+/* Where the CPU time goes, counted with the DWT cycle counter.
+ * CoOS charges the cycles each task runs to it at every context
+ * switch (CFG_CPU_STATS_EN). The ISRs below count their own
+ * cycles, calling cpu_load_isr_enter() first and
+ * cpu_load_isr_exit() last. A nested ISR's cycles are taken off
+ * the ISR it interrupted, and all of them off the task they
+ * interrupted. Other ISRs (SysTick, PendSV) are charged to the
+ * task they interrupt.
+ */
+
+/* Includes the idle task, which is always task 0. */
+#define CPU_LOAD_MAX_TASKS (CFG_MAX_USER_TASKS + 1)
+
+typedef enum cpu_load_isr_t
+{
+    cpu_load_isr_tim2, /* Crank capture and the CoOS tickless compare. */
+    cpu_load_isr_tim1_cc,
+    cpu_load_isr_tim3,
+    cpu_load_isr_tim4,
+    cpu_load_isr_tim8_cc,
+    cpu_load_isr_exti0,
+    cpu_load_isr_exti9_5,
+    cpu_load_isr_usart1,
+    cpu_load_isr_usart1_tx_dma,
+    cpu_load_isr_usart1_rx_dma,
+    cpu_load_isr_adc_dma,
+    cpu_load_isr_COUNT
+} cpu_load_isr_t;
+
+typedef struct cpu_load_isr_stats_st
+{
+    uint32_t count;
+    uint64_t cycles; /* Less nested ISRs. */
+    uint32_t max_cycles;
+    /* How late a timer ISR saw its compare or capture. */
+    uint32_t max_latency_us;
+} cpu_load_isr_stats_st;
+
+typedef struct cpu_load_isr_stamp_st
+{
+    uint32_t start;
+    uint32_t isr_cycles; /* OSIsrCycles at the start. */
+} cpu_load_isr_stamp_st;
+
+/* The totals at one time. The load between two samples is taken
+ * from the difference.
+ */
+typedef struct cpu_load_sample_st
+{
+    uint64_t task_cycles[CPU_LOAD_MAX_TASKS];
+    uint64_t isr_cycles[cpu_load_isr_COUNT];
+} cpu_load_sample_st;
+
+extern cpu_load_isr_stats_st cpu_load_isr_stats[cpu_load_isr_COUNT];
+
+static inline cpu_load_isr_stamp_st cpu_load_isr_enter(void)
+{
+    cpu_load_isr_stamp_st stamp = { .start = 0, .isr_cycles = 0 };
+
+#if CFG_CPU_STATS_EN > 0
+    __disable_irq();
+    stamp.start = CpuCycles();
+    stamp.isr_cycles = OSIsrCycles;
+    __enable_irq();
+#endif
+
+    return stamp;
+}
+
+static inline void cpu_load_isr_exit(cpu_load_isr_t const isr, cpu_load_isr_stamp_st const stamp)
+{
+#if CFG_CPU_STATS_EN > 0
+    cpu_load_isr_stats_st * const stats = &cpu_load_isr_stats[isr];
+    uint32_t elapsed;
+    uint32_t nested;
+
+    /* ISRs that interrupted this one have already added theirs to
+     * OSIsrCycles.
+     */
+    __disable_irq();
+    elapsed = CpuCycles() - stamp.start;
+    nested = OSIsrCycles - stamp.isr_cycles;
+    OSIsrCycles = stamp.isr_cycles + elapsed;
+    __enable_irq();
+
+    elapsed -= nested;
+    stats->count++;
+    stats->cycles += elapsed;
+    if (elapsed > stats->max_cycles)
+    {
+        stats->max_cycles = elapsed;
+    }
+#else
+    UNUSED(isr);
+    UNUSED(stamp);
+#endif
+}
+
+static inline void cpu_load_isr_latency_record(cpu_load_isr_t const isr, uint32_t const latency_us)
+{
+#if CFG_CPU_STATS_EN > 0
+    cpu_load_isr_stats_st * const stats = &cpu_load_isr_stats[isr];
+
+    if (latency_us > stats->max_latency_us)
+    {
+        stats->max_latency_us = latency_us;
+    }
+#else
+    UNUSED(isr);
+    UNUSED(latency_us);
+#endif
+}
+
+/* For the report. name must be a string literal. */
+void cpu_load_task_name_set(OS_TID const task_id, char const * const name);
+
+void cpu_load_sample(cpu_load_sample_st * const sample);
+
+/* Returns the load, in tenths of a percent, since the sample in
+ * since, and takes a new sample into it.
+ */
+uint32_t cpu_load_permille_get(cpu_load_sample_st * const since);
+
+/* Load of each task and ISR since the last report. Worst cases are
+ * since startup.
+ */
+void print_cpu_load_debug(void);
+
+#endif /* __CPU_LOAD_H__ */
@@ -0,0 +1,16 @@
+#ifndef __CRC_H__
+#define __CRC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CRC16_CCITT_INITIAL 0xffff
+
+/* CRC-16/CCITT-FALSE (polynomial 0x1021, no reflection). 
+ * Start with CRC16_CCITT_INITIAL and feed the result back in to 
+ * continue a CRC over several blocks. Also built into the host 
+ * tools. 
+ */
+uint16_t crc16_ccitt_update(uint16_t crc, void const * const data, size_t const len);
+
+#endif /* __CRC_H__ */
@@ -0,0 +1,51 @@
+#include "engine_sensors.h"
+#include "analog_inputs.h"
+#include "sensor_conversion.h"
+#include "map_sampler.h"
+
+float engine_sensors_map_kpa_get(void)
+{
+    return sensor_value_get(analog_input_map);
+}
+
+float engine_sensors_cylinder_map_kpa_get(size_t const cylinder)
+{
+    map_window_result_st result;
+    float map_kpa;
+
+    if (map_sampler_cylinder_result_get(cylinder, &result))
+    {
+        map_kpa = (float)sensor_convert(analog_input_map, result.average) / sensor_scale_get(analog_input_map);
+    }
+    else
+    {
+        map_kpa = engine_sensors_map_kpa_get();
+    }
+
+    return map_kpa;
+}
+
+float engine_sensors_throttle_position_get(void)
+{
+    return sensor_value_get(analog_input_tps);
+}
+
+float engine_sensors_intake_air_temperature_get(void)
+{
+    return sensor_value_get(analog_input_iat);
+}
+
+float engine_sensors_coolant_temperature_get(void)
+{
+    return sensor_value_get(analog_input_clt);
+}
+
+float engine_sensors_lambda_get(void)
+{
+    return sensor_value_get(analog_input_o2);
+}
+
+float engine_sensors_battery_voltage_get(void)
+{
+    return sensor_value_get(analog_input_battery);
+}
@@ -0,0 +1,18 @@
+#ifndef __ENGINE_SENSORS_H__
+#define __ENGINE_SENSORS_H__
+
+#include <stddef.h>
+
+/* Latest values of the engine sensors in engineering units. */
+float engine_sensors_map_kpa_get(void);
+/* Average MAP over the cylinder's intake stroke. Falls back to 
+ * engine_sensors_map_kpa_get() if there is no recent value. 
+ */
+float engine_sensors_cylinder_map_kpa_get(size_t const cylinder);
+float engine_sensors_throttle_position_get(void); /* % */
+float engine_sensors_intake_air_temperature_get(void);
+float engine_sensors_coolant_temperature_get(void);
+float engine_sensors_lambda_get(void);
+float engine_sensors_battery_voltage_get(void);
+
+#endif /* __ENGINE_SENSORS_H__ */
@@ -0,0 +1,119 @@
+#include "event_log.h"
+#include "main_input_timer.h"
+#include "utils.h"
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+
+#define EVENT_LOG_ENTRIES 32 /* must be power of two */
+
+typedef struct event_log_entry_st
+{
+    /* Set to the slot's reservation count + 1 once the rest of 
+     * the entry has been written. Until then the reader leaves the 
+     * entry alone. 
+     */
+    uint32_t sequence;
+    char const * format;
+    uint32_t timestamp;
+    uint32_t args[EVENT_LOG_MAX_ARGS];
+} event_log_entry_st;
+
+typedef struct event_log_st
+{
+    /* Free running counts. Slot = count % EVENT_LOG_ENTRIES. */
+    uint32_t head; /* Next slot to reserve. Shared by all writers. */
+    uint32_t tail; /* Next slot to print. Only written by the reader. */
+
+    uint32_t dropped;
+    uint32_t reported_dropped;
+    uint32_t recorded;
+
+    event_log_entry_st entries[EVENT_LOG_ENTRIES];
+} event_log_st;
+
+static event_log_st event_log;
+
+void event_log_record(char const * const format, uint32_t const a, uint32_t const b, uint32_t const c)
+{
+    event_log_st * const log = &event_log;
+    event_log_entry_st * entry;
+    uint32_t slot;
+
+    /* Reserve a slot. A writer that interrupts this one just 
+     * causes the compare and swap to fail and go round again. 
+     * These builtins compile to LDREX/STREX, so no interrupts are 
+     * disabled. 
+     */
+    slot = __atomic_load_n(&log->head, __ATOMIC_RELAXED);
+    do
+    {
+        if (slot - __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE) >= EVENT_LOG_ENTRIES)
+        {
+            __atomic_fetch_add(&log->dropped, 1, __ATOMIC_RELAXED);
+            goto done;
+        }
+    }
+    while (!__atomic_compare_exchange_n(&log->head, &slot, slot + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    entry = &log->entries[slot % EVENT_LOG_ENTRIES];
+    entry->format = format;
+    entry->timestamp = main_input_timer_count_get();
+    entry->args[0] = a;
+    entry->args[1] = b;
+    entry->args[2] = c;
+
+    /* Publish. */
+    __atomic_store_n(&entry->sequence, slot + 1, __ATOMIC_RELEASE);
+
+done:
+    return;
+}
+
+void event_log_flush(void)
+{
+    event_log_st * const log = &event_log;
+    uint32_t tail = log->tail;
+    uint32_t dropped;
+
+    while (1)
+    {
+        event_log_entry_st const * const entry = &log->entries[tail % EVENT_LOG_ENTRIES];
+
+        /* Stops at the first entry that hasn't been completed, even 
+         * if later ones have been. Entries are always printed in 
+         * the order they were reserved. 
+         */
+        if (__atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE) != tail + 1)
+        {
+            break;
+        }
+
+        printf("%"PRIu32": ", entry->timestamp);
+        printf(entry->format, entry->args[0], entry->args[1], entry->args[2]);
+
+        tail++;
+        log->recorded++;
+        /* Hand the slot back to the writers. */
+        __atomic_store_n(&log->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    dropped = __atomic_load_n(&log->dropped, __ATOMIC_RELAXED);
+    if (dropped != log->reported_dropped)
+    {
+        printf("event log: %"PRIu32" entries dropped\r\n", dropped - log->reported_dropped);
+        log->reported_dropped = dropped;
+    }
+}
+
+void print_event_log_debug(void)
+{
+    event_log_st const * const log = &event_log;
+
+    printf("event log head %"PRIu32" tail %"PRIu32" printed %"PRIu32" dropped %"PRIu32"\r\n",
+           log->head,
+           log->tail,
+           log->recorded,
+           log->dropped);
+}
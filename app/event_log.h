@@ -0,0 +1,40 @@
+#ifndef __EVENT_LOG_H__
+#define __EVENT_LOG_H__
+
+#include <stdint.h>
+
+/* Deferred formatting log. 
+ * A log call only stores a timestamp, the address of the format 
+ * string and up to EVENT_LOG_MAX_ARGS raw 32 bit argument words 
+ * in a lock-free ring. It never blocks, so it is safe to call 
+ * from any task or ISR, including the engine event callbacks. 
+ * If the ring is full the entry is dropped and counted. 
+ * The entries are formatted later by event_log_flush(), called 
+ * from the lowest priority task. 
+ *  
+ * Format strings must be string literals (only the address is 
+ * kept) and may only use conversions that take a 32 bit integer 
+ * (%d, %u, %x, PRId32 etc). Scale floats to integers first. 
+ */
+
+#define EVENT_LOG_MAX_ARGS 3
+
+#define EVENT_LOG0(format) \
+    event_log_record((format), 0, 0, 0)
+#define EVENT_LOG1(format, a) \
+    event_log_record((format), (uint32_t)(a), 0, 0)
+#define EVENT_LOG2(format, a, b) \
+    event_log_record((format), (uint32_t)(a), (uint32_t)(b), 0)
+#define EVENT_LOG3(format, a, b, c) \
+    event_log_record((format), (uint32_t)(a), (uint32_t)(b), (uint32_t)(c))
+
+void event_log_record(char const * const format, uint32_t const a, uint32_t const b, uint32_t const c);
+
+/* Formats and prints all complete entries in the log. Not 
+ * re-entrant. Must only be called from one task. 
+ */
+void event_log_flush(void);
+
+void print_event_log_debug(void);
+
+#endif /* __EVENT_LOG_H__ */
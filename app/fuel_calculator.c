@@ -0,0 +1,419 @@
+#include "fuel_calculator.h"
+#include "cpu_load.h"
+#include "injector_output.h"
+#include "maps.h"
+#include "engine_sensors.h"
+#include "wall_film.h"
+#include "tune_config.h"
+#include "main_input_timer.h"
+#include "utils.h"
+
+#include "CoOS.h"
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FUEL_CALCULATOR_TASK_STACK_SIZE 512
+#define FUEL_CALCULATOR_TASK_PRIORITY 3 /* Below the trigger input and pulser tasks. */
+#define FUEL_CALCULATION_PERIOD_MS 10
+
+#define FUEL_DENSITY_GRAMS_PER_CC 0.74
+#define AIR_GAS_CONSTANT 287.05 /* J/(kg.K) */
+#define STANDARD_PRESSURE_KPA 100.0
+#define STANDARD_TEMPERATURE_KELVIN 293.15
+#define CELSIUS_TO_KELVIN_OFFSET 273.15
+
+/* Smoothing applied to the battery voltage used for the dead 
+ * time calculation, so that ripple doesn't get passed on to the 
+ * pulse widths. 
+ */
+#define BATTERY_VOLTAGE_SMOOTHING_FACTOR 0.1
+#define BATTERY_VOLTAGE_SCALE 10 /* Dead time table bins are in units of 0.1V. */
+
+#define MAXIMUM_PULSE_WIDTH_US 0xffffUL /* Limited by pulser_schedule_st.pulse_width_us. */
+
+#define VE_SCALE 100.0 /* VE table cells are in units of 0.01%. */
+#define AFR_SCALE 100.0 /* AFR table cells are in units of 0.01. */
+#define ENRICHMENT_SCALE 1000.0 /* Enrichment table cells are in units of 0.1%. */
+
+/* The small pulse correction table is resampled at evenly spaced 
+ * pulse widths so that the event path can index it directly. The 
+ * spacing is the smallest power of 2 that covers the table, up to 
+ * the maximum pulse width. 
+ */
+#define SMALL_PULSE_LUT_ENTRIES 64
+#define SMALL_PULSE_LUT_MAXIMUM_SHIFT 10 /* (SMALL_PULSE_LUT_ENTRIES - 1) << 10 is just under MAXIMUM_PULSE_WIDTH_US. */
+
+typedef struct fuel_injection_parameters_st
+{
+    uint32_t fuel_pulse_width_us[MAX_INJECTORS]; /* Fuel required by each cylinder. Excludes dead time. */
+    uint32_t dead_time_us; /* Added to every pulse that isn't 0. */
+    /* Indexed by the wall film compensated pulse width >> 
+     * small_pulse_lut_shift, and interpolated between entries. 
+     */
+    int16_t small_pulse_correction_lut_us[SMALL_PULSE_LUT_ENTRIES];
+    uint32_t small_pulse_lut_shift;
+    wall_film_coefficients_st wall_film_coefficients;
+} fuel_injection_parameters_st;
+
+typedef struct fuel_calculator_st
+{
+    trigger_wheel_36_1_context_st * trigger_wheel;
+
+    tune_config_st const * config; /* The configuration the maps currently use. */
+    float required_fuel_us; /* Pulse width at 100% VE, standard temperature and pressure, stoichiometric. */
+    float stoichiometric_afr;
+    map_3d_st ve_map;
+    map_3d_st afr_target_map;
+    map_2d_st warmup_enrichment_map;
+    map_2d_st dead_time_map;
+    map_2d_st small_pulse_correction_map;
+    int16_t small_pulse_correction_lut_us[SMALL_PULSE_LUT_ENTRIES]; /* Resampled from the map whenever it changes. */
+    uint32_t small_pulse_lut_shift;
+
+    float filtered_battery_voltage;
+
+    /* The calculation writes into whichever buffer is not
+     * currently published, then publishes it with a single pointer
+     * write. Readers only ever see a complete set of parameters.
+     */
+    fuel_injection_parameters_st parameter_buffers[2];
+    fuel_injection_parameters_st const * volatile published_parameters;
+
+    /* Only accessed from the injection event path. */
+    wall_film_st wall_films[MAX_INJECTORS];
+
+    /* Debug */
+    uint32_t update_count;
+    uint32_t last_update_time_us;
+    uint32_t maximum_update_time_us;
+    float debug_ve;
+    float debug_target_afr;
+    float debug_dead_time_us;
+    int32_t debug_small_pulse_correction_us;
+
+    __attribute((aligned(8))) OS_STK task_stack[FUEL_CALCULATOR_TASK_STACK_SIZE];
+} fuel_calculator_st;
+
+static fuel_calculator_st fuel_calculator;
+
+static unsigned int num_cylinders_get(void)
+{
+    return tune_config_engine_get()->num_cylinders;
+}
+
+static float filtered_battery_voltage_update(fuel_calculator_st * const calculator)
+{
+    calculator->filtered_battery_voltage += (engine_sensors_battery_voltage_get() - calculator->filtered_battery_voltage)
+                                            * BATTERY_VOLTAGE_SMOOTHING_FACTOR;
+
+    return calculator->filtered_battery_voltage;
+}
+
+static float required_fuel_us_calculate(tune_config_st const * const config)
+{
+    /* The mass of fuel required to fill one cylinder with a
+     * stoichiometric mixture at standard temperature and
+     * pressure, and how long the injector takes to deliver it.
+     */
+    float const cylinder_volume_m3 = ((float)config->fuel.engine_displacement_cc / num_cylinders_get()) / 1.0e6;
+    float const air_density_kg_per_m3 = (STANDARD_PRESSURE_KPA * 1000.0)
+                                        / (AIR_GAS_CONSTANT * STANDARD_TEMPERATURE_KELVIN);
+    float const air_mass_grams = cylinder_volume_m3 * air_density_kg_per_m3 * 1000.0;
+    float const fuel_mass_grams = air_mass_grams / (config->fuel.stoichiometric_afr / AFR_SCALE);
+    float const injector_flow_grams_per_second = (config->injector.injector_flow_cc_per_minute / 60.0)
+                                                 * FUEL_DENSITY_GRAMS_PER_CC;
+
+    return (fuel_mass_grams / injector_flow_grams_per_second) * 1.0e6;
+}
+
+static uint32_t pulse_width_limit(float const pulse_width_us)
+{
+    uint32_t limited_pulse_width_us;
+
+    if (pulse_width_us <= 0.0)
+    {
+        limited_pulse_width_us = 0;
+    }
+    else if (pulse_width_us >= MAXIMUM_PULSE_WIDTH_US)
+    {
+        limited_pulse_width_us = MAXIMUM_PULSE_WIDTH_US;
+    }
+    else
+    {
+        limited_pulse_width_us = lrintf(pulse_width_us);
+    }
+
+    return limited_pulse_width_us;
+}
+
+static fuel_injection_parameters_st * unpublished_parameters_get(fuel_calculator_st * const calculator)
+{
+    return (calculator->published_parameters == &calculator->parameter_buffers[0])
+        ? &calculator->parameter_buffers[1]
+        : &calculator->parameter_buffers[0];
+}
+
+static void small_pulse_correction_lut_init(fuel_calculator_st * const calculator, 
+                                            tune_injector_page_st const * const injector)
+{
+    int32_t const last_bin = injector->small_pulse_width_bins[SMALL_PULSE_TABLE_BINS - 1];
+    uint32_t shift = 0;
+    size_t index;
+
+    while (shift < SMALL_PULSE_LUT_MAXIMUM_SHIFT
+           && ((int32_t)(SMALL_PULSE_LUT_ENTRIES - 1) << shift) < last_bin)
+    {
+        shift++;
+    }
+
+    for (index = 0; index < SMALL_PULSE_LUT_ENTRIES; index++)
+    {
+        calculator->small_pulse_correction_lut_us[index] =
+            map_2d_lookup(&calculator->small_pulse_correction_map, (int32_t)(index << shift));
+    }
+    calculator->small_pulse_lut_shift = shift;
+}
+
+static void fuel_maps_init(fuel_calculator_st * const calculator, tune_config_st const * const config)
+{
+    tune_fuel_page_st const * const fuel = &config->fuel;
+    tune_injector_page_st const * const injector = &config->injector;
+
+    map_3d_init(&calculator->ve_map,
+                fuel->ve_table_rpm_bins, VE_TABLE_RPM_BINS,
+                fuel->ve_table_map_bins, VE_TABLE_MAP_BINS,
+                &fuel->ve_table[0][0]);
+    map_3d_init(&calculator->afr_target_map,
+                fuel->ve_table_rpm_bins, VE_TABLE_RPM_BINS,
+                fuel->ve_table_map_bins, VE_TABLE_MAP_BINS,
+                &fuel->afr_target_table[0][0]);
+    map_2d_init(&calculator->warmup_enrichment_map,
+                fuel->warmup_enrichment_clt_bins, WARMUP_TABLE_BINS,
+                fuel->warmup_enrichment_table);
+    map_2d_init(&calculator->dead_time_map,
+                injector->dead_time_voltage_bins, DEAD_TIME_TABLE_BINS,
+                injector->dead_time_table);
+    map_2d_init(&calculator->small_pulse_correction_map,
+                injector->small_pulse_width_bins, SMALL_PULSE_TABLE_BINS,
+                injector->small_pulse_correction_table);
+    small_pulse_correction_lut_init(calculator, injector);
+    wall_film_init(fuel);
+
+    calculator->required_fuel_us = required_fuel_us_calculate(config);
+    calculator->stoichiometric_afr = fuel->stoichiometric_afr / AFR_SCALE;
+    calculator->config = config;
+}
+
+/* Switches the maps over to a newly burnt configuration. Called
+ * before each calculation, never part way through one.
+ */
+static void fuel_maps_update(fuel_calculator_st * const calculator)
+{
+    tune_config_st const * const config = tune_config_get();
+
+    if (config != calculator->config)
+    {
+        fuel_maps_init(calculator, config);
+    }
+}
+
+static void fuel_calculator_update(fuel_calculator_st * const calculator)
+{
+    uint32_t const start_time = main_input_timer_count_get();
+    fuel_injection_parameters_st * const parameters = unpublished_parameters_get(calculator);
+    unsigned int const num_cylinders = num_cylinders_get();
+    float const rpm = trigger_36_1_rpm_get(calculator->trigger_wheel);
+    float const map_kpa = engine_sensors_map_kpa_get();
+    float const intake_air_kelvin = engine_sensors_intake_air_temperature_get() + CELSIUS_TO_KELVIN_OFFSET;
+    int32_t const rpm_bin_value = lrintf(rpm);
+    int32_t const map_bin_value = lrintf(map_kpa);
+    float const ve = map_3d_lookup(&calculator->ve_map, rpm_bin_value, map_bin_value) / VE_SCALE;
+    float const target_afr = map_3d_lookup(&calculator->afr_target_map, rpm_bin_value, map_bin_value) / AFR_SCALE;
+    float const air_density_correction = STANDARD_TEMPERATURE_KELVIN / intake_air_kelvin;
+    int32_t const coolant_temperature = lrintf(engine_sensors_coolant_temperature_get());
+    float const warmup_enrichment = map_2d_lookup(&calculator->warmup_enrichment_map, coolant_temperature) / ENRICHMENT_SCALE;
+    int32_t const battery_voltage = lrintf(filtered_battery_voltage_update(calculator) * BATTERY_VOLTAGE_SCALE);
+    float const dead_time_us = map_2d_lookup(&calculator->dead_time_map, battery_voltage);
+    float const fuel_pulse_width_us = calculator->required_fuel_us
+                                      * (ve / 100.0)
+                                      * (map_kpa / STANDARD_PRESSURE_KPA)
+                                      * air_density_correction
+                                      * (calculator->stoichiometric_afr / target_afr)
+                                      * warmup_enrichment;
+    size_t cylinder;
+
+    /* TODO: Per-cylinder trims. */
+    for (cylinder = 0; cylinder < num_cylinders; cylinder++)
+    {
+        /* The fuel quantity is proportional to MAP, so correct for 
+         * the MAP seen by each cylinder during its intake stroke. 
+         */
+        float const cylinder_map_kpa = engine_sensors_cylinder_map_kpa_get(cylinder);
+        float const cylinder_map_correction = (map_kpa > 0.0) ? (cylinder_map_kpa / map_kpa) : 1.0;
+
+        parameters->fuel_pulse_width_us[cylinder] = pulse_width_limit(fuel_pulse_width_us * cylinder_map_correction);
+    }
+    parameters->dead_time_us = pulse_width_limit(dead_time_us);
+    /* Published alongside the dead time, so an injection never 
+     * mixes the dead time from one configuration with the 
+     * correction from another. 
+     */
+    memcpy(parameters->small_pulse_correction_lut_us,
+           calculator->small_pulse_correction_lut_us,
+           sizeof parameters->small_pulse_correction_lut_us);
+    parameters->small_pulse_lut_shift = calculator->small_pulse_lut_shift;
+    wall_film_coefficients_get(&parameters->wall_film_coefficients, rpm_bin_value, coolant_temperature);
+
+    /* A single pointer write, so the readers get either the old
+     * or new set of parameters, never a mix of the two.
+     */
+    calculator->published_parameters = parameters;
+
+    calculator->debug_ve = ve;
+    calculator->debug_target_afr = target_afr;
+    calculator->debug_dead_time_us = dead_time_us;
+
+    calculator->update_count++;
+    calculator->last_update_time_us = main_input_timer_count_get() - start_time;
+    if (calculator->last_update_time_us > calculator->maximum_update_time_us)
+    {
+        calculator->maximum_update_time_us = calculator->last_update_time_us;
+    }
+}
+
+static int32_t small_pulse_correction_us_get(fuel_injection_parameters_st const * const parameters, 
+                                             uint32_t const fuel_pulse_width_us)
+{
+    uint32_t const shift = parameters->small_pulse_lut_shift;
+    uint32_t const index = fuel_pulse_width_us >> shift;
+    int32_t correction_us;
+
+    if (index >= SMALL_PULSE_LUT_ENTRIES - 1)
+    {
+        correction_us = parameters->small_pulse_correction_lut_us[SMALL_PULSE_LUT_ENTRIES - 1];
+    }
+    else
+    {
+        int32_t const low_us = parameters->small_pulse_correction_lut_us[index];
+        int32_t const high_us = parameters->small_pulse_correction_lut_us[index + 1];
+        int32_t const fraction = fuel_pulse_width_us & ((1UL << shift) - 1);
+
+        correction_us = low_us + (((high_us - low_us) * fraction) >> shift);
+    }
+
+    return correction_us;
+}
+
+uint32_t fuel_injector_pulse_width_us_get(size_t const cylinder)
+{
+    fuel_calculator_st * const calculator = &fuel_calculator;
+    fuel_injection_parameters_st const * const parameters = calculator->published_parameters;
+    uint32_t fuel_pulse_width_us;
+    int32_t small_pulse_correction_us;
+    int32_t pulse_width_us;
+
+    fuel_pulse_width_us = wall_film_compensate(&calculator->wall_films[cylinder],
+                                               &parameters->wall_film_coefficients,
+                                               parameters->fuel_pulse_width_us[cylinder]);
+    if (fuel_pulse_width_us == 0)
+    {
+        /* No fuel wanted, so don't open the injector at all. */
+        pulse_width_us = 0;
+        goto done;
+    }
+
+    /* Injectors deliver less (or more) than the linear flow rate 
+     * suggests at short pulse widths, so the correction is taken 
+     * from the width that will actually be injected. 
+     */
+    small_pulse_correction_us = small_pulse_correction_us_get(parameters, fuel_pulse_width_us);
+    calculator->debug_small_pulse_correction_us = small_pulse_correction_us;
+
+    pulse_width_us = (int32_t)fuel_pulse_width_us
+                     + small_pulse_correction_us
+                     + (int32_t)parameters->dead_time_us;
+    if (pulse_width_us < 0)
+    {
+        pulse_width_us = 0;
+    }
+    else if (pulse_width_us > (int32_t)MAXIMUM_PULSE_WIDTH_US)
+    {
+        pulse_width_us = MAXIMUM_PULSE_WIDTH_US;
+    }
+
+done:
+    return pulse_width_us;
+}
+
+void fuel_injection_scheduled(size_t const cylinder)
+{
+    fuel_calculator_st * const calculator = &fuel_calculator;
+    fuel_injection_parameters_st const * const parameters = calculator->published_parameters;
+
+    wall_film_injection_scheduled(&calculator->wall_films[cylinder], &parameters->wall_film_coefficients);
+}
+
+void print_fuel_debug(void)
+{
+    fuel_calculator_st * const calculator = &fuel_calculator;
+
+    printf("fuel ve %f afr %f dead time %f small pulse %"PRId32" required %f\r\n",
+           calculator->debug_ve,
+           calculator->debug_target_afr,
+           calculator->debug_dead_time_us,
+           calculator->debug_small_pulse_correction_us,
+           calculator->required_fuel_us);
+    printf("pulse width %"PRIu32" film %"PRId32"\r\n",
+           calculator->published_parameters->fuel_pulse_width_us[0],
+           calculator->wall_films[0].film_us);
+    printf("updates %"PRIu32" time %"PRIu32" max %"PRIu32"\r\n",
+           calculator->update_count,
+           calculator->last_update_time_us,
+           calculator->maximum_update_time_us);
+}
+
+static void fuel_calculator_task(void * arg)
+{
+    fuel_calculator_st * const calculator = arg;
+
+    while (1)
+    {
+        fuel_maps_update(calculator);
+        fuel_calculator_update(calculator);
+
+        CoTickDelay(MSTOTICKS(FUEL_CALCULATION_PERIOD_MS));
+    }
+}
+
+void fuel_calculator_init(trigger_wheel_36_1_context_st * const trigger_wheel)
+{
+    fuel_calculator_st * const calculator = &fuel_calculator;
+    size_t index;
+
+    calculator->trigger_wheel = trigger_wheel;
+
+    fuel_maps_init(calculator, tune_config_get());
+    calculator->filtered_battery_voltage = engine_sensors_battery_voltage_get();
+    calculator->published_parameters = &calculator->parameter_buffers[0];
+
+    for (index = 0; index < MAX_INJECTORS; index++)
+    {
+        wall_film_reset(&calculator->wall_films[index]);
+    }
+
+    /* Ensure there are sensible parameters published before the
+     * injectors are scheduled.
+     */
+    fuel_calculator_update(calculator);
+
+    cpu_load_task_name_set(CoCreateTask(fuel_calculator_task,
+                                        calculator,
+                                        FUEL_CALCULATOR_TASK_PRIORITY,
+                                        &calculator->task_stack[FUEL_CALCULATOR_TASK_STACK_SIZE - 1],
+                                        FUEL_CALCULATOR_TASK_STACK_SIZE),
+                           "fuel");
+}
@@ -0,0 +1,27 @@
+#ifndef __FUEL_CALCULATOR_H__
+#define __FUEL_CALCULATOR_H__
+
+#include "trigger_wheel_36_1.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+void fuel_calculator_init(trigger_wheel_36_1_context_st * const trigger_wheel);
+
+/* Returns the injector pulse width (including dead time) for 
+ * the next injection on the specified cylinder, based upon the 
+ * most recently published fuel calculation and the state of the 
+ * cylinder's wall film. Safe to call from the engine event 
+ * callbacks. No floating point math is performed. 
+ */
+uint32_t fuel_injector_pulse_width_us_get(size_t const cylinder);
+
+/* Called once the pulse returned by 
+ * fuel_injector_pulse_width_us_get() has been scheduled so that 
+ * the wall film model can be updated. 
+ */
+void fuel_injection_scheduled(size_t const cylinder);
+
+void print_fuel_debug(void);
+
+#endif /* __FUEL_CALCULATOR_H__ */
@@ -0,0 +1,343 @@
+#include "ignition_calculator.h"
+#include "cpu_load.h"
+#include "ignition_output.h"
+#include "engine_sensors.h"
+#include "knock.h"
+#include "maps.h"
+#include "tune_config.h"
+#include "main.h"
+#include "main_input_timer.h"
+#include "utils.h"
+
+#include "CoOS.h"
+#include "OsArch.h"
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+
+#define IGNITION_CALCULATOR_TASK_STACK_SIZE 512
+#define IGNITION_CALCULATOR_TASK_PRIORITY 3 /* Below the trigger input and pulser tasks. */
+
+/* Each cylinder's spark schedule is calculated this many degrees
+ * before its TDC. This is well before the ignition control
+ * schedules the spark (roughly 1 revolution + maximum advance
+ * before TDC).
+ */
+#define IGNITION_CALCULATION_DEGREES_BEFORE_TDC 540
+
+/* If defined, the advance is also updated on every tooth using
+ * the instantaneous RPM, so that it tracks fast changes in RPM.
+ * Only the RPM axis is interpolated on each tooth. The load
+ * axis is interpolated in the background once per cylinder.
+ */
+#define IGNITION_PER_TOOTH_ADVANCE_UPDATE
+
+#define BATTERY_VOLTAGE_SCALE 10 /* Dwell table bins are in units of 0.1V. */
+
+/* The advance at the current load for each of the RPM bins,
+ * along with the dwell. Produced in the background and used
+ * whenever the spark schedules are updated. The RPM bins are
+ * copied in too, so the tooth callback never reads the
+ * configuration.
+ */
+typedef struct ignition_load_slice_st
+{
+    int32_t rpm_bins[ADVANCE_TABLE_RPM_BINS];
+    int16_t advance[ADVANCE_TABLE_RPM_BINS]; /* 0.1 degrees BTDC. */
+    map_2d_st advance_curve;
+    uint16_t dwell_ticks;
+} ignition_load_slice_st;
+
+/* The spark angle and dwell are packed into a single word so
+ * that they are always published and read together.
+ */
+typedef union ignition_spark_schedule_packed_st
+{
+    uint32_t packed;
+    ignition_spark_schedule_st schedule;
+} ignition_spark_schedule_packed_st;
+
+typedef struct ignition_calculator_st
+{
+    trigger_wheel_36_1_context_st * trigger_wheel;
+
+    tune_config_st const * config; /* The configuration the maps currently use. */
+    map_3d_st advance_map;
+    map_2d_st dwell_map;
+
+    ignition_load_slice_st slice_buffers[2];
+    ignition_load_slice_st * volatile published_slice;
+
+    volatile uint32_t spark_schedules[MAX_IGNITIONS];
+
+    OS_FlagID calculation_flag;
+    volatile uint32_t pending_cylinders;
+    uint32_t cylinder_numbers[MAX_IGNITIONS]; /* Callback args. */
+
+    /* Debug */
+    uint32_t slice_update_count;
+    uint32_t tooth_update_count;
+    uint32_t last_tooth_rpm;
+
+    __attribute((aligned(8))) OS_STK task_stack[IGNITION_CALCULATOR_TASK_STACK_SIZE];
+} ignition_calculator_st;
+
+static ignition_calculator_st ignition_calculator;
+
+static unsigned int num_cylinders_get(void)
+{
+    return tune_config_engine_get()->num_cylinders;
+}
+
+static int32_t cylinder_tdc_angle_get(size_t const cylinder)
+{
+    return ((int32_t)get_engine_cycle_degrees() * IGNITION_ANGLE_SCALE * cylinder) / num_cylinders_get();
+}
+
+static ignition_load_slice_st * unpublished_slice_get(ignition_calculator_st * const calculator)
+{
+    return (calculator->published_slice == &calculator->slice_buffers[0])
+        ? &calculator->slice_buffers[1]
+        : &calculator->slice_buffers[0];
+}
+
+static void ignition_maps_init(ignition_calculator_st * const calculator, tune_config_st const * const config)
+{
+    tune_ignition_page_st const * const ignition = &config->ignition;
+
+    map_3d_init(&calculator->advance_map,
+                ignition->advance_table_rpm_bins, ADVANCE_TABLE_RPM_BINS,
+                ignition->advance_table_load_bins, ADVANCE_TABLE_LOAD_BINS,
+                &ignition->advance_table[0][0]);
+    map_2d_init(&calculator->dwell_map,
+                ignition->dwell_table_voltage_bins, DWELL_TABLE_BINS,
+                ignition->dwell_table);
+
+    calculator->config = config;
+}
+
+/* Switches the maps over to a newly burnt configuration. Called
+ * before each slice update, never part way through one.
+ */
+static void ignition_maps_update(ignition_calculator_st * const calculator)
+{
+    tune_config_st const * const config = tune_config_get();
+
+    if (config != calculator->config)
+    {
+        ignition_maps_init(calculator, config);
+    }
+}
+
+static void load_slice_update(ignition_calculator_st * const calculator)
+{
+    ignition_load_slice_st * const slice = unpublished_slice_get(calculator);
+    int32_t const * const rpm_bins = calculator->config->ignition.advance_table_rpm_bins;
+    int32_t const load = lrintf(engine_sensors_map_kpa_get());
+    int32_t const battery_voltage = lrintf(engine_sensors_battery_voltage_get() * BATTERY_VOLTAGE_SCALE);
+    size_t index;
+
+    for (index = 0; index < ADVANCE_TABLE_RPM_BINS; index++)
+    {
+        slice->rpm_bins[index] = rpm_bins[index];
+        slice->advance[index] = map_3d_lookup(&calculator->advance_map, rpm_bins[index], load);
+    }
+    slice->dwell_ticks = map_2d_lookup(&calculator->dwell_map, battery_voltage);
+
+    calculator->published_slice = slice;
+    calculator->slice_update_count++;
+}
+
+static uint32_t spark_schedule_calculate(ignition_load_slice_st * const slice,
+                                         size_t const cylinder,
+                                         int32_t const advance)
+{
+    int32_t const engine_cycle_angle = get_engine_cycle_degrees() * IGNITION_ANGLE_SCALE;
+    int32_t spark_angle = cylinder_tdc_angle_get(cylinder) - (advance - knock_retard_get(cylinder));
+    ignition_spark_schedule_packed_st spark_schedule;
+
+    if (spark_angle < 0)
+    {
+        spark_angle += engine_cycle_angle;
+    }
+    else if (spark_angle >= engine_cycle_angle)
+    {
+        spark_angle -= engine_cycle_angle;
+    }
+
+    spark_schedule.schedule.spark_angle = spark_angle;
+    spark_schedule.schedule.dwell_ticks = slice->dwell_ticks;
+
+    return spark_schedule.packed;
+}
+
+static void spark_schedules_update(ignition_calculator_st * const calculator,
+                                   uint32_t const cylinders,
+                                   int32_t const rpm)
+{
+    ignition_load_slice_st * const slice = calculator->published_slice;
+    int32_t const advance = map_2d_lookup(&slice->advance_curve, rpm);
+    unsigned int const num_cylinders = num_cylinders_get();
+    size_t cylinder;
+
+    for (cylinder = 0; cylinder < num_cylinders; cylinder++)
+    {
+        if ((cylinders & (1UL << cylinder)) != 0)
+        {
+            /* Single word write. */
+            calculator->spark_schedules[cylinder] = spark_schedule_calculate(slice, cylinder, advance);
+        }
+    }
+}
+
+#if defined(IGNITION_PER_TOOTH_ADVANCE_UPDATE)
+static void ignition_tooth_callback(unsigned int const tooth_number,
+                                    unsigned int const tooth_angle,
+                                    uint32_t const tooth_period,
+                                    void * const arg)
+{
+    ignition_calculator_st * const calculator = arg;
+    /* RPM = degrees per second / 6 */
+    int32_t const rpm = (tooth_angle * (TIMER_FREQUENCY / 6)) / tooth_period;
+
+    UNUSED(tooth_number);
+
+    calculator->last_tooth_rpm = rpm;
+    spark_schedules_update(calculator, (1UL << num_cylinders_get()) - 1, rpm);
+    calculator->tooth_update_count++;
+}
+#endif
+
+static void ignition_calculation_callback(float const crank_angle,
+                                          uint32_t timestamp,
+                                          void * const user_arg)
+{
+    uint32_t const * const cylinder_number = user_arg;
+
+    UNUSED(crank_angle);
+    UNUSED(timestamp);
+
+    IRQ_DISABLE_SAVE();
+    ignition_calculator.pending_cylinders |= 1UL << *cylinder_number;
+    IRQ_ENABLE_RESTORE();
+
+    CoSetFlag(ignition_calculator.calculation_flag);
+}
+
+static uint32_t pending_cylinders_get(ignition_calculator_st * const calculator)
+{
+    uint32_t pending_cylinders;
+
+    IRQ_DISABLE_SAVE();
+    pending_cylinders = calculator->pending_cylinders;
+    calculator->pending_cylinders = 0;
+    IRQ_ENABLE_RESTORE();
+
+    return pending_cylinders;
+}
+
+static void ignition_calculator_task(void * arg)
+{
+    ignition_calculator_st * const calculator = arg;
+
+    while (1)
+    {
+        uint32_t pending_cylinders;
+
+        CoWaitForSingleFlag(calculator->calculation_flag, 0);
+
+        pending_cylinders = pending_cylinders_get(calculator);
+        if (pending_cylinders != 0)
+        {
+            ignition_maps_update(calculator);
+            load_slice_update(calculator);
+            spark_schedules_update(calculator,
+                                   pending_cylinders,
+                                   lrintf(trigger_36_1_rpm_get(calculator->trigger_wheel)));
+        }
+    }
+}
+
+ignition_spark_schedule_st ignition_spark_schedule_get(size_t const cylinder)
+{
+    ignition_spark_schedule_packed_st spark_schedule;
+
+    spark_schedule.packed = ignition_calculator.spark_schedules[cylinder];
+
+    return spark_schedule.schedule;
+}
+
+void print_ignition_calculator_debug(void)
+{
+    ignition_calculator_st * const calculator = &ignition_calculator;
+    ignition_spark_schedule_st const spark_schedule = ignition_spark_schedule_get(0);
+
+    printf("spark angle %u dwell %u\r\n",
+           (unsigned int)spark_schedule.spark_angle,
+           (unsigned int)spark_schedule.dwell_ticks);
+    printf("slice updates %"PRIu32" tooth updates %"PRIu32" tooth rpm %"PRIu32"\r\n",
+           calculator->slice_update_count,
+           calculator->tooth_update_count,
+           calculator->last_tooth_rpm);
+}
+
+static void setup_ignition_calculation_events(ignition_calculator_st * const calculator)
+{
+    unsigned int const num_cylinders = num_cylinders_get();
+    size_t cylinder;
+
+    for (cylinder = 0; cylinder < num_cylinders; cylinder++)
+    {
+        float const calculation_angle = (float)cylinder_tdc_angle_get(cylinder) / IGNITION_ANGLE_SCALE
+                                        - IGNITION_CALCULATION_DEGREES_BEFORE_TDC;
+
+        calculator->cylinder_numbers[cylinder] = cylinder;
+        trigger_36_1_register_callback(calculator->trigger_wheel,
+                                       normalise_engine_cycle_angle(calculation_angle),
+                                       ignition_calculation_callback,
+                                       &calculator->cylinder_numbers[cylinder]);
+    }
+}
+
+void ignition_calculator_init(trigger_wheel_36_1_context_st * const trigger_wheel)
+{
+    ignition_calculator_st * const calculator = &ignition_calculator;
+    size_t index;
+
+    calculator->trigger_wheel = trigger_wheel;
+
+    ignition_maps_init(calculator, tune_config_get());
+
+    for (index = 0; index < ARRAY_SIZE(calculator->slice_buffers); index++)
+    {
+        ignition_load_slice_st * const slice = &calculator->slice_buffers[index];
+
+        map_2d_init(&slice->advance_curve,
+                    slice->rpm_bins, ADVANCE_TABLE_RPM_BINS,
+                    slice->advance);
+    }
+    calculator->published_slice = &calculator->slice_buffers[0];
+
+    /* Ensure there are sensible spark schedules published before
+     * the ignition outputs are scheduled.
+     */
+    load_slice_update(calculator);
+    spark_schedules_update(calculator, (1UL << num_cylinders_get()) - 1, 0);
+
+    calculator->calculation_flag = CoCreateFlag(Co_TRUE, Co_FALSE);
+
+    cpu_load_task_name_set(CoCreateTask(ignition_calculator_task,
+                                        calculator,
+                                        IGNITION_CALCULATOR_TASK_PRIORITY,
+                                        &calculator->task_stack[IGNITION_CALCULATOR_TASK_STACK_SIZE - 1],
+                                        IGNITION_CALCULATOR_TASK_STACK_SIZE),
+                           "ignition");
+
+    setup_ignition_calculation_events(calculator);
+
+#if defined(IGNITION_PER_TOOTH_ADVANCE_UPDATE)
+    trigger_36_1_register_tooth_callback(trigger_wheel, ignition_tooth_callback, calculator);
+#endif
+}
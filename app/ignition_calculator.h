@@ -0,0 +1,27 @@
+#ifndef __IGNITION_CALCULATOR_H__
+#define __IGNITION_CALCULATOR_H__
+
+#include "trigger_wheel_36_1.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define IGNITION_ANGLE_SCALE 10 /* Spark angles are in units of 0.1 degrees. */
+
+typedef struct ignition_spark_schedule_st
+{
+    uint16_t spark_angle; /* Engine cycle angle ATDC at which the spark occurs. */
+    uint16_t dwell_ticks;
+} ignition_spark_schedule_st;
+
+void ignition_calculator_init(trigger_wheel_36_1_context_st * const trigger_wheel);
+
+/* Returns the most recently published spark schedule for the 
+ * specified cylinder. The spark angle and dwell are always 
+ * read as a pair from the same calculation. 
+ */
+ignition_spark_schedule_st ignition_spark_schedule_get(size_t const cylinder);
+
+void print_ignition_calculator_debug(void);
+
+#endif /* __IGNITION_CALCULATOR_H__ */
@@ -1,6 +1,8 @@
 #include "ignition_control.h"
 #include "ignition_output.h"
+#include "ignition_calculator.h"
 #include "main.h"
+#include "tune_config.h"
 #include "main_input_timer.h"
 #include "utils.h"
 #include "pulser.h"
@@ -22,6 +24,7 @@ typedef struct ignition_control_st
        with the pulser.*/
     ignition_output_st * output; /* The ignition output to control */
     float debug_engine_cycle_angle; /* engine angle when the latest spark occured. */
+    uint32_t debug_latency;
 
 } ignition_control_st;
 
@@ -34,8 +37,7 @@ static trigger_wheel_36_1_context_st * trigger_wheel;
 
 static unsigned int num_ignition_outputs_get(void)
 {
-    /* XXX - Get the value from the configuration. */
-    return 4;
+    return tune_config_engine_get()->num_cylinders;
 }
 
 float debug_desired_spark_angle;
@@ -59,6 +61,11 @@ void print_ignition_debug(size_t const index)
            );
 }
 
+uint32_t ignition_scheduling_latency_us_get(size_t const index)
+{
+    return (index < MAX_IGNITIONS) ? ignition_controls[index].debug_latency : 0;
+}
+
 static void pulser_active_callback(void * const arg)
 {
     ignition_control_st * const ignition_control = arg;
@@ -93,16 +100,17 @@ void ignition_pulse_callback(float const crank_angle,
     UNUSED(timestamp);
 
 #if 1
-    unsigned int const num_ignitions = num_ignition_outputs_get();
+    /* The spark angle and dwell are calculated in the background 
+     * by the ignition calculator. 
+     */
+    ignition_spark_schedule_st const spark_schedule = ignition_spark_schedule_get(ignition_control->number);
     unsigned int degrees_per_engine_cycle = get_engine_cycle_degrees();
-    float const degrees_per_cylinder_ignition = (float)degrees_per_engine_cycle / num_ignitions;
-    float const ignition_spark_angle = normalise_engine_cycle_angle((degrees_per_cylinder_ignition * ignition_control->number) - get_ignition_advance());
+    float const ignition_spark_angle = (float)spark_schedule.spark_angle / IGNITION_ANGLE_SCALE;
     float const ignition_scheduling_angle = trigger_36_1_engine_cycle_angle_get(trigger_wheel); /* Current engine angle. */
     /* Determine how long it will take to rotate this many degrees. */
     float const time_to_next_spark = trigger_36_1_rotation_time_get(trigger_wheel,
                                                                     (float)degrees_per_engine_cycle - normalise_crank_angle(ignition_scheduling_angle - ignition_spark_angle));
-    /* The injector pulse width must include the time taken to open the injector (dead time). */
-    uint32_t const ignition_pulse_width_us = get_ignition_dwell_us();
+    uint32_t const ignition_pulse_width_us = spark_schedule.dwell_ticks;
     uint32_t ignition_us_until_open = lrintf(time_to_next_spark * TIMER_FREQUENCY) - ignition_pulse_width_us;
     uint32_t const current_timestamp = main_input_timer_count_get();
     uint32_t const latency = current_timestamp - timestamp;
@@ -111,6 +119,7 @@ void ignition_pulse_callback(float const crank_angle,
 
     ignition_control->latest_scheduling_angle = ignition_scheduling_angle;
     ignition_control->spark_angle = ignition_spark_angle;
+    ignition_control->debug_latency = latency;
 
     if ((int)ignition_us_until_open < 0)
     {
@@ -143,7 +152,6 @@ done:
 
 static void get_ignition_outputs(void)
 {
-#if 1
     unsigned int const num_ignitions = num_ignition_outputs_get();
     size_t index;
 
@@ -160,15 +168,6 @@ static void get_ignition_outputs(void)
         ignition_control->output = ignition_output_get();
 
     }
-#else
-    size_t index;
-    float const ignition_spark_angle = get_ignition_advance();
-
-    for (index = 0; index < num_ignition_outputs_get(); index++)
-    {
-        ignitions[index] = ignition_output_get(index, ignition_spark_angle);
-    }
-#endif
 }
 
 static void setup_ignition_scheduling(trigger_wheel_36_1_context_st * const trigger_wheel)
@@ -3,6 +3,14 @@
 
 #include "trigger_wheel_36_1.h"
 
+#include <stdint.h>
+#include <stddef.h>
+
 void ignition_initialise(trigger_wheel_36_1_context_st * const trigger_wheel_in);
 
+/* Latency of the most recent spark scheduling callback. */
+uint32_t ignition_scheduling_latency_us_get(size_t const index);
+
+void print_ignition_debug(size_t const index);
+
 #endif /* __IGNITION_CONTROL_H__ */
@@ -1,8 +1,10 @@
 #include "injector_control.h"
 #include "injector_output.h"
+#include "fuel_calculator.h"
 #include "pulser.h"
 #include "utils.h"
 #include "main.h"
+#include "tune_config.h"
 #include "main_input_timer.h"
 
 #include <math.h>
@@ -43,21 +45,7 @@ static trigger_wheel_36_1_context_st * trigger_wheel;
 
 static unsigned int num_injectors_get(void)
 {
-    /* XXX - Get the value from the configuration. */
-    return 4;
-}
-
-uint32_t get_injector_pulse_width_us(void)
-{
-    /* TODO - Calculate pulse width. */
-    return 1500;
-}
-
-#define TEST_INJECTOR_DEAD_TIME_US 500UL
-uint32_t get_injector_dead_time_us(void)
-{
-    /* TODO - Calculate from battery voltage and configuration table. */
-    return TEST_INJECTOR_DEAD_TIME_US;
+    return tune_config_engine_get()->num_cylinders;
 }
 
 void print_injector_debug(size_t const index)
@@ -84,6 +72,16 @@ void print_injector_debug(size_t const index)
     printf("pulse width %"PRIu32"\r\n", injector_control->close_timestamp - injector_control->open_timestamp);
 }
 
+uint32_t injector_pulse_width_us_get(size_t const index)
+{
+    return (index < MAX_INJECTORS) ? injector_controls[index].debug_injector_pulse_width_us : 0;
+}
+
+uint32_t injector_scheduling_latency_us_get(size_t const index)
+{
+    return (index < MAX_INJECTORS) ? injector_controls[index].debug_latency : 0;
+}
+
 static void pulser_active_callback(void * const arg)
 {
     injector_control_st * const injector_control = arg;
@@ -120,8 +118,10 @@ static void injector_pulse_callback(float const crank_angle,
     /* Determine how long it will take to rotate this many degrees. */
     injector_control->degrees_to_closing_time = (float)get_engine_cycle_degrees() - normalise_engine_cycle_angle(injector_scheduling_angle - injector_close_angle);
     float const time_to_next_injector_close = trigger_36_1_rotation_time_get(trigger_wheel, injector_control->degrees_to_closing_time);
-    /* The injector pulse width must include the time taken to open the injector (dead time). */
-    uint32_t const injector_pulse_width_us = get_injector_pulse_width_us() + get_injector_dead_time_us();
+    /* The fuel calculator publishes pulse widths that already 
+     * include the time taken to open the injector (dead time). 
+     */
+    uint32_t const injector_pulse_width_us = fuel_injector_pulse_width_us_get(injector_control->number);
     uint32_t injector_us_until_open = lrintf(time_to_next_injector_close * TIMER_FREQUENCY) - injector_pulse_width_us;
     uint32_t const current_timestamp = main_input_timer_count_get();
     uint32_t const latency = current_timestamp - timestamp;
@@ -150,7 +150,7 @@ static void injector_pulse_callback(float const crank_angle,
 
 #else
     uint32_t const timer_base_count = injector_timer_count_get(injector); /* This is the time from which we base the injector event. */
-    uint32_t const injector_pulse_width_us = get_injector_pulse_width_us();
+    uint32_t const injector_pulse_width_us = fuel_injector_pulse_width_us_get(injector_control->number);
     uint32_t const injector_us_until_open = 100;
 
 #endif
@@ -162,7 +162,14 @@ static void injector_pulse_callback(float const crank_angle,
             .pulse_width_us = injector_pulse_width_us,
             .programmed_at = current_timestamp
         };
-        pulser_schedule_pulse(injector_control->pulser, &pulser_schedule);
+        /* No fuel wanted. The wall film still gives some up this 
+         * cycle, so the model is updated all the same. 
+         */
+        if (injector_pulse_width_us > 0)
+        {
+            pulser_schedule_pulse(injector_control->pulser, &pulser_schedule);
+        }
+        fuel_injection_scheduled(injector_control->number);
     }
 
 done:
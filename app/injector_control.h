@@ -3,6 +3,15 @@
 
 #include "trigger_wheel_36_1.h"
 
+#include <stdint.h>
+#include <stddef.h>
+
 void injection_initialise(trigger_wheel_36_1_context_st * const trigger_wheel);
 
+/* Values from the most recent pulse scheduled on the injector. */
+uint32_t injector_pulse_width_us_get(size_t const index);
+uint32_t injector_scheduling_latency_us_get(size_t const index);
+
+void print_injector_debug(size_t const index);
+
 #endif /* __INJECTOR_CONTROL_H__ */
@@ -0,0 +1,414 @@
+#include "knock.h"
+#include "ignition_calculator.h"
+#include "ignition_output.h"
+#include "main_input_timer.h"
+#include "main.h"
+#include "tune_config.h"
+#include "adc.h"
+#include "utils.h"
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+
+#if defined(__ARM_FEATURE_DSP)
+#include "stm32f4xx.h" /* For the CMSIS SIMD intrinsics. */
+#define KNOCK_USE_DSP_INSTRUCTIONS
+#endif
+
+/* The knock sensor signal is AC coupled and biased to half the 
+ * ADC reference. 
+ */
+#define KNOCK_ADC_CHANNEL 2 /* PA2 */
+#define KNOCK_SAMPLE_OFFSET 2048
+/* Scales the 12 bit samples up to use more of the 16 bit range 
+ * of the filter. 
+ */
+#define KNOCK_SAMPLE_SHIFT 3
+
+/* At ~42.7kHz this covers the window down to ~1000 RPM. Windows 
+ * at lower engine speeds are truncated. 
+ */
+#define KNOCK_WINDOW_MAX_SAMPLES 512
+#define KNOCK_WINDOW_MIN_SAMPLES 16
+
+/* Window relative to each cylinder's TDC. */
+#define KNOCK_WINDOW_START_DEGREES 10
+#define KNOCK_WINDOW_DEGREES 60
+
+#define KNOCK_FREQUENCY_HZ 6800.0
+#define KNOCK_FILTER_Q 4.0
+
+#define KNOCK_FILTER_FRACTION_BITS 14
+#define KNOCK_FILTER_ONE (1L << KNOCK_FILTER_FRACTION_BITS)
+#define KNOCK_FILTER_ROUNDING (1L << (KNOCK_FILTER_FRACTION_BITS - 1))
+
+/* Knock is detected when the power in the window exceeds the 
+ * background power by this ratio. 
+ */
+#define KNOCK_THRESHOLD_NUMERATOR 3
+#define KNOCK_THRESHOLD_DENOMINATOR 1
+/* Background filter time constant is 2^n windows. */
+#define KNOCK_BACKGROUND_SHIFT 4
+/* Stops noise being detected as knock on a very quiet sensor. */
+#define KNOCK_BACKGROUND_MINIMUM 64
+
+/* Retard amounts, in 1/IGNITION_ANGLE_SCALE degrees. */
+#define KNOCK_RETARD_STEP 20 /* Per knock event. */
+#define KNOCK_RETARD_MAXIMUM 100
+#define KNOCK_RETARD_RECOVERY 1 /* Per window without knock. */
+
+#define NO_ACTIVE_CYLINDER (-1)
+
+typedef struct knock_cylinder_st
+{
+    bool have_background;
+    uint32_t background_power;
+    uint32_t last_power;
+    uint32_t knock_count;
+} knock_cylinder_st;
+
+typedef struct knock_context_st
+{
+    trigger_wheel_36_1_context_st * trigger_wheel;
+    void const * adc_burst;
+    knock_filter_st filter;
+
+    int active_cylinder;
+    uint16_t samples[KNOCK_WINDOW_MAX_SAMPLES];
+
+    knock_cylinder_st cylinders[MAX_IGNITIONS];
+    volatile int32_t retard[MAX_IGNITIONS];
+    uint32_t cylinder_numbers[MAX_IGNITIONS]; /* Callback args. */
+
+    uint32_t window_count;
+    uint32_t short_window_count;
+    uint32_t last_window_samples;
+    uint32_t last_process_time_us;
+    uint32_t max_process_time_us;
+} knock_context_st;
+
+static knock_context_st knock_context;
+
+static unsigned int num_cylinders_get(void)
+{
+    return tune_config_engine_get()->num_cylinders;
+}
+
+/* RBJ band-pass (constant 0dB peak gain). */
+void knock_filter_init(knock_filter_st * const filter,
+                       float const centre_frequency_hz,
+                       float const q,
+                       uint32_t const sample_rate_hz)
+{
+    float const w0 = 2.0 * M_PI * centre_frequency_hz / sample_rate_hz;
+    float const alpha = sinf(w0) / (2.0 * q);
+    float const a0 = 1.0 + alpha;
+    int16_t const b0 = lrintf((alpha / a0) * KNOCK_FILTER_ONE);
+    int16_t const a1 = lrintf((-2.0 * cosf(w0) / a0) * KNOCK_FILTER_ONE);
+    int16_t const a2 = lrintf(((1.0 - alpha) / a0) * KNOCK_FILTER_ONE);
+
+    filter->b_pair = ((uint32_t)(uint16_t)b0) | ((uint32_t)(uint16_t)-b0 << 16);
+    filter->a_pair = ((uint32_t)(uint16_t)-a1) | ((uint32_t)(uint16_t)-a2 << 16);
+}
+
+/* Filter a single sample. 
+ * x_pair: x[n] (bottom), x[n-2] (top) 
+ * y_pair: y[n-1] (bottom), y[n-2] (top) 
+ * Returns y[n]. 
+ */
+static inline int32_t knock_filter_step(knock_filter_st const * const filter,
+                                        uint32_t const x_pair,
+                                        uint32_t const y_pair)
+{
+#if defined(KNOCK_USE_DSP_INSTRUCTIONS)
+    int32_t sum = (int32_t)__SMLAD(x_pair, filter->b_pair, KNOCK_FILTER_ROUNDING);
+
+    sum = (int32_t)__SMLAD(y_pair, filter->a_pair, sum);
+
+    return __SSAT(sum >> KNOCK_FILTER_FRACTION_BITS, 16);
+#else
+    /* Summed as unsigned so that it wraps as SMLAD does, rather 
+     * than overflowing. 
+     */
+    uint32_t wrapped_sum = (uint32_t)((int32_t)(int16_t)x_pair * (int16_t)filter->b_pair)
+                           + (uint32_t)((int32_t)(int16_t)(x_pair >> 16) * (int16_t)(filter->b_pair >> 16))
+                           + KNOCK_FILTER_ROUNDING;
+    int32_t sum;
+
+    wrapped_sum += (uint32_t)((int32_t)(int16_t)y_pair * (int16_t)filter->a_pair)
+                   + (uint32_t)((int32_t)(int16_t)(y_pair >> 16) * (int16_t)(filter->a_pair >> 16));
+    sum = (int32_t)wrapped_sum >> KNOCK_FILTER_FRACTION_BITS;
+
+    if (sum > INT16_MAX)
+    {
+        sum = INT16_MAX;
+    }
+    else if (sum < INT16_MIN)
+    {
+        sum = INT16_MIN;
+    }
+
+    return sum;
+#endif
+}
+
+/* Removes the bias and scales up. Multiplied rather than shifted, 
+ * as shifting a negative value left is undefined. 
+ */
+static inline int32_t knock_sample_scale(uint16_t const sample)
+{
+    return ((int32_t)sample - KNOCK_SAMPLE_OFFSET) * (1 << KNOCK_SAMPLE_SHIFT);
+}
+
+static inline uint32_t pack_pair(int32_t const bottom, int32_t const top)
+{
+#if defined(KNOCK_USE_DSP_INSTRUCTIONS)
+    return __PKHBT((uint32_t)bottom, (uint32_t)top, 16);
+#else
+    return ((uint32_t)bottom & 0xffff) | ((uint32_t)top << 16);
+#endif
+}
+
+/* Samples are processed in pairs, so that the power of both 
+ * outputs can be accumulated with a single SMLALD. A trailing 
+ * odd sample is ignored. 
+ * Each sample costs two SMLADs, a saturation and a couple of 
+ * packs. At 8000 RPM the 60 degree window is ~53 samples, well 
+ * within the 1.875ms between sparks on an 8 cylinder engine. 
+ */
+uint32_t knock_filter_power(knock_filter_st const * const filter,
+                            uint16_t const * const samples,
+                            size_t const num_samples)
+{
+    size_t const num_pairs = num_samples / 2;
+    /* Start with the history equal to the first sample so that 
+     * the DC offset doesn't produce a step response. 
+     */
+    int32_t const first_sample = knock_sample_scale(samples[0]);
+    int32_t x1 = first_sample;
+    int32_t x2 = first_sample;
+    uint32_t y_pair = 0;
+    uint64_t energy = 0;
+    size_t pair;
+
+    if (num_pairs == 0)
+    {
+        return 0;
+    }
+
+    for (pair = 0; pair < num_pairs; pair++)
+    {
+        int32_t const x0 = knock_sample_scale(samples[2 * pair]);
+        int32_t const x0_next = knock_sample_scale(samples[2 * pair + 1]);
+        int32_t y0;
+
+        y0 = knock_filter_step(filter, pack_pair(x0, x2), y_pair);
+        y_pair = pack_pair(y0, y_pair);
+
+        y0 = knock_filter_step(filter, pack_pair(x0_next, x1), y_pair);
+        y_pair = pack_pair(y0, y_pair);
+
+        x2 = x0;
+        x1 = x0_next;
+
+#if defined(KNOCK_USE_DSP_INSTRUCTIONS)
+        energy = __SMLALD(y_pair, y_pair, energy);
+#else
+        /* Two squares of -32768 together overflow 32 bits. */
+        energy += ((int64_t)(int16_t)y_pair * (int16_t)y_pair)
+                  + ((int64_t)(int16_t)(y_pair >> 16) * (int16_t)(y_pair >> 16));
+#endif
+    }
+
+    return energy / (2 * num_pairs);
+}
+
+static void knock_cylinder_update(knock_context_st * const knock,
+                                  size_t const cylinder,
+                                  uint32_t const power)
+{
+    knock_cylinder_st * const knock_cylinder = &knock->cylinders[cylinder];
+    int32_t retard = knock->retard[cylinder];
+    uint32_t background_power;
+    bool knock_detected;
+
+    knock_cylinder->last_power = power;
+
+    if (!knock_cylinder->have_background)
+    {
+        knock_cylinder->background_power = power;
+        knock_cylinder->have_background = true;
+    }
+
+    background_power = knock_cylinder->background_power;
+    if (background_power < KNOCK_BACKGROUND_MINIMUM)
+    {
+        background_power = KNOCK_BACKGROUND_MINIMUM;
+    }
+    knock_detected = (uint64_t)power * KNOCK_THRESHOLD_DENOMINATOR
+                     > (uint64_t)background_power * KNOCK_THRESHOLD_NUMERATOR;
+
+    if (knock_detected)
+    {
+        knock_cylinder->knock_count++;
+        retard += KNOCK_RETARD_STEP;
+        if (retard > KNOCK_RETARD_MAXIMUM)
+        {
+            retard = KNOCK_RETARD_MAXIMUM;
+        }
+    }
+    else
+    {
+        /* Only track the background while there is no knock. */
+        knock_cylinder->background_power += ((int32_t)power - (int32_t)knock_cylinder->background_power) 
+                                            >> KNOCK_BACKGROUND_SHIFT;
+        retard -= KNOCK_RETARD_RECOVERY;
+        if (retard < 0)
+        {
+            retard = 0;
+        }
+    }
+
+    /* Single word write. */
+    knock->retard[cylinder] = retard;
+}
+
+static void knock_window_finish(knock_context_st * const knock)
+{
+    uint32_t const start_time = main_input_timer_count_get();
+    size_t const cylinder = knock->active_cylinder;
+    size_t const num_samples = stm32_adc_burst_stop(knock->adc_burst);
+
+    knock->active_cylinder = NO_ACTIVE_CYLINDER;
+    knock->window_count++;
+    knock->last_window_samples = num_samples;
+
+    if (num_samples < KNOCK_WINDOW_MIN_SAMPLES)
+    {
+        knock->short_window_count++;
+        goto done;
+    }
+
+    knock_cylinder_update(knock, cylinder, knock_filter_power(&knock->filter, knock->samples, num_samples));
+
+    knock->last_process_time_us = main_input_timer_count_get() - start_time;
+    if (knock->last_process_time_us > knock->max_process_time_us)
+    {
+        knock->max_process_time_us = knock->last_process_time_us;
+    }
+
+done:
+    return;
+}
+
+static void knock_window_start_callback(float const crank_angle,
+                                        uint32_t timestamp,
+                                        void * const user_arg)
+{
+    knock_context_st * const knock = &knock_context;
+    uint32_t const * const cylinder = user_arg;
+
+    UNUSED(crank_angle);
+    UNUSED(timestamp);
+
+    if (knock->active_cylinder != NO_ACTIVE_CYLINDER)
+    {
+        knock_window_finish(knock);
+    }
+
+    knock->active_cylinder = *cylinder;
+    stm32_adc_burst_start(knock->adc_burst, knock->samples, KNOCK_WINDOW_MAX_SAMPLES);
+}
+
+static void knock_window_end_callback(float const crank_angle,
+                                      uint32_t timestamp,
+                                      void * const user_arg)
+{
+    knock_context_st * const knock = &knock_context;
+    uint32_t const * const cylinder = user_arg;
+
+    UNUSED(crank_angle);
+    UNUSED(timestamp);
+
+    if (knock->active_cylinder == (int)*cylinder)
+    {
+        knock_window_finish(knock);
+    }
+}
+
+int32_t knock_retard_get(size_t const cylinder)
+{
+    return knock_context.retard[cylinder];
+}
+
+void print_knock_debug(void)
+{
+    knock_context_st * const knock = &knock_context;
+    unsigned int const num_cylinders = num_cylinders_get();
+    size_t cylinder;
+
+    printf("knock windows %"PRIu32" short %"PRIu32" last samples %"PRIu32" time last %"PRIu32" max %"PRIu32"\r\n",
+           knock->window_count,
+           knock->short_window_count,
+           knock->last_window_samples,
+           knock->last_process_time_us,
+           knock->max_process_time_us);
+
+    for (cylinder = 0; cylinder < num_cylinders; cylinder++)
+    {
+        knock_cylinder_st const * const knock_cylinder = &knock->cylinders[cylinder];
+
+        printf("%u: power %"PRIu32" background %"PRIu32" count %"PRIu32" retard %"PRId32"\r\n",
+               (unsigned)cylinder,
+               knock_cylinder->last_power,
+               knock_cylinder->background_power,
+               knock_cylinder->knock_count,
+               knock->retard[cylinder]);
+    }
+}
+
+void knock_init(trigger_wheel_36_1_context_st * const trigger_wheel)
+{
+    knock_context_st * const knock = &knock_context;
+    unsigned int const num_cylinders = num_cylinders_get();
+    unsigned int const engine_cycle_degrees = get_engine_cycle_degrees();
+    adc_burst_init_st cfg;
+    size_t cylinder;
+
+    knock->trigger_wheel = trigger_wheel;
+    knock->active_cylinder = NO_ACTIVE_CYLINDER;
+
+    cfg.trigger = adc_burst_trigger_continuous;
+    cfg.channel = KNOCK_ADC_CHANNEL;
+    if ((knock->adc_burst = stm32_adc_burst_init(&cfg)) == NULL)
+    {
+        printf("knock init failed\r\n");
+        goto done;
+    }
+
+    knock_filter_init(&knock->filter,
+                      KNOCK_FREQUENCY_HZ,
+                      KNOCK_FILTER_Q,
+                      stm32_adc_burst_sample_rate_get(knock->adc_burst));
+
+    for (cylinder = 0; cylinder < num_cylinders; cylinder++)
+    {
+        float const tdc_angle = (float)(engine_cycle_degrees * cylinder) / num_cylinders;
+        float const window_start = tdc_angle + KNOCK_WINDOW_START_DEGREES;
+
+        knock->cylinder_numbers[cylinder] = cylinder;
+        trigger_36_1_register_callback(trigger_wheel,
+                                       normalise_engine_cycle_angle(window_start),
+                                       knock_window_start_callback,
+                                       &knock->cylinder_numbers[cylinder]);
+        trigger_36_1_register_callback(trigger_wheel,
+                                       normalise_engine_cycle_angle(window_start + KNOCK_WINDOW_DEGREES),
+                                       knock_window_end_callback,
+                                       &knock->cylinder_numbers[cylinder]);
+    }
+
+done:
+    return;
+}
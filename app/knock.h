@@ -0,0 +1,44 @@
+#ifndef __KNOCK_H__
+#define __KNOCK_H__
+
+#include "trigger_wheel_36_1.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Knock detection. The knock sensor is sampled over an angle 
+ * window after each cylinder's TDC. The samples are band-pass 
+ * filtered around the knock frequency, and the energy compared 
+ * against that cylinder's background level. Detected knock 
+ * retards that cylinder's spark, which then gradually recovers. 
+ */
+
+/* Band-pass biquad. Coefficients are Q14, with b1 = 0 and 
+ * b2 = -b0. The pairs are packed for the SIMD instructions. 
+ */
+typedef struct knock_filter_st
+{
+    uint32_t b_pair; /* b0 (bottom), -b0 (top) */
+    uint32_t a_pair; /* -a1 (bottom), -a2 (top) */
+} knock_filter_st;
+
+void knock_filter_init(knock_filter_st * const filter,
+                       float const centre_frequency_hz,
+                       float const q,
+                       uint32_t const sample_rate_hz);
+
+/* Returns the mean power of the filtered 12 bit samples. */
+uint32_t knock_filter_power(knock_filter_st const * const filter,
+                            uint16_t const * const samples,
+                            size_t const num_samples);
+
+void knock_init(trigger_wheel_36_1_context_st * const trigger_wheel);
+
+/* Spark retard for the cylinder, in 1/IGNITION_ANGLE_SCALE 
+ * degrees. Safe to call from the engine event callbacks. 
+ */
+int32_t knock_retard_get(size_t const cylinder);
+
+void print_knock_debug(void);
+
+#endif /* __KNOCK_H__ */
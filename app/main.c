@@ -26,6 +26,15 @@
 #include "timed_events.h"
 #include "pulser.h"
 #include "injector_control.h"
+#include "analog_inputs.h"
+#include "cpu_load.h"
+#include "fuel_calculator.h"
+#include "map_sampler.h"
+#include "knock.h"
+#include "telemetry.h"
+#include "tune_config.h"
+#include "config_flash.h"
+#include "ignition_calculator.h"
 #include "ignition_control.h"
 #include "trigger_input.h"
 #include "leds.h"
@@ -130,9 +139,7 @@ unsigned int get_engine_cycle_degrees(void)
 
 float get_config_injector_close_angle(void)
 {
-    /* TODO: Calculate from configuration. */
-
-    return -50.0;
+    return tune_config_engine_get()->injector_close_angle / 10.0;
 }
 
 float current_engine_cycle_angle_get(void)
@@ -140,17 +147,6 @@ float current_engine_cycle_angle_get(void)
     return trigger_36_1_engine_cycle_angle_get(trigger_context);
 }
 
-float get_ignition_advance(void)
-{
-    /* TODO get from configuration */
-    return 10.0; /* NB - value is in degrees BTDC. */
-}
-
-uint32_t get_ignition_dwell_us(void)
-{
-    return 3000;
-}
-
 float get_ignition_maximum_advance(void)
 {
     return 50.0; /* Debug. */
@@ -161,16 +157,30 @@ float get_ignition_maximum_advance(void)
 static __attribute((aligned(8))) OS_STK main_task_stack[MAIN_TASK_STACK_SIZE];
 static void main_task(void * arg)
 {
+    uint32_t const config_load_start = main_input_timer_count_get();
+    uint32_t config_load_time;
+
     UNUSED(arg);
 
+    /* Before the tuning server and the calculators can use it. */
+    tune_config_init(&config_flash);
+    config_load_time = main_input_timer_count_get() - config_load_start;
+
     serial_task_init();
 
     fprintf(stderr, "CoOS RTOS: Started scheduler\r\n");
+    fprintf(stderr, "Configuration load took %"PRIu32" us\r\n", config_load_time);
 
     init_pulsers();
 
     trigger_context = trigger_36_1_init();
 
+    map_sampler_init(trigger_context);
+    knock_init(trigger_context);
+    telemetry_init(trigger_context);
+    fuel_calculator_init(trigger_context);
+    ignition_calculator_init(trigger_context);
+
     injection_initialise(trigger_context);
     ignition_initialise(trigger_context);
 
@@ -194,13 +204,16 @@ int main(void)
 
     timed_events_init(TIMER_FREQUENCY);
 
+    analog_inputs_init();
+
     CoInitOS(); /*!< Initialise CoOS */
 
-    CoCreateTask(main_task,
-                 NULL,
-                 1,
-                 &main_task_stack[MAIN_TASK_STACK_SIZE - 1],
-                 MAIN_TASK_STACK_SIZE); 
+    cpu_load_task_name_set(CoCreateTask(main_task,
+                                        NULL,
+                                        1,
+                                        &main_task_stack[MAIN_TASK_STACK_SIZE - 1],
+                                        MAIN_TASK_STACK_SIZE),
+                           "main");
 
     CoStartOS(); /* Start scheduler. */
 
@@ -0,0 +1,270 @@
+#include "map_sampler.h"
+#include "injector_output.h"
+#include "main_input_timer.h"
+#include "main.h"
+#include "tune_config.h"
+#include "adc.h"
+#include "utils.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+/* At the start of each cylinder's window a burst of timer 
+ * triggered conversions is started, with DMA writing the 
+ * samples to a buffer. At the end of the window the burst is 
+ * stopped and the samples reduced to an average and minimum. 
+ * There is no CPU involvement for each sample. 
+ * The window events are called from the trigger wheel task, 
+ * not from interrupt context. 
+ */
+
+/* MAP is also connected to PA1 (ADC123_IN1) so that these 
+ * conversions don't use the same channel as the analog input 
+ * scan. 
+ */
+#define MAP_SAMPLER_ADC_CHANNEL 1
+#define MAP_SAMPLE_RATE_HZ 10000
+/* 25.6ms of samples. Windows at low engine speeds are 
+ * truncated. 
+ */
+#define MAP_WINDOW_MAX_SAMPLES 256
+
+/* The window for each cylinder, relative to its compression 
+ * TDC. 360 degrees is the start of the intake stroke. 
+ */
+#define MAP_WINDOW_START_DEGREES 380
+#define MAP_WINDOW_DEGREES 160
+
+/* Results older than this aren't used. */
+#define MAP_RESULT_MAXIMUM_AGE_US 200000
+
+/* Scale 12 bit samples to the analog inputs 16 bit scale. */
+#define MAP_SAMPLE_SCALE 16
+
+#define NO_ACTIVE_CYLINDER (-1)
+
+typedef union map_window_result_packed_st
+{
+    uint32_t packed;
+    map_window_result_st result;
+} map_window_result_packed_st;
+
+typedef struct map_sampler_st
+{
+    trigger_wheel_36_1_context_st * trigger_wheel;
+    void const * adc_burst;
+
+    int active_cylinder;
+    uint16_t samples[MAP_WINDOW_MAX_SAMPLES];
+
+    /* Average and minimum are packed into a single word so 
+     * that they are always published and read together. 
+     */
+    volatile uint32_t results[MAX_INJECTORS];
+    volatile uint32_t result_timestamps[MAX_INJECTORS];
+    volatile uint32_t valid_results; /* Bit per cylinder. */
+    uint32_t cylinder_numbers[MAX_INJECTORS]; /* Callback args. */
+
+    uint32_t window_count;
+    uint32_t empty_window_count;
+    uint32_t truncated_window_count;
+    uint32_t last_window_samples;
+} map_sampler_st;
+
+static map_sampler_st map_sampler;
+
+static unsigned int num_cylinders_get(void)
+{
+    return tune_config_engine_get()->num_cylinders;
+}
+
+bool map_window_reduce(uint16_t const * const samples, 
+                       size_t const num_samples, 
+                       map_window_result_st * const result)
+{
+    bool have_result;
+    uint32_t sum = 0;
+    uint16_t minimum = UINT16_MAX;
+    size_t index;
+
+    if (num_samples == 0)
+    {
+        have_result = false;
+        goto done;
+    }
+
+    for (index = 0; index < num_samples; index++)
+    {
+        uint16_t const sample = samples[index];
+
+        sum += sample;
+        if (sample < minimum)
+        {
+            minimum = sample;
+        }
+    }
+
+    result->average = (sum * MAP_SAMPLE_SCALE) / num_samples;
+    result->minimum = minimum * MAP_SAMPLE_SCALE;
+    have_result = true;
+
+done:
+    return have_result;
+}
+
+static void map_window_finish(map_sampler_st * const sampler, uint32_t const timestamp)
+{
+    size_t const cylinder = sampler->active_cylinder;
+    size_t const num_samples = stm32_adc_burst_stop(sampler->adc_burst);
+    map_window_result_packed_st window_result;
+
+    sampler->active_cylinder = NO_ACTIVE_CYLINDER;
+    sampler->window_count++;
+    sampler->last_window_samples = num_samples;
+    if (num_samples >= MAP_WINDOW_MAX_SAMPLES)
+    {
+        sampler->truncated_window_count++;
+    }
+
+    if (!map_window_reduce(sampler->samples, num_samples, &window_result.result))
+    {
+        sampler->empty_window_count++;
+        goto done;
+    }
+
+    sampler->results[cylinder] = window_result.packed;
+    sampler->result_timestamps[cylinder] = timestamp;
+    sampler->valid_results |= 1UL << cylinder;
+
+done:
+    return;
+}
+
+static void map_window_start_callback(float const crank_angle,
+                                      uint32_t timestamp,
+                                      void * const user_arg)
+{
+    map_sampler_st * const sampler = &map_sampler;
+    uint32_t const * const cylinder = user_arg;
+
+    UNUSED(crank_angle);
+
+    /* Adjacent windows may end and start on the same tooth, and 
+     * the end event may be called after this one. 
+     */
+    if (sampler->active_cylinder != NO_ACTIVE_CYLINDER)
+    {
+        map_window_finish(sampler, timestamp);
+    }
+
+    sampler->active_cylinder = *cylinder;
+    stm32_adc_burst_start(sampler->adc_burst, sampler->samples, MAP_WINDOW_MAX_SAMPLES);
+}
+
+static void map_window_end_callback(float const crank_angle,
+                                    uint32_t timestamp,
+                                    void * const user_arg)
+{
+    map_sampler_st * const sampler = &map_sampler;
+    uint32_t const * const cylinder = user_arg;
+
+    UNUSED(crank_angle);
+
+    if (sampler->active_cylinder == (int)*cylinder)
+    {
+        map_window_finish(sampler, timestamp);
+    }
+}
+
+bool map_sampler_cylinder_result_get(size_t const cylinder, map_window_result_st * const result)
+{
+    map_sampler_st * const sampler = &map_sampler;
+    map_window_result_packed_st window_result;
+    uint32_t const result_timestamp = sampler->result_timestamps[cylinder];
+    bool have_result;
+
+    if (cylinder >= num_cylinders_get()
+        || (sampler->valid_results & (1UL << cylinder)) == 0
+        || (main_input_timer_count_get() - result_timestamp) > MAP_RESULT_MAXIMUM_AGE_US)
+    {
+        have_result = false;
+        goto done;
+    }
+
+    window_result.packed = sampler->results[cylinder];
+    *result = window_result.result;
+    have_result = true;
+
+done:
+    return have_result;
+}
+
+void print_map_sampler_debug(void)
+{
+    map_sampler_st * const sampler = &map_sampler;
+    unsigned int const num_cylinders = num_cylinders_get();
+    size_t cylinder;
+
+    printf("map windows %"PRIu32" empty %"PRIu32" truncated %"PRIu32" last samples %"PRIu32"\r\n",
+           sampler->window_count,
+           sampler->empty_window_count,
+           sampler->truncated_window_count,
+           sampler->last_window_samples);
+
+    for (cylinder = 0; cylinder < num_cylinders; cylinder++)
+    {
+        map_window_result_st result;
+
+        if (map_sampler_cylinder_result_get(cylinder, &result))
+        {
+            printf("%u: avg %u min %u\r\n", 
+                   (unsigned)cylinder, 
+                   (unsigned)result.average, 
+                   (unsigned)result.minimum);
+        }
+        else
+        {
+            printf("%u: -\r\n", (unsigned)cylinder);
+        }
+    }
+}
+
+void map_sampler_init(trigger_wheel_36_1_context_st * const trigger_wheel)
+{
+    map_sampler_st * const sampler = &map_sampler;
+    unsigned int const num_cylinders = num_cylinders_get();
+    unsigned int const engine_cycle_degrees = get_engine_cycle_degrees();
+    adc_burst_init_st cfg;
+    size_t cylinder;
+
+    sampler->trigger_wheel = trigger_wheel;
+    sampler->active_cylinder = NO_ACTIVE_CYLINDER;
+
+    cfg.trigger = adc_burst_trigger_timer;
+    cfg.channel = MAP_SAMPLER_ADC_CHANNEL;
+    cfg.sample_rate_hz = MAP_SAMPLE_RATE_HZ;
+    if ((sampler->adc_burst = stm32_adc_burst_init(&cfg)) == NULL)
+    {
+        printf("MAP sampler init failed\r\n");
+        goto done;
+    }
+
+    for (cylinder = 0; cylinder < num_cylinders; cylinder++)
+    {
+        float const tdc_angle = (float)(engine_cycle_degrees * cylinder) / num_cylinders;
+        float const window_start = tdc_angle + MAP_WINDOW_START_DEGREES;
+
+        sampler->cylinder_numbers[cylinder] = cylinder;
+        trigger_36_1_register_callback(trigger_wheel,
+                                       normalise_engine_cycle_angle(window_start),
+                                       map_window_start_callback,
+                                       &sampler->cylinder_numbers[cylinder]);
+        trigger_36_1_register_callback(trigger_wheel,
+                                       normalise_engine_cycle_angle(window_start + MAP_WINDOW_DEGREES),
+                                       map_window_end_callback,
+                                       &sampler->cylinder_numbers[cylinder]);
+    }
+
+done:
+    return;
+}
@@ -0,0 +1,39 @@
+#ifndef __MAP_SAMPLER_H__
+#define __MAP_SAMPLER_H__
+
+#include "trigger_wheel_36_1.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Crank angle synchronous MAP sampling. MAP is sampled at a 
+ * fixed rate over an angle window during each cylinder's intake 
+ * stroke. The average and minimum over the window are kept for 
+ * each cylinder. 
+ */
+
+typedef struct map_window_result_st
+{
+    /* Same scaling as the analog inputs module. */
+    uint16_t average;
+    uint16_t minimum;
+} map_window_result_st;
+
+void map_sampler_init(trigger_wheel_36_1_context_st * const trigger_wheel);
+
+/* Returns false if there is no recent result for the cylinder, 
+ * e.g. if the engine isn't running. 
+ */
+bool map_sampler_cylinder_result_get(size_t const cylinder, map_window_result_st * const result);
+
+/* Reduce a window of raw 12 bit samples. Returns false if there 
+ * were no samples. 
+ */
+bool map_window_reduce(uint16_t const * const samples, 
+                       size_t const num_samples, 
+                       map_window_result_st * const result);
+
+void print_map_sampler_debug(void);
+
+#endif /* __MAP_SAMPLER_H__ */
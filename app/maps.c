@@ -0,0 +1,134 @@
+#include "maps.h"
+
+#if defined(__ARM_FEATURE_DSP)
+#include "stm32f4xx.h" /* For the CMSIS SIMD intrinsics. */
+#define MAPS_USE_DSP_INSTRUCTIONS
+#endif
+
+#define MAP_ROUNDING (1L << (MAP_FRACTION_BITS - 1))
+
+/* Find the bin such that bins[bin] <= value < bins[bin + 1] 
+ * and the fraction (scaled by MAP_FRACTION_ONE) of the way 
+ * through that bin. Values outside the axis are clamped to the 
+ * end bins. 
+ * The search starts from the bin found by the previous lookup. 
+ * The inputs to the maps (RPM, load, temperatures etc) normally 
+ * change slowly relative to the lookup rate, so the search 
+ * rarely has to move more than one bin. 
+ * The hint is shared by everyone looking up the axis. It is read 
+ * and written once per lookup and the search is correct from any 
+ * starting bin, so lookups of the same map from several contexts 
+ * (tasks and interrupts) are safe; they just make the hint less 
+ * useful to each other. 
+ */
+static size_t map_axis_bin_find(map_axis_st * const axis, int32_t const value, int32_t * const fraction)
+{
+    int32_t const * const bins = axis->bins;
+    size_t const last_bin = axis->num_bins - 2;
+    size_t bin;
+
+    if (value <= bins[0])
+    {
+        bin = 0;
+        *fraction = 0;
+        goto done;
+    }
+
+    if (value >= bins[last_bin + 1])
+    {
+        bin = last_bin;
+        *fraction = MAP_FRACTION_ONE;
+        goto done;
+    }
+
+    bin = __atomic_load_n(&axis->last_bin, __ATOMIC_RELAXED);
+    if (bin > last_bin)
+    {
+        bin = last_bin;
+    }
+    while (value < bins[bin])
+    {
+        bin--;
+    }
+    while (value >= bins[bin + 1])
+    {
+        bin++;
+    }
+
+    *fraction = ((value - bins[bin]) << MAP_FRACTION_BITS) / (bins[bin + 1] - bins[bin]);
+
+done:
+    __atomic_store_n(&axis->last_bin, bin, __ATOMIC_RELAXED);
+
+    return bin;
+}
+
+/* Returns (a * (1 - fraction)) + (b * fraction), rounded. 
+ * The weights are kept in Q14 so that a weight of 1.0 still 
+ * fits into a signed halfword, which keeps the end of each axis 
+ * exact. 
+ */
+static inline int16_t interpolate(int16_t const a, int16_t const b, int32_t const fraction)
+{
+#if defined(MAPS_USE_DSP_INSTRUCTIONS)
+    uint32_t const cells = __PKHBT((uint32_t)a, (uint32_t)b, 16);
+    uint32_t const weights = __PKHBT((uint32_t)(MAP_FRACTION_ONE - fraction), (uint32_t)fraction, 16);
+    int32_t const sum = (int32_t)__SMLAD(cells, weights, MAP_ROUNDING);
+#else
+    int32_t const sum = ((int32_t)a * (MAP_FRACTION_ONE - fraction))
+                        + ((int32_t)b * fraction)
+                        + MAP_ROUNDING;
+#endif
+
+    return (int16_t)(sum >> MAP_FRACTION_BITS);
+}
+
+void map_2d_init(map_2d_st * const map,
+                 int32_t const * const x_bins,
+                 size_t const num_x_bins,
+                 int16_t const * const cells)
+{
+    map->x_axis.bins = x_bins;
+    map->x_axis.num_bins = num_x_bins;
+    map->x_axis.last_bin = 0;
+    map->cells = cells;
+}
+
+void map_3d_init(map_3d_st * const map,
+                 int32_t const * const x_bins,
+                 size_t const num_x_bins,
+                 int32_t const * const y_bins,
+                 size_t const num_y_bins,
+                 int16_t const * const cells)
+{
+    map->x_axis.bins = x_bins;
+    map->x_axis.num_bins = num_x_bins;
+    map->x_axis.last_bin = 0;
+    map->y_axis.bins = y_bins;
+    map->y_axis.num_bins = num_y_bins;
+    map->y_axis.last_bin = 0;
+    map->cells = cells;
+}
+
+int16_t map_2d_lookup(map_2d_st * const map, int32_t const x)
+{
+    int32_t x_fraction;
+    size_t const x_bin = map_axis_bin_find(&map->x_axis, x, &x_fraction);
+    int16_t const * const cell = &map->cells[x_bin];
+
+    return interpolate(cell[0], cell[1], x_fraction);
+}
+
+int16_t map_3d_lookup(map_3d_st * const map, int32_t const x, int32_t const y)
+{
+    int32_t x_fraction;
+    int32_t y_fraction;
+    size_t const x_bin = map_axis_bin_find(&map->x_axis, x, &x_fraction);
+    size_t const y_bin = map_axis_bin_find(&map->y_axis, y, &y_fraction);
+    int16_t const * const low_row = &map->cells[(y_bin * map->x_axis.num_bins) + x_bin];
+    int16_t const * const high_row = low_row + map->x_axis.num_bins;
+    int16_t const low = interpolate(low_row[0], low_row[1], x_fraction);
+    int16_t const high = interpolate(high_row[0], high_row[1], x_fraction);
+
+    return interpolate(low, high, y_fraction);
+}
@@ -0,0 +1,58 @@
+#ifndef __MAPS_H__
+#define __MAPS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Table (map) lookups with linear (2D) and bilinear (3D)
+ * interpolation.
+ * Axis bins are integers and must be in ascending order. Cells
+ * are 16 bit signed fixed point values. The interpretation of
+ * the cell values (Q15, 0.1%, etc) is left to the user of the
+ * map. Interpolation is done entirely in integer arithmetic,
+ * using the Cortex-M4 DSP instructions when available. The C
+ * fallback produces bit-identical results.
+ * A map may be looked up from more than one context at once.
+ */
+
+#define MAP_FRACTION_BITS 14
+#define MAP_FRACTION_ONE (1L << MAP_FRACTION_BITS)
+
+typedef struct map_axis_st
+{
+    int32_t const * bins; /* Adjacent bins must be no more than 131071 apart. */
+    size_t num_bins; /* Must be >= 2. */
+    size_t last_bin; /* Hint. Lookups usually land in the same bin as the last one. Any value is safe. */
+} map_axis_st;
+
+/* A curve. y = f(x) */
+typedef struct map_2d_st
+{
+    map_axis_st x_axis;
+    int16_t const * cells; /* [x] */
+} map_2d_st;
+
+/* A surface. z = f(x, y) */
+typedef struct map_3d_st
+{
+    map_axis_st x_axis;
+    map_axis_st y_axis;
+    int16_t const * cells; /* [y][x] */
+} map_3d_st;
+
+void map_2d_init(map_2d_st * const map,
+                 int32_t const * const x_bins,
+                 size_t const num_x_bins,
+                 int16_t const * const cells);
+
+void map_3d_init(map_3d_st * const map,
+                 int32_t const * const x_bins,
+                 size_t const num_x_bins,
+                 int32_t const * const y_bins,
+                 size_t const num_y_bins,
+                 int16_t const * const cells);
+
+int16_t map_2d_lookup(map_2d_st * const map, int32_t const x);
+int16_t map_3d_lookup(map_3d_st * const map, int32_t const x, int32_t const y);
+
+#endif /* __MAPS_H__ */
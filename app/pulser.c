@@ -1,4 +1,5 @@
 #include "pulser.h"
+#include "cpu_load.h"
 #include "timed_events.h"
 #include "leds.h"
 #include "main_input_timer.h"
@@ -12,7 +13,7 @@
 #include <stdio.h>
 
 #define STACK_SIZE_PULSER 1024
-#define NUM_PULSERS 16 /* Must be >= number of injectors + number of ignition outputs && <= number of timer channels. */
+#define NUM_PULSERS 16 /* Must be >= number of injectors + number of ignition outputs && <= number of timer channels && <= 32. */
 
 #define MAXIMUM_TIMER_LENGTH_SECS 20
 
@@ -34,8 +35,7 @@ typedef void (* state_handler)(pulser_st * pulser);
 
 struct pulser_st
 {
-    OS_FlagID event_completion_flag; /* Used to signal the pulser task to run from the ISR. */
-    uint32_t event_completion_bit; 
+    uint32_t event_completion_bit; /* Notifies the pulser task to run from the ISR. */
 
     /* ISR level and task level state machine handlers. */
     volatile state_handler isr_state_handler;
@@ -68,9 +68,9 @@ typedef struct pulser_state_st
 {
     __attribute((aligned(8))) OS_STK pulser_stk[STACK_SIZE_PULSER];
 
+    OS_TID pulser_task_id;
     pulser_st pulsers[NUM_PULSERS];
     size_t next_pulser;
-    uint32_t active_pulser_flags;
 } pulser_state_st;
 
 static pulser_state_st pulser_state;
@@ -79,7 +79,7 @@ static void indicate_timeout(pulser_st * pulser)
 {
     CoEnterISR();
 
-    isr_SetFlag(pulser->event_completion_flag);
+    isr_NotifyTask(pulser_state.pulser_task_id, pulser->event_completion_bit);
 
     CoExitISR();
 }
@@ -284,7 +284,6 @@ pulser_st * pulser_get(pulser_callback const active_callback,
     pulser->user_arg = user_arg;
 
     pulser_state.next_pulser++;
-    pulser_state.active_pulser_flags |= pulser->event_completion_bit;
 
 done:
     return pulser;
@@ -296,20 +295,15 @@ static void pulser_task(void * pdata)
 
     while (1)
     {
-        size_t index;
-        StatusType err;
-        U32 readyFlags;
+        /* Every pulser that has timed out since the last wait. */
+        uint32_t ready_pulsers = CoWaitNotify();
 
-        readyFlags = CoWaitForMultipleFlags(pulser_state.active_pulser_flags, OPT_WAIT_ANY, 0, &err);
-
-        for (index = 0; index < pulser_state.next_pulser; index++)
+        while (ready_pulsers != 0)
         {
-            pulser_st * const pulser = &pulser_state.pulsers[index];
+            pulser_st * const pulser = &pulser_state.pulsers[__builtin_ctz(ready_pulsers)];
 
-            if ((readyFlags & pulser->event_completion_bit) != 0)
-            {
-                pulser->task_state_handler(pulser); 
-            }
+            ready_pulsers &= ready_pulsers - 1;
+            pulser->task_state_handler(pulser); 
         }
     }
 }
@@ -318,14 +312,14 @@ void init_pulsers(void)
 {
     size_t index;
 
-    CoCreateTask(pulser_task, 0, 2, &pulser_state.pulser_stk[STACK_SIZE_PULSER - 1], STACK_SIZE_PULSER);
+    pulser_state.pulser_task_id = CoCreateTask(pulser_task, 0, 2, &pulser_state.pulser_stk[STACK_SIZE_PULSER - 1], STACK_SIZE_PULSER);
+    cpu_load_task_name_set(pulser_state.pulser_task_id, "pulser");
 
     for (index = 0; index < NUM_PULSERS; index++)
     {
         pulser_st * const pulser = &pulser_state.pulsers[index];
 
-        pulser->event_completion_flag = CoCreateFlag(Co_TRUE, Co_FALSE);
-        pulser->event_completion_bit = 1 << pulser->event_completion_flag;
+        pulser->event_completion_bit = 1UL << index;
 
         pulser->pending_event = false;
 
@@ -346,7 +340,14 @@ uint32_t pulser_timer_count_get(pulser_st const * const pulser)
 
 void print_pulser_debug(size_t const index)
 {
-    pulser_st * const pulser = &pulser_state.pulsers[index];
+    pulser_st * pulser;
+
+    if (index >= NUM_PULSERS)
+    {
+        printf("pulser %d doesn't exist\r\n", (int)index);
+        goto done;
+    }
+    pulser = &pulser_state.pulsers[index];
 
     printf("pulser %d current initial %"PRIu32" width %u\r\n",
            index,
@@ -357,4 +358,7 @@ void print_pulser_debug(size_t const index)
     printf("initial delay remaining: %"PRIu32" current time %"PRIu32"\r\n", 
            (uint32_t)pulser->current_schedule.initial_delay_us, main_input_timer_count_get());
     printf("\r\n");
+
+done:
+    return;
 }
@@ -2,6 +2,7 @@
 #define __PULSER_H__
 
 #include <stdint.h>
+#include <stddef.h>
 
 typedef struct pulser_st pulser_st;
 typedef void (* pulser_callback)(void * const user_arg);
@@ -22,4 +23,6 @@ void pulser_schedule_pulse(pulser_st * const context,
 void init_pulsers(void);
 uint32_t pulser_timer_count_get(pulser_st const * const pulser);
 
+void print_pulser_debug(size_t const index);
+
 #endif /* __PULSER_H__ */
@@ -0,0 +1,16 @@
+#include "sensor_conversion.h"
+
+int32_t sensor_convert(analog_input_t const input, uint16_t const value)
+{
+    return sensor_table_interpolate(&sensor_tables[input], value);
+}
+
+int16_t sensor_scale_get(analog_input_t const input)
+{
+    return sensor_tables[input].scale;
+}
+
+float sensor_value_get(analog_input_t const input)
+{
+    return (float)sensor_convert(input, analog_input_value_get(input)) / sensor_scale_get(input);
+}
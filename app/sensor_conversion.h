@@ -0,0 +1,49 @@
+#ifndef __SENSOR_CONVERSION_H__
+#define __SENSOR_CONVERSION_H__
+
+#include "analog_inputs.h"
+
+#include <stdint.h>
+
+/* Conversion of the filtered analog input values to 
+ * engineering units. Each input has a table of evenly spaced 
+ * points across the full input range. The tables are generated 
+ * at build time from the sensor calibration (see 
+ * tools/sensor_table_gen.c), so converting a value is just an 
+ * index and a linear interpolation. 
+ */
+
+#define SENSOR_TABLE_INDEX_BITS 7
+#define SENSOR_TABLE_FRACTION_BITS (16 - SENSOR_TABLE_INDEX_BITS)
+#define SENSOR_TABLE_ENTRIES ((1 << SENSOR_TABLE_INDEX_BITS) + 1)
+
+typedef struct sensor_table_st
+{
+    int16_t scale; /* Table values are in units of 1/scale. */
+    int16_t values[SENSOR_TABLE_ENTRIES];
+} sensor_table_st;
+
+/* Generated. */
+extern sensor_table_st const sensor_tables[analog_input_COUNT];
+
+/* Also used by the table generator to check the accuracy of 
+ * the tables, so must not depend on anything else. 
+ */
+static inline int32_t sensor_table_interpolate(sensor_table_st const * const table, uint16_t const value)
+{
+    unsigned int const index = value >> SENSOR_TABLE_FRACTION_BITS;
+    int32_t const fraction = value & ((1UL << SENSOR_TABLE_FRACTION_BITS) - 1);
+    int32_t const y0 = table->values[index];
+    int32_t const y1 = table->values[index + 1];
+
+    return y0 + (((y1 - y0) * fraction + (1L << (SENSOR_TABLE_FRACTION_BITS - 1))) >> SENSOR_TABLE_FRACTION_BITS);
+}
+
+/* Returns the input converted to units of 1/scale. */
+int32_t sensor_convert(analog_input_t const input, uint16_t const value);
+int16_t sensor_scale_get(analog_input_t const input);
+
+/* The latest value of the input in engineering units. */
+float sensor_value_get(analog_input_t const input);
+
+#endif /* __SENSOR_CONVERSION_H__ */
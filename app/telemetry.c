@@ -0,0 +1,251 @@
+#include "telemetry.h"
+#include "cpu_load.h"
+#include "crc.h"
+#include "engine_sensors.h"
+#include "ignition_calculator.h"
+#include "ignition_control.h"
+#include "injector_control.h"
+#include "knock.h"
+#include "main_input_timer.h"
+#include "utils.h"
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+
+/* Field values are returned already multiplied by the field's 
+ * scale. 
+ */
+typedef int32_t (* telemetry_value_get_fn)(size_t const index, int32_t const scale);
+
+typedef struct telemetry_field_st
+{
+    telemetry_value_get_fn value_get;
+    size_t index;
+    int32_t scale;
+    telemetry_field_type_t type;
+} telemetry_field_st;
+
+typedef struct telemetry_context_st
+{
+    trigger_wheel_36_1_context_st * trigger_wheel;
+    /* The load is over the time since the previous frame. */
+    cpu_load_sample_st cpu_load_since;
+
+    uint16_t sequence;
+    uint32_t frames_built;
+    uint32_t frames_dropped;
+} telemetry_context_st;
+
+static telemetry_context_st telemetry_context;
+
+static int32_t float_to_scaled(float const value, int32_t const scale)
+{
+    int32_t scaled;
+
+    if (isnan(value))
+    {
+        scaled = 0;
+    }
+    else
+    {
+        scaled = lrintf(value * scale);
+    }
+
+    return scaled;
+}
+
+static int32_t telemetry_rpm_get(size_t const index, int32_t const scale)
+{
+    UNUSED(index);
+
+    return float_to_scaled(trigger_36_1_rpm_get(telemetry_context.trigger_wheel), scale);
+}
+
+static int32_t telemetry_synched_get(size_t const index, int32_t const scale)
+{
+    UNUSED(index);
+    UNUSED(scale);
+
+    return trigger_36_1_synched_get(telemetry_context.trigger_wheel);
+}
+
+static int32_t telemetry_crank_angle_get(size_t const index, int32_t const scale)
+{
+    UNUSED(index);
+
+    return float_to_scaled(trigger_36_1_crank_angle_get(telemetry_context.trigger_wheel), scale);
+}
+
+static int32_t telemetry_engine_cycle_angle_get(size_t const index, int32_t const scale)
+{
+    UNUSED(index);
+
+    return float_to_scaled(trigger_36_1_engine_cycle_angle_get(telemetry_context.trigger_wheel), scale);
+}
+
+static int32_t telemetry_map_kpa_get(size_t const index, int32_t const scale)
+{
+    UNUSED(index);
+
+    return float_to_scaled(engine_sensors_map_kpa_get(), scale);
+}
+
+static int32_t telemetry_injector_pulse_width_get(size_t const index, int32_t const scale)
+{
+    return injector_pulse_width_us_get(index) * scale;
+}
+
+static int32_t telemetry_spark_angle_get(size_t const index, int32_t const scale)
+{
+    ignition_spark_schedule_st const spark_schedule = ignition_spark_schedule_get(index);
+
+    return ((int32_t)spark_schedule.spark_angle * scale) / IGNITION_ANGLE_SCALE;
+}
+
+static int32_t telemetry_knock_retard_get(size_t const index, int32_t const scale)
+{
+    return (knock_retard_get(index) * scale) / IGNITION_ANGLE_SCALE;
+}
+
+static int32_t telemetry_injector_latency_get(size_t const index, int32_t const scale)
+{
+    return injector_scheduling_latency_us_get(index) * scale;
+}
+
+static int32_t telemetry_ignition_latency_get(size_t const index, int32_t const scale)
+{
+    return ignition_scheduling_latency_us_get(index) * scale;
+}
+
+static int32_t telemetry_cpu_load_get(size_t const index, int32_t const scale)
+{
+    UNUSED(index);
+
+    return ((int32_t)cpu_load_permille_get(&telemetry_context.cpu_load_since) * scale) / 10;
+}
+
+#define TELEMETRY_FIELD_DESCRIPTOR(field_name, field_type, field_scale, field_value_get, field_index) \
+    { \
+        .value_get = field_value_get, \
+        .index = field_index, \
+        .scale = field_scale, \
+        .type = telemetry_field_##field_type \
+    },
+
+static telemetry_field_st const telemetry_fields[] =
+{
+    TELEMETRY_FIELDS(TELEMETRY_FIELD_DESCRIPTOR)
+};
+
+static int32_t saturate(int32_t const value, int32_t const minimum, int32_t const maximum)
+{
+    int32_t result = value;
+
+    if (result < minimum)
+    {
+        result = minimum;
+    }
+    else if (result > maximum)
+    {
+        result = maximum;
+    }
+
+    return result;
+}
+
+static uint8_t * put_u16(uint8_t * const p, uint16_t const value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+
+    return p + 2;
+}
+
+static uint8_t * put_u32(uint8_t * const p, uint32_t const value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+
+    return p + 4;
+}
+
+static uint8_t * field_put(uint8_t * p, telemetry_field_st const * const field)
+{
+    int32_t const value = field->value_get(field->index, field->scale);
+
+    switch (field->type)
+    {
+        case telemetry_field_u8:
+            *p++ = saturate(value, 0, UINT8_MAX);
+            break;
+        case telemetry_field_u16:
+            p = put_u16(p, saturate(value, 0, UINT16_MAX));
+            break;
+        case telemetry_field_s16:
+            p = put_u16(p, (uint16_t)saturate(value, INT16_MIN, INT16_MAX));
+            break;
+        case telemetry_field_u32:
+            p = put_u32(p, value);
+            break;
+    }
+
+    return p;
+}
+
+size_t telemetry_frame_build(uint8_t * const frame, size_t const max_len)
+{
+    telemetry_context_st * const telemetry = &telemetry_context;
+    uint8_t * p = frame;
+    size_t index;
+    size_t frame_len = 0;
+
+    if (max_len < TELEMETRY_FRAME_SIZE)
+    {
+        goto done;
+    }
+
+    *p++ = TELEMETRY_SYNC_0;
+    *p++ = TELEMETRY_SYNC_1;
+    *p++ = TELEMETRY_PAYLOAD_SIZE;
+    p = put_u16(p, telemetry->sequence);
+    p = put_u32(p, main_input_timer_count_get());
+
+    for (index = 0; index < ARRAY_SIZE(telemetry_fields); index++)
+    {
+        p = field_put(p, &telemetry_fields[index]);
+    }
+
+    /* The sync bytes aren't included in the CRC. */
+    p = put_u16(p, crc16_ccitt_update(CRC16_CCITT_INITIAL, &frame[2], p - &frame[2]));
+
+    frame_len = p - frame;
+    telemetry->sequence++;
+    telemetry->frames_built++;
+
+done:
+    return frame_len;
+}
+
+void telemetry_frame_dropped(void)
+{
+    telemetry_context.frames_dropped++;
+}
+
+void print_telemetry_debug(void)
+{
+    telemetry_context_st const * const telemetry = &telemetry_context;
+
+    printf("telemetry frame size %u built %"PRIu32" dropped %"PRIu32"\r\n",
+           (unsigned)TELEMETRY_FRAME_SIZE,
+           telemetry->frames_built,
+           telemetry->frames_dropped);
+}
+
+void telemetry_init(trigger_wheel_36_1_context_st * const trigger_wheel)
+{
+    telemetry_context.trigger_wheel = trigger_wheel;
+}
@@ -0,0 +1,24 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include "trigger_wheel_36_1.h"
+#include "telemetry_frame.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+void telemetry_init(trigger_wheel_36_1_context_st * const trigger_wheel);
+
+/* Builds a frame containing the current values of all the 
+ * telemetry fields (see telemetry_frame.h). Returns the frame 
+ * length, or 0 if max_len is less than TELEMETRY_FRAME_SIZE. 
+ * No floating point formatting is done. 
+ */
+size_t telemetry_frame_build(uint8_t * const frame, size_t const max_len);
+
+/* Called when a built frame couldn't be sent. */
+void telemetry_frame_dropped(void);
+
+void print_telemetry_debug(void);
+
+#endif /* __TELEMETRY_H__ */
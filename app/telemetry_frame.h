@@ -0,0 +1,77 @@
+#ifndef __TELEMETRY_FRAME_H__
+#define __TELEMETRY_FRAME_H__
+
+/* Layout of the binary telemetry frames. Shared by the target and 
+ * the host decoder (tools/telemetry_decode.c). 
+ *  
+ * frame: 
+ *   sync         2 bytes  TELEMETRY_SYNC_0, TELEMETRY_SYNC_1
+ *   length       1 byte   number of payload bytes
+ *   sequence     2 bytes  incremented for every frame built
+ *   timestamp    4 bytes  main input timer count (us)
+ *   payload      length bytes, fields in TELEMETRY_FIELDS order
+ *   crc          2 bytes  crc16_ccitt over length..payload
+ * All multi-byte values are little endian. 
+ */
+
+#include <stdint.h>
+
+#define TELEMETRY_SYNC_0 0xa5
+#define TELEMETRY_SYNC_1 0x5a
+
+#define TELEMETRY_HEADER_SIZE 9
+#define TELEMETRY_CRC_SIZE 2
+
+typedef enum telemetry_field_type_t
+{
+    telemetry_field_u8,
+    telemetry_field_u16,
+    telemetry_field_s16,
+    telemetry_field_u32
+} telemetry_field_type_t;
+
+#define TELEMETRY_FIELD_SIZE_u8 1
+#define TELEMETRY_FIELD_SIZE_u16 2
+#define TELEMETRY_FIELD_SIZE_s16 2
+#define TELEMETRY_FIELD_SIZE_u32 4
+
+/* FIELD(name, type, scale, value_get, index) 
+ * The transmitted value is the real value multiplied by scale. 
+ * value_get(index) is only referenced on the target. Fields may 
+ * only be added to the end of the list so that old logs can 
+ * still be decoded. 
+ */
+#define TELEMETRY_FIELDS(FIELD) \
+    FIELD(rpm,                   u16,  1, telemetry_rpm_get, 0) \
+    FIELD(synched,               u8,   1, telemetry_synched_get, 0) \
+    FIELD(crank_angle,           s16, 10, telemetry_crank_angle_get, 0) \
+    FIELD(engine_cycle_angle,    u16, 10, telemetry_engine_cycle_angle_get, 0) \
+    FIELD(map_kpa,               u16, 10, telemetry_map_kpa_get, 0) \
+    FIELD(injector_pw_us_0,      u16,  1, telemetry_injector_pulse_width_get, 0) \
+    FIELD(injector_pw_us_1,      u16,  1, telemetry_injector_pulse_width_get, 1) \
+    FIELD(injector_pw_us_2,      u16,  1, telemetry_injector_pulse_width_get, 2) \
+    FIELD(injector_pw_us_3,      u16,  1, telemetry_injector_pulse_width_get, 3) \
+    FIELD(spark_angle_0,         u16, 10, telemetry_spark_angle_get, 0) \
+    FIELD(spark_angle_1,         u16, 10, telemetry_spark_angle_get, 1) \
+    FIELD(spark_angle_2,         u16, 10, telemetry_spark_angle_get, 2) \
+    FIELD(spark_angle_3,         u16, 10, telemetry_spark_angle_get, 3) \
+    FIELD(knock_retard_0,        u8,  10, telemetry_knock_retard_get, 0) \
+    FIELD(knock_retard_1,        u8,  10, telemetry_knock_retard_get, 1) \
+    FIELD(knock_retard_2,        u8,  10, telemetry_knock_retard_get, 2) \
+    FIELD(knock_retard_3,        u8,  10, telemetry_knock_retard_get, 3) \
+    FIELD(injector_latency_us_0, u16,  1, telemetry_injector_latency_get, 0) \
+    FIELD(injector_latency_us_1, u16,  1, telemetry_injector_latency_get, 1) \
+    FIELD(injector_latency_us_2, u16,  1, telemetry_injector_latency_get, 2) \
+    FIELD(injector_latency_us_3, u16,  1, telemetry_injector_latency_get, 3) \
+    FIELD(ignition_latency_us_0, u16,  1, telemetry_ignition_latency_get, 0) \
+    FIELD(ignition_latency_us_1, u16,  1, telemetry_ignition_latency_get, 1) \
+    FIELD(ignition_latency_us_2, u16,  1, telemetry_ignition_latency_get, 2) \
+    FIELD(ignition_latency_us_3, u16,  1, telemetry_ignition_latency_get, 3) \
+    FIELD(cpu_load_percent,      u16, 10, telemetry_cpu_load_get, 0)
+
+#define TELEMETRY_FIELD_SIZE_ADD(name, type, scale, value_get, index) + TELEMETRY_FIELD_SIZE_##type
+#define TELEMETRY_PAYLOAD_SIZE (0 TELEMETRY_FIELDS(TELEMETRY_FIELD_SIZE_ADD))
+
+#define TELEMETRY_FRAME_SIZE (TELEMETRY_HEADER_SIZE + TELEMETRY_PAYLOAD_SIZE + TELEMETRY_CRC_SIZE)
+
+#endif /* __TELEMETRY_FRAME_H__ */
@@ -4,6 +4,7 @@
 #include "main_input_timer.h"
 #include "leds.h"
 #include "stm32f4_utils.h"
+#include "cpu_load.h"
 
 #include "CoOS.h"
 #include "OsArch.h"
@@ -17,14 +18,6 @@
 #include <inttypes.h>
 #include <stdio.h>
 
-/* The CoOS queue system seems to have a bug in it such that 
- * messages posted to the queue can arrive out of order. Sigh. 
- * Rather than fix it I've used another method that uses the 
- * CoOS flags to indicate that a message has been delivered to 
- * a custom list of messages. This technique seems to work.
- */
-#define USE_FLAG_METHOD
-
 /* 
     Note:
     Franksenso board has crank on PA5 and cam on PC6. This needs fixing up.
@@ -67,13 +60,12 @@ static trigger_signal_st cam_trigger_signals[CAM_TRIGGER_SIGNAL_QUEUE_LEN];
 
 typedef STAILQ_HEAD(trigger_signal_list, trigger_signal_st) trigger_signal_list;
 
-#if defined(USE_FLAG_METHOD)
-static OS_FlagID trigger_message_queue_flag;
-static trigger_signal_list pending_trigger_signal_list; 
-#else
+/* Big enough for every signal, so posting never finds it full. 
+ * The ISRs post straight into it, so signals arrive in the order 
+ * they were posted. 
+ */
 static trigger_signal_st * trigger_signal_queue[TOTAL_TRIGGER_SIGNAL_LEN];
 static OS_EventID trigger_signal_message_queue_id;
-#endif
 
 /* TODO: Need a trigger input context with fields for the 
  * trigger context and the crank and cam callbacks which are 
@@ -181,17 +173,9 @@ static void handle_trigger_signal(trigger_signal_st * const trigger_signal,
     trigger_signal->timestamp = timestamp;
     trigger_signal->source = source;
 
-#if defined(USE_FLAG_METHOD)
-    trigger_signal_put(&pending_trigger_signal_list, trigger_signal);
-#endif
-
     CoEnterISR();
 
-#if defined(USE_FLAG_METHOD)
-    isr_SetFlag(trigger_message_queue_flag);
-#else
     isr_PostQueueMail(trigger_signal_message_queue_id, trigger_signal);
-#endif
 
     CoExitISR();
 }
@@ -240,6 +224,7 @@ static void handle_cam_trigger_signal(uint32_t const timestamp)
 void EXTI0_IRQHandler(void)
 {
     uint32_t timestamp = main_input_timer_count_get();
+    cpu_load_isr_stamp_st const stamp = cpu_load_isr_enter();
 
     /* XXX - Need to determine the EXTI_Line to check for some 
      * other way. Hard-coded assumption that this is for the crank 
@@ -254,11 +239,14 @@ void EXTI0_IRQHandler(void)
 
         handle_crank_trigger_signal(timestamp);
     }
+
+    cpu_load_isr_exit(cpu_load_isr_exti0, stamp);
 }
 
 void EXTI9_5_IRQHandler(void)
 {
     uint32_t timestamp = main_input_timer_count_get();
+    cpu_load_isr_stamp_st const stamp = cpu_load_isr_enter();
 
     /* XXX - Need to determine the EXTI_Line to check for some 
      * other way. Hard-coded assumption that this is for the cam or 
@@ -280,6 +268,8 @@ void EXTI9_5_IRQHandler(void)
 
         handle_crank_trigger_signal(timestamp);
     }
+
+    cpu_load_isr_exit(cpu_load_isr_exti9_5, stamp);
 }
 
 
@@ -308,18 +298,8 @@ static void init_cam_trigger_signal_list(void)
     init_trigger_signal_list(&cam_trigger_signal_free_list, cam_trigger_signals, CAM_TRIGGER_SIGNAL_QUEUE_LEN);
 }
 
-#if defined(USE_FLAG_METHOD)
-static void init_pending_trigger_signal_list(void)
-{
-    STAILQ_INIT(&pending_trigger_signal_list);
-}
-#endif
-
 static void init_trigger_signal_lists(void)
 {
-#if defined(USE_FLAG_METHOD)
-    init_pending_trigger_signal_list();
-#endif
     init_crank_trigger_signal_list();
     init_cam_trigger_signal_list();
 }
@@ -339,27 +319,40 @@ float engine_cycle_angle_get(void)
     return trigger_36_1_engine_cycle_angle_get(trigger_context);
 }
 
-trigger_signal_st * pend_on_trigger_message(void)
+void trigger_schedule_update(void)
 {
-    trigger_signal_st * trigger_signal;
-#if defined(USE_FLAG_METHOD)
-
-    do
+    if (trigger_context != NULL)
     {
-        trigger_signal = trigger_signal_get(&pending_trigger_signal_list);
-        if (trigger_signal == NULL)
-        {
-            CoWaitForSingleFlag(trigger_message_queue_flag, 0);
-        }
+        trigger_36_1_schedule_update(trigger_context);
     }
-    while (trigger_signal == NULL);
-#else
+}
+
+/* Waits for at least one trigger signal and takes all those 
+ * waiting, oldest first. Returns the number taken. 
+ */
+static size_t pend_on_trigger_messages(trigger_signal_st * * const trigger_signals, size_t const max_signals)
+{
     StatusType err;
 
-    trigger_signal = CoPendQueueMail(trigger_signal_message_queue_id, 0, &err);
-#endif
+    return CoPendQueueMailN(trigger_signal_message_queue_id, (void * *)trigger_signals, max_signals, 0, &err);
+}
 
-    return trigger_signal;
+static void handle_trigger_message(trigger_signal_st * const trigger_signal)
+{
+    uint32_t const timestamp = trigger_signal->timestamp;
+    trigger_signal_source_t const trigger_source = trigger_signal->source;
+
+    switch (trigger_source)
+    {
+        case trigger_signal_source_crank:
+            crank_trigger_signal_put(trigger_signal);
+            trigger_36_1_handle_crank_pulse(trigger_context, timestamp);
+            break;
+        case trigger_signal_source_cam:
+            cam_trigger_signal_put(trigger_signal);
+            trigger_36_1_handle_cam_pulse(trigger_context, timestamp);
+            break;
+    }
 }
 
 void trigger_input_task(void * pdata)
@@ -368,25 +361,13 @@ void trigger_input_task(void * pdata)
 
     while (1)
     {
-        trigger_signal_st * trigger_signal;
-        uint32_t timestamp;
-        trigger_signal_source_t trigger_source;
+        trigger_signal_st * trigger_signals[TOTAL_TRIGGER_SIGNAL_LEN];
+        size_t const num_signals = pend_on_trigger_messages(trigger_signals, TOTAL_TRIGGER_SIGNAL_LEN);
+        size_t index;
 
-        trigger_signal = pend_on_trigger_message();
-
-        timestamp = trigger_signal->timestamp;
-        trigger_source = trigger_signal->source;
-
-        switch (trigger_source)
+        for (index = 0; index < num_signals; index++)
         {
-            case trigger_signal_source_crank:
-                crank_trigger_signal_put(trigger_signal);
-                trigger_36_1_handle_crank_pulse(trigger_context, timestamp);
-                break;
-            case trigger_signal_source_cam:
-                cam_trigger_signal_put(trigger_signal);
-                trigger_36_1_handle_cam_pulse(trigger_context, timestamp);
-                break;
+            handle_trigger_message(trigger_signals[index]);
         }
     }
 }
@@ -485,11 +466,7 @@ void init_trigger_signals(trigger_wheel_36_1_context_st * const trigger_wheel_co
      */
     init_trigger_signal_lists(); 
 
-#if defined(USE_FLAG_METHOD)
-    trigger_message_queue_flag = CoCreateFlag(Co_TRUE, Co_FALSE);
-#else
     trigger_signal_message_queue_id = CoCreateQueue((void * *)&trigger_signal_queue, TOTAL_TRIGGER_SIGNAL_LEN, EVENT_SORT_TYPE_FIFO);
-#endif
 
     /* XXX - FIXME. Get trigger wheel decoder to register for 
      * trigger events from this module. Also support enabling and 
@@ -497,11 +474,12 @@ void init_trigger_signals(trigger_wheel_36_1_context_st * const trigger_wheel_co
      */
     trigger_context = trigger_wheel_context;
 
-    CoCreateTask(trigger_input_task,
-                 NULL,
-                 1,
-                 &trigger_signal_task_stack[TRIGGER_SIGNAL_TASK_STACK_SIZE - 1],
-                 TRIGGER_SIGNAL_TASK_STACK_SIZE);
+    cpu_load_task_name_set(CoCreateTask(trigger_input_task,
+                                        NULL,
+                                        1,
+                                        &trigger_signal_task_stack[TRIGGER_SIGNAL_TASK_STACK_SIZE - 1],
+                                        TRIGGER_SIGNAL_TASK_STACK_SIZE),
+                           "trigger");
 
     initialise_crank_trigger_input();
 
@@ -12,4 +12,10 @@ typedef enum trigger_signal_source_t
 
 void init_trigger_signals(trigger_wheel_36_1_context_st * const context);
 
+float rpm_get(void);
+float crank_angle_get(void);
+float engine_cycle_angle_get(void);
+
+void trigger_schedule_update(void);
+
 #endif /* __TRIGGER_INPUT_H__ */
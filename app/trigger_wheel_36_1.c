@@ -2,8 +2,9 @@
 #include "trigger_wheel_36_1.h"
 #include "queue.h"
 #include "rpm_calculator.h"
-#include "leds.h"
 #include "main_input_timer.h"
+#include "event_log.h"
+#include "tune_config.h"
 #include "utils.h"
 
 #include "CoOS.h"
@@ -17,7 +18,7 @@
 #define NUM_TEETH 35
 #define NUM_MISSING_TEETH 1
 #define TOTAL_TEETH (NUM_TEETH + NUM_MISSING_TEETH)
-#define NUM_EVENT_ENTRIES 20 /* Ensure is enough to cover all injectors + ignition outputs 
+#define NUM_EVENT_ENTRIES 32 /* Ensure is enough to cover all injectors + ignition outputs 
                                 and anything else that requires updating at a particualr engine angle. */
 
 typedef void (* trigger_36_1_state_handler)(trigger_wheel_36_1_context_st * const context, 
@@ -37,6 +38,31 @@ struct event_st
 
 typedef SLIST_HEAD(event_list_head_st, event_st) event_list_head_st;
 
+typedef struct registered_event_st
+{
+    float engine_cycle_angle;
+    trigger_event_callback user_callback;
+    void * user_arg;
+} registered_event_st;
+
+/* The angle of each tooth and the events to make at each tooth, 
+ * for one tooth #1 crank angle and cam phase. 
+ * Built by trigger_36_1_schedule_update() in a low priority task 
+ * and made live at the start of an engine cycle, so the event 
+ * path never has to work any of this out. 
+ */
+typedef struct trigger_schedule_st
+{
+    int32_t tooth_1_crank_angle; /* As configured. */
+    uint8_t cam_phase; /* As configured. */
+
+    /* Indexed by [second_revolution][tooth number - 1]. */
+    float engine_cycle_angles[2][NUM_TEETH];
+    event_list_head_st event_callbacks[2][NUM_TEETH];
+
+    event_st events[NUM_EVENT_ENTRIES]; /* One for each registered event. */
+} trigger_schedule_st;
+
 typedef struct tooth_context_st
 {
     CIRCLEQ_ENTRY(tooth_context_st) entry; 
@@ -45,7 +71,6 @@ typedef struct tooth_context_st
     uint32_t time_since_previous_tooth; /* Difference in timestamp between this tooth and the previous timestamp.
                                             Valid only if pulse_counter > 1.
                                         */
-    float crank_angle; /* Retain this information for each tooth. It may vary depending on the configuration of the tooth #1 offset.*/
 
 } tooth_context_st;
 
@@ -64,10 +89,23 @@ struct trigger_wheel_36_1_context_st
 
     tooth_context_st tooth_contexts[NUM_TEETH];
 
-    /* Note that the event callbacks are in tooth order, starting 
-     * at tooth #1. 
+    registered_event_st registered_events[NUM_EVENT_ENTRIES];
+    size_t num_registered_events;
+
+    /* The live schedule is only swapped at the start of an engine 
+     * cycle. The other one is only written by 
+     * trigger_36_1_schedule_update(), which runs below everything 
+     * that reads the live one, so it can be rebuilt as soon as it 
+     * has been replaced. pending is handed between the two using 
+     * the atomic builtins. 
      */
-    event_list_head_st event_callbacks[2][NUM_TEETH];
+    trigger_schedule_st schedules[2];
+    trigger_schedule_st const * schedule;
+    trigger_schedule_st * pending_schedule;
+
+    /* Optional callback made on every tooth. */
+    trigger_tooth_callback tooth_callback;
+    void * tooth_callback_arg;
 
     tooth_context_st * tooth_1; /* When synched, this points to the entry for tooth #1, 
                                     which is the tooth after the missing tooth. 
@@ -84,7 +122,6 @@ struct trigger_wheel_36_1_context_st
      */
     bool second_revolution; /* In second half of the 720 degree cycle. */
 
-    float tooth_1_crank_angle; /* -ve indicates BTDC, +ve indicates ATDC. */
     uint32_t timestamp; /* timestamp taken when the last tooth was processed. */
 
     CIRCLEQ_HEAD(,tooth_context_st) teeth_queue;
@@ -101,12 +138,6 @@ static void crank_trigger_wheel_state_synched_handler(trigger_wheel_36_1_context
 static void cam_trigger_wheel_state_handler(trigger_wheel_36_1_context_st * const context,
                                             uint32_t const timestamp);
 
-static float rpm_smoothing_factor = 0.98; /* TODO - Make configurable. */
-static float tooth_1_crank_angle = 0.0; /* TODO - Make configurable. */
-
-static event_list_head_st free_event_entries;
-static event_st event_entries[NUM_EVENT_ENTRIES];
-
 static trigger_wheel_36_1_context_st trigger_wheel_context;
 
 static unsigned int const trigger_wheel_tooth_angles[NUM_TEETH] =
@@ -117,26 +148,9 @@ static unsigned int const trigger_wheel_tooth_angles[NUM_TEETH] =
     280, 290, 300, 310, 320, 330, 340
 };
 
-/* Crank angles at each tooth after the tooth #1 crank angle 
-   offset has been applied. */
-static float runtime_crank_angles[NUM_TEETH + 1] = /* +1 is to avoid stupid array-bounds compiler warning */
-{
-    0, 10, 20, 30, 40, 50, 60, 70, 80, 90,
-    100, 110, 120, 130, 140, 150, 160, 170, 180,
-    190, 200, 210, 220, 230, 240, 250, 260, 270,
-    280, 290, 300, 310, 320, 330, 340
-};
-
 float rpm_smoothing_factor_get(void)
 {
-    /* TODO - Make configurable. */
-    return rpm_smoothing_factor;
-}
-
-float tooth_1_crank_angle_get(void)
-{
-    /* TODO - Make configurable. */
-    return tooth_1_crank_angle;
+    return tune_config_derived_get()->rpm_smoothing_factor;
 }
 
 /* All event_entry list code relating to accessing of the list 
@@ -153,34 +167,6 @@ static inline void event_entry_list_insert(event_list_head_st * head, event_st *
     SLIST_INSERT_HEAD(head, event, entry);
 }
 
-static void event_entry_init(void)
-{
-    size_t index;
-
-    event_entry_list_init(&free_event_entries);
-
-    /* Add all events into a linked list for easy retrieval. Easier 
-     * to keep track of which ones are free if support for 
-     * deregistering callbacks is ever supported. 
-    */
-    for (index = 0; index < NUM_EVENT_ENTRIES; index++)
-    {
-        SLIST_INSERT_HEAD(&free_event_entries, &event_entries[index], entry);
-    }
-}
-
-static event_st * event_entry_get(void)
-{
-    event_st * event = SLIST_FIRST(&free_event_entries);
-
-    if (event != NULL)
-    {
-        SLIST_REMOVE_HEAD(&free_event_entries, entry);
-    }
-
-    return event;
-}
-
 static void iterate_events(event_list_head_st * const head, event_list_callback_fn callback, void * const user_arg)
 {
     event_st * event;
@@ -220,25 +206,102 @@ tooth_context_st * next_tooth_get(trigger_wheel_36_1_context_st * const context,
     return next;
 }
 
-/* XXX Only needs to be done once when the trigger wheel is 
- * synched. 
- * The engine_cycle angle can be determined when needed by 
- * adding 360 degrees if in the second cycle. Beware of race 
- * when doing this. 
+/* Find the tooth that most closely matches the desired angle, 
+ * i.e. the last one at or before it. Returns the index into 
+ * engine_cycle_angles. 
  */
-static void update_engine_angles(trigger_wheel_36_1_context_st * const context)
+static size_t closest_tooth_find(trigger_schedule_st const * const schedule, float const engine_cycle_angle)
+{
+    float const * const angles = &schedule->engine_cycle_angles[0][0];
+    size_t closest_index = 0;
+    float closest_degrees = 720.0;
+    size_t index;
+
+    for (index = 0; index < 2 * NUM_TEETH; index++)
+    {
+        float const degrees = normalise_engine_cycle_angle(engine_cycle_angle - angles[index]);
+
+        if (degrees < closest_degrees)
+        {
+            closest_degrees = degrees;
+            closest_index = index;
+        }
+    }
+
+    return closest_index;
+}
+
+static void schedule_build(trigger_wheel_36_1_context_st * const context,
+                           trigger_schedule_st * const schedule,
+                           int32_t const tooth_1_crank_angle,
+                           uint8_t const cam_phase)
+{
+    float const tooth_1_engine_cycle_angle = tooth_1_crank_angle / 10.0 + (cam_phase ? 360.0 : 0.0);
+    size_t revolution;
+    size_t index;
+
+    schedule->tooth_1_crank_angle = tooth_1_crank_angle;
+    schedule->cam_phase = cam_phase;
+
+    for (revolution = 0; revolution < 2; revolution++)
+    {
+        for (index = 0; index < NUM_TEETH; index++)
+        {
+            schedule->engine_cycle_angles[revolution][index] = 
+                normalise_engine_cycle_angle(tooth_1_engine_cycle_angle
+                                             + trigger_wheel_tooth_angles[index]
+                                             + (360.0 * revolution));
+            event_entry_list_init(&schedule->event_callbacks[revolution][index]);
+        }
+    }
+
+    for (index = 0; index < context->num_registered_events; index++)
+    {
+        registered_event_st const * const registered_event = &context->registered_events[index];
+        event_st * const event = &schedule->events[index];
+        size_t const tooth_index = closest_tooth_find(schedule, registered_event->engine_cycle_angle);
+
+        event->user_callback = registered_event->user_callback;
+        event->user_arg = registered_event->user_arg;
+        event_entry_list_insert(&schedule->event_callbacks[0][0] + tooth_index, event);
+    }
+}
+
+static bool schedule_matches(trigger_schedule_st const * const schedule, tune_engine_page_st const * const engine)
+{
+    return schedule->tooth_1_crank_angle == engine->tooth_1_crank_angle
+        && schedule->cam_phase == engine->cam_phase;
+}
+
+/* Called at tooth #1 at the start of the engine cycle. */
+static void schedule_publish(trigger_wheel_36_1_context_st * const context)
 {
-    tooth_context_st * tooth = context->tooth_1; 
-    size_t index; 
+    trigger_schedule_st * const schedule = __atomic_exchange_n(&context->pending_schedule, NULL, __ATOMIC_ACQ_REL);
 
-    for (index = 0; index < NUM_TEETH; index++);
+    if (schedule != NULL)
     {
-        /* Work out crank angle. */
-        runtime_crank_angles[index] = normalise_crank_angle((float)trigger_wheel_tooth_angles[index] + context->tooth_1_crank_angle);
-        tooth->crank_angle = runtime_crank_angles[index];
+        /* A single pointer write. */
+        __atomic_store_n(&context->schedule, schedule, __ATOMIC_RELEASE);
+    }
+}
 
-        tooth = next_tooth_get(context, tooth);
+/* Get the number of crank degrees between the specified tooth 
+ * and the one before it. 
+ */
+static unsigned int tooth_angle_get(unsigned int const tooth_number)
+{
+    unsigned int tooth_angle;
+
+    if (tooth_number == 1)
+    {
+        tooth_angle = 360 - trigger_wheel_tooth_angles[NUM_TEETH - 1];
     }
+    else
+    {
+        tooth_angle = trigger_wheel_tooth_angles[tooth_number - 1] - trigger_wheel_tooth_angles[tooth_number - 2];
+    }
+
+    return tooth_angle;
 }
 
 static float trigger_36_1_unsynched_angle_get(trigger_wheel_36_1_context_st * const context, bool const engine_angle)
@@ -255,19 +318,23 @@ static float trigger_36_1_unsynched_angle_get(trigger_wheel_36_1_context_st * co
 static float trigger_36_1_synched_angle_get(trigger_wheel_36_1_context_st * const context, bool const engine_angle)
 {
     unsigned int tooth_number;
-    float crank_angle;
+    float angle;
     uint32_t ticks_since_tooth_passed;
     uint32_t tooth_timestamp;
     uint32_t time_now;
     float degrees_since_tooth_passed;
     bool previous_tooth_in_second_revolution;
+    float tooth_angle;
 
     CoEnterMutexSection(context->teeth_mutex);
 
     tooth_timestamp = context->timestamp;
     tooth_number = context->tooth_number;
-    previous_tooth_in_second_revolution = (context->second_revolution && context->tooth_number != 1)
-        || (!context->second_revolution && context->tooth_number == 1);
+    /* second_revolution is updated at tooth #1, so it is always 
+     * the revolution of the last tooth. 
+     */
+    previous_tooth_in_second_revolution = context->second_revolution;
+    tooth_angle = __atomic_load_n(&context->schedule, __ATOMIC_ACQUIRE)->engine_cycle_angles[previous_tooth_in_second_revolution][tooth_number - 1];
 
     CoLeaveMutexSection(context->teeth_mutex);
 
@@ -275,14 +342,16 @@ static float trigger_36_1_synched_angle_get(trigger_wheel_36_1_context_st * cons
     ticks_since_tooth_passed = time_now - tooth_timestamp;
     degrees_since_tooth_passed = rpm_calcuator_get_degrees_turned(context->rpm_calculator, (float)ticks_since_tooth_passed / TIMER_FREQUENCY);
 
-    crank_angle = normalise_crank_angle(runtime_crank_angles[tooth_number - 1] + degrees_since_tooth_passed);
-
-    if (engine_angle && previous_tooth_in_second_revolution)
+    if (engine_angle)
     {
-        crank_angle += 360.0;
+        angle = normalise_engine_cycle_angle(tooth_angle + degrees_since_tooth_passed);
+    }
+    else
+    {
+        angle = normalise_crank_angle(tooth_angle + degrees_since_tooth_passed);
     }
 
-    return crank_angle;
+    return angle;
 }
 
 static float trigger_36_1_synched_rotation_time_get(trigger_wheel_36_1_context_st * const context, float const rotation_angle)
@@ -311,7 +380,11 @@ static void set_unsynched(trigger_wheel_36_1_context_st * const context)
     context->rotation_time_get_handler = trigger_36_1_unsynched_rotation_time_get;
     context->pulse_counter = 0;
     context->tooth_1 = NULL;
-    rpm_calculator_init(context->rpm_calculator, rpm_smoothing_factor); 
+    rpm_calculator_init(context->rpm_calculator, rpm_smoothing_factor_get()); 
+    /* No more engine cycle starts to make a new configuration live 
+     * at. 
+     */
+    tune_config_cycle_publishing_set(false);
 }
 
 static void set_synched(trigger_wheel_36_1_context_st * const context)
@@ -322,7 +395,7 @@ static void set_synched(trigger_wheel_36_1_context_st * const context)
     context->rotation_time_get_handler = trigger_36_1_synched_rotation_time_get;
     context->had_cam_signal = false; /* Still need a cam signal to know which half of the cycle the engine is in.
                                       */
-    update_engine_angles(context);
+    tune_config_cycle_publishing_set(true);
 }
 
 static inline uint32_t single_tooth_change_low_limit(uint32_t const time)
@@ -465,13 +538,14 @@ static void execute_engine_cycle_events(trigger_wheel_36_1_context_st * const co
                                         unsigned int const tooth_number, 
                                         uint32_t const timestamp)
 {
+    trigger_schedule_st * const schedule = (trigger_schedule_st *)context->schedule;
     unsigned int const event_index = tooth_number - 1;
     event_callback_info_st callback_info;
 
-    callback_info.crank_angle = runtime_crank_angles[event_index];
+    callback_info.crank_angle = normalise_crank_angle(schedule->engine_cycle_angles[context->second_revolution][event_index]);
     callback_info.timestamp = timestamp;
 
-    iterate_events(&context->event_callbacks[context->second_revolution][event_index], 
+    iterate_events(&schedule->event_callbacks[context->second_revolution][event_index], 
                    event_callback,
                    &callback_info);
 
@@ -489,14 +563,14 @@ static bool validate_tooth_interval(unsigned int tooth_number,
      */
     if (this_delta <= 0)
     {
-        printf("-ve %"PRId32"\r\n", this_delta);
+        EVENT_LOG1("-ve %"PRId32"\r\n", this_delta);
         tooth_interval_is_valid = false;
         goto done;
     }
 
     if (this_delta > TIMER_FREQUENCY)
     {
-        printf("1 %"PRIu32"\r\n", this_delta);
+        EVENT_LOG1("1 %"PRIu32"\r\n", this_delta);
         tooth_interval_is_valid = false;
         goto done;
     }
@@ -505,7 +579,7 @@ static bool validate_tooth_interval(unsigned int tooth_number,
     {
         if (!is_second_tooth_after_skip_tooth(this_delta, previous_delta))
         {
-            printf("2 %"PRIu32" %"PRIu32"\r\n", this_delta, previous_delta);
+            EVENT_LOG2("2 %"PRIu32" %"PRIu32"\r\n", this_delta, previous_delta);
             tooth_interval_is_valid = false;
             goto done;
         }
@@ -514,14 +588,14 @@ static bool validate_tooth_interval(unsigned int tooth_number,
     {
         if (!interval_matches_skip_tooth(this_delta, previous_delta))
         {
-            printf("3 %"PRIu32" %"PRIu32"\r\n", this_delta, previous_delta);
+            EVENT_LOG2("3 %"PRIu32" %"PRIu32"\r\n", this_delta, previous_delta);
             tooth_interval_is_valid = false;
             goto done;
         }
     }
     else if (!interval_matches_previous_tooth(this_delta, previous_delta))
     {
-        printf("4 %"PRIu32" %"PRIu32"\r\n", this_delta, previous_delta);
+        EVENT_LOG2("4 %"PRIu32" %"PRIu32"\r\n", this_delta, previous_delta);
 
         /* Maybe if it's just a single missed tooth we can recover 
          * from this by pretending we got the tooth half this delta's 
@@ -615,8 +689,29 @@ static void crank_trigger_wheel_state_synched_handler(trigger_wheel_36_1_context
         goto done;
     }
 
+    /* A newly burnt configuration and a new schedule take effect 
+     * from the start of the engine cycle, so every event in a cycle 
+     * sees the same ones. 
+     */
+    if (tooth_number == 1 && !context->second_revolution)
+    {
+        if (tune_config_cycle_start())
+        {
+            rpm_calculator_smoothing_factor_set(context->rpm_calculator, rpm_smoothing_factor_get());
+        }
+        schedule_publish(context);
+    }
+
     execute_engine_cycle_events(context, tooth_number, timestamp);
 
+    if (context->tooth_callback != NULL)
+    {
+        context->tooth_callback(tooth_number, 
+                                tooth_angle_get(tooth_number), 
+                                time_since_previous_tooth, 
+                                context->tooth_callback_arg);
+    }
+
     /* TODO: Validate time deltas between teeth. 
      */
     if (context->tooth_number == 1)
@@ -651,12 +746,16 @@ done:
 trigger_wheel_36_1_context_st * trigger_36_1_init(void)
 {
     trigger_wheel_36_1_context_st * context = &trigger_wheel_context;
+    tune_engine_page_st const * const engine = tune_config_engine_get();
     size_t index;
 
-    /* TODO: Support changing this angle while the engine is 
-     * turning. 
+    /* Nothing is registered yet. The events are added to this 
+     * schedule as they are registered. 
      */
-    context->tooth_1_crank_angle = tooth_1_crank_angle_get();
+    context->num_registered_events = 0;
+    schedule_build(context, &context->schedules[0], engine->tooth_1_crank_angle, engine->cam_phase);
+    context->schedule = &context->schedules[0];
+    context->pending_schedule = NULL;
 
     /* RPM calculator is needed before setting unsynched state as 
      * set_unsynched references the calculator. 
@@ -669,13 +768,6 @@ trigger_wheel_36_1_context_st * trigger_36_1_init(void)
 
     context->revolution_counter = 0;
 
-    event_entry_init();
-    for (index = 0; index < NUM_TEETH; index++)
-    {
-        event_entry_list_init(&context->event_callbacks[0][index]);
-        event_entry_list_init(&context->event_callbacks[1][index]);
-    }
-
     CIRCLEQ_INIT(&context->teeth_queue);
     for (index = 0; index < NUM_TEETH; index++)
     {
@@ -692,57 +784,82 @@ trigger_wheel_36_1_context_st * trigger_36_1_init(void)
     return context;
 }
 
-static int find_closest_tooth(float const engine_cycle_angle, int const cycle)
+void trigger_36_1_register_callback(trigger_wheel_36_1_context_st * const context,
+                                    float const engine_cycle_angle,
+                                    trigger_event_callback callback,
+                                    void * const user_arg)
 {
-    int index;
+    /* Only called before the trigger signals are started, so the 
+     * event can go straight into the live schedule. Note that the 
+     * desired angle is specified in engine cycle degrees ATDC. 
+     */
+    trigger_schedule_st * const schedule = (trigger_schedule_st *)context->schedule;
+    size_t const index = context->num_registered_events;
 
-    for (index = NUM_TEETH - 1; index >= 0; index--)
+    if (index < ARRAY_SIZE(context->registered_events))
     {
-        if ((runtime_crank_angles[index] + (360.0 * cycle)) <= engine_cycle_angle)
-        {
-            break;
-        }
+        registered_event_st * const registered_event = &context->registered_events[index];
+        event_st * const event = &schedule->events[index];
+        size_t const tooth_index = closest_tooth_find(schedule, engine_cycle_angle);
+
+        registered_event->engine_cycle_angle = normalise_engine_cycle_angle(engine_cycle_angle);
+        registered_event->user_callback = callback;
+        registered_event->user_arg = user_arg;
+        context->num_registered_events++;
+
+        event->user_callback = callback;
+        event->user_arg = user_arg;
+        event_entry_list_insert(&schedule->event_callbacks[0][0] + tooth_index, event);
     }
-
-    return index;
+    /* Else we have a problem. */
 }
 
-void trigger_36_1_register_callback(trigger_wheel_36_1_context_st * const context,
-                                    float const engine_cycle_angle,
-                                    trigger_event_callback callback,
-                                    void * const user_arg)
+void trigger_36_1_schedule_update(trigger_wheel_36_1_context_st * const context)
 {
-    int cycle;
-    int index;
+    tune_engine_page_st const * const engine = &tune_config_get()->engine;
+    trigger_schedule_st const * live_schedule;
+    trigger_schedule_st * schedule;
 
-    /* Find the tooth that most closely matches the desired angle. 
-     * Note that the desired angle is specified in engine cycle 
-     * degrees ATDC. 
+    /* Nothing to do if the schedule waiting for the next cycle is 
+     * already the right one. It is never written once pending. 
      */
-
-    for (cycle = 1; cycle >= 0; cycle--)
+    schedule = __atomic_load_n(&context->pending_schedule, __ATOMIC_ACQUIRE);
+    if (schedule != NULL && schedule_matches(schedule, engine))
     {
-        index = find_closest_tooth(engine_cycle_angle, cycle);
+        goto done;
+    }
 
-        if (index >= 0)
-        {
-            break;
-        }
+    /* Take back any schedule that hasn't been made live yet. After 
+     * this the live schedule can't change under us, and the one 
+     * that isn't live is free, as nothing that could still be 
+     * reading it runs below this task. 
+     */
+    schedule = __atomic_exchange_n(&context->pending_schedule, NULL, __ATOMIC_ACQ_REL);
+    live_schedule = __atomic_load_n(&context->schedule, __ATOMIC_ACQUIRE);
+    if (schedule == NULL)
+    {
+        schedule = (live_schedule == &context->schedules[0]) ? &context->schedules[1] : &context->schedules[0];
     }
 
-    if (cycle >= 0 && index >= 0)
+    if (schedule_matches(live_schedule, engine))
     {
-        event_st * const event = event_entry_get();
+        /* Any schedule that was pending is out of date. */
+        goto done;
+    }
 
-        if (event != NULL)
-        {
-            event->user_callback = callback;
-            event->user_arg = user_arg;
+    schedule_build(context, schedule, engine->tooth_1_crank_angle, engine->cam_phase);
+    __atomic_store_n(&context->pending_schedule, schedule, __ATOMIC_RELEASE);
 
-            event_entry_list_insert(&context->event_callbacks[cycle][index], event);
-        }
-        /* Else we have a problem. */
-    }
+done:
+    return;
+}
+
+void trigger_36_1_register_tooth_callback(trigger_wheel_36_1_context_st * const context,
+                                          trigger_tooth_callback callback,
+                                          void * const user_arg)
+{
+    context->tooth_callback_arg = user_arg;
+    context->tooth_callback = callback;
 }
 
 void trigger_36_1_handle_crank_pulse(trigger_wheel_36_1_context_st * const context,
@@ -762,6 +879,11 @@ float trigger_36_1_rpm_get(trigger_wheel_36_1_context_st * const context)
     return rpm_calculator_smoothed_rpm_get(context->rpm_calculator);
 }
 
+bool trigger_36_1_synched_get(trigger_wheel_36_1_context_st * const context)
+{
+    return context->angle_get_handler == trigger_36_1_synched_angle_get;
+}
+
 float trigger_36_1_crank_angle_get(trigger_wheel_36_1_context_st * const context)
 {
     return context->angle_get_handler(context, false);
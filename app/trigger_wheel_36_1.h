@@ -4,12 +4,23 @@
 typedef struct trigger_wheel_36_1_context_st trigger_wheel_36_1_context_st;
 
 #include <stdint.h>
+#include <stdbool.h>
 
 
 typedef void (* trigger_event_callback)(float const crank_angle_atdc, 
                                         uint32_t timestamp,
                                         void * const arg); 
 
+/* Called for every tooth while the decoder is synchronised. 
+ * tooth_angle is the number of crank degrees between the 
+ * previous tooth and this one, and tooth_period the time taken 
+ * to rotate through it. 
+ */
+typedef void (* trigger_tooth_callback)(unsigned int const tooth_number,
+                                        unsigned int const tooth_angle,
+                                        uint32_t const tooth_period,
+                                        void * const arg);
+
 trigger_wheel_36_1_context_st * trigger_36_1_init(void);
 
 void trigger_36_1_register_callback(trigger_wheel_36_1_context_st * const context,
@@ -17,6 +28,17 @@ void trigger_36_1_register_callback(trigger_wheel_36_1_context_st * const contex
                                     trigger_event_callback callback,
                                     void * const user_arg);
 
+/* Rebuilds the decoder schedule if the tooth #1 crank angle or cam 
+ * phase in the live configuration has changed. The new schedule 
+ * is made live at the start of the next engine cycle. Must be 
+ * called from a task below anything that gets the angle. 
+ */
+void trigger_36_1_schedule_update(trigger_wheel_36_1_context_st * const context);
+
+void trigger_36_1_register_tooth_callback(trigger_wheel_36_1_context_st * const context,
+                                          trigger_tooth_callback callback,
+                                          void * const user_arg);
+
 void trigger_36_1_handle_crank_pulse(trigger_wheel_36_1_context_st * const context, 
                                      uint32_t const timestamp);
 
@@ -25,6 +47,8 @@ void trigger_36_1_handle_cam_pulse(trigger_wheel_36_1_context_st * const context
 
 float trigger_36_1_rpm_get(trigger_wheel_36_1_context_st * const context);
 
+bool trigger_36_1_synched_get(trigger_wheel_36_1_context_st * const context);
+
 float trigger_36_1_crank_angle_get(trigger_wheel_36_1_context_st * const context);
 
 float trigger_36_1_engine_cycle_angle_get(trigger_wheel_36_1_context_st * const context);
@@ -0,0 +1,519 @@
+#include "tune_config.h"
+#include "utils.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#define MAXIMUM_AXIS_BIN_SPACING 131071 /* See map_axis_st. */
+#define MAXIMUM_TOOTH_1_CRANK_ANGLE 3600
+#define MAXIMUM_INJECTOR_CLOSE_ANGLE 7200
+#define MAXIMUM_RPM_SMOOTHING_FACTOR 1000
+#define TUNE_CONFIG_COPIES 4
+
+typedef struct tune_page_desc_st
+{
+    size_t offset;
+    size_t size;
+} tune_page_desc_st;
+
+typedef struct tune_config_copy_st
+{
+    tune_config_st config;
+    tune_derived_st derived;
+} tune_config_copy_st;
+
+typedef struct tune_config_context_st
+{
+    /* Each copy is always one of staging, live, spare, pending or
+     * retired. There are two copies besides staging and live, so
+     * that a burn can be made while the copy replaced by the
+     * previous one is still waiting to be retired.
+     * pending and retired are handed between the writer and the
+     * event path, so are only accessed with the atomic builtins.
+     * These compile to LDREX/STREX, so no interrupts are disabled.
+     */
+    tune_config_copy_st copies[TUNE_CONFIG_COPIES];
+    tune_config_copy_st * staging;
+    tune_config_copy_st const * live;
+    tune_config_copy_st * spares[TUNE_CONFIG_COPIES - 2];
+    tune_config_copy_st * pending;
+    tune_config_copy_st * retired[TUNE_CONFIG_COPIES - 2];
+    volatile bool cycle_publishing;
+    volatile uint32_t generation;
+    tune_engine_page_st startup_engine;
+
+    config_store_st store;
+    bool store_enabled;
+    tune_config_st stored_config; /* Used by the store. */
+    bool loaded; /* False if the defaults were used. */
+    bool save_pending;
+} tune_config_context_st;
+
+static tune_config_context_st tune_config_context;
+
+static tune_page_desc_st const tune_pages[tune_page_count] =
+{
+    [tune_page_fuel] = { offsetof(tune_config_copy_st, config.fuel), sizeof(tune_fuel_page_st) },
+    [tune_page_injector] = { offsetof(tune_config_copy_st, config.injector), sizeof(tune_injector_page_st) },
+    [tune_page_ignition] = { offsetof(tune_config_copy_st, config.ignition), sizeof(tune_ignition_page_st) },
+    [tune_page_engine] = { offsetof(tune_config_copy_st, config.engine), sizeof(tune_engine_page_st) }
+};
+
+/* Used until a configuration is loaded from storage. */
+static tune_config_st const tune_config_defaults =
+{
+    .fuel =
+    {
+        .ve_table_rpm_bins = { 500, 1000, 2000, 3000, 4000, 5000, 6000, 7000 },
+        .ve_table_map_bins = { 20, 30, 40, 50, 60, 70, 85, 100 },
+        .warmup_enrichment_clt_bins = { -20, 0, 20, 40, 60, 80 },
+        .ve_table =
+        {
+            { 3500, 3800, 4200, 4500, 4500, 4300, 4000, 3800 },
+            { 4000, 4400, 4800, 5100, 5100, 4900, 4600, 4300 },
+            { 4500, 5000, 5500, 5800, 5800, 5600, 5200, 4800 },
+            { 5000, 5500, 6100, 6500, 6500, 6300, 5800, 5400 },
+            { 5500, 6000, 6700, 7200, 7200, 6900, 6400, 5900 },
+            { 5800, 6400, 7200, 7800, 7800, 7500, 7000, 6400 },
+            { 6000, 6700, 7700, 8400, 8500, 8200, 7600, 7000 },
+            { 6200, 7000, 8000, 8800, 9000, 8700, 8100, 7500 }
+        },
+        .afr_target_table =
+        {
+            { 1470, 1470, 1470, 1470, 1470, 1470, 1470, 1470 },
+            { 1470, 1470, 1470, 1470, 1470, 1470, 1470, 1470 },
+            { 1470, 1470, 1470, 1470, 1470, 1470, 1470, 1470 },
+            { 1470, 1470, 1470, 1470, 1470, 1470, 1470, 1470 },
+            { 1420, 1420, 1420, 1420, 1420, 1400, 1400, 1400 },
+            { 1350, 1350, 1350, 1350, 1320, 1300, 1300, 1300 },
+            { 1300, 1300, 1280, 1280, 1260, 1250, 1250, 1250 },
+            { 1280, 1280, 1250, 1250, 1230, 1220, 1220, 1220 }
+        },
+        .warmup_enrichment_table = { 1600, 1400, 1250, 1120, 1040, 1000 },
+        .wall_film_rpm_bins = { 500, 1000, 2000, 3000, 4000, 5000, 6000, 7000 },
+        .wall_film_clt_bins = { -20, 0, 20, 40, 60, 80 },
+        .wall_film_evaporation_time_table = { 800, 500, 350, 250, 180, 150 },
+        .wall_film_deposit_fraction_table = { 16384, 13107, 9830, 7864, 6554, 5898 },
+        .engine_displacement_cc = 2000,
+        .stoichiometric_afr = 1470
+    },
+    .injector =
+    {
+        .dead_time_voltage_bins = { 80, 100, 110, 120, 130, 140, 150, 160 },
+        .small_pulse_width_bins = { 0, 250, 500, 750, 1000, 1250, 1500, 2000 },
+        .dead_time_table = { 1500, 1050, 900, 780, 680, 600, 540, 490 },
+        /* Accounts for the non-linear flow of the injector while it
+         * is still opening.
+         */
+        .small_pulse_correction_table = { 0, 120, 90, 60, 35, 15, 5, 0 },
+        .injector_flow_cc_per_minute = 240
+    },
+    .ignition =
+    {
+        .advance_table_rpm_bins = { 500, 1000, 2000, 3000, 4000, 5000, 6000, 7000 },
+        .advance_table_load_bins = { 20, 30, 40, 50, 60, 70, 85, 100 },
+        .dwell_table_voltage_bins = { 80, 100, 120, 130, 140, 160 },
+        .advance_table =
+        {
+            { 100, 150, 280, 350, 380, 400, 400, 400 },
+            { 100, 150, 270, 340, 370, 390, 390, 390 },
+            { 100, 140, 250, 320, 350, 370, 370, 370 },
+            { 100, 130, 230, 300, 330, 350, 350, 350 },
+            { 100, 120, 210, 270, 300, 320, 320, 320 },
+            { 100, 110, 190, 250, 280, 300, 300, 300 },
+            { 100, 100, 170, 220, 250, 270, 270, 270 },
+            { 100, 100, 150, 200, 230, 250, 250, 250 }
+        },
+        .dwell_table = { 6000, 4500, 3500, 3200, 3000, 2600 }
+    },
+    .engine =
+    {
+        .tooth_1_crank_angle = 0,
+        .injector_close_angle = -500,
+        .rpm_smoothing_factor = 980,
+        .num_cylinders = 4
+    }
+};
+
+static bool axis_valid(int32_t const * const bins, size_t const num_bins)
+{
+    size_t index;
+    bool valid = true;
+
+    for (index = 1; index < num_bins; index++)
+    {
+        int64_t const spacing = (int64_t)bins[index] - bins[index - 1];
+
+        if (spacing <= 0 || spacing > MAXIMUM_AXIS_BIN_SPACING)
+        {
+            valid = false;
+            break;
+        }
+    }
+
+    return valid;
+}
+
+static bool fuel_page_valid(tune_fuel_page_st const * const fuel)
+{
+    size_t index;
+    /* The wall film time per engine cycle is worked out from the
+     * RPM bins.
+     */
+    bool valid = fuel->wall_film_rpm_bins[0] > 0
+                 && fuel->engine_displacement_cc > 0
+                 && fuel->stoichiometric_afr > 0;
+
+    for (index = 0; index < WALL_FILM_CLT_BINS; index++)
+    {
+        if (fuel->wall_film_evaporation_time_table[index] <= 0
+            || fuel->wall_film_deposit_fraction_table[index] < 0)
+        {
+            valid = false;
+            break;
+        }
+    }
+
+    return valid;
+}
+
+static bool engine_page_valid(tune_engine_page_st const * const engine)
+{
+    return engine->tooth_1_crank_angle >= -MAXIMUM_TOOTH_1_CRANK_ANGLE
+        && engine->tooth_1_crank_angle <= MAXIMUM_TOOTH_1_CRANK_ANGLE
+        && engine->injector_close_angle >= -MAXIMUM_INJECTOR_CLOSE_ANGLE
+        && engine->injector_close_angle <= MAXIMUM_INJECTOR_CLOSE_ANGLE
+        && engine->rpm_smoothing_factor > 0
+        && engine->rpm_smoothing_factor <= MAXIMUM_RPM_SMOOTHING_FACTOR
+        && engine->num_cylinders > 0
+        && engine->num_cylinders <= TUNE_MAXIMUM_CYLINDERS
+        && engine->cam_phase <= 1;
+}
+
+static bool tune_config_valid(tune_config_st const * const config)
+{
+    return engine_page_valid(&config->engine)
+        && fuel_page_valid(&config->fuel)
+        && config->injector.injector_flow_cc_per_minute > 0
+        && axis_valid(config->fuel.ve_table_rpm_bins, VE_TABLE_RPM_BINS)
+        && axis_valid(config->fuel.ve_table_map_bins, VE_TABLE_MAP_BINS)
+        && axis_valid(config->fuel.warmup_enrichment_clt_bins, WARMUP_TABLE_BINS)
+        && axis_valid(config->fuel.wall_film_rpm_bins, WALL_FILM_RPM_BINS)
+        && axis_valid(config->fuel.wall_film_clt_bins, WALL_FILM_CLT_BINS)
+        && axis_valid(config->injector.dead_time_voltage_bins, DEAD_TIME_TABLE_BINS)
+        && axis_valid(config->injector.small_pulse_width_bins, SMALL_PULSE_TABLE_BINS)
+        && axis_valid(config->ignition.advance_table_rpm_bins, ADVANCE_TABLE_RPM_BINS)
+        && axis_valid(config->ignition.advance_table_load_bins, ADVANCE_TABLE_LOAD_BINS)
+        && axis_valid(config->ignition.dwell_table_voltage_bins, DWELL_TABLE_BINS);
+}
+
+static void tune_derived_calculate(tune_derived_st * const derived, tune_config_st const * const config)
+{
+    derived->rpm_smoothing_factor = config->engine.rpm_smoothing_factor / 1000.0f;
+}
+
+static tune_config_copy_st const * live_copy_get(void)
+{
+    return __atomic_load_n(&tune_config_context.live, __ATOMIC_ACQUIRE);
+}
+
+/* Called from either the event path or the writer. Only one of
+ * them can take the pending copy.
+ */
+static bool pending_publish(void)
+{
+    tune_config_context_st * const context = &tune_config_context;
+    tune_config_copy_st * const copy = __atomic_exchange_n(&context->pending, NULL, __ATOMIC_ACQ_REL);
+    tune_config_copy_st * previous_copy;
+    size_t index;
+
+    if (copy == NULL)
+    {
+        goto done;
+    }
+
+    previous_copy = (tune_config_copy_st *)context->live;
+    /* A single pointer write. */
+    __atomic_store_n(&context->live, copy, __ATOMIC_RELEASE);
+    context->generation++;
+
+    /* There is always a free slot, as there is one for every copy
+     * that isn't staging or live.
+     */
+    for (index = 0; previous_copy != NULL; index++)
+    {
+        tune_config_copy_st * expected = NULL;
+
+        if (__atomic_compare_exchange_n(&context->retired[index], &expected, previous_copy,
+                                        false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            previous_copy = NULL;
+        }
+    }
+
+done:
+    return copy != NULL;
+}
+
+static void spare_put(tune_config_copy_st * const copy)
+{
+    tune_config_context_st * const context = &tune_config_context;
+    size_t index;
+
+    for (index = 0; index < ARRAY_SIZE(context->spares); index++)
+    {
+        if (context->spares[index] == NULL)
+        {
+            context->spares[index] = copy;
+            break;
+        }
+    }
+}
+
+static tune_config_copy_st * spare_get(void)
+{
+    tune_config_context_st * const context = &tune_config_context;
+    tune_config_copy_st * copy = NULL;
+    size_t index;
+
+    for (index = 0; index < ARRAY_SIZE(context->spares) && copy == NULL; index++)
+    {
+        copy = context->spares[index];
+        context->spares[index] = NULL;
+    }
+
+    return copy;
+}
+
+void tune_config_init(config_flash_st const * const flash)
+{
+    tune_config_context_st * const context = &tune_config_context;
+    tune_config_st const * initial_config = &tune_config_defaults;
+    size_t index;
+
+    context->store_enabled = flash != NULL;
+    context->loaded = false;
+    if (context->store_enabled
+        && config_store_load(&context->store,
+                             flash,
+                             (uint8_t *)&context->stored_config,
+                             sizeof context->stored_config,
+                             TUNE_CONFIG_LAYOUT_VERSION)
+        && tune_config_valid(&context->stored_config))
+    {
+        initial_config = &context->stored_config;
+        context->loaded = true;
+    }
+    /* The defaults aren't saved until something is burnt. */
+    context->save_pending = false;
+
+    for (index = 0; index < ARRAY_SIZE(context->copies); index++)
+    {
+        context->copies[index].config = *initial_config;
+        tune_derived_calculate(&context->copies[index].derived, initial_config);
+    }
+    context->live = &context->copies[0];
+    context->staging = &context->copies[1];
+    for (index = 0; index < ARRAY_SIZE(context->spares); index++)
+    {
+        context->spares[index] = &context->copies[index + 2];
+        context->retired[index] = NULL;
+    }
+    context->pending = NULL;
+    context->cycle_publishing = false;
+    context->generation = 0;
+    context->startup_engine = initial_config->engine;
+}
+
+tune_config_st const * tune_config_get(void)
+{
+    return &live_copy_get()->config;
+}
+
+tune_derived_st const * tune_config_derived_get(void)
+{
+    return &live_copy_get()->derived;
+}
+
+uint32_t tune_config_generation_get(void)
+{
+    return tune_config_context.generation;
+}
+
+tune_engine_page_st const * tune_config_engine_get(void)
+{
+    return &tune_config_context.startup_engine;
+}
+
+size_t tune_config_page_size(unsigned int const page)
+{
+    return (page < ARRAY_SIZE(tune_pages)) ? tune_pages[page].size : 0;
+}
+
+void const * tune_config_page_get(unsigned int const page)
+{
+    void const * page_data = NULL;
+
+    if (page < ARRAY_SIZE(tune_pages))
+    {
+        page_data = (uint8_t const *)live_copy_get() + tune_pages[page].offset;
+    }
+
+    return page_data;
+}
+
+bool tune_config_page_write(unsigned int const page,
+                            size_t const offset,
+                            void const * const data,
+                            size_t const len)
+{
+    tune_config_context_st * const context = &tune_config_context;
+    bool written = false;
+
+    if (page >= ARRAY_SIZE(tune_pages)
+        || offset > tune_pages[page].size
+        || len > tune_pages[page].size - offset)
+    {
+        goto done;
+    }
+
+    memcpy((uint8_t *)context->staging + tune_pages[page].offset + offset, data, len);
+    written = true;
+
+done:
+    return written;
+}
+
+bool tune_config_burn(void)
+{
+    tune_config_context_st * const context = &tune_config_context;
+    tune_config_copy_st * copy = NULL;
+    tune_config_copy_st * replaced_copy;
+    bool burnt = false;
+
+    if (!tune_config_valid(&context->staging->config))
+    {
+        goto done;
+    }
+
+    copy = spare_get();
+    if (copy == NULL)
+    {
+        /* The last two burns were both made live since the last
+         * retire.
+         */
+        goto done;
+    }
+    copy->config = context->staging->config;
+    tune_derived_calculate(&copy->derived, &copy->config);
+
+    replaced_copy = __atomic_exchange_n(&context->pending, copy, __ATOMIC_ACQ_REL);
+    if (replaced_copy != NULL)
+    {
+        /* Never made live, so nothing has seen it. */
+        spare_put(replaced_copy);
+    }
+    burnt = true;
+
+    /* If the engine stops now, the pending copy is made live when
+     * cycle publishing is turned off, so it can't be left behind.
+     * If it syncs now, this may make the copy live part way through
+     * the first cycle, which is no worse than syncing a little
+     * later.
+     */
+    if (!context->cycle_publishing)
+    {
+        pending_publish();
+    }
+
+done:
+    return burnt;
+}
+
+bool tune_config_publish_pending(void)
+{
+    return __atomic_load_n(&tune_config_context.pending, __ATOMIC_RELAXED) != NULL;
+}
+
+bool tune_config_cycle_start(void)
+{
+    return pending_publish();
+}
+
+void tune_config_cycle_publishing_set(bool const enabled)
+{
+    tune_config_context_st * const context = &tune_config_context;
+
+    context->cycle_publishing = enabled;
+    if (!enabled)
+    {
+        pending_publish();
+    }
+}
+
+void tune_config_retire(void)
+{
+    tune_config_context_st * const context = &tune_config_context;
+    bool retired = false;
+    size_t index;
+
+    for (index = 0; index < ARRAY_SIZE(context->retired); index++)
+    {
+        tune_config_copy_st * const copy = __atomic_exchange_n(&context->retired[index], NULL, __ATOMIC_ACQ_REL);
+
+        if (copy != NULL)
+        {
+            spare_put(copy);
+            retired = true;
+        }
+    }
+
+    if (retired)
+    {
+        context->save_pending = true;
+    }
+}
+
+bool tune_config_save_pending(void)
+{
+    return tune_config_context.save_pending;
+}
+
+bool tune_config_save(bool const allow_erase)
+{
+    tune_config_context_st * const context = &tune_config_context;
+
+    if (context->save_pending
+        && context->store_enabled
+        && config_store_save(&context->store, &live_copy_get()->config, allow_erase))
+    {
+        context->save_pending = false;
+    }
+
+    return !context->save_pending;
+}
+
+void print_tune_config_debug(void)
+{
+    tune_config_context_st * const context = &tune_config_context;
+    config_store_st const * const store = &context->store;
+
+    printf("config %s generation %"PRIu32" publish pending %u save pending %u\r\n",
+           context->loaded ? "loaded" : "defaults",
+           context->generation,
+           tune_config_publish_pending(),
+           context->save_pending);
+    if (context->store_enabled)
+    {
+        printf("sector %u sequence %"PRIu32" journal end %u%s\r\n",
+               store->active_sector,
+               store->sequence,
+               (unsigned int)store->journal_end,
+               store->journal_damaged ? " damaged" : "");
+        printf("records %"PRIu32" rotations %"PRIu32" erases %"PRIu32"\r\n",
+               store->journal_records,
+               store->rotations,
+               store->erases);
+    }
+}
@@ -0,0 +1,206 @@
+#ifndef __TUNE_CONFIG_H__
+#define __TUNE_CONFIG_H__
+
+#include "config_store.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* The tunable tables, grouped into pages that the tuning protocol
+ * (tune_protocol.h) reads and writes as raw memory.
+ *
+ * Writes from the tuning server go into a staging copy. A burn
+ * copies the staging copy into a spare copy, along with the data
+ * derived from it (tune_derived_st), and leaves it pending. The
+ * pending copy is made live with a single pointer write at the
+ * start of the next engine cycle, so the tables never change part
+ * way through a cycle. While the engine isn't turning it is made
+ * live straight away.
+ * Readers fetch the live pointer once per calculation or engine
+ * event and never hold on to it across a blocking call. The
+ * writer (the tuning server) runs in the lowest priority task, so
+ * by the time it runs again nothing can still be using the copy
+ * that was replaced, and tune_config_retire() takes it back as
+ * the next spare. Nothing is ever written to a copy that is live.
+ * The configuration is kept in flash (config_store.h). It is
+ * loaded at startup, and a burn made live is saved once the engine
+ * has stopped.
+ */
+
+/* Increment whenever the layout of tune_config_st changes. A
+ * saved configuration with a different layout is ignored.
+ */
+#define TUNE_CONFIG_LAYOUT_VERSION 2
+
+#define TUNE_MAXIMUM_CYLINDERS 8 /* MAX_INJECTORS and MAX_IGNITIONS. */
+
+#define VE_TABLE_RPM_BINS 8
+#define VE_TABLE_MAP_BINS 8
+#define WARMUP_TABLE_BINS 6
+#define WALL_FILM_RPM_BINS 8
+#define WALL_FILM_CLT_BINS 6
+#define DEAD_TIME_TABLE_BINS 8
+#define SMALL_PULSE_TABLE_BINS 8
+#define ADVANCE_TABLE_RPM_BINS 8
+#define ADVANCE_TABLE_LOAD_BINS 8
+#define DWELL_TABLE_BINS 6
+
+/* Page layouts are sent over the wire as they are in memory
+ * (little endian), so the int32_t arrays come first to avoid
+ * padding. Fields may only be added to the end of a page.
+ */
+typedef struct tune_fuel_page_st
+{
+    int32_t ve_table_rpm_bins[VE_TABLE_RPM_BINS];
+    int32_t ve_table_map_bins[VE_TABLE_MAP_BINS];
+    int32_t warmup_enrichment_clt_bins[WARMUP_TABLE_BINS];
+    int16_t ve_table[VE_TABLE_MAP_BINS][VE_TABLE_RPM_BINS]; /* 0.01% indexed [map][rpm]. */
+    int16_t afr_target_table[VE_TABLE_MAP_BINS][VE_TABLE_RPM_BINS]; /* 0.01 AFR indexed [map][rpm]. */
+    int16_t warmup_enrichment_table[WARMUP_TABLE_BINS]; /* 0.1% */
+    int32_t wall_film_rpm_bins[WALL_FILM_RPM_BINS];
+    int32_t wall_film_clt_bins[WALL_FILM_CLT_BINS];
+    int16_t wall_film_evaporation_time_table[WALL_FILM_CLT_BINS]; /* ms */
+    int16_t wall_film_deposit_fraction_table[WALL_FILM_CLT_BINS]; /* Q15 */
+    uint16_t engine_displacement_cc;
+    int16_t stoichiometric_afr; /* 0.01 AFR */
+} tune_fuel_page_st;
+
+typedef struct tune_injector_page_st
+{
+    int32_t dead_time_voltage_bins[DEAD_TIME_TABLE_BINS]; /* 0.1V */
+    int32_t small_pulse_width_bins[SMALL_PULSE_TABLE_BINS]; /* us */
+    int16_t dead_time_table[DEAD_TIME_TABLE_BINS]; /* us */
+    int16_t small_pulse_correction_table[SMALL_PULSE_TABLE_BINS]; /* us */
+    int32_t injector_flow_cc_per_minute;
+} tune_injector_page_st;
+
+typedef struct tune_ignition_page_st
+{
+    int32_t advance_table_rpm_bins[ADVANCE_TABLE_RPM_BINS];
+    int32_t advance_table_load_bins[ADVANCE_TABLE_LOAD_BINS]; /* kPa */
+    int32_t dwell_table_voltage_bins[DWELL_TABLE_BINS]; /* 0.1V */
+    int16_t advance_table[ADVANCE_TABLE_LOAD_BINS][ADVANCE_TABLE_RPM_BINS]; /* 0.1 degrees BTDC indexed [load][rpm]. */
+    int16_t dwell_table[DWELL_TABLE_BINS]; /* us */
+} tune_ignition_page_st;
+
+/* Only read at startup, and changes take effect after a restart,
+ * except for rpm_smoothing_factor, which is used through
+ * tune_derived_st, and tooth_1_crank_angle and cam_phase, which the
+ * trigger decoder picks up while the engine is turning.
+ */
+typedef struct tune_engine_page_st
+{
+    int32_t tooth_1_crank_angle; /* 0.1 degrees. -ve indicates BTDC, +ve indicates ATDC. */
+    int32_t injector_close_angle; /* 0.1 degrees of the engine cycle. */
+    uint16_t rpm_smoothing_factor; /* 0.1% */
+    uint8_t num_cylinders;
+    uint8_t cam_phase; /* 0 or 1. 1 adds 360 degrees to the engine cycle angle of every tooth. */
+} tune_engine_page_st;
+
+typedef struct tune_config_st
+{
+    tune_fuel_page_st fuel;
+    tune_injector_page_st injector;
+    tune_ignition_page_st ignition;
+    tune_engine_page_st engine;
+} tune_config_st;
+
+/* Calculated from the configuration by the writer before it is
+ * made live, so that the event path doesn't have to.
+ */
+typedef struct tune_derived_st
+{
+    float rpm_smoothing_factor; /* 0.0 - 1.0 */
+} tune_derived_st;
+
+typedef enum tune_page_t
+{
+    tune_page_fuel,
+    tune_page_injector,
+    tune_page_ignition,
+    tune_page_engine,
+    tune_page_count
+} tune_page_t;
+
+/* Loads the configuration from flash, or uses the defaults if
+ * there isn't a valid one there. flash may be NULL, in which case
+ * the defaults are used and nothing is saved.
+ */
+void tune_config_init(config_flash_st const * const flash);
+
+/* The live configuration. Fetch it once per calculation. */
+tune_config_st const * tune_config_get(void);
+
+/* The data derived from the live configuration. Fetch it once per
+ * event.
+ */
+tune_derived_st const * tune_config_derived_get(void);
+
+/* Incremented every time a burn is made live. */
+uint32_t tune_config_generation_get(void);
+
+/* The engine page as it was at startup. */
+tune_engine_page_st const * tune_config_engine_get(void);
+
+/* Returns 0 if page is not a valid page. */
+size_t tune_config_page_size(unsigned int const page);
+
+/* Returns the live copy of the page, or NULL if page is not a
+ * valid page.
+ */
+void const * tune_config_page_get(unsigned int const page);
+
+/* Copies data into the staging copy of the page. Fails if the
+ * data doesn't fit in the page.
+ */
+bool tune_config_page_write(unsigned int const page,
+                            size_t const offset,
+                            void const * const data,
+                            size_t const len);
+
+/* Checks the staging copy and, if it is valid, leaves a copy of
+ * it pending, replacing any earlier burn that is still pending.
+ * Fails if any of the table axes are not in ascending order or a
+ * setting is out of range, or if the copies replaced by
+ * the last two burns haven't been retired yet. The staging copy
+ * is unchanged either way.
+ */
+bool tune_config_burn(void);
+
+/* True if a burn is waiting for the start of an engine cycle. */
+bool tune_config_publish_pending(void);
+
+/* Called on the event path at the start of each engine cycle.
+ * Makes any pending burn live. Returns true if it did.
+ */
+bool tune_config_cycle_start(void);
+
+/* Tells the configuration whether tune_config_cycle_start() is
+ * being called, i.e. whether the engine is turning. While it
+ * isn't, burns are made live straight away. A burn still pending
+ * when the calls stop is made live then.
+ */
+void tune_config_cycle_publishing_set(bool const enabled);
+
+/* Called by the writer. Takes back the copy replaced by the last
+ * burn to be made live, and marks the new live copy to be saved.
+ * Must not be called while anything could still be using the
+ * replaced copy (see above).
+ */
+void tune_config_retire(void);
+
+bool tune_config_save_pending(void);
+
+/* Saves the live copy if it hasn't been saved yet. Each word
+ * written stalls every fetch from flash, ISRs included, for tens of
+ * microseconds, so this must only be called while the engine is
+ * stopped. If allow_erase is set the save can't fail for lack of
+ * erased flash, but it may stall the CPU for seconds. Returns false
+ * if the live copy still hasn't been saved.
+ */
+bool tune_config_save(bool const allow_erase);
+
+void print_tune_config_debug(void);
+
+#endif /* __TUNE_CONFIG_H__ */
@@ -0,0 +1,73 @@
+#ifndef __TUNE_PROTOCOL_H__
+#define __TUNE_PROTOCOL_H__
+
+/* Binary tuning protocol. Shared by the target (serial/tune_server.c)
+ * and the host client (tools/tune_client.c). Requests share the
+ * serial port with the CLI. The sync bytes are never typed, so
+ * the server can pick requests out of the CLI input.
+ *
+ * request:
+ *   sync         2 bytes  TUNE_REQUEST_SYNC_0, TUNE_REQUEST_SYNC_1
+ *   command      1 byte   tune_command_t
+ *   page         1 byte
+ *   offset       2 bytes  byte offset within the page
+ *   length       2 bytes  read: bytes wanted, write: bytes of data
+ *   data         length bytes, write requests only
+ *   crc          2 bytes  crc16_ccitt over command..data
+ *
+ * response:
+ *   sync         2 bytes  TUNE_RESPONSE_SYNC_0, TUNE_RESPONSE_SYNC_1
+ *   command      1 byte   as in the request
+ *   status       1 byte   tune_status_t
+ *   length       2 bytes  number of data bytes
+ *   data         length bytes
+ *   crc          2 bytes  crc16_ccitt over command..data
+ * All multi-byte values are little endian. Page data is sent as
+ * laid out in memory (see tune_config.h).
+ * While the engine is turning, a burn is made live at the start of
+ * the next engine cycle, so the generation and saved flag in the
+ * burn response may not include it yet. Page info has the latest
+ * generation.
+ */
+
+#include <stdint.h>
+
+#define TUNE_REQUEST_SYNC_0 0xa5
+#define TUNE_REQUEST_SYNC_1 0xc3
+#define TUNE_RESPONSE_SYNC_0 0xa5
+#define TUNE_RESPONSE_SYNC_1 0x3c
+
+#define TUNE_REQUEST_HEADER_SIZE 8
+#define TUNE_RESPONSE_HEADER_SIZE 6
+#define TUNE_CRC_SIZE 2
+
+/* Write requests are buffered whole before being checked, so
+ * their data is limited. Reads are streamed straight out of the
+ * live configuration and may cover a whole page.
+ */
+#define TUNE_MAXIMUM_WRITE_CHUNK_SIZE 128
+
+typedef enum tune_command_t
+{
+    tune_command_page_info = 'i',   /* data: u16 page size, u8 number of pages, u32 generation. */
+    tune_command_page_read = 'r',   /* data: the page data from offset. */
+    tune_command_chunk_write = 'w', /* Into the staging copy. No data. */
+    tune_command_burn = 'b',        /* Staging copy becomes live. data: u32 generation, u8 saved to flash. */
+    tune_command_page_crc = 'c',    /* data: u16 crc16_ccitt of the whole live page. */
+    tune_command_realtime = 'o'     /* data: one telemetry frame (telemetry_frame.h). */
+} tune_command_t;
+
+typedef enum tune_status_t
+{
+    tune_status_ok,
+    tune_status_bad_crc,
+    tune_status_bad_command,
+    tune_status_bad_page,
+    tune_status_bad_range,
+    tune_status_rejected
+} tune_status_t;
+
+#define TUNE_PAGE_INFO_SIZE 7
+#define TUNE_BURN_RESULT_SIZE 5
+
+#endif /* __TUNE_PROTOCOL_H__ */
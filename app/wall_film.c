@@ -0,0 +1,122 @@
+#include "wall_film.h"
+#include "maps.h"
+
+#include <math.h>
+
+#define WALL_FILM_Q15_ONE (1L << 15)
+#define WALL_FILM_GAIN_BITS 12
+#define MAXIMUM_DEPOSIT_FRACTION ((WALL_FILM_Q15_ONE * 3) / 4) /* Limits the compensation gain to 4. */
+#define MAXIMUM_RETAINED_FRACTION ((WALL_FILM_Q15_ONE * 95) / 100)
+
+#define DEGREES_PER_ENGINE_CYCLE 720.0
+#define RPM_TO_DEGREES_PER_SECOND_FACTOR 6.0
+
+typedef struct wall_film_tables_st
+{
+    /* beta = exp(-(time per engine cycle) / tau) is calculated 
+     * for each RPM and coolant temperature bin whenever the 
+     * configuration changes so that exp() isn't called on each 
+     * lookup. 
+     */
+    int16_t retained_fraction_table[WALL_FILM_CLT_BINS][WALL_FILM_RPM_BINS];
+
+    map_3d_st retained_fraction_map;
+    map_2d_st deposit_fraction_map;
+} wall_film_tables_st;
+
+static wall_film_tables_st wall_film_tables;
+
+static void retained_fraction_table_build(wall_film_tables_st * const tables, 
+                                          tune_fuel_page_st const * const fuel)
+{
+    size_t clt_index;
+    size_t rpm_index;
+
+    for (clt_index = 0; clt_index < WALL_FILM_CLT_BINS; clt_index++)
+    {
+        float const tau_seconds = fuel->wall_film_evaporation_time_table[clt_index] / 1000.0;
+
+        for (rpm_index = 0; rpm_index < WALL_FILM_RPM_BINS; rpm_index++)
+        {
+            float const cycle_seconds = DEGREES_PER_ENGINE_CYCLE
+                                        / (fuel->wall_film_rpm_bins[rpm_index] * RPM_TO_DEGREES_PER_SECOND_FACTOR);
+            int32_t retained_fraction = lrintf(expf(-cycle_seconds / tau_seconds) * WALL_FILM_Q15_ONE);
+
+            if (retained_fraction > MAXIMUM_RETAINED_FRACTION)
+            {
+                retained_fraction = MAXIMUM_RETAINED_FRACTION;
+            }
+            tables->retained_fraction_table[clt_index][rpm_index] = retained_fraction;
+        }
+    }
+}
+
+void wall_film_init(tune_fuel_page_st const * const fuel)
+{
+    wall_film_tables_st * const tables = &wall_film_tables;
+
+    retained_fraction_table_build(tables, fuel);
+
+    map_3d_init(&tables->retained_fraction_map,
+                fuel->wall_film_rpm_bins, WALL_FILM_RPM_BINS,
+                fuel->wall_film_clt_bins, WALL_FILM_CLT_BINS,
+                &tables->retained_fraction_table[0][0]);
+    map_2d_init(&tables->deposit_fraction_map,
+                fuel->wall_film_clt_bins, WALL_FILM_CLT_BINS,
+                fuel->wall_film_deposit_fraction_table);
+}
+
+void wall_film_reset(wall_film_st * const wall_film)
+{
+    wall_film->film_us = 0;
+    wall_film->pending_injection_us = 0;
+}
+
+void wall_film_coefficients_get(wall_film_coefficients_st * const coefficients,
+                                int32_t const rpm,
+                                int32_t const coolant_temperature)
+{
+    wall_film_tables_st * const tables = &wall_film_tables;
+    int32_t deposit_fraction = map_2d_lookup(&tables->deposit_fraction_map, coolant_temperature);
+
+    if (deposit_fraction > MAXIMUM_DEPOSIT_FRACTION)
+    {
+        deposit_fraction = MAXIMUM_DEPOSIT_FRACTION;
+    }
+    else if (deposit_fraction < 0)
+    {
+        deposit_fraction = 0;
+    }
+
+    coefficients->deposit_fraction = deposit_fraction;
+    coefficients->retained_fraction = map_3d_lookup(&tables->retained_fraction_map, rpm, coolant_temperature);
+    coefficients->compensation_gain = (WALL_FILM_Q15_ONE << WALL_FILM_GAIN_BITS) / (WALL_FILM_Q15_ONE - deposit_fraction);
+}
+
+uint32_t wall_film_compensate(wall_film_st * const wall_film,
+                              wall_film_coefficients_st const * const coefficients,
+                              uint32_t const desired_us)
+{
+    /* Fuel drawn off the walls this cycle. */
+    int32_t const evaporated_us = ((int64_t)(WALL_FILM_Q15_ONE - coefficients->retained_fraction) * wall_film->film_us) >> 15;
+    /* Of what gets injected, only (1 - X) reaches the cylinder 
+     * directly. 
+     */
+    int32_t injection_us = ((int64_t)((int32_t)desired_us - evaporated_us) * coefficients->compensation_gain) >> WALL_FILM_GAIN_BITS;
+
+    if (injection_us < 0)
+    {
+        /* There is more fuel coming off the walls than required. */
+        injection_us = 0;
+    }
+    wall_film->pending_injection_us = injection_us;
+
+    return injection_us;
+}
+
+void wall_film_injection_scheduled(wall_film_st * const wall_film,
+                                   wall_film_coefficients_st const * const coefficients)
+{
+    wall_film->film_us = (((int64_t)coefficients->retained_fraction * wall_film->film_us)
+                          + ((int64_t)coefficients->deposit_fraction * wall_film->pending_injection_us)) >> 15;
+}
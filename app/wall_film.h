@@ -0,0 +1,56 @@
+#ifndef __WALL_FILM_H__
+#define __WALL_FILM_H__
+
+#include "tune_config.h"
+
+#include <stdint.h>
+
+/* X-tau wall wetting model. 
+ * Each injection event, a fraction X of the injected fuel is 
+ * deposited on the intake port walls, and a fraction (1 - beta) 
+ * of the fuel already on the walls is drawn into the cylinder. 
+ * Fuel quantities are expressed as injector open time (us). 
+ */
+
+typedef struct wall_film_coefficients_st
+{
+    int32_t deposit_fraction; /* X, Q15. */
+    int32_t retained_fraction; /* beta, Q15. The fraction of the film remaining after one engine cycle. */
+    int32_t compensation_gain; /* 1 / (1 - X), Q12. */
+} wall_film_coefficients_st;
+
+typedef struct wall_film_st
+{
+    int32_t film_us;
+    int32_t pending_injection_us;
+} wall_film_st;
+
+/* Builds the tables from the wall film fields of the fuel page. 
+ * Called from the background fuel calculation whenever the 
+ * configuration changes. The bins are used where they are, so the 
+ * page must stay valid until the next call. 
+ */
+void wall_film_init(tune_fuel_page_st const * const fuel);
+
+void wall_film_reset(wall_film_st * const wall_film);
+
+/* Called from the background fuel calculation. */
+void wall_film_coefficients_get(wall_film_coefficients_st * const coefficients,
+                                int32_t const rpm,
+                                int32_t const coolant_temperature);
+
+/* Returns the injector open time required to get the desired 
+ * quantity of fuel into the cylinder, given the current state 
+ * of the wall film. 
+ */
+uint32_t wall_film_compensate(wall_film_st * const wall_film,
+                              wall_film_coefficients_st const * const coefficients,
+                              uint32_t const desired_us);
+
+/* Update the wall film once the injection returned by the last 
+ * call to wall_film_compensate() has been scheduled. 
+ */
+void wall_film_injection_scheduled(wall_film_st * const wall_film,
+                                   wall_film_coefficients_st const * const coefficients);
+
+#endif /* __WALL_FILM_H__ */
@@ -0,0 +1,75 @@
+/* Default sensor calibration. Select a different calibration 
+ * with 'make SENSOR_CALIBRATION=<file>'. 
+ */
+
+static sensor_calibration_st const sensor_calibrations[] =
+{
+    {
+        /* Linear 1 bar MAP sensor, 2:3 divider. */
+        SENSOR_INPUT(analog_input_map),
+        .type = sensor_type_polynomial,
+        .scale = 10.0,
+        .minimum = 0.0,
+        .maximum = 400.0,
+        .tolerance = 0.1,
+        .divider_ratio = 1.5,
+        .coefficients = { 10.0, 21.0 }
+    },
+    {
+        /* 0.5V closed, 4.5V open. 2:3 divider. */
+        SENSOR_INPUT(analog_input_tps),
+        .type = sensor_type_polynomial,
+        .scale = 10.0,
+        .minimum = 0.0,
+        .maximum = 100.0,
+        .tolerance = 0.25, /* Worst where the output is clamped. */
+        .divider_ratio = 1.5,
+        .coefficients = { -12.5, 25.0 }
+    },
+    {
+        /* GM coolant temperature sensor. */
+        SENSOR_INPUT(analog_input_clt),
+        .type = sensor_type_thermistor,
+        .scale = 10.0,
+        .minimum = -40.0,
+        .maximum = 150.0,
+        .tolerance = 1.5, /* Worst at the cold end, where the curve is steepest. */
+        .pullup_ohms = 2490.0,
+        .steinhart_hart = { 1.142e-3, 2.318e-4, 9.266e-8 }
+    },
+    {
+        /* GM intake air temperature sensor. */
+        SENSOR_INPUT(analog_input_iat),
+        .type = sensor_type_thermistor,
+        .scale = 10.0,
+        .minimum = -40.0,
+        .maximum = 150.0,
+        .tolerance = 1.5, /* Worst at the cold end, where the curve is steepest. */
+        .pullup_ohms = 2490.0,
+        .steinhart_hart = { 1.142e-3, 2.318e-4, 9.266e-8 }
+    },
+    {
+        /* Wideband controller output, 0V = 0.68 lambda, 
+         * 5V = 1.36 lambda. 2:3 divider. 
+         */
+        SENSOR_INPUT(analog_input_o2),
+        .type = sensor_type_polynomial,
+        .scale = 1000.0,
+        .minimum = 0.5,
+        .maximum = 1.6,
+        .tolerance = 0.002,
+        .divider_ratio = 1.5,
+        .coefficients = { 0.68, 0.136 }
+    },
+    {
+        /* 1:6 divider. */
+        SENSOR_INPUT(analog_input_battery),
+        .type = sensor_type_polynomial,
+        .scale = 100.0,
+        .minimum = 0.0,
+        .maximum = 25.0,
+        .tolerance = 0.02,
+        .divider_ratio = 6.0,
+        .coefficients = { 0.0, 1.0 }
+    }
+};
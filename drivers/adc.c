@@ -0,0 +1,513 @@
+#include "stm32f4_utils.h"
+#include "utils.h"
+#include "adc.h"
+#include "cpu_load.h"
+
+#include "stm32f4xx_adc.h"
+#include "stm32f4xx_dma.h"
+#include "stm32f4xx_gpio.h"
+#include "stm32f4xx_rcc.h"
+#include "stm32f4xx_tim.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ADC1 continuously scans the regular channels and DMA2 stream 
+ * 0 writes the results into a circular buffer. The only 
+ * interrupts are the DMA half and full transfer interrupts, each 
+ * of which hands a block of scans to the owner. 
+ * 
+ * ADC2 and ADC3 are used for bursts of conversions on a single 
+ * channel, written by DMA into a linear buffer. ADC2 
+ * conversions are triggered by TIM5. ADC3 converts continuously 
+ * with the longest sample time. No interrupts are used. 
+ */
+
+typedef struct adc_pin_config_st
+{
+    uint32_t        RCC_AHBPeriph;
+    GPIO_TypeDef    *port;
+    uint_fast16_t   pin;
+} adc_pin_config_st;
+
+typedef struct adc_config_st
+{
+    ADC_TypeDef             *adc;
+    uint32_t                RCC_APB2Periph;
+
+    DMA_Stream_TypeDef      *dma_stream;
+    uint32_t                dma_channel;
+    uint32_t                RCC_AHBPeriph_DMA;
+    uint32_t                dma_half_transfer_flag;
+    uint32_t                dma_transfer_complete_flag;
+    uint_fast8_t            irq;
+} adc_config_st;
+
+typedef enum adc_burst_idx_t {
+    ADC2_BURST_IDX,
+    ADC3_BURST_IDX,
+    MAX_ADC_BURSTS
+} adc_burst_idx_t;
+
+typedef struct adc_burst_config_st
+{
+    ADC_BURST_TRIGGER_T     trigger;
+    ADC_TypeDef             *adc;
+    uint32_t                RCC_APB2Periph;
+    uint32_t                adc_trigger;    /* adc_burst_trigger_timer only */
+    uint8_t                 sample_time;
+    uint32_t                sample_cycles;  /* Sample time + conversion time in ADC clocks */
+
+    TIM_TypeDef             *tim;           /* adc_burst_trigger_timer only */
+    uint32_t                RCC_APB1Periph_TIM;
+
+    DMA_Stream_TypeDef      *dma_stream;
+    uint32_t                dma_channel;
+    uint32_t                RCC_AHBPeriph_DMA;
+    uint32_t                dma_flags;
+} adc_burst_config_st;
+
+typedef struct adc_burst_ctx_st
+{
+    bool                    in_use;
+    uint32_t                sample_rate_hz;
+    size_t                  max_samples;
+} adc_burst_ctx_st;
+
+typedef struct adc_ctx_st
+{
+    adc_cb_st               callback;
+    uint16_t const          *sample_buffer;
+    size_t                  scans_per_block;
+    size_t                  samples_per_block;
+} adc_ctx_st;
+
+/* ADC123_IN0 - ADC123_IN15 */
+static const adc_pin_config_st adc_pin_configs[] =
+{
+    [0] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOA, .port = GPIOA, .pin = GPIO_Pin_0 },
+    [1] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOA, .port = GPIOA, .pin = GPIO_Pin_1 },
+    [2] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOA, .port = GPIOA, .pin = GPIO_Pin_2 },
+    [3] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOA, .port = GPIOA, .pin = GPIO_Pin_3 },
+    [4] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOA, .port = GPIOA, .pin = GPIO_Pin_4 },
+    [5] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOA, .port = GPIOA, .pin = GPIO_Pin_5 },
+    [6] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOA, .port = GPIOA, .pin = GPIO_Pin_6 },
+    [7] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOA, .port = GPIOA, .pin = GPIO_Pin_7 },
+    [8] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOB, .port = GPIOB, .pin = GPIO_Pin_0 },
+    [9] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOB, .port = GPIOB, .pin = GPIO_Pin_1 },
+    [10] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOC, .port = GPIOC, .pin = GPIO_Pin_0 },
+    [11] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOC, .port = GPIOC, .pin = GPIO_Pin_1 },
+    [12] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOC, .port = GPIOC, .pin = GPIO_Pin_2 },
+    [13] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOC, .port = GPIOC, .pin = GPIO_Pin_3 },
+    [14] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOC, .port = GPIOC, .pin = GPIO_Pin_4 },
+    [15] = { .RCC_AHBPeriph = RCC_AHB1Periph_GPIOC, .port = GPIOC, .pin = GPIO_Pin_5 },
+};
+
+static const adc_config_st adc_config =
+{
+    .adc = ADC1,
+    .RCC_APB2Periph = RCC_APB2Periph_ADC1,
+    .dma_stream = DMA2_Stream0,
+    .dma_channel = DMA_Channel_0,
+    .RCC_AHBPeriph_DMA = RCC_AHB1Periph_DMA2,
+    .dma_half_transfer_flag = DMA_IT_HTIF0,
+    .dma_transfer_complete_flag = DMA_IT_TCIF0,
+    .irq = DMA2_Stream0_IRQn
+};
+
+static const adc_burst_config_st adc_burst_configs[] =
+{
+    [ADC2_BURST_IDX] =
+    {
+        .trigger = adc_burst_trigger_timer,
+        .adc = ADC2,
+        .RCC_APB2Periph = RCC_APB2Periph_ADC2,
+        .adc_trigger = ADC_ExternalTrigConv_T5_CC1,
+        /* A shorter sample time than the scan, as the conversions 
+         * must be done well within one sample period. 
+         */
+        .sample_time = ADC_SampleTime_84Cycles,
+        .sample_cycles = 84 + 12,
+        .tim = TIM5,
+        .RCC_APB1Periph_TIM = RCC_APB1Periph_TIM5,
+        .dma_stream = DMA2_Stream2,
+        .dma_channel = DMA_Channel_1,
+        .RCC_AHBPeriph_DMA = RCC_AHB1Periph_DMA2,
+        .dma_flags = DMA_FLAG_FEIF2 | DMA_FLAG_DMEIF2 | DMA_FLAG_TEIF2 | DMA_FLAG_HTIF2 | DMA_FLAG_TCIF2
+    },
+    [ADC3_BURST_IDX] =
+    {
+        .trigger = adc_burst_trigger_continuous,
+        .adc = ADC3,
+        .RCC_APB2Periph = RCC_APB2Periph_ADC3,
+        /* 21MHz / (480 + 12) = ~42.7kHz */
+        .sample_time = ADC_SampleTime_480Cycles,
+        .sample_cycles = 480 + 12,
+        .dma_stream = DMA2_Stream1,
+        .dma_channel = DMA_Channel_2,
+        .RCC_AHBPeriph_DMA = RCC_AHB1Periph_DMA2,
+        .dma_flags = DMA_FLAG_FEIF1 | DMA_FLAG_DMEIF1 | DMA_FLAG_TEIF1 | DMA_FLAG_HTIF1 | DMA_FLAG_TCIF1
+    }
+};
+#define GET_ADC_BURST_IDX(ptr)	((ptr)-adc_burst_configs)
+
+/* The ADC clock prescaler set up in adcConfigure(). */
+#define ADC_CLOCK_PRESCALER 4
+
+static adc_ctx_st adc_ctx;
+static adc_burst_ctx_st adc_burst_ctxs[MAX_ADC_BURSTS];
+
+static void adcPinConfigure(adc_pin_config_st const * const pin_config)
+{
+    GPIO_InitTypeDef GPIO_InitStructure;
+
+    RCC_AHB1PeriphClockCmd(pin_config->RCC_AHBPeriph, ENABLE);
+
+    GPIO_StructInit(&GPIO_InitStructure);
+    GPIO_InitStructure.GPIO_Pin = pin_config->pin;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AN;
+    GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
+    GPIO_Init(pin_config->port, &GPIO_InitStructure);
+}
+
+static void adcDmaStructInit(DMA_InitTypeDef * const DMA_InitStructure, 
+                             ADC_TypeDef * const adc, 
+                             uint32_t const dma_channel)
+{
+    DMA_StructInit(DMA_InitStructure);
+    DMA_InitStructure->DMA_Channel = dma_channel;
+    DMA_InitStructure->DMA_PeripheralBaseAddr = (uint32_t)&adc->DR;
+    DMA_InitStructure->DMA_DIR = DMA_DIR_PeripheralToMemory;
+    DMA_InitStructure->DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure->DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure->DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStructure->DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure->DMA_Priority = DMA_Priority_High;
+    DMA_InitStructure->DMA_FIFOMode = DMA_FIFOMode_Disable;
+    DMA_InitStructure->DMA_FIFOThreshold = DMA_FIFOThreshold_HalfFull;
+    DMA_InitStructure->DMA_MemoryBurst = DMA_MemoryBurst_Single;
+    DMA_InitStructure->DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+}
+
+static void adcDmaConfigure(adc_config_st const * const config, 
+                            uint16_t * const sample_buffer, 
+                            size_t const num_samples)
+{
+    DMA_InitTypeDef DMA_InitStructure;
+
+    RCC_AHB1PeriphClockCmd(config->RCC_AHBPeriph_DMA, ENABLE);
+
+    DMA_DeInit(config->dma_stream);
+    adcDmaStructInit(&DMA_InitStructure, config->adc, config->dma_channel);
+    DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)sample_buffer;
+    DMA_InitStructure.DMA_BufferSize = num_samples;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+    DMA_Init(config->dma_stream, &DMA_InitStructure);
+
+    DMA_ITConfig(config->dma_stream, DMA_IT_HT | DMA_IT_TC, ENABLE);
+    DMA_Cmd(config->dma_stream, ENABLE);
+}
+
+static void adcConfigure(adc_config_st const * const config, 
+                         uint8_t const * const channels, 
+                         size_t const num_channels)
+{
+    ADC_CommonInitTypeDef ADC_CommonInitStructure;
+    ADC_InitTypeDef ADC_InitStructure;
+    size_t index;
+
+    RCC_APB2PeriphClockCmd(config->RCC_APB2Periph, ENABLE);
+
+    /* 84MHz PCLK2 / 4 = 21MHz ADC clock. */
+    ADC_CommonStructInit(&ADC_CommonInitStructure);
+    ADC_CommonInitStructure.ADC_Mode = ADC_Mode_Independent;
+    ADC_CommonInitStructure.ADC_Prescaler = ADC_Prescaler_Div4; /* ADC_CLOCK_PRESCALER */
+    ADC_CommonInitStructure.ADC_DMAAccessMode = ADC_DMAAccessMode_Disabled;
+    ADC_CommonInitStructure.ADC_TwoSamplingDelay = ADC_TwoSamplingDelay_5Cycles;
+    ADC_CommonInit(&ADC_CommonInitStructure);
+
+    ADC_StructInit(&ADC_InitStructure);
+    ADC_InitStructure.ADC_Resolution = ADC_Resolution_12b;
+    ADC_InitStructure.ADC_ScanConvMode = ENABLE;
+    ADC_InitStructure.ADC_ContinuousConvMode = ENABLE;
+    ADC_InitStructure.ADC_ExternalTrigConvEdge = ADC_ExternalTrigConvEdge_None;
+    ADC_InitStructure.ADC_DataAlign = ADC_DataAlign_Right;
+    ADC_InitStructure.ADC_NbrOfConversion = num_channels;
+    ADC_Init(config->adc, &ADC_InitStructure);
+
+    /* With the longest sample time each conversion takes 
+     * (480 + 12) / 21MHz = ~23.4us. This keeps the block rate down 
+     * and gives high impedance sources time to settle. 
+     */
+    for (index = 0; index < num_channels; index++)
+    {
+        ADC_RegularChannelConfig(config->adc, channels[index], index + 1, ADC_SampleTime_480Cycles);
+    }
+
+    ADC_DMARequestAfterLastTransferCmd(config->adc, ENABLE);
+    ADC_DMACmd(config->adc, ENABLE);
+    ADC_Cmd(config->adc, ENABLE);
+}
+
+void const * stm32_adc_scan_init(adc_init_st const *cfg)
+{
+    adc_config_st const * config = NULL;
+    size_t index;
+
+    if (cfg->num_channels == 0 || cfg->num_channels > 16 
+        || cfg->scans_per_block == 0 || cfg->sample_buffer == NULL)
+    {
+        goto done;
+    }
+
+    for (index = 0; index < cfg->num_channels; index++)
+    {
+        if (cfg->channels[index] >= ARRAY_SIZE(adc_pin_configs))
+        {
+            goto done;
+        }
+    }
+
+    config = &adc_config;
+
+    adc_ctx.callback = cfg->callback;
+    adc_ctx.sample_buffer = cfg->sample_buffer;
+    adc_ctx.scans_per_block = cfg->scans_per_block;
+    adc_ctx.samples_per_block = cfg->scans_per_block * cfg->num_channels;
+
+    for (index = 0; index < cfg->num_channels; index++)
+    {
+        adcPinConfigure(&adc_pin_configs[cfg->channels[index]]);
+    }
+
+    adcDmaConfigure(config, cfg->sample_buffer, 2 * adc_ctx.samples_per_block);
+    adcConfigure(config, cfg->channels, cfg->num_channels);
+
+    /* Higher priority than the serial port, but lower than the 
+     * engine timing related interrupts. 
+     */
+    stm32f4_enable_IRQ(config->irq, 3, 0);
+
+    ADC_SoftwareStartConv(config->adc);
+
+done:
+    return config;
+}
+
+static adc_burst_config_st const * adcBurstConfigLookup( ADC_BURST_TRIGGER_T trigger )
+{
+    int i;
+
+    for ( i=0; i < MAX_ADC_BURSTS; i++ )
+    {
+        if ( adc_burst_configs[i].trigger == trigger )
+        {
+            return &adc_burst_configs[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void adcBurstTimerConfigure(adc_burst_config_st const * const config, uint32_t const sample_rate_hz)
+{
+    TIM_OCInitTypeDef TIM_OCInitStructure;
+    uint32_t const timer_frequency = 1000000;
+    uint32_t const period = timer_frequency / sample_rate_hz;
+
+    /* The timer compare event triggers each conversion. The 
+     * timer is only run while a burst is in progress. 
+     */
+    RCC_APB1PeriphClockCmd(config->RCC_APB1Periph_TIM, ENABLE);
+    stm32f4_timer_configure(config->tim, period - 1, timer_frequency, false);
+
+    TIM_OCStructInit(&TIM_OCInitStructure);
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM1;
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+    TIM_OCInitStructure.TIM_Pulse = period / 2;
+    TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
+    TIM_OC1Init(config->tim, &TIM_OCInitStructure);
+}
+
+void const * stm32_adc_burst_init(adc_burst_init_st const *cfg)
+{
+    adc_burst_config_st const * config = NULL;
+    adc_burst_ctx_st * ctx;
+    ADC_InitTypeDef ADC_InitStructure;
+    RCC_ClocksTypeDef clocks;
+
+    if (cfg->channel >= ARRAY_SIZE(adc_pin_configs))
+    {
+        goto done;
+    }
+    if (cfg->trigger == adc_burst_trigger_timer 
+        && (cfg->sample_rate_hz == 0 || cfg->sample_rate_hz > 500000))
+    {
+        goto done;
+    }
+
+    if ((config = adcBurstConfigLookup(cfg->trigger)) == NULL)
+    {
+        goto done;
+    }
+    ctx = &adc_burst_ctxs[GET_ADC_BURST_IDX(config)];
+    if (ctx->in_use)
+    {
+        config = NULL;
+        goto done;
+    }
+    ctx->in_use = true;
+
+    adcPinConfigure(&adc_pin_configs[cfg->channel]);
+
+    RCC_AHB1PeriphClockCmd(config->RCC_AHBPeriph_DMA, ENABLE);
+    DMA_DeInit(config->dma_stream);
+
+    /* The common ADC settings have already been set up by 
+     * stm32_adc_scan_init(). 
+     */
+    RCC_APB2PeriphClockCmd(config->RCC_APB2Periph, ENABLE);
+
+    ADC_StructInit(&ADC_InitStructure);
+    ADC_InitStructure.ADC_Resolution = ADC_Resolution_12b;
+    ADC_InitStructure.ADC_ScanConvMode = DISABLE;
+    ADC_InitStructure.ADC_DataAlign = ADC_DataAlign_Right;
+    ADC_InitStructure.ADC_NbrOfConversion = 1;
+    if (config->trigger == adc_burst_trigger_timer)
+    {
+        ADC_InitStructure.ADC_ContinuousConvMode = DISABLE;
+        ADC_InitStructure.ADC_ExternalTrigConvEdge = ADC_ExternalTrigConvEdge_Rising;
+        ADC_InitStructure.ADC_ExternalTrigConv = config->adc_trigger;
+    }
+    else
+    {
+        ADC_InitStructure.ADC_ContinuousConvMode = ENABLE;
+        ADC_InitStructure.ADC_ExternalTrigConvEdge = ADC_ExternalTrigConvEdge_None;
+    }
+    ADC_Init(config->adc, &ADC_InitStructure);
+
+    ADC_RegularChannelConfig(config->adc, cfg->channel, 1, config->sample_time);
+    ADC_DMARequestAfterLastTransferCmd(config->adc, ENABLE);
+    ADC_Cmd(config->adc, ENABLE);
+
+    if (config->trigger == adc_burst_trigger_timer)
+    {
+        adcBurstTimerConfigure(config, cfg->sample_rate_hz);
+        ctx->sample_rate_hz = cfg->sample_rate_hz;
+    }
+    else
+    {
+        RCC_GetClocksFreq(&clocks);
+        ctx->sample_rate_hz = clocks.PCLK2_Frequency / (ADC_CLOCK_PRESCALER * config->sample_cycles);
+    }
+
+done:
+    return config;
+}
+
+uint32_t stm32_adc_burst_sample_rate_get(void const *burst)
+{
+    adc_burst_config_st const * const config = burst;
+
+    return adc_burst_ctxs[GET_ADC_BURST_IDX(config)].sample_rate_hz;
+}
+
+void stm32_adc_burst_start(void const *burst, uint16_t *buffer, size_t max_samples)
+{
+    adc_burst_config_st const * const config = burst;
+    DMA_InitTypeDef DMA_InitStructure;
+
+    adc_burst_ctxs[GET_ADC_BURST_IDX(config)].max_samples = max_samples;
+
+    DMA_Cmd(config->dma_stream, DISABLE);
+    while (DMA_GetCmdStatus(config->dma_stream) != DISABLE)
+    {
+    }
+    DMA_ClearFlag(config->dma_stream, config->dma_flags);
+
+    adcDmaStructInit(&DMA_InitStructure, config->adc, config->dma_channel);
+    DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)buffer;
+    DMA_InitStructure.DMA_BufferSize = max_samples;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+    DMA_Init(config->dma_stream, &DMA_InitStructure);
+    DMA_Cmd(config->dma_stream, ENABLE);
+
+    /* Toggling the DMA enable bit resets the ADC DMA state after 
+     * the previous burst ended with an overrun. 
+     */
+    ADC_DMACmd(config->adc, DISABLE);
+    ADC_ClearFlag(config->adc, ADC_FLAG_OVR);
+    ADC_DMACmd(config->adc, ENABLE);
+
+    if (config->trigger == adc_burst_trigger_timer)
+    {
+        TIM_SetCounter(config->tim, 0);
+        TIM_Cmd(config->tim, ENABLE);
+    }
+    else
+    {
+        ADC_SoftwareStartConv(config->adc);
+    }
+}
+
+size_t stm32_adc_burst_stop(void const *burst)
+{
+    adc_burst_config_st const * const config = burst;
+    size_t samples_remaining;
+
+    if (config->trigger == adc_burst_trigger_timer)
+    {
+        TIM_Cmd(config->tim, DISABLE);
+    }
+    else
+    {
+        /* Continuous conversions stop once the DMA request can't 
+         * be serviced. 
+         */
+        ADC_DMACmd(config->adc, DISABLE);
+    }
+    samples_remaining = DMA_GetCurrDataCounter(config->dma_stream);
+    DMA_Cmd(config->dma_stream, DISABLE);
+
+    return adc_burst_ctxs[GET_ADC_BURST_IDX(config)].max_samples - samples_remaining;
+}
+
+static void adcDmaIrqHandler(adc_config_st const * const config, adc_ctx_st * const ctx)
+{
+    if (DMA_GetITStatus(config->dma_stream, config->dma_half_transfer_flag) != RESET)
+    {
+        DMA_ClearITPendingBit(config->dma_stream, config->dma_half_transfer_flag);
+
+        /* First half is complete. DMA is now writing to the second 
+         * half. 
+         */
+        if (ctx->callback.samplesReady != NULL)
+        {
+            ctx->callback.samplesReady(ctx->callback.pv, 
+                                       ctx->sample_buffer, 
+                                       ctx->scans_per_block);
+        }
+    }
+
+    if (DMA_GetITStatus(config->dma_stream, config->dma_transfer_complete_flag) != RESET)
+    {
+        DMA_ClearITPendingBit(config->dma_stream, config->dma_transfer_complete_flag);
+
+        if (ctx->callback.samplesReady != NULL)
+        {
+            ctx->callback.samplesReady(ctx->callback.pv, 
+                                       ctx->sample_buffer + ctx->samples_per_block, 
+                                       ctx->scans_per_block);
+        }
+    }
+}
+
+void DMA2_Stream0_IRQHandler(void)
+{
+    cpu_load_isr_stamp_st const stamp = cpu_load_isr_enter();
+
+    adcDmaIrqHandler(&adc_config, &adc_ctx);
+
+    cpu_load_isr_exit(cpu_load_isr_adc_dma, stamp);
+}
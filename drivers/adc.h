@@ -0,0 +1,29 @@
+#ifndef __ADC_H__
+#define __ADC_H__
+
+#include <adc_interface.h>
+
+/* Start a continuous scan of the configured channels into the 
+ * sample buffer. Returns NULL on failure. 
+ */
+void const *stm32_adc_scan_init(adc_init_st const *cfg);
+
+/* Returns the burst handle passed to the other burst 
+ * functions, or NULL on failure. Each trigger type can only be 
+ * used once. 
+ */
+void const *stm32_adc_burst_init(adc_burst_init_st const *cfg);
+
+uint32_t stm32_adc_burst_sample_rate_get(void const *burst);
+
+/* Start converting into the buffer. Conversions stop once the 
+ * buffer is full. 
+ */
+void stm32_adc_burst_start(void const *burst, uint16_t *buffer, size_t max_samples);
+
+/* Returns the number of samples written since the burst was 
+ * started. 
+ */
+size_t stm32_adc_burst_stop(void const *burst);
+
+#endif /* __ADC_H__ */
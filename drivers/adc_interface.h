@@ -0,0 +1,50 @@
+#ifndef __ADC_INTERFACE_H__
+#define __ADC_INTERFACE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Boundary between the analog input processing and the micro 
+ * specific ADC driver. Nothing in here depends on the micro, so 
+ * a host stand-in driver can feed sample blocks to the owner. 
+ */
+
+typedef struct adc_cb_st
+{
+    void            *pv;    /* owner context */
+    /* Called from interrupt context each time a block of scans 
+     * has been written to the sample buffer. Samples are laid out 
+     * as [scan][channel]. 
+     */
+    void            (*samplesReady)( void *pv, uint16_t const *samples, size_t num_scans );
+} adc_cb_st;
+
+typedef struct adc_init_st
+{
+    uint8_t const   *channels;          /* ADC channel numbers in scan order */
+    size_t          num_channels;
+    /* Must have room for 2 * scans_per_block * num_channels 
+     * samples. One half is processed while the other is written. 
+     */
+    uint16_t        *sample_buffer;
+    size_t          scans_per_block;
+    adc_cb_st       callback;
+} adc_init_st;
+
+typedef enum ADC_BURST_TRIGGER_T
+{
+    adc_burst_trigger_timer,        /* Conversions at sample_rate_hz */
+    adc_burst_trigger_continuous    /* Back to back conversions at a fixed rate */
+} ADC_BURST_TRIGGER_T;
+
+/* Conversions of a single channel, written by DMA into a linear 
+ * buffer between a start and a stop. 
+ */
+typedef struct adc_burst_init_st
+{
+    ADC_BURST_TRIGGER_T trigger;
+    uint8_t         channel;
+    uint32_t        sample_rate_hz; /* adc_burst_trigger_timer only */
+} adc_burst_init_st;
+
+#endif /* __ADC_INTERFACE_H__ */
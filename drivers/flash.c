@@ -0,0 +1,75 @@
+#include "flash.h"
+
+#include "stm32f4xx.h"
+#include "stm32f4xx_flash.h"
+
+#include <string.h>
+
+#define FLASH_SECTOR_STEP (FLASH_Sector_1 - FLASH_Sector_0)
+#define NUM_FLASH_SECTORS 12
+
+#define FLASH_ERROR_FLAGS (FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR \
+                           | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR)
+
+static void flash_unlock(void)
+{
+    FLASH_Unlock();
+    FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_ERROR_FLAGS);
+}
+
+/* The ART data cache may still hold what was there before. */
+static void flash_lock(void)
+{
+    FLASH_Lock();
+
+    FLASH_DataCacheCmd(DISABLE);
+    FLASH_DataCacheReset();
+    FLASH_DataCacheCmd(ENABLE);
+}
+
+bool stm32_flash_sector_erase(unsigned int const sector)
+{
+    bool erased = false;
+
+    if (sector >= NUM_FLASH_SECTORS)
+    {
+        goto done;
+    }
+
+    flash_unlock();
+    /* VoltageRange_3 (2.7 - 3.6V) erases 32 bits at a time. */
+    erased = FLASH_EraseSector(FLASH_Sector_0 + (sector * FLASH_SECTOR_STEP), VoltageRange_3) == FLASH_COMPLETE;
+    flash_lock();
+
+done:
+    return erased;
+}
+
+bool stm32_flash_program(uint32_t const address, void const * const data, size_t const len)
+{
+    uint8_t const * const source = data;
+    size_t offset;
+    bool programmed = false;
+
+    if ((address % sizeof(uint32_t)) != 0 || (len % sizeof(uint32_t)) != 0)
+    {
+        goto done;
+    }
+
+    flash_unlock();
+    for (offset = 0; offset < len; offset += sizeof(uint32_t))
+    {
+        uint32_t word;
+
+        memcpy(&word, &source[offset], sizeof word);
+        if (FLASH_ProgramWord(address + offset, word) != FLASH_COMPLETE)
+        {
+            break;
+        }
+    }
+    flash_lock();
+    programmed = offset == len;
+
+done:
+    return programmed;
+}
@@ -0,0 +1,20 @@
+#ifndef __FLASH_H__
+#define __FLASH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Internal flash programming. The CPU can't fetch instructions 
+ * from flash while it is being erased or programmed, so 
+ * everything (including interrupts) stalls until the operation 
+ * has finished. Erasing a 128k sector takes 1 - 2 seconds. 
+ */
+
+/* sector is the sector number (0 - 11). */
+bool stm32_flash_sector_erase(unsigned int const sector);
+
+/* address and len must be multiples of 4. */
+bool stm32_flash_program(uint32_t const address, void const * const data, size_t const len);
+
+#endif /* __FLASH_H__ */
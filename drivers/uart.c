@@ -10,18 +10,31 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
-#define USART1_RX_BUFFER_SIZE	128	/* must be power of two */
-#define USART1_TX_BUFFER_SIZE	128
+#define USART1_RX_BUFFER_SIZE	256	/* must be power of two */
+#define USART1_TX_BUFFER_SIZE	1024	/* must be power of two */
 #define USART2_RX_BUFFER_SIZE	128	/* must be power of two */
 #define USART2_TX_BUFFER_SIZE	128
 
+/* Maximum number of bytes copied into the TX ring while interrupts 
+ * are disabled. Keeps the lockout short when several tasks are 
+ * writing to the same port. 
+ */
+#define TX_COPY_CHUNK_SIZE		64
+
 static volatile uint8_t Usart1TxBuffer[USART1_TX_BUFFER_SIZE];
 static volatile uint8_t Usart1RxBuffer[USART1_RX_BUFFER_SIZE];
 
 typedef struct serial_uart_statistics_st
 {
 	uint32_t txTimeout;
+	uint32_t txOverflow;	/* non-blocking writes that didn't fit */
+	uint32_t txDmaTransfers;
+	uint32_t rxEvents;			/* idle line and DMA half/full transfer interrupts */
+	uint32_t rxHardwareOverrun;	/* USART overrun. DMA didn't take the char in time */
+	uint32_t rxBufferOverrun;	/* reader fell behind and the DMA wrapped over unread data */
+	uint32_t rxCharsLost;
 } serial_uart_statistics_st;
 
 typedef struct uart_ports_config_t
@@ -46,10 +59,14 @@ typedef struct uart_ctx_st
 	uint_fast16_t				rxBufferSize;
 	volatile uint8_t 			* txBuffer;
 	uint_fast16_t				txBufferSize;
-	volatile uint_fast16_t		rxBufferHead;
+	volatile uint_fast16_t		rxBufferHead;	/* DMA write position as of the last RX event */
 	volatile uint_fast16_t		rxBufferTail;
-	volatile uint_fast16_t		txBufferHead;
-	volatile uint_fast16_t		txBufferTail;
+	volatile uint32_t			rxCharsReceived;	/* free running totals used to detect overruns */
+	uint32_t					rxCharsConsumed;
+	volatile uint_fast16_t		txBufferHead;	/* written by producers */
+	volatile uint_fast16_t		txBufferTail;	/* advanced when a DMA transfer completes */
+	volatile uint_fast16_t		txDmaLength;	/* length of the transfer in progress. 0 if idle */
+	OS_FlagID					txSpaceFlag;	/* set each time TX buffer space is freed */
 
 	void 						(*newRxDataCb)( void *pv );
 
@@ -61,6 +78,8 @@ static int uartTxBusy(void *pv);
 static int uartReadChar(void *pv);
 static void uartWriteChar(void *pv, uint8_t ch);
 static int uartWriteCharBlockingWithTimeout(void * const pv, uint8_t const ch, uint_fast16_t const max_millisecs_to_wait);
+static int uartWriteBulk(void * const pv, uint8_t const * buf, unsigned int buflen);
+static int uartWriteBulkBlockingWithTimeout(void * const pv, uint8_t const * buf, unsigned int buflen, uint_fast16_t const max_millisecs_to_wait);
 
 static const serial_port_methods_st uart_port_methods =
 {
@@ -69,8 +88,8 @@ static const serial_port_methods_st uart_port_methods =
 	.rxReady = uartRxReady,
 	.writeChar = uartWriteChar,
 	.writeCharBlockingWithTimeout = uartWriteCharBlockingWithTimeout,
-	.writeBulk = NULL,
-	.writeBulkBlockingWithTimeout = NULL
+	.writeBulk = uartWriteBulk,
+	.writeBulkBlockingWithTimeout = uartWriteBulkBlockingWithTimeout
 };
 
 
@@ -92,33 +111,89 @@ static const uart_ports_config_t uart_ports[] =
 static uart_ctx_st uart_ctxs[NB_UART_PORTS];
 static serial_uart_statistics_st serial_uart_statistics;
 
-static int getTxChar( void *pv )
+/* Must be called with interrupts disabled. 
+ * Starts a DMA transfer of the largest contiguous block of queued 
+ * data if no transfer is currently in progress. 
+ */
+static void uartTxDmaKick(uart_ctx_st * const pctx)
+{
+	uint_fast16_t const head = pctx->txBufferHead;
+	uint_fast16_t const tail = pctx->txBufferTail;
+	uint_fast16_t len;
+
+	if (pctx->txDmaLength != 0 || head == tail)
+	{
+		goto done;
+	}
+
+	if (head > tail)
+	{
+		len = head - tail;
+	}
+	else
+	{
+		/* Data wraps. Send up to the end of the buffer first. */
+		len = pctx->txBufferSize - tail;
+	}
+	pctx->txDmaLength = len;
+	serial_uart_statistics.txDmaTransfers++;
+
+	stm32_usart_tx_dma_start(pctx->ll_info, (uint8_t const *)&pctx->txBuffer[tail], len);
+
+done:
+	return;
+}
+
+static void txDmaComplete( void *pv )
 {
 	uart_ctx_st *pctx = (uart_ctx_st *)pv;
-	int ch;
 
-    if (pctx->txBufferTail != pctx->txBufferHead)
-    {
-    	ch = pctx->txBuffer[pctx->txBufferTail];
-        pctx->txBufferTail = (pctx->txBufferTail + 1) % pctx->txBufferSize;
-    }
-    else
-    	ch = -1;
+	pctx->txBufferTail = (pctx->txBufferTail + pctx->txDmaLength) & (pctx->txBufferSize - 1);
+	pctx->txDmaLength = 0;
 
-    return ch;
+	/* Interrupts are already masked up to this priority. */
+	uartTxDmaKick(pctx);
+
+	CoEnterISR();
+	isr_SetFlag(pctx->txSpaceFlag);
+	CoExitISR();
 }
 
-static void putRxChar( void *pv, uint8_t ch )
+static void rxDmaEvent( void *pv )
 {
 	uart_ctx_st *pctx = (uart_ctx_st *)pv;
+	/* Counted from the DMA laps as well as its position, so that 
+	 * the DMA lapping the reader is seen even if an event is late. 
+	 */
+	uint32_t const chars_received = stm32_usart_rx_dma_count_get(pctx->ll_info, pctx->rxBufferSize);
+	uint32_t const received = chars_received - pctx->rxCharsReceived;
+
+	serial_uart_statistics.rxEvents++;
+
+	if (received == 0)
+	{
+		goto done;
+	}
 
-    pctx->rxBuffer[pctx->rxBufferHead] = ch;
-    pctx->rxBufferHead = (pctx->rxBufferHead + 1) % pctx->rxBufferSize;
+	pctx->rxCharsReceived = chars_received;
+	/* XXX assumes that buffer length is a power a two */
+	pctx->rxBufferHead = chars_received & (pctx->rxBufferSize - 1);
 
+	/* One wakeup per burst rather than one per char. */
 	if (pctx->newRxDataCb != NULL)
 	{
 		pctx->newRxDataCb(pctx);
 	}
+
+done:
+	return;
+}
+
+static void rxOverrun( void *pv )
+{
+	UNUSED(pv);
+
+	serial_uart_statistics.rxHardwareOverrun++;
 }
 
 static void uartConfigure(uart_ctx_st *pctx)
@@ -163,6 +238,21 @@ serial_port_st * uartOpen( serial_port_t port, uint32_t baudrate, serial_modes_t
 	{
 		pctx = &uart_ctxs[UART_IDX(uart_config)];
 
+		pctx->rxBuffer = uart_config->rxBuffer;
+		pctx->rxBufferSize = uart_config->rxBufferSize;
+		pctx->txBuffer = uart_config->txBuffer;
+		pctx->txBufferSize = uart_config->txBufferSize;
+
+	    pctx->rxBufferHead = pctx->rxBufferTail = 0;
+	    pctx->rxCharsReceived = pctx->rxCharsConsumed = 0;
+	    pctx->txBufferHead = pctx->txBufferTail = 0;
+	    pctx->txDmaLength = 0;
+	    pctx->txSpaceFlag = CoCreateFlag(Co_TRUE, Co_FALSE);
+	    pctx->uartConfig = uart_config;
+	    pctx->mode = mode;
+	    pctx->baudRate = baudrate;
+	    pctx->newRxDataCb = newRxDataCb;
+
 		cfg.mode = 0;
 		if (mode & uart_mode_rx)
 			cfg.mode |= usart_mode_rx;
@@ -170,8 +260,13 @@ serial_port_st * uartOpen( serial_port_t port, uint32_t baudrate, serial_modes_t
 			cfg.mode |= usart_mode_tx;
 		cfg.usart = uart_config->usart;
 		cfg.callback.pv = pctx;
-		cfg.callback.getTxChar = getTxChar;
-		cfg.callback.putRxChar = putRxChar;
+		cfg.callback.getTxChar = NULL;	/* TX is done by DMA */
+		cfg.callback.putRxChar = NULL;	/* RX is done by DMA */
+		cfg.callback.txDmaComplete = txDmaComplete;
+		cfg.callback.rxDmaEvent = rxDmaEvent;
+		cfg.callback.rxOverrun = rxOverrun;
+		cfg.rxDmaBuffer = uart_config->rxBuffer;
+		cfg.rxDmaBufferSize = uart_config->rxBufferSize;
 
 		if ((pctx->ll_info=stm32_usart_init( &cfg )) == NULL)
 		{
@@ -179,33 +274,10 @@ serial_port_st * uartOpen( serial_port_t port, uint32_t baudrate, serial_modes_t
 			goto done;
 		}
 
-		pctx->rxBuffer = uart_config->rxBuffer;
-		pctx->rxBufferSize = uart_config->rxBufferSize;
-		pctx->txBuffer = uart_config->txBuffer;
-		pctx->txBufferSize = uart_config->txBufferSize;
-
-	    pctx->rxBufferHead = pctx->rxBufferTail = 0;
-	    pctx->txBufferHead = pctx->txBufferTail = 0;
-	    pctx->uartConfig = uart_config;
-	    pctx->mode = mode;
-	    pctx->baudRate = baudrate;
-	    pctx->newRxDataCb = newRxDataCb;
-
 		pctx->serialPort.serialCtx = pctx;
 		pctx->serialPort.methods = &uart_port_methods;
 	    uartConfigure(pctx);
 
-	    // Receive IRQ
-	    if (mode & uart_mode_rx) {
-	        USART_ClearITPendingBit(uart_config->usart, USART_IT_RXNE);
-		    USART_ITConfig(uart_config->usart, USART_IT_RXNE, ENABLE);
-	    }
-
-	    // Transmit IRQ
-	    if (mode & uart_mode_tx) {
-	        USART_ITConfig(uart_config->usart, USART_IT_TXE, ENABLE);
-	    }
-
 	    USART_Cmd(uart_config->usart, ENABLE);
 		serialPort = &pctx->serialPort;
     }
@@ -217,9 +289,30 @@ done:
 static int uartRxReady(void *pv)
 {
 	uart_ctx_st *pctx = pv;
+	uint32_t pending;
+	int ready;
+
+	IRQ_DISABLE_SAVE();
+
+	pending = pctx->rxCharsReceived - pctx->rxCharsConsumed;
+	if (pending >= pctx->rxBufferSize)
+	{
+		/* The DMA has written over data that hadn't been read yet, 
+		 * so what's in the buffer can't be trusted. Drop it all and 
+		 * carry on from the current write position. 
+		 */
+		serial_uart_statistics.rxBufferOverrun++;
+		serial_uart_statistics.rxCharsLost += pending;
+		pctx->rxBufferTail = pctx->rxBufferHead;
+		pctx->rxCharsConsumed = pctx->rxCharsReceived;
+	}
 
 	/* XXX assumes that buffer length is a power a two */
-    return (pctx->rxBufferHead - pctx->rxBufferTail) & (pctx->rxBufferSize - 1);
+    ready = (pctx->rxBufferHead - pctx->rxBufferTail) & (pctx->rxBufferSize - 1);
+
+	IRQ_ENABLE_RESTORE();
+
+    return ready;
 }
 
 static int uartTxBusy(void *pv)
@@ -236,58 +329,177 @@ static int uartReadChar(void *pv)
 
     ch = pctx->rxBuffer[pctx->rxBufferTail];
     pctx->rxBufferTail = (pctx->rxBufferTail + 1) % pctx->rxBufferSize;
+    pctx->rxCharsConsumed++;
 
     return ch;
 }
 
-static void uartWriteChar(void *pv, uint8_t ch)
+/* Returns the number of bytes that can be written at txBufferHead 
+ * without wrapping. One byte is always left free so that a full 
+ * buffer can be told apart from an empty one. 
+ */
+static uint_fast16_t uartTxContiguousSpace(uart_ctx_st const * const pctx)
 {
-	uart_ctx_st *pctx = pv;
+	uint_fast16_t const head = pctx->txBufferHead;
+	uint_fast16_t const tail = pctx->txBufferTail;
+	uint_fast16_t space;
 
-    pctx->txBuffer[pctx->txBufferHead] = ch;
-    pctx->txBufferHead = (pctx->txBufferHead + 1) % pctx->txBufferSize;
+	if (head >= tail)
+	{
+		space = pctx->txBufferSize - head;
+		if (tail == 0)
+		{
+			space--;
+		}
+	}
+	else
+	{
+		space = tail - head - 1;
+	}
 
-    USART_ITConfig(pctx->uartConfig->usart, USART_IT_TXE, ENABLE);
+	return space;
 }
 
-static int uartWriteCharBlockingWithTimeout(void * const pv, uint8_t const ch, uint_fast16_t const max_millisecs_to_wait)
+/* Must be called with interrupts disabled. Copies as much of buf 
+ * as will fit (up to TX_COPY_CHUNK_SIZE bytes) into the TX buffer 
+ * and returns the number of bytes copied. 
+ */
+static unsigned int uartTxCopyChunk(uart_ctx_st * const pctx, uint8_t const * buf, unsigned int buflen)
 {
-	uart_ctx_st *pctx = pv;
-	uint_fast16_t millisecs_counter = 0;
-	int result = -1;
-	int timed_out = 0;
+	unsigned int copied = 0;
+
+	if (buflen > TX_COPY_CHUNK_SIZE)
+	{
+		buflen = TX_COPY_CHUNK_SIZE;
+	}
 
-    /* wait until the TX buffer can accept at least one more character */
-    IRQ_DISABLE_SAVE();
-    while (timed_out == 0 && ((pctx->txBufferHead + 1) % pctx->txBufferSize) == pctx->txBufferTail)
+	/* At most two copies are needed when the data wraps. */
+	while (copied < buflen)
 	{
-		if (millisecs_counter >= max_millisecs_to_wait)
+		uint_fast16_t space = uartTxContiguousSpace(pctx);
+
+		if (space == 0)
 		{
-			timed_out = 1;
+			break;
 		}
-        else
-        {
-            IRQ_ENABLE_RESTORE();
-            CoTimeDelay(0, 0, 0, MSPERTICK);
-            millisecs_counter += MSPERTICK;
-            IRQ_DISABLE_SAVE();
-        }
-    }
-	if ( timed_out == 0 )
-	{
-        uartWriteChar(pctx, ch);
+		if (space > buflen - copied)
+		{
+			space = buflen - copied;
+		}
+		memcpy((uint8_t *)&pctx->txBuffer[pctx->txBufferHead], buf + copied, space);
+		pctx->txBufferHead = (pctx->txBufferHead + space) & (pctx->txBufferSize - 1);
+		copied += space;
+	}
 
-	    result = 0;
+	if (copied > 0)
+	{
+		uartTxDmaKick(pctx);
 	}
-	else
+
+	return copied;
+}
+
+/* Non-blocking. Data is only queued if all of it fits. Must only 
+ * be called from a task. 
+ */
+static int uartWriteBulk(void * const pv, uint8_t const * buf, unsigned int buflen)
+{
+	uart_ctx_st *pctx = pv;
+	unsigned int space;
+	int result;
+
+	/* With the scheduler locked no other task can queue data 
+	 * between the chunks, so the data stays together, and the DMA 
+	 * completion only ever frees more space. Interrupts are only 
+	 * disabled while each chunk is copied. 
+	 */
+	CoSchedLock();
+
+	IRQ_DISABLE_SAVE();
+	/* XXX assumes that buffer length is a power a two */
+	space = (pctx->txBufferTail - pctx->txBufferHead - 1) & (pctx->txBufferSize - 1);
+	IRQ_ENABLE_RESTORE();
+
+	if (space < buflen)
 	{
-		serial_uart_statistics.txTimeout++;
+		serial_uart_statistics.txOverflow++;
 		result = -1;
+		goto done;
 	}
-    IRQ_ENABLE_RESTORE(); 
 
+	while (buflen > 0)
+	{
+		unsigned int copied;
+
+		IRQ_DISABLE_SAVE();
+		copied = uartTxCopyChunk(pctx, buf, buflen);
+		IRQ_ENABLE_RESTORE();
+
+		buf += copied;
+		buflen -= copied;
+	}
+	result = 0;
+
+done:
+	CoSchedUnlock();
 
 	return result;
 }
 
+static int uartWriteBulkBlockingWithTimeout(void * const pv, uint8_t const * buf, unsigned int buflen, uint_fast16_t const max_millisecs_to_wait)
+{
+	uart_ctx_st *pctx = pv;
+	uint32_t wait_ticks = MSTOTICKS(max_millisecs_to_wait);
+	uint32_t deadline;
+	int result = 0;
+
+	/* A zero tick wait would mean waiting forever. */
+	if (max_millisecs_to_wait > 0 && wait_ticks == 0)
+	{
+		wait_ticks = 1;
+	}
+	deadline = CoGetOSTime32() + wait_ticks;
+
+	while (buflen > 0)
+	{
+		unsigned int copied;
+		int32_t ticks_left;
+
+		IRQ_DISABLE_SAVE();
+		copied = uartTxCopyChunk(pctx, buf, buflen);
+		IRQ_ENABLE_RESTORE();
+
+		buf += copied;
+		buflen -= copied;
+
+		if (buflen == 0 || copied > 0)
+		{
+			continue;
+		}
+
+		/* Buffer is full. Wait for the current DMA transfer to free 
+		 * some space. 
+		 */
+		ticks_left = (int32_t)(deadline - CoGetOSTime32());
+		if (max_millisecs_to_wait == 0 || ticks_left <= 0
+			|| CoWaitForSingleFlag(pctx->txSpaceFlag, ticks_left) != E_OK)
+		{
+			serial_uart_statistics.txTimeout++;
+			result = -1;
+			break;
+		}
+	}
+
+	return result;
+}
+
+static void uartWriteChar(void *pv, uint8_t ch)
+{
+	(void)uartWriteBulk(pv, &ch, 1);
+}
+
+static int uartWriteCharBlockingWithTimeout(void * const pv, uint8_t const ch, uint_fast16_t const max_millisecs_to_wait)
+{
+	return uartWriteBulkBlockingWithTimeout(pv, &ch, 1, max_millisecs_to_wait);
+}
 
@@ -14,6 +14,9 @@ typedef struct usart_cb_st
 	void			*pv;						/* owner context */
 	int				(*getTxChar)( void *pv );	/* get next char to TX to UART from owner */
 	void			(*putRxChar)( void *pv, uint8_t ch );	/* put next char from UART to owner */
+	void			(*txDmaComplete)( void *pv );	/* DMA TX transfer finished. If set, DMA is used for TX */
+	void			(*rxDmaEvent)( void *pv );	/* line idle or DMA RX buffer half/fully written */
+	void			(*rxOverrun)( void *pv );	/* hardware overrun. At least one char was lost */
 } usart_cb_st;
 
 typedef struct usart_init_st
@@ -21,7 +24,11 @@ typedef struct usart_init_st
 	USART_MODE_T	mode;
 	USART_TypeDef	*usart;
 	usart_cb_st		callback;
-	// TODO: DMA support
+	/* If set, RX is done by circular DMA into this buffer and 
+	 * putRxChar is not used. 
+	 */
+	volatile uint8_t	*rxDmaBuffer;
+	uint_fast16_t	rxDmaBufferSize;
 } usart_init_st;
 
 
@@ -1,6 +1,7 @@
 #include "stm32f4_utils.h"
 #include "utils.h"
 #include "usart.h"
+#include "cpu_load.h"
 
 #if defined(STM32F30X)
 #include "stm32f30x_usart.h"
@@ -11,6 +12,7 @@
 #include "stm32f4xx_usart.h"
 #include "stm32f4xx_gpio.h"
 #include "stm32f4xx_rcc.h"
+#include "stm32f4xx_dma.h"
 #include "misc.h"
 #elif defined(STM32F10X)
 #include "stm32f10x_usart.h"
@@ -49,6 +51,19 @@ typedef struct usart_port_config_st
 	uint_fast32_t		RCC_APBPeriph;
 	uint_fast16_t		irq;
 
+	DMA_Stream_TypeDef	*txDmaStream;
+	uint32_t			txDmaChannel;
+	uint32_t			txDmaFlags;		/* all flags for the stream */
+	uint32_t			txDmaTcIt;
+	uint_fast16_t		txDmaIrq;
+
+	DMA_Stream_TypeDef	*rxDmaStream;
+	uint32_t			rxDmaChannel;
+	uint32_t			rxDmaHtIt;
+	uint32_t			rxDmaTcIt;
+	uint32_t			rxDmaTcFlag;
+	uint_fast16_t		rxDmaIrq;
+
 } usart_port_config_st;
 
 static const usart_port_config_st usart_configs[] =
@@ -68,13 +83,30 @@ static const usart_port_config_st usart_configs[] =
         .RCC_APBPeriphClockCmd = RCC_APB2PeriphClockCmd,
         .RCC_APBPeriph = RCC_APB2Periph_USART1,
 
-        .irq = USART1_IRQn
+        .irq = USART1_IRQn,
+
+        .txDmaStream = DMA2_Stream7,
+        .txDmaChannel = DMA_Channel_4,
+        .txDmaFlags = DMA_FLAG_FEIF7 | DMA_FLAG_DMEIF7 | DMA_FLAG_TEIF7 | DMA_FLAG_HTIF7 | DMA_FLAG_TCIF7,
+        .txDmaTcIt = DMA_IT_TCIF7,
+        .txDmaIrq = DMA2_Stream7_IRQn,
+
+        .rxDmaStream = DMA2_Stream5,
+        .rxDmaChannel = DMA_Channel_4,
+        .rxDmaHtIt = DMA_IT_HTIF5,
+        .rxDmaTcIt = DMA_IT_TCIF5,
+        .rxDmaTcFlag = DMA_FLAG_TCIF5,
+        .rxDmaIrq = DMA2_Stream5_IRQn
     }
 };
 #define NB_UART_PORTS ARRAY_SIZE(usart_configs)
 #define GET_USART_IDX(ptr)	((ptr)-usart_configs)
 
 static usart_cb_st usartCallbackInfo[NB_UART_PORTS];
+/* Times the RX DMA has wrapped, counted by the transfer complete 
+ * interrupt. 
+ */
+static volatile uint32_t usartRxDmaLaps[NB_UART_PORTS];
 
 static usart_port_config_st const * usartConfigLookup( USART_TypeDef *usart )
 {
@@ -99,6 +131,7 @@ void const * stm32_usart_init(usart_init_st *cfg)
 		goto done;
 
 	usartCallbackInfo[GET_USART_IDX(uart_config)] = cfg->callback;
+	usartRxDmaLaps[GET_USART_IDX(uart_config)] = 0;
 
 	/* enable appropriate clocks */
     RCC_AHB1PeriphClockCmd(uart_config->RCC_AHBPeriph, ENABLE);
@@ -135,6 +168,67 @@ void const * stm32_usart_init(usart_init_st *cfg)
         GPIO_Init(uart_config->gpioPort, &GPIO_InitStructure);
     }
 
+    if ((cfg->mode & usart_mode_tx) && cfg->callback.txDmaComplete != NULL)
+    {
+        DMA_InitTypeDef DMA_InitStructure;
+
+        RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
+
+        DMA_DeInit(uart_config->txDmaStream);
+        DMA_StructInit(&DMA_InitStructure);
+        DMA_InitStructure.DMA_Channel = uart_config->txDmaChannel;
+        DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&uart_config->usart->DR;
+        DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+        DMA_InitStructure.DMA_BufferSize = 1;	/* set for each transfer */
+        DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+        DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+        DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+        DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+        DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+        DMA_InitStructure.DMA_Priority = DMA_Priority_Low;
+        DMA_Init(uart_config->txDmaStream, &DMA_InitStructure);
+
+        DMA_ITConfig(uart_config->txDmaStream, DMA_IT_TC, ENABLE);
+        USART_DMACmd(uart_config->usart, USART_DMAReq_Tx, ENABLE);
+
+        stm32f4_enable_IRQ(uart_config->txDmaIrq, 4, 2);
+    }
+
+    if ((cfg->mode & usart_mode_rx) && cfg->rxDmaBuffer != NULL)
+    {
+        DMA_InitTypeDef DMA_InitStructure;
+
+        RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
+
+        DMA_DeInit(uart_config->rxDmaStream);
+        DMA_StructInit(&DMA_InitStructure);
+        DMA_InitStructure.DMA_Channel = uart_config->rxDmaChannel;
+        DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&uart_config->usart->DR;
+        DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)cfg->rxDmaBuffer;
+        DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+        DMA_InitStructure.DMA_BufferSize = cfg->rxDmaBufferSize;
+        DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+        DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+        DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+        DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+        DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+        DMA_InitStructure.DMA_Priority = DMA_Priority_Medium;
+        DMA_Init(uart_config->rxDmaStream, &DMA_InitStructure);
+
+        /* The half and full transfer interrupts make sure the owner 
+         * hears about a continuous stream of data before the DMA 
+         * wraps around on it. Short bursts are reported by the 
+         * idle line interrupt. 
+         */
+        DMA_ITConfig(uart_config->rxDmaStream, DMA_IT_HT | DMA_IT_TC, ENABLE);
+        USART_DMACmd(uart_config->usart, USART_DMAReq_Rx, ENABLE);
+        DMA_Cmd(uart_config->rxDmaStream, ENABLE);
+
+        USART_ITConfig(uart_config->usart, USART_IT_IDLE, ENABLE);
+
+        stm32f4_enable_IRQ(uart_config->rxDmaIrq, 4, 2);
+    }
+
     /* Make this IRQ lower priority than the ones used for engine 
      * control related tasks. 
      */
@@ -144,6 +238,41 @@ done:
     return uart_config;
 }
 
+void stm32_usart_tx_dma_start(void const *ll_info, uint8_t const *buf, uint_fast16_t len)
+{
+	usart_port_config_st const * uart_config = ll_info;
+	DMA_Stream_TypeDef * const stream = uart_config->txDmaStream;
+
+	/* The stream disables itself at the end of each transfer, so 
+	 * the memory address and count can be written directly. 
+	 */
+	DMA_ClearFlag(stream, uart_config->txDmaFlags);
+	DMA_MemoryTargetConfig(stream, (uint32_t)buf, DMA_Memory_0);
+	DMA_SetCurrDataCounter(stream, len);
+	DMA_Cmd(stream, ENABLE);
+}
+
+uint32_t stm32_usart_rx_dma_count_get(void const *ll_info, uint_fast16_t const buffer_size)
+{
+	usart_port_config_st const * uart_config = ll_info;
+	uint32_t laps = usartRxDmaLaps[GET_USART_IDX(uart_config)];
+	/* The counter reloads to buffer_size after the last char, 
+	 * rather than reading 0. 
+	 */
+	uint_fast16_t const position = (buffer_size - DMA_GetCurrDataCounter(uart_config->rxDmaStream)) % buffer_size;
+
+	/* Called from the USART interrupt, the DMA may have wrapped 
+	 * without its interrupt having counted the lap yet. 
+	 */
+	if (DMA_GetFlagStatus(uart_config->rxDmaStream, uart_config->rxDmaTcFlag) != RESET
+		&& position < buffer_size / 2)
+	{
+		laps++;
+	}
+
+	return (laps * buffer_size) + position;
+}
+
 static void usartIrqHandler(usart_port_config_st const * const uart_config, usart_cb_st * runtime)
 {
     if (USART_GetITStatus(uart_config->usart, USART_IT_RXNE) != RESET)
@@ -186,16 +315,89 @@ static void usartIrqHandler(usart_port_config_st const * const uart_config, usar
         }
     }
 
+    if (USART_GetITStatus(uart_config->usart, USART_IT_IDLE) != RESET)
+    {
+        /* IDLE is cleared by reading SR (done above) and then DR. 
+         * The DMA has already taken any received char. 
+         */
+        (void)USART_ReceiveData(uart_config->usart);
+
+        if (runtime->rxDmaEvent != NULL)
+        {
+            runtime->rxDmaEvent(runtime->pv);
+        }
+    }
+
     if (USART_GetITStatus(uart_config->usart, USART_IT_ORE) != RESET)
     {
         USART_ClearITPendingBit (uart_config->usart, USART_IT_ORE);
-        // TODO: statistic?
+        if (runtime->rxOverrun != NULL)
+        {
+            runtime->rxOverrun(runtime->pv);
+        }
     }
 }
 
 void USART1_IRQHandler(void)
 {
+    cpu_load_isr_stamp_st const stamp = cpu_load_isr_enter();
+
     usartIrqHandler(&usart_configs[USART1_IDX], &usartCallbackInfo[USART1_IDX]);
+
+    cpu_load_isr_exit(cpu_load_isr_usart1, stamp);
+}
+
+static void usartTxDmaIrqHandler(usart_port_config_st const * const uart_config, usart_cb_st * runtime)
+{
+    if (DMA_GetITStatus(uart_config->txDmaStream, uart_config->txDmaTcIt) != RESET)
+    {
+        DMA_ClearITPendingBit(uart_config->txDmaStream, uart_config->txDmaTcIt);
+
+        if (runtime->txDmaComplete != NULL)
+        {
+            runtime->txDmaComplete(runtime->pv);
+        }
+    }
+}
+
+void DMA2_Stream7_IRQHandler(void)
+{
+    cpu_load_isr_stamp_st const stamp = cpu_load_isr_enter();
+
+    usartTxDmaIrqHandler(&usart_configs[USART1_IDX], &usartCallbackInfo[USART1_IDX]);
+
+    cpu_load_isr_exit(cpu_load_isr_usart1_tx_dma, stamp);
+}
+
+static void usartRxDmaIrqHandler(usart_port_config_st const * const uart_config, usart_cb_st * runtime)
+{
+    int new_data = 0;
+
+    if (DMA_GetITStatus(uart_config->rxDmaStream, uart_config->rxDmaHtIt) != RESET)
+    {
+        DMA_ClearITPendingBit(uart_config->rxDmaStream, uart_config->rxDmaHtIt);
+        new_data = 1;
+    }
+    if (DMA_GetITStatus(uart_config->rxDmaStream, uart_config->rxDmaTcIt) != RESET)
+    {
+        DMA_ClearITPendingBit(uart_config->rxDmaStream, uart_config->rxDmaTcIt);
+        usartRxDmaLaps[GET_USART_IDX(uart_config)]++;
+        new_data = 1;
+    }
+
+    if (new_data && runtime->rxDmaEvent != NULL)
+    {
+        runtime->rxDmaEvent(runtime->pv);
+    }
+}
+
+void DMA2_Stream5_IRQHandler(void)
+{
+    cpu_load_isr_stamp_st const stamp = cpu_load_isr_enter();
+
+    usartRxDmaIrqHandler(&usart_configs[USART1_IDX], &usartCallbackInfo[USART1_IDX]);
+
+    cpu_load_isr_exit(cpu_load_isr_usart1_rx_dma, stamp);
 }
 
 
@@ -5,5 +5,19 @@
 
 void const *stm32_usart_init(usart_init_st *cfg);
 
+/* Start a DMA transfer to the USART. The txDmaComplete callback 
+ * is called from interrupt context once it has finished. 
+ */
+void stm32_usart_tx_dma_start(void const *ll_info, uint8_t const *buf, uint_fast16_t len);
+
+/* Returns the number of chars the RX DMA has written since the 
+ * USART was initialised. It wraps at 2^32, and buffer_size must be 
+ * a power of two, so the index the next char will be written to 
+ * is the count modulo buffer_size. Must be called from the USART 
+ * or RX DMA interrupt, which run at the same priority. A lap is 
+ * only lost if the RX DMA interrupt is held off for a whole lap. 
+ */
+uint32_t stm32_usart_rx_dma_count_get(void const *ll_info, uint_fast16_t const buffer_size);
+
 
 #endif /* __USART_STM32F30X_H__ */
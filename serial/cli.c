@@ -0,0 +1,651 @@
+#include "cli.h"
+#include "serial_task.h"
+#include "analog_inputs.h"
+#include "cpu_load.h"
+#include "event_log.h"
+#include "fuel_calculator.h"
+#include "ignition_calculator.h"
+#include "ignition_control.h"
+#include "ignition_output.h"
+#include "injector_control.h"
+#include "injector_output.h"
+#include "knock.h"
+#include "map_sampler.h"
+#include "pulser.h"
+#include "telemetry.h"
+#include "trigger_input.h"
+#include "tune_config.h"
+#include "tune_server.h"
+#include "utils.h"
+
+#include "CoOS.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <math.h>
+
+#define CLI_MAX_ARGS 4
+
+#define CLI_CHAR_BACKSPACE 0x08
+#define CLI_CHAR_DELETE 0x7f
+#define CLI_CHAR_CTRL_C 0x03
+
+typedef union cli_arg_st
+{
+    uint32_t u;
+    int32_t i;
+    float f;
+    char const * s;
+} cli_arg_st;
+
+typedef void (* cli_command_handler)(cli_arg_st const * const args);
+
+typedef struct cli_command_st
+{
+    char const * name;
+    /* One char per argument: 'u' unsigned, 'i' signed, 'f' float, 
+     * 's' string. 
+     */
+    char const * arg_types;
+    cli_command_handler handler;
+    char const * help;
+} cli_command_st;
+
+typedef bool (* cli_param_set_handler)(cli_arg_st const * const value);
+typedef void (* cli_param_get_handler)(cli_arg_st * const value);
+
+/* A live parameter that can be read and changed with the get and 
+ * set commands. 
+ */
+typedef struct cli_param_st
+{
+    char const * name;
+    char type; /* As for cli_command_st.arg_types */
+    cli_param_get_handler get;
+    cli_param_set_handler set; /* NULL if read only. */
+} cli_param_st;
+
+static void rpm_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    printf("rpm: %"PRIu32"\r\n", (uint32_t)lrintf(rpm_get()));
+}
+
+static void crank_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    printf("crank: %f\r\n", crank_angle_get());
+}
+
+static void engine_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    printf("engine: %f\r\n", engine_cycle_angle_get());
+}
+
+static void analog_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    print_analog_inputs_debug();
+}
+
+static void fuel_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    print_fuel_debug();
+}
+
+static void spark_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    print_ignition_calculator_debug();
+}
+
+static void knock_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    print_knock_debug();
+}
+
+static void map_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    print_map_sampler_debug();
+}
+
+static void log_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    print_event_log_debug();
+}
+
+static void injector_command(cli_arg_st const * const args)
+{
+    if (args[0].u >= MAX_INJECTORS)
+    {
+        printf("injector must be < %u\r\n", (unsigned)MAX_INJECTORS);
+        goto done;
+    }
+    print_injector_debug(args[0].u);
+
+done:
+    return;
+}
+
+static void ignition_command(cli_arg_st const * const args)
+{
+    if (args[0].u >= MAX_IGNITIONS)
+    {
+        printf("ignition must be < %u\r\n", (unsigned)MAX_IGNITIONS);
+        goto done;
+    }
+    print_ignition_debug(args[0].u);
+
+done:
+    return;
+}
+
+static void pulser_command(cli_arg_st const * const args)
+{
+    print_pulser_debug(args[0].u);
+}
+
+static void telemetry_command(cli_arg_st const * const args)
+{
+    serial_telemetry_rate_set(args[0].u);
+}
+
+static void telemetry_stats_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    print_telemetry_debug();
+}
+
+static void config_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    print_tune_config_debug();
+}
+
+static void cpu_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    print_cpu_load_debug();
+}
+
+static void save_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    /* Saving may need a sector erase, which stalls the CPU. */
+    if (rpm_get() > 0.0)
+    {
+        printf("stop the engine first\r\n");
+        goto done;
+    }
+    printf("%s\r\n", tune_config_save(true) ? "saved" : "save failed");
+
+done:
+    return;
+}
+
+static void srq_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    /* ISR requests to the kernel made while the scheduler was locked. */
+    printf("srq overflows: %"PRIu32" high water: %"PRIu32"/%u\r\n",
+           (uint32_t)CoGetSRQOverflows(),
+           (uint32_t)CoGetSRQHighWater(),
+           (unsigned)CFG_MAX_SERVICE_REQUEST);
+}
+
+static void tune_command(cli_arg_st const * const args)
+{
+    UNUSED(args);
+
+    print_tune_server_debug();
+}
+
+static void telemetry_rate_get(cli_arg_st * const value)
+{
+    value->u = serial_telemetry_rate_get();
+}
+
+static bool telemetry_rate_set(cli_arg_st const * const value)
+{
+    serial_telemetry_rate_set(value->u);
+
+    return true;
+}
+
+/* Sets a field of the engine page as a burn from the tuning client
+ * would: it is written into the staging copy, which is checked and 
+ * made live at the start of the next engine cycle, along with any 
+ * tuning writes not yet burnt. If the check fails, the field is 
+ * put back as it is in the live copy. 
+ */
+static bool engine_page_field_set(size_t const offset, void const * const data, size_t const len)
+{
+    uint8_t const * const live_page = tune_config_page_get(tune_page_engine);
+    bool burnt;
+
+    (void)tune_config_page_write(tune_page_engine, offset, data, len);
+    burnt = tune_config_burn();
+    if (!burnt)
+    {
+        (void)tune_config_page_write(tune_page_engine, offset, &live_page[offset], len);
+    }
+
+    return burnt;
+}
+
+static void cam_phase_get(cli_arg_st * const value)
+{
+    value->u = tune_config_get()->engine.cam_phase;
+}
+
+static bool cam_phase_set(cli_arg_st const * const value)
+{
+    uint8_t const cam_phase = value->u;
+
+    return value->u <= UINT8_MAX
+        && engine_page_field_set(offsetof(tune_engine_page_st, cam_phase), &cam_phase, sizeof cam_phase);
+}
+
+static void rpm_smoothing_factor_get(cli_arg_st * const value)
+{
+    value->u = tune_config_get()->engine.rpm_smoothing_factor;
+}
+
+static bool rpm_smoothing_factor_set(cli_arg_st const * const value)
+{
+    uint16_t const rpm_smoothing_factor = value->u;
+
+    return value->u <= UINT16_MAX
+        && engine_page_field_set(offsetof(tune_engine_page_st, rpm_smoothing_factor),
+                                 &rpm_smoothing_factor, sizeof rpm_smoothing_factor);
+}
+
+static void tooth_1_crank_angle_get(cli_arg_st * const value)
+{
+    value->i = tune_config_get()->engine.tooth_1_crank_angle;
+}
+
+static bool tooth_1_crank_angle_set(cli_arg_st const * const value)
+{
+    return engine_page_field_set(offsetof(tune_engine_page_st, tooth_1_crank_angle),
+                                 &value->i, sizeof value->i);
+}
+
+/* Must be kept in strcmp() order. Looked up by binary search. 
+ * The engine page fields are the ones that take effect while the 
+ * engine is running (tune_config.h), in the page's units. 
+ */
+static cli_param_st const cli_params[] =
+{
+    { .name = "cam_phase", .type = 'u', .get = cam_phase_get, .set = cam_phase_set },
+    { .name = "rpm_smoothing_factor", .type = 'u', .get = rpm_smoothing_factor_get, .set = rpm_smoothing_factor_set },
+    { .name = "telemetry_rate", .type = 'u', .get = telemetry_rate_get, .set = telemetry_rate_set },
+    { .name = "tooth_1_crank_angle", .type = 'i', .get = tooth_1_crank_angle_get, .set = tooth_1_crank_angle_set },
+};
+
+static void help_command(cli_arg_st const * const args);
+static void get_command(cli_arg_st const * const args);
+static void set_command(cli_arg_st const * const args);
+static void params_command(cli_arg_st const * const args);
+
+/* Must be kept in strcmp() order. Looked up by binary search, so 
+ * the time taken to find a command only grows with log2 of the 
+ * number of commands. 
+ */
+static cli_command_st const cli_commands[] =
+{
+    { .name = "analog", .arg_types = "", .handler = analog_command, .help = "analog input values" },
+    { .name = "config", .arg_types = "", .handler = config_command, .help = "configuration store" },
+    { .name = "cpu", .arg_types = "", .handler = cpu_command, .help = "task and isr cpu load since the last report" },
+    { .name = "crank", .arg_types = "", .handler = crank_command, .help = "crank angle" },
+    { .name = "engine", .arg_types = "", .handler = engine_command, .help = "engine cycle angle" },
+    { .name = "fuel", .arg_types = "", .handler = fuel_command, .help = "fuel calculation" },
+    { .name = "get", .arg_types = "s", .handler = get_command, .help = "<param> show a parameter" },
+    { .name = "help", .arg_types = "", .handler = help_command, .help = "list commands" },
+    { .name = "ignition", .arg_types = "u", .handler = ignition_command, .help = "<n> ignition output n" },
+    { .name = "injector", .arg_types = "u", .handler = injector_command, .help = "<n> injector n" },
+    { .name = "knock", .arg_types = "", .handler = knock_command, .help = "knock detection" },
+    { .name = "log", .arg_types = "", .handler = log_command, .help = "event log counters" },
+    { .name = "map", .arg_types = "", .handler = map_command, .help = "per cylinder MAP" },
+    { .name = "params", .arg_types = "", .handler = params_command, .help = "list parameters" },
+    { .name = "pulser", .arg_types = "u", .handler = pulser_command, .help = "<n> pulser n" },
+    { .name = "rpm", .arg_types = "", .handler = rpm_command, .help = "engine speed" },
+    { .name = "save", .arg_types = "", .handler = save_command, .help = "save the configuration, erasing flash if needed" },
+    { .name = "set", .arg_types = "ss", .handler = set_command, .help = "<param> <value> change a parameter" },
+    { .name = "spark", .arg_types = "", .handler = spark_command, .help = "ignition calculation" },
+    { .name = "srq", .arg_types = "", .handler = srq_command, .help = "kernel service request queue" },
+    { .name = "telemetry", .arg_types = "u", .handler = telemetry_command, .help = "<frames/s> start telemetry, 0 stops" },
+    { .name = "telemetry_stats", .arg_types = "", .handler = telemetry_stats_command, .help = "telemetry counters" },
+    { .name = "tune", .arg_types = "", .handler = tune_command, .help = "tuning protocol counters" },
+};
+
+/* Binary search of a table sorted by name. The name must be the 
+ * first member of each entry. 
+ */
+static void const * table_lookup(void const * const table,
+                                 size_t const num_entries,
+                                 size_t const entry_size,
+                                 char const * const name)
+{
+    size_t low = 0;
+    size_t high = num_entries;
+    void const * found = NULL;
+
+    while (low < high)
+    {
+        size_t const middle = low + (high - low) / 2;
+        void const * const entry = (uint8_t const *)table + (middle * entry_size);
+        int const comparison = strcmp(name, *(char const * const *)entry);
+
+        if (comparison == 0)
+        {
+            found = entry;
+            break;
+        }
+        if (comparison < 0)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+
+    return found;
+}
+
+static bool arg_parse(char const type, char const * const token, cli_arg_st * const arg)
+{
+    char * end = NULL;
+    bool parsed = true;
+
+    switch (type)
+    {
+        case 'u':
+            arg->u = strtoul(token, &end, 0);
+            break;
+        case 'i':
+            arg->i = strtol(token, &end, 0);
+            break;
+        case 'f':
+            arg->f = strtof(token, &end);
+            break;
+        case 's':
+        default:
+            arg->s = token;
+            break;
+    }
+
+    if (end != NULL && (end == token || *end != '\0'))
+    {
+        parsed = false;
+    }
+
+    return parsed;
+}
+
+static void arg_print(char const type, cli_arg_st const * const arg)
+{
+    switch (type)
+    {
+        case 'u':
+            printf("%"PRIu32, arg->u);
+            break;
+        case 'i':
+            printf("%"PRId32, arg->i);
+            break;
+        case 'f':
+            printf("%f", arg->f);
+            break;
+        case 's':
+        default:
+            printf("%s", arg->s);
+            break;
+    }
+}
+
+static cli_param_st const * param_lookup(char const * const name)
+{
+    cli_param_st const * const param = table_lookup(cli_params, ARRAY_SIZE(cli_params), sizeof cli_params[0], name);
+
+    if (param == NULL)
+    {
+        printf("unknown parameter: %s\r\n", name);
+    }
+
+    return param;
+}
+
+static void param_print(cli_param_st const * const param)
+{
+    cli_arg_st value;
+
+    param->get(&value);
+    printf("%s ", param->name);
+    arg_print(param->type, &value);
+    printf("\r\n");
+}
+
+static void get_command(cli_arg_st const * const args)
+{
+    cli_param_st const * const param = param_lookup(args[0].s);
+
+    if (param != NULL)
+    {
+        param_print(param);
+    }
+}
+
+static void set_command(cli_arg_st const * const args)
+{
+    cli_param_st const * const param = param_lookup(args[0].s);
+    cli_arg_st value;
+
+    if (param == NULL)
+    {
+        goto done;
+    }
+    if (param->set == NULL)
+    {
+        printf("%s is read only\r\n", param->name);
+        goto done;
+    }
+    if (!arg_parse(param->type, args[1].s, &value))
+    {
+        printf("bad value: %s\r\n", args[1].s);
+        goto done;
+    }
+    if (!param->set(&value))
+    {
+        printf("value rejected\r\n");
+        goto done;
+    }
+    param_print(param);
+
+done:
+    return;
+}
+
+static void params_command(cli_arg_st const * const args)
+{
+    size_t index;
+
+    UNUSED(args);
+
+    for (index = 0; index < ARRAY_SIZE(cli_params); index++)
+    {
+        param_print(&cli_params[index]);
+    }
+}
+
+static void help_command(cli_arg_st const * const args)
+{
+    size_t index;
+
+    UNUSED(args);
+
+    for (index = 0; index < ARRAY_SIZE(cli_commands); index++)
+    {
+        printf("%s %s\r\n", cli_commands[index].name, cli_commands[index].help);
+    }
+}
+
+void cli_command_line_run(char * const line)
+{
+    char * tokens[CLI_MAX_ARGS + 1];
+    cli_arg_st args[CLI_MAX_ARGS];
+    size_t num_tokens = 0;
+    char * saveptr;
+    char * token;
+    cli_command_st const * command;
+    size_t num_args;
+    size_t index;
+
+    for (token = strtok_r(line, " \t", &saveptr);
+         token != NULL && num_tokens < ARRAY_SIZE(tokens);
+         token = strtok_r(NULL, " \t", &saveptr))
+    {
+        tokens[num_tokens++] = token;
+    }
+
+    if (num_tokens == 0)
+    {
+        goto done;
+    }
+
+    command = table_lookup(cli_commands, ARRAY_SIZE(cli_commands), sizeof cli_commands[0], tokens[0]);
+    if (command == NULL)
+    {
+        printf("unknown command: %s\r\n", tokens[0]);
+        goto done;
+    }
+
+    num_args = strlen(command->arg_types);
+    if (num_tokens - 1 != num_args || token != NULL)
+    {
+        printf("usage: %s %s\r\n", command->name, command->help);
+        goto done;
+    }
+
+    for (index = 0; index < num_args; index++)
+    {
+        if (!arg_parse(command->arg_types[index], tokens[index + 1], &args[index]))
+        {
+            printf("bad argument: %s\r\nusage: %s %s\r\n", tokens[index + 1], command->name, command->help);
+            goto done;
+        }
+    }
+
+    command->handler(args);
+
+done:
+    return;
+}
+
+static void echo(cli_line_editor_st const * const editor, char const * const str, size_t const len)
+{
+    serial_port_st * const port = editor->port;
+
+    if (port != NULL && port->methods->writeBulk != NULL)
+    {
+        (void)port->methods->writeBulk(port->serialCtx, (uint8_t const *)str, len);
+    }
+}
+
+void cli_line_editor_char_handle(cli_line_editor_st * const editor, char const ch)
+{
+    char const previous_ch = editor->previous_ch;
+
+    editor->previous_ch = ch;
+
+    switch (ch)
+    {
+        case '\n':
+            if (previous_ch == '\r')
+            {
+                /* Already handled the CR of a CR LF pair. */
+                break;
+            }
+            /* Fall through. */
+        case '\r':
+            echo(editor, "\r\n", 2);
+            editor->line[editor->length] = '\0';
+            cli_command_line_run(editor->line);
+            editor->length = 0;
+            break;
+        case CLI_CHAR_BACKSPACE:
+        case CLI_CHAR_DELETE:
+            if (editor->length > 0)
+            {
+                editor->length--;
+                echo(editor, "\b \b", 3);
+            }
+            break;
+        case CLI_CHAR_CTRL_C:
+            editor->length = 0;
+            echo(editor, "^C\r\n", 4);
+            break;
+        default:
+            /* Ignore other control chars, and anything beyond the end 
+             * of the line buffer. 
+             */
+            if (ch >= ' ' && editor->length < sizeof editor->line - 1)
+            {
+                editor->line[editor->length++] = ch;
+                echo(editor, &ch, 1);
+            }
+            break;
+    }
+}
+
+void cli_line_editor_init(cli_line_editor_st * const editor, serial_port_st * const port)
+{
+    editor->port = port;
+    editor->length = 0;
+    editor->previous_ch = '\0';
+}
+
+void cli_tables_check(void)
+{
+    size_t index;
+
+    /* A table out of order would break the binary search. */
+    for (index = 1; index < ARRAY_SIZE(cli_commands); index++)
+    {
+        if (strcmp(cli_commands[index - 1].name, cli_commands[index].name) >= 0)
+        {
+            printf("cli: command table not sorted at %s\r\n", cli_commands[index].name);
+        }
+    }
+    for (index = 1; index < ARRAY_SIZE(cli_params); index++)
+    {
+        if (strcmp(cli_params[index - 1].name, cli_params[index].name) >= 0)
+        {
+            printf("cli: parameter table not sorted at %s\r\n", cli_params[index].name);
+        }
+    }
+}
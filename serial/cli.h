@@ -0,0 +1,35 @@
+#ifndef __CLI_H__
+#define __CLI_H__
+
+#include "serial.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CLI_LINE_SIZE 64
+
+/* Collects chars from a serial port into a command line and runs 
+ * the command when the line is complete. 
+ */
+typedef struct cli_line_editor_st
+{
+    serial_port_st * port; /* Typed chars are echoed back to this port. */
+    size_t length;
+    char previous_ch;
+    char line[CLI_LINE_SIZE];
+} cli_line_editor_st;
+
+void cli_line_editor_init(cli_line_editor_st * const editor, serial_port_st * const port);
+
+/* Report any command or parameter table that isn't sorted by
+ * name. Call once the debug port is set so the report is seen.
+ */
+void cli_tables_check(void);
+
+/* Handle a char received from the editor's port. */
+void cli_line_editor_char_handle(cli_line_editor_st * const editor, char const ch);
+
+/* Parse and run a complete command line. The line is modified. */
+void cli_command_line_run(char * const line);
+
+#endif /* __CLI_H__ */
@@ -1,26 +1,33 @@
 #include "serial_task.h"
 #include "serial.h"
+#include "cli.h"
+#include "cpu_load.h"
+#include "tune_server.h"
+#include "tune_config.h"
+#include "trigger_input.h"
 #include "main_input_timer.h"
-#include "pulser.h"
+#include "telemetry.h"
+#include "event_log.h"
 #include "utils.h"
 
-#include "stm32f4xx_gpio.h"
-
 #include "CoOS.h"
 
-#include <inttypes.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
-#include <math.h>
 
-#define CLI_TASK_STACK_SIZE 1024
+/* Command responses are streamed out through the TX ring by 
+ * printf, so the task doesn't need large buffers. 
+ */
+#define CLI_TASK_STACK_SIZE 512
 #define SERIAL_TASK_PRIORITY 4
 
 typedef struct serialCli_st
 {
 	serial_port_st *cli_uart;
+	cli_line_editor_st line_editor;
+	tune_server_st tune_server;
 } serialCli_st;
 
 static OS_TID serialTaskID;
@@ -41,6 +48,11 @@ static struct cli_context_st
     OS_FlagID cli_data_ready_flag;
     uint32_t cli_data_ready_bit;
 
+    OS_FlagID telemetry_timer_flag;
+    uint32_t telemetry_timer_bit;
+    OS_TCID telemetry_timer_id;
+    unsigned int telemetry_rate;
+
     uint32_t all_flags;
 
     OS_STK cli_task_stack[CLI_TASK_STACK_SIZE];
@@ -65,13 +77,29 @@ void debug_put_char(char ch)
 
 int debug_put_block(void * data, size_t len)
 {
-    size_t x;
-    char * pch;
+    serial_port_st * serialPort = debug_port;
+
+    if (serialPort == NULL)
+    {
+        goto done;
+    }
 
-    for (x = 0, pch = data; x < len; x++, pch++)
+    if (serialPort->methods->writeBulkBlockingWithTimeout != NULL)
     {
-        debug_put_char(*pch);
+        serialPort->methods->writeBulkBlockingWithTimeout(serialPort->serialCtx, data, len, 10);
+    }
+    else
+    {
+        size_t x;
+        char * pch;
+
+        for (x = 0, pch = data; x < len; x++, pch++)
+        {
+            debug_put_char(*pch);
+        }
     }
+
+done:
     return len;
 }
 
@@ -80,6 +108,56 @@ static void periodic_timer_cb( void )
     isr_SetFlag(cli_context.periodic_tasks_timer_flag);
 }
 
+static void telemetry_timer_cb( void )
+{
+    isr_SetFlag(cli_context.telemetry_timer_flag);
+}
+
+/* Frames share the debug port with the text output. The host 
+ * decoder finds them using the sync bytes and CRC. 
+ */
+static void send_telemetry_frame(void)
+{
+    uint8_t frame[TELEMETRY_FRAME_SIZE];
+    size_t const frame_len = telemetry_frame_build(frame, sizeof frame);
+    serial_port_st * const serialPort = debug_port;
+
+    /* Never wait for space. A frame that doesn't fit is dropped 
+     * and the next one carries the latest values anyway. 
+     */
+    if (serialPort == NULL
+        || serialPort->methods->writeBulk == NULL
+        || serialPort->methods->writeBulk(serialPort->serialCtx, frame, frame_len) != 0)
+    {
+        telemetry_frame_dropped();
+    }
+}
+
+unsigned int serial_telemetry_rate_get(void)
+{
+    return cli_context.telemetry_rate;
+}
+
+void serial_telemetry_rate_set(unsigned int const frames_per_second)
+{
+    CoStopTmr(cli_context.telemetry_timer_id);
+
+    if (frames_per_second > 0)
+    {
+        /* Rounded up to whole ticks unless CoOS is tickless. */
+        U32 period_us = 1000000 / frames_per_second;
+
+        if (period_us == 0)
+        {
+            period_us = 1;
+        }
+        CoSetTmrCntUs(cli_context.telemetry_timer_id, period_us, period_us);
+        CoStartTmr(cli_context.telemetry_timer_id);
+    }
+
+    cli_context.telemetry_rate = frames_per_second;
+}
+
 static void new_uart_data_cb( void *pv )
 {
 	UNUSED(pv);
@@ -94,68 +172,20 @@ static void new_uart_data_cb( void *pv )
 static void handle_new_serial_data(void)
 {
 	unsigned int uart_index;
-    static size_t output_index;
 
 	for (uart_index = 0; uart_index < ARRAY_SIZE(serialCli); uart_index++ )
 	{
-		if ( serialCli[uart_index].cli_uart != NULL )
+		serial_port_st * const cli_uart = serialCli[uart_index].cli_uart;
+
+		if ( cli_uart != NULL )
 		{
-			while ( serialCli[uart_index].cli_uart->methods->rxReady( serialCli[uart_index].cli_uart->serialCtx ) )
+			while ( cli_uart->methods->rxReady( cli_uart->serialCtx ) )
 			{
-				int ch;
-
-				ch = serialCli[uart_index].cli_uart->methods->readChar( serialCli[uart_index].cli_uart->serialCtx );
+				int const ch = cli_uart->methods->readChar( cli_uart->serialCtx );
 
-                if (ch >= 0)
+                if (ch >= 0 && !tune_server_char_handle(&serialCli[uart_index].tune_server, ch, main_input_timer_count_get()))
                 {
-                    //uartPutChar(serialCli[uart_index].cli_uart, ch);
-                    if (ch == ' ')
-                    {
-                        float rpm_get(void);
-                        float const rpm = rpm_get();
-                        uint32_t rpm_32 = lrintf(rpm);
-
-                        //printf("rpm: %f\r\n", rpm);
-                        printf("rpm_32: %"PRIu32"\r\n", rpm_32);
-                    }
-                    if (ch == 'c')
-                    {
-                        float crank_angle_get(void);
-                        float const crank_angle = crank_angle_get();
-                        uint32_t crank_angle_32 = lrintf(crank_angle);
-
-                        printf("crank: %f %"PRIu32"\r\n", crank_angle, crank_angle_32);
-                    }
-                    if (ch == 'e')
-                    {
-                        float engine_cycle_angle_get(void);
-                        float const engine_cycle_angle = engine_cycle_angle_get();
-                        uint32_t engine_cycle_angle_32 = lrintf(engine_cycle_angle);
-
-                        printf("engine: %"PRIu32" %f\r\n", engine_cycle_angle_32, engine_cycle_angle);
-                    }
-                    if (ch == 'i')
-                    {
-                        void print_injector_debug(size_t const index);
-
-                        print_injector_debug(output_index);
-                    }
-                    if (ch == 'g')
-                    {
-                        void print_ignition_debug(size_t index);
-
-                        print_ignition_debug(output_index);
-                    }
-                    if (ch == 'p')
-                    {
-                        void print_pulser_debug(size_t const index);
-
-                        print_pulser_debug(output_index);
-                    }
-                    if (ch == '0' || ch == '1' || ch == '2' || ch == '3')
-                    {
-                        output_index = ch - '0';
-                    }
+                    cli_line_editor_char_handle(&serialCli[uart_index].line_editor, ch);
                 }
 			}
 		}
@@ -164,6 +194,20 @@ static void handle_new_serial_data(void)
 
 static void do_periodic_serial_tasks(void)
 {
+    event_log_flush();
+    /* Takes back the copy replaced by a burn made live at the start
+     * of an engine cycle.
+     */
+    tune_config_retire();
+    /* Writing flash stalls the crank and ignition ISRs, so a burn
+     * is only saved once the engine has stopped.
+     */
+    if (rpm_get() == 0.0)
+    {
+        tune_config_save(false);
+    }
+    /* Picks up a change to the tooth #1 crank angle or cam phase. */
+    trigger_schedule_update();
 }
 
 static void cli_task(void * pv)
@@ -172,7 +216,8 @@ static void cli_task(void * pv)
 
     UNUSED(pv);
 
-    debugTimerID = CoCreateTmr(TMR_TYPE_PERIODIC, CFG_SYSTICK_FREQ, CFG_SYSTICK_FREQ, periodic_timer_cb);
+    /* 10 times per second. */
+    debugTimerID = CoCreateTmr(TMR_TYPE_PERIODIC, CFG_SYSTICK_FREQ / 10, CFG_SYSTICK_FREQ / 10, periodic_timer_cb);
     CoStartTmr(debugTimerID);
 
     while (1)
@@ -190,6 +235,11 @@ static void cli_task(void * pv)
         {
             do_periodic_serial_tasks();
         }
+
+        if ((readyFlags & cli_context.telemetry_timer_bit) != 0)
+        {
+            send_telemetry_frame();
+        }
     }
 }
 
@@ -223,13 +273,24 @@ void serial_task_init(void)
     cli_context.cli_data_ready_flag = CoCreateFlag(Co_TRUE, Co_FALSE);
     cli_context.cli_data_ready_bit = 1 << cli_context.cli_data_ready_flag;
 
-    cli_context.all_flags = cli_context.periodic_tasks_timer_bit | cli_context.cli_data_ready_bit;
+    cli_context.telemetry_timer_flag = CoCreateFlag(Co_TRUE, Co_FALSE);
+    cli_context.telemetry_timer_bit = 1 << cli_context.telemetry_timer_flag;
+
+    cli_context.all_flags = cli_context.periodic_tasks_timer_bit | cli_context.cli_data_ready_bit | cli_context.telemetry_timer_bit;
+
+    /* Telemetry is off until turned on from the CLI. */
+    cli_context.telemetry_timer_id = CoCreateTmr(TMR_TYPE_PERIODIC, 1, 1, telemetry_timer_cb);
+    cli_context.telemetry_rate = 0;
     
 	for ( cli_index = 0 ; cli_index < ARRAY_SIZE(serial_ports); cli_index++ )
 	{
         serialCli[cli_index].cli_uart = serialOpen(serial_ports[cli_index], 115200, uart_mode_rx | uart_mode_tx, new_uart_data_cb);
+        cli_line_editor_init(&serialCli[cli_index].line_editor, serialCli[cli_index].cli_uart);
+        tune_server_init(&serialCli[cli_index].tune_server, serialCli[cli_index].cli_uart);
 	}
     set_debug_port(0); /* Temp debug assign the debug port right now until we have a CLI command that allows it to be turned on/off. */
+    cli_tables_check();
 
     serialTaskID = CoCreateTask(cli_task, Co_NULL, SERIAL_TASK_PRIORITY, &cli_context.cli_task_stack[CLI_TASK_STACK_SIZE - 1], CLI_TASK_STACK_SIZE);
+    cpu_load_task_name_set(serialTaskID, "serial");
 }
@@ -10,5 +10,11 @@ void debug_put_char(char ch);
 
 void serial_task_init(void);
 
+/* Sets the rate at which binary telemetry frames are sent on the 
+ * debug port. 0 turns telemetry off. 
+ */
+void serial_telemetry_rate_set(unsigned int const frames_per_second);
+unsigned int serial_telemetry_rate_get(void);
+
 #endif /* __SERIAL_TASK_H__ */
 
@@ -0,0 +1,346 @@
+#include "tune_server.h"
+#include "tune_config.h"
+#include "telemetry.h"
+#include "crc.h"
+#include "utils.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+/* Long enough to send a whole page through the TX ring at 115200. */
+#define TUNE_RESPONSE_TIMEOUT_MS 100
+
+typedef struct tune_server_stats_st
+{
+    uint32_t requests;
+    uint32_t crc_errors;
+    uint32_t errors;
+    uint32_t timeouts;
+    uint32_t bytes_read;
+    uint32_t bytes_written;
+    uint32_t burns;
+} tune_server_stats_st;
+
+static tune_server_stats_st tune_server_stats;
+
+static uint16_t get_le16(uint8_t const * const p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static void put_le16(uint8_t * const p, uint16_t const value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void put_le32(uint8_t * const p, uint32_t const value)
+{
+    put_le16(&p[0], value);
+    put_le16(&p[2], value >> 16);
+}
+
+static void response_write(tune_server_st * const server, void const * const data, size_t const len)
+{
+    serial_port_st * const port = server->port;
+
+    if (len > 0)
+    {
+        port->methods->writeBulkBlockingWithTimeout(port->serialCtx, data, len, TUNE_RESPONSE_TIMEOUT_MS);
+    }
+}
+
+/* The data is written straight from where it lives, so a page read
+ * is sent from the live configuration without being copied here
+ * first. The CRC is calculated as the data goes.
+ */
+static void response_send(tune_server_st * const server,
+                          uint8_t const command,
+                          tune_status_t const status,
+                          void const * const data,
+                          size_t const len)
+{
+    uint8_t header[TUNE_RESPONSE_HEADER_SIZE];
+    uint8_t crc_bytes[TUNE_CRC_SIZE];
+    uint16_t crc;
+
+    header[0] = TUNE_RESPONSE_SYNC_0;
+    header[1] = TUNE_RESPONSE_SYNC_1;
+    header[2] = command;
+    header[3] = status;
+    put_le16(&header[4], len);
+
+    crc = crc16_ccitt_update(CRC16_CCITT_INITIAL, &header[2], sizeof header - 2);
+    crc = crc16_ccitt_update(crc, data, len);
+    put_le16(crc_bytes, crc);
+
+    response_write(server, header, sizeof header);
+    response_write(server, data, len);
+    response_write(server, crc_bytes, sizeof crc_bytes);
+
+    if (status != tune_status_ok)
+    {
+        tune_server_stats.errors++;
+    }
+}
+
+static void page_info_handle(tune_server_st * const server, unsigned int const page)
+{
+    uint8_t info[TUNE_PAGE_INFO_SIZE];
+    size_t const page_size = tune_config_page_size(page);
+
+    if (page_size == 0)
+    {
+        response_send(server, tune_command_page_info, tune_status_bad_page, NULL, 0);
+        goto done;
+    }
+
+    put_le16(&info[0], page_size);
+    info[2] = tune_page_count;
+    put_le32(&info[3], tune_config_generation_get());
+    response_send(server, tune_command_page_info, tune_status_ok, info, sizeof info);
+
+done:
+    return;
+}
+
+static void page_read_handle(tune_server_st * const server,
+                             unsigned int const page,
+                             size_t const offset,
+                             size_t const len)
+{
+    size_t const page_size = tune_config_page_size(page);
+    uint8_t const * const page_data = tune_config_page_get(page);
+
+    if (page_data == NULL)
+    {
+        response_send(server, tune_command_page_read, tune_status_bad_page, NULL, 0);
+        goto done;
+    }
+    if (offset > page_size || len > page_size - offset)
+    {
+        response_send(server, tune_command_page_read, tune_status_bad_range, NULL, 0);
+        goto done;
+    }
+
+    /* The live copy can be swapped while the page is being sent, by
+     * the trigger path publishing a burn at the start of an engine
+     * cycle (tune_config_cycle_start()). The copy being sent is then
+     * only moved to retired[], and it isn't reused until this task
+     * calls tune_config_retire(), so it doesn't change under the
+     * send.
+     */
+    response_send(server, tune_command_page_read, tune_status_ok, &page_data[offset], len);
+    tune_server_stats.bytes_read += len;
+
+done:
+    return;
+}
+
+static void chunk_write_handle(tune_server_st * const server,
+                               unsigned int const page,
+                               size_t const offset,
+                               uint8_t const * const data,
+                               size_t const len)
+{
+    tune_status_t status;
+
+    if (tune_config_page_size(page) == 0)
+    {
+        status = tune_status_bad_page;
+    }
+    else if (!tune_config_page_write(page, offset, data, len))
+    {
+        status = tune_status_bad_range;
+    }
+    else
+    {
+        status = tune_status_ok;
+        tune_server_stats.bytes_written += len;
+    }
+
+    response_send(server, tune_command_chunk_write, status, NULL, 0);
+}
+
+static void burn_handle(tune_server_st * const server)
+{
+    uint8_t result[TUNE_BURN_RESULT_SIZE];
+
+    /* This task runs below everything that reads the
+     * configuration, so nothing can still be using a replaced copy.
+     */
+    tune_config_retire();
+    if (!tune_config_burn())
+    {
+        response_send(server, tune_command_burn, tune_status_rejected, NULL, 0);
+        goto done;
+    }
+
+    tune_server_stats.burns++;
+    put_le32(&result[0], tune_config_generation_get());
+    result[4] = !tune_config_save_pending();
+    response_send(server, tune_command_burn, tune_status_ok, result, sizeof result);
+
+done:
+    return;
+}
+
+static void page_crc_handle(tune_server_st * const server, unsigned int const page)
+{
+    void const * const page_data = tune_config_page_get(page);
+    uint8_t crc_bytes[TUNE_CRC_SIZE];
+
+    if (page_data == NULL)
+    {
+        response_send(server, tune_command_page_crc, tune_status_bad_page, NULL, 0);
+        goto done;
+    }
+
+    put_le16(crc_bytes, crc16_ccitt_update(CRC16_CCITT_INITIAL, page_data, tune_config_page_size(page)));
+    response_send(server, tune_command_page_crc, tune_status_ok, crc_bytes, sizeof crc_bytes);
+
+done:
+    return;
+}
+
+static void realtime_handle(tune_server_st * const server)
+{
+    uint8_t frame[TELEMETRY_FRAME_SIZE];
+    size_t const frame_len = telemetry_frame_build(frame, sizeof frame);
+
+    response_send(server, tune_command_realtime, tune_status_ok, frame, frame_len);
+}
+
+static void request_handle(tune_server_st * const server)
+{
+    uint8_t const * const request = server->request;
+    size_t const crc_offset = server->expected - TUNE_CRC_SIZE;
+    uint8_t const command = request[2];
+    unsigned int const page = request[3];
+    size_t const offset = get_le16(&request[4]);
+    size_t const len = get_le16(&request[6]);
+
+    tune_server_stats.requests++;
+
+    if (crc16_ccitt_update(CRC16_CCITT_INITIAL, &request[2], crc_offset - 2) != get_le16(&request[crc_offset]))
+    {
+        tune_server_stats.crc_errors++;
+        response_send(server, command, tune_status_bad_crc, NULL, 0);
+        goto done;
+    }
+
+    switch (command)
+    {
+        case tune_command_page_info:
+            page_info_handle(server, page);
+            break;
+        case tune_command_page_read:
+            page_read_handle(server, page, offset, len);
+            break;
+        case tune_command_chunk_write:
+            chunk_write_handle(server, page, offset, &request[TUNE_REQUEST_HEADER_SIZE], len);
+            break;
+        case tune_command_burn:
+            burn_handle(server);
+            break;
+        case tune_command_page_crc:
+            page_crc_handle(server, page);
+            break;
+        case tune_command_realtime:
+            realtime_handle(server);
+            break;
+        default:
+            response_send(server, command, tune_status_bad_command, NULL, 0);
+            break;
+    }
+
+done:
+    return;
+}
+
+void tune_server_init(tune_server_st * const server, serial_port_st * const port)
+{
+    server->port = port;
+    server->received = 0;
+    server->expected = 0;
+    server->last_char_us = 0;
+}
+
+bool tune_server_char_handle(tune_server_st * const server, uint8_t const ch, uint32_t const now_us)
+{
+    bool consumed = true;
+
+    if (server->received > 0 && (uint32_t)(now_us - server->last_char_us) > TUNE_REQUEST_CHAR_TIMEOUT_US)
+    {
+        /* The rest of the request was lost. Start again with this
+         * char, which may be the start of a new request or CLI input.
+         */
+        tune_server_stats.timeouts++;
+        server->received = 0;
+    }
+    server->last_char_us = now_us;
+
+    switch (server->received)
+    {
+        case 0:
+            if (ch != TUNE_REQUEST_SYNC_0)
+            {
+                consumed = false;
+                goto done;
+            }
+            break;
+        case 1:
+            if (ch != TUNE_REQUEST_SYNC_1)
+            {
+                /* Not a request after all. */
+                server->received = 0;
+                consumed = false;
+                goto done;
+            }
+            break;
+        default:
+            break;
+    }
+
+    server->request[server->received++] = ch;
+
+    if (server->received == TUNE_REQUEST_HEADER_SIZE)
+    {
+        size_t data_len = 0;
+
+        if (server->request[2] == tune_command_chunk_write)
+        {
+            data_len = get_le16(&server->request[6]);
+        }
+        if (data_len > TUNE_MAXIMUM_WRITE_CHUNK_SIZE)
+        {
+            response_send(server, server->request[2], tune_status_bad_range, NULL, 0);
+            server->received = 0;
+            goto done;
+        }
+        server->expected = TUNE_REQUEST_HEADER_SIZE + data_len + TUNE_CRC_SIZE;
+    }
+    else if (server->received > TUNE_REQUEST_HEADER_SIZE && server->received == server->expected)
+    {
+        request_handle(server);
+        server->received = 0;
+    }
+
+done:
+    return consumed;
+}
+
+void print_tune_server_debug(void)
+{
+    printf("tune requests %"PRIu32" crc errors %"PRIu32" errors %"PRIu32" timeouts %"PRIu32"\r\n",
+           tune_server_stats.requests,
+           tune_server_stats.crc_errors,
+           tune_server_stats.errors,
+           tune_server_stats.timeouts);
+    printf("read %"PRIu32" written %"PRIu32" burns %"PRIu32" generation %"PRIu32"\r\n",
+           tune_server_stats.bytes_read,
+           tune_server_stats.bytes_written,
+           tune_server_stats.burns,
+           tune_config_generation_get());
+}
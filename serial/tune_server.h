@@ -0,0 +1,43 @@
+#ifndef __TUNE_SERVER_H__
+#define __TUNE_SERVER_H__
+
+#include "serial.h"
+#include "tune_protocol.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define TUNE_REQUEST_MAXIMUM_SIZE (TUNE_REQUEST_HEADER_SIZE + TUNE_MAXIMUM_WRITE_CHUNK_SIZE + TUNE_CRC_SIZE)
+
+/* A partly received request is dropped if no char arrives for
+ * this long, so a lost char can't swallow the CLI input that
+ * follows.
+ */
+#define TUNE_REQUEST_CHAR_TIMEOUT_US 100000UL
+
+/* Picks tuning protocol requests (tune_protocol.h) out of the
+ * chars received on a serial port and sends the responses back
+ * on the same port.
+ */
+typedef struct tune_server_st
+{
+    serial_port_st * port;
+    size_t received;
+    size_t expected; /* Size of the request being received, once the header is in. */
+    uint32_t last_char_us; /* When the last char of the request so far arrived. */
+    uint8_t request[TUNE_REQUEST_MAXIMUM_SIZE];
+} tune_server_st;
+
+void tune_server_init(tune_server_st * const server, serial_port_st * const port);
+
+/* Handle a char received from the server's port at now_us
+ * (a free running microsecond count). Returns false if the char
+ * isn't part of a request, in which case it should be passed on
+ * to the CLI.
+ */
+bool tune_server_char_handle(tune_server_st * const server, uint8_t const ch, uint32_t const now_us);
+
+void print_tune_server_debug(void);
+
+#endif /* __TUNE_SERVER_H__ */
@@ -3,475 +3,425 @@
  * @brief    Implementation of several stdio.h methods, such as printf(),
  *           sprintf() and so on. This reduces the memory footprint of the
  *           binary when using those methods, compared to the libc implementation.
+ *
+ *           All the methods share one streaming formatter. Output is passed
+ *           in chunks to a sink, either a string or the debug port, so no
+ *           intermediate buffer is needed for the complete output.
  ********************************************************************************/
 #include "utils.h"
 #include "serial_task.h"
 
 #include <stdio.h>
 #include <stdarg.h>
-#include <math.h>
-
-/**
- * @brief  Transmit a char, if you want to use printf(),
- *         you need implement this function
- *
- * @param  pStr	Storage string.
- * @param  c    Character to write.
- */
-void PrintChar(char c)
-{
-    debug_put_char(c);
-}
+#include <stdint.h>
+#include <string.h>
 
-/** Maximum string size allowed (in bytes). */
+/** Maximum string size allowed (in bytes) by vsprintf() and sprintf(). */
 #define MAX_STRING_SIZE       255
 
+/** Output to the debug port is staged in chunks of this size. */
+#define STREAM_CHUNK_SIZE     64
+
+/** Default number of digits after the decimal point for %f. */
+#define DEFAULT_FLOAT_PRECISION 5
+/** Keeps the scaled fraction within 32 bits. */
+#define MAX_FLOAT_PRECISION   9
+
+/** Enough for any 32 bit value in decimal, with sign. */
+#define MAX_INTEGER_DIGITS    11
+
 
 /** Required for proper compilation. */
 //struct _reent r = {0, (FILE *) 0, (FILE *) 1, (FILE *) 0, 0};
 //struct _reent r = {._inc = 0};
 //struct _reent *_impure_ptr = &r;
 
-/**
- * @brief  Writes a character inside the given string. Returns 1.
- *
- * @param  pStr	Storage string.
- * @param  c    Character to write.
- */
-signed int PutChar(char *pStr, char c)
-{
-    *pStr = c;
-    return 1;
-}
-
+typedef struct format_sink_st format_sink_st;
 
 /**
- * @brief  Writes a string inside the given string.
+ * @brief  Destination for formatted output.
  *
- * @param  pStr     Storage string.
- * @param  pSource  Source string.
- * @return  The size of the written
+ * @param put  Called with each chunk of output, in order.
  */
-signed int PutString(char *pStr, const char *pSource)
+struct format_sink_st
 {
-    signed int num = 0;
-
-    while (*pSource != 0) {
-
-        *pStr++ = *pSource++;
-        num++;
-    }
-
-    return num;
-}
+    void (*put)(format_sink_st * const sink, char const * const data, size_t const len);
+    size_t count; /**< Number of chars passed to put(). */
+};
 
-
-/**
- * @brief  Writes an unsigned int inside the given string, using the provided fill &
- *         width parameters.
- *
- * @param  pStr  Storage string.
- * @param  fill  Fill character.
- * @param  width  Minimum integer width.
- * @param  value  Integer value.
- */
-signed int PutUnsignedInt(
-    char *pStr,
-    char fill,
-    signed int width,
-    unsigned int value)
+typedef struct string_sink_st
 {
-    signed int num = 0;
-
-    /* Take current digit into account when calculating width */
-    width--;
-
-    /* Recursively write upper digits */
-    if ((value / 10) > 0) {
-
-        num = PutUnsignedInt(pStr, fill, width, value / 10);
-        pStr += num;
-    }
-
-    /* Write filler characters */
-    else {
+    format_sink_st sink;
+    char * pStr;
+    size_t space; /**< Remaining space, excluding the terminating NUL. */
+} string_sink_st;
 
-        while (width > 0) {
-
-            PutChar(pStr, fill);
-            pStr++;
-            num++;
-            width--;
-        }
-    }
-
-    /* Write lower digit */
-    num += PutChar(pStr, (value % 10) + '0');
-
-    return num;
-}
+typedef struct stream_sink_st
+{
+    format_sink_st sink;
+    size_t used;
+    char chunk[STREAM_CHUNK_SIZE];
+} stream_sink_st;
 
+/** Two digit decimal strings for 00 - 99. Halves the number of divisions. */
+static char const digit_pairs[200] =
+{
+    '0','0','0','1','0','2','0','3','0','4','0','5','0','6','0','7','0','8','0','9',
+    '1','0','1','1','1','2','1','3','1','4','1','5','1','6','1','7','1','8','1','9',
+    '2','0','2','1','2','2','2','3','2','4','2','5','2','6','2','7','2','8','2','9',
+    '3','0','3','1','3','2','3','3','3','4','3','5','3','6','3','7','3','8','3','9',
+    '4','0','4','1','4','2','4','3','4','4','4','5','4','6','4','7','4','8','4','9',
+    '5','0','5','1','5','2','5','3','5','4','5','5','5','6','5','7','5','8','5','9',
+    '6','0','6','1','6','2','6','3','6','4','6','5','6','6','6','7','6','8','6','9',
+    '7','0','7','1','7','2','7','3','7','4','7','5','7','6','7','7','7','8','7','9',
+    '8','0','8','1','8','2','8','3','8','4','8','5','8','6','8','7','8','8','8','9',
+    '9','0','9','1','9','2','9','3','9','4','9','5','9','6','9','7','9','8','9','9'
+};
+
+static uint32_t const powers_of_10[MAX_FLOAT_PRECISION + 1] =
+{
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
 
 /**
- * @brief  Writes a signed int inside the given string, using the provided fill & width
- *         parameters.
+ * @brief  Writes the decimal digits of value, ending just before end.
  *
- * @param pStr   Storage string.
- * @param fill   Fill character.
- * @param width  Minimum integer width.
- * @param value  Signed integer value.
+ * @param end        One past the last char to write.
+ * @param value      Value to convert.
+ * @param min_digits Leading zeros are added to make up this many digits.
+ *
+ * @return  Pointer to the first digit.
  */
-signed int PutSignedInt(
-    char *pStr,
-    char fill,
-    signed int width,
-    signed int value)
+static char * decimal_digits(char * end, uint32_t value, unsigned int const min_digits)
 {
-    signed int num = 0;
-    unsigned int absolute;
+    char * const last = end;
 
-    /* Compute absolute value */
-    if (value < 0) {
+    while (value >= 100)
+    {
+        uint32_t const pair = (value % 100) * 2;
 
-        absolute = -value;
+        value /= 100;
+        *--end = digit_pairs[pair + 1];
+        *--end = digit_pairs[pair];
     }
-    else {
-
-        absolute = value;
+    if (value >= 10)
+    {
+        *--end = digit_pairs[value * 2 + 1];
+        *--end = digit_pairs[value * 2];
     }
-
-    /* Take current digit into account when calculating width */
-    width--;
-
-    /* Recursively write upper digits */
-    if ((absolute / 10) > 0) {
-
-        if (value < 0) {
-
-            num = PutSignedInt(pStr, fill, width, -(absolute / 10));
-        }
-        else {
-
-            num = PutSignedInt(pStr, fill, width, absolute / 10);
-        }
-        pStr += num;
+    else
+    {
+        *--end = '0' + value;
     }
-    else {
-
-        /* Reserve space for sign */
-        if (value < 0) {
-
-            width--;
-        }
-
-        /* Write filler characters */
-        while (width > 0) {
-
-            PutChar(pStr, fill);
-            pStr++;
-            num++;
-            width--;
-        }
-
-        /* Write sign */
-        if (value < 0) {
 
-            num += PutChar(pStr, '-');
-            pStr++;
-        }
+    while ((unsigned int)(last - end) < min_digits)
+    {
+        *--end = '0';
     }
 
-    /* Write lower digit */
-    num += PutChar(pStr, (absolute % 10) + '0');
-
-    return num;
+    return end;
 }
 
-// reverses a string 'str' of length 'len'
-void reverse(char *str, int len)
+static char * hex_digits(char * end, uint32_t value, int const upper_case)
 {
-    int i=0, j=len-1, temp;
-    while (i<j)
+    char const * const digits = upper_case ? "0123456789ABCDEF" : "0123456789abcdef";
+
+    do
     {
-        temp = str[i];
-        str[i] = str[j];
-        str[j] = temp;
-        i++; j--;
+        *--end = digits[value & 0xf];
+        value >>= 4;
     }
+    while (value != 0);
+
+    return end;
 }
- 
- // Converts a given integer x to string str[].  d is the number
- // of digits required in output. If d is more than the number
- // of digits in x, then 0s are added at the beginning.
-int intToStr(unsigned int x, char str[], int d)
+
+static void put_fill(format_sink_st * const sink, char const fill, unsigned int count)
 {
-    int i = 0;
-    while (x)
+    static char const spaces[] = "                ";
+    static char const zeros[] = "0000000000000000";
+    char const * const fill_chars = (fill == '0') ? zeros : spaces;
+
+    while (count > 0)
     {
-        char ch = (x % 10) + '0'; 
-        str[i++] = ch;
-        x = x/10;
+        unsigned int const len = (count < sizeof spaces - 1) ? count : sizeof spaces - 1;
+
+        sink->put(sink, fill_chars, len);
+        count -= len;
     }
-    // If number of digits required is more, then
-    // add 0s at the beginning
-    while (i < d)
-        str[i++] = '0';
-    str[i] = '\0'; 
-    reverse(str, i);
-    return i;
 }
- 
-// Converts a floating point number to string.
-int ftoa(float n, char *res, int afterpoint)
+
+/**
+ * @brief  Outputs a converted value padded to the requested width. Zero fill
+ *         goes after the sign, space fill before it.
+ */
+static void put_padded(format_sink_st * const sink,
+                       char const fill,
+                       unsigned int const width,
+                       int const negative,
+                       char const * const digits,
+                       size_t const len)
 {
-    int i = 0;
-    // Extract integer part
-    unsigned int ipart;
-    float fpart; 
+    size_t const total = len + (negative ? 1 : 0);
+    unsigned int const padding = (width > total) ? width - total : 0;
 
- 
-    if (n < 0.0)
+    if (fill != '0')
     {
-        n = -n;
-        res[i] = '-';
-        i++;
+        put_fill(sink, fill, padding);
     }
-    ipart = (unsigned int)n; 
-    // Extract floating part
-    fpart = n - (float)ipart; 
-
-    // convert integer part to string
-    i += intToStr(ipart, res + i, 1);
- 
-    // check for display option after point
-    if (afterpoint != 0)
+    if (negative)
     {
-        res[i] = '.';  // add dot
-        i++;
-        // Get the value of fraction part up to given no.
-        // of points after dot. The third parameter is needed
-        // to handle cases like 233.007
-        fpart = fpart * pow(10, afterpoint);
- 
-        i += intToStr((unsigned int)fpart, res + i, afterpoint);
+        sink->put(sink, "-", 1);
     }
-
-    return i;
-}
-
-signed int PutFloat(
-    char * pStr,
-    char fill,
-    signed int width,
-    float value)
-{
-    UNUSED(fill);
-    UNUSED(width);
-
-    return ftoa(value, pStr, 5);
+    if (fill == '0')
+    {
+        put_fill(sink, fill, padding);
+    }
+    sink->put(sink, digits, len);
 }
 
 /**
- * @brief  Writes an hexadecimal value into a string, using the given fill, width &
- *         capital parameters.
- *
- * @param pStr   Storage string.
- * @param fill   Fill character.
- * @param width  Minimum integer width.
- * @param maj    Indicates if the letters must be printed in lower- or upper-case.
- * @param value  Hexadecimal value.
- *
- * @return  The number of char written
+ * @brief  Fixed precision float conversion using scaled integers. Only
+ *         single precision operations are used, which the FPU supports.
+ *         Values beyond the range of a 32 bit integer are clamped.
  */
-signed int PutHexa(
-    char *pStr,
-    char fill,
-    signed int width,
-    unsigned char maj,
-    unsigned int value)
+static void put_float(format_sink_st * const sink,
+                      char const fill,
+                      unsigned int const width,
+                      unsigned int precision,
+                      float value)
 {
-    signed int num = 0;
-
-    /* Decrement width */
-    width--;
-
-    /* Recursively output upper digits */
-    if ((value >> 4) > 0) {
+    char buf[MAX_INTEGER_DIGITS + 1 + MAX_FLOAT_PRECISION];
+    char * const end = buf + sizeof buf;
+    char * start;
+    int negative = 0;
+    uint32_t integer_part;
+    uint32_t fraction;
+
+    if (value != value)
+    {
+        put_padded(sink, ' ', width, 0, "nan", 3);
+        goto done;
+    }
 
-        num += PutHexa(pStr, fill, width, maj, value >> 4);
-        pStr += num;
+    if (precision > MAX_FLOAT_PRECISION)
+    {
+        precision = MAX_FLOAT_PRECISION;
     }
-    /* Write filler chars */
-    else {
 
-        while (width > 0) {
+    if (value < 0.0f)
+    {
+        negative = 1;
+        value = -value;
+    }
+    if (value >= 4294967295.0f)
+    {
+        integer_part = UINT32_MAX;
+        fraction = 0;
+    }
+    else
+    {
+        float fraction_scaled;
 
-            PutChar(pStr, fill);
-            pStr++;
-            num++;
-            width--;
+        integer_part = (uint32_t)value;
+        fraction_scaled = (value - (float)integer_part) * (float)powers_of_10[precision] + 0.5f;
+        fraction = (uint32_t)fraction_scaled;
+        /* Rounding may carry into the integer part. */
+        if (fraction >= powers_of_10[precision])
+        {
+            fraction -= powers_of_10[precision];
+            integer_part++;
         }
     }
 
-    /* Write current digit */
-    if ((value & 0xF) < 10) {
-
-        PutChar(pStr, (value & 0xF) + '0');
+    if (precision > 0)
+    {
+        start = decimal_digits(end, fraction, precision);
+        *--start = '.';
+        start = decimal_digits(start, integer_part, 1);
     }
-    else if (maj) {
-
-        PutChar(pStr, (value & 0xF) - 10 + 'A');
+    else
+    {
+        start = decimal_digits(end, integer_part, 1);
     }
-    else {
 
-        PutChar(pStr, (value & 0xF) - 10 + 'a');
-    }
-    num++;
+    put_padded(sink, fill, width, negative, start, end - start);
 
-    return num;
+done:
+    return;
 }
 
-
-
-/* Global Functions ----------------------------------------------------------- */
-
-#define IS_DOUBLE_WORD_ALIGNED(x) ((x) & 1)
-
-static signed int local_vsnprintf(int isDoubleWordAligned, char * pStr, size_t length, const char * pFormat, va_list ap)
+/**
+ * @brief  The formatter shared by all the printf style methods.
+ *
+ * @return  The number of characters output, or -1 if the format string
+ *          contains an unsupported conversion.
+ */
+static signed int format_stream(format_sink_st * const sink, const char * pFormat, va_list ap)
 {
-    char          fill;
-    unsigned char width;
-    signed int    num = 0;
-    size_t    size = 0;
-
-    /* Clear the string */
-    if (pStr)
-    {
+    signed int result;
 
-        *pStr = 0;
-    }
+    sink->count = 0;
 
-    /* Phase string */
-    while (*pFormat != 0 && size < length)
+    while (*pFormat != 0)
     {
-
-        /* Normal character */
-        if (*pFormat != '%')
+        char const * const literal = pFormat;
+        char buf[MAX_INTEGER_DIGITS];
+        char * const end = buf + sizeof buf;
+        char * start;
+        char fill = ' ';
+        unsigned int width = 0;
+        unsigned int precision = DEFAULT_FLOAT_PRECISION;
+
+        /* Output runs of normal characters in one go. */
+        while (*pFormat != 0 && *pFormat != '%')
         {
-
-            *pStr++ = *pFormat++;
-            size++;
+            pFormat++;
         }
-        /* Escaped '%' */
-        else if (*(pFormat + 1) == '%')
+        if (pFormat != literal)
         {
-
-            *pStr++ = '%';
-            pFormat += 2;
-            size++;
+            sink->put(sink, literal, pFormat - literal);
         }
-        /* Token delimiter */
-        else
+        if (*pFormat == 0)
         {
+            break;
+        }
+        pFormat++;
 
-            fill = ' ';
-            width = 0;
+        /* Escaped '%' */
+        if (*pFormat == '%')
+        {
+            sink->put(sink, "%", 1);
             pFormat++;
+            continue;
+        }
 
-            /* Parse filler */
-            if (*pFormat == '0')
-            {
+        /* Parse filler */
+        if (*pFormat == '0')
+        {
+            fill = '0';
+            pFormat++;
+        }
 
-                fill = '0';
-                pFormat++;
-            }
+        /* Parse width */
+        while ((*pFormat >= '0') && (*pFormat <= '9'))
+        {
+            width = (width * 10) + *pFormat - '0';
+            pFormat++;
+        }
 
-            /* Parse width */
+        /* Parse precision */
+        if (*pFormat == '.')
+        {
+            pFormat++;
+            precision = 0;
             while ((*pFormat >= '0') && (*pFormat <= '9'))
             {
-
-                width = (width * 10) + *pFormat - '0';
+                precision = (precision * 10) + *pFormat - '0';
                 pFormat++;
             }
+        }
+
+        if (*pFormat == 'l')
+        {
+            pFormat++;
+        }
 
-            /* Check if there is enough space */
-            if (size + width > length)
+        /* Parse type */
+        switch (*pFormat)
+        {
+            case 'd':
+            case 'i':
             {
+                signed int const value = va_arg(ap, signed int);
+                uint32_t const absolute = (value < 0) ? -(uint32_t)value : (uint32_t)value;
 
-                width = length - size;
+                start = decimal_digits(end, absolute, 1);
+                put_padded(sink, fill, width, value < 0, start, end - start);
+                break;
             }
-
-            if (*pFormat == 'l')
+            case 'u':
+                start = decimal_digits(end, va_arg(ap, unsigned int), 1);
+                put_padded(sink, fill, width, 0, start, end - start);
+                break;
+            case 'p':
+            case 'x':
+            case 'X':
+                start = hex_digits(end, va_arg(ap, unsigned int), *pFormat == 'X');
+                put_padded(sink, fill, width, 0, start, end - start);
+                break;
+            case 's':
             {
-                pFormat++;
-            }
+                char const * const pSource = va_arg(ap, char *);
 
-            /* Parse type */
-            switch (*pFormat)
-            {
-                case 'd':
-                case 'i':
-                    num = PutSignedInt(pStr, fill, width, va_arg(ap, signed int)); isDoubleWordAligned++; break;
-                case 'u':
-                    num = PutUnsignedInt(pStr, fill, width, va_arg(ap, unsigned int)); isDoubleWordAligned++; break;
-                case 'p':
-                case 'x':
-                    num = PutHexa(pStr, fill, width, 0, va_arg(ap, unsigned int)); isDoubleWordAligned++; break;
-                case 'X':
-                    num = PutHexa(pStr, fill, width, 1, va_arg(ap, unsigned int)); isDoubleWordAligned++; break;
-                case 's':
-                    num = PutString(pStr, va_arg(ap, char *)); isDoubleWordAligned++; break;
-                case 'c':
-                    num = PutChar(pStr, va_arg(ap, unsigned int)); isDoubleWordAligned++; break;
-                case 'f':
-                {
-                    union
-                    {
-                        uint32_t i[2];
-                        double f;
-                    } u;
-                    if (IS_DOUBLE_WORD_ALIGNED(isDoubleWordAligned) == 0)
-                    {
-                        u.i[0] = va_arg(ap, uint32_t);
-                        isDoubleWordAligned++;
-                    }
-                    u.i[0] = va_arg(ap, uint32_t);
-                    u.i[1] = va_arg(ap, uint32_t);
-                    num = PutFloat(pStr, 0, 0, u.f); break;
-                }
-#if 0
-                case 'g':
-                {
-                    float *pf = (float *)va_arg(ap, long);
-                    isDoubleWordAligned++;
-                    num = PutFloat(pStr, *pf);
-                    break;
-                }
-#endif
-                default:
-                    return -1;
+                sink->put(sink, pSource, strlen(pSource));
+                break;
             }
-
-            pFormat++;
-            pStr += num;
-            size += num;
+            case 'c':
+                buf[0] = va_arg(ap, unsigned int);
+                sink->put(sink, buf, 1);
+                break;
+            case 'f':
+                /* float arguments are promoted to double. */
+                put_float(sink, fill, width, precision, (float)va_arg(ap, double));
+                break;
+            default:
+                result = -1;
+                goto done;
         }
+
+        pFormat++;
     }
 
-    /* NUL terminated (final '\0' is not counted) */
-    if (size < length)
-    {
+    result = sink->count;
+
+done:
+    return result;
+}
+
+static void string_sink_put(format_sink_st * const sink, char const * const data, size_t const len)
+{
+    string_sink_st * const string_sink = (string_sink_st *)sink;
+    size_t const to_copy = (len < string_sink->space) ? len : string_sink->space;
+
+    memcpy(string_sink->pStr, data, to_copy);
+    string_sink->pStr += to_copy;
+    string_sink->space -= to_copy;
+    sink->count += to_copy;
+}
 
-        *pStr = '\0';
+static void stream_sink_flush(stream_sink_st * const stream_sink)
+{
+    if (stream_sink->used > 0)
+    {
+        debug_put_block(stream_sink->chunk, stream_sink->used);
+        stream_sink->used = 0;
     }
-    else
+}
+
+static void stream_sink_put(format_sink_st * const sink, char const * data, size_t len)
+{
+    stream_sink_st * const stream_sink = (stream_sink_st *)sink;
+
+    sink->count += len;
+
+    /* Large blocks skip the staging chunk. */
+    if (len >= STREAM_CHUNK_SIZE)
     {
+        stream_sink_flush(stream_sink);
+        debug_put_block((void *)data, len);
+        goto done;
+    }
 
-        *(--pStr) = '\0';
-        size--;
+    if (stream_sink->used + len > STREAM_CHUNK_SIZE)
+    {
+        stream_sink_flush(stream_sink);
     }
+    memcpy(&stream_sink->chunk[stream_sink->used], data, len);
+    stream_sink->used += len;
 
-    return size;
+done:
+    return;
 }
 
 /**
@@ -487,7 +437,26 @@ static signed int local_vsnprintf(int isDoubleWordAligned, char * pStr, size_t l
  */
 signed int vsnprintf(char *pStr, size_t length, const char *pFormat, va_list ap)
 {
-    return local_vsnprintf(0, pStr, length, pFormat, ap);
+    string_sink_st string_sink;
+    signed int result;
+
+    if (length == 0)
+    {
+        result = 0;
+        goto done;
+    }
+
+    string_sink.sink.put = string_sink_put;
+    string_sink.pStr = pStr;
+    string_sink.space = length - 1;
+
+    result = format_stream(&string_sink.sink, pFormat, ap);
+
+    /* NUL terminated (final '\0' is not counted) */
+    *string_sink.pStr = '\0';
+
+done:
+    return result;
 }
 
 
@@ -533,26 +502,34 @@ signed int vsprintf(char *pString, const char *pFormat, va_list ap)
 
 /**
  * @brief  Outputs a formatted string on the given stream. Format arguments are given
- *         in a va_list instance.
+ *         in a va_list instance. There is no limit on the length of the output.
  *
  * @param pStream  Output stream.
  * @param pFormat  Format string
  * @param ap       Argument list.
+ *
+ * @return  The number of characters written, or -1 if the output stream is not
+ *          stdout or stderr.
  */
 signed int vfprintf(FILE *pStream, const char *pFormat, va_list ap)
 {
-    char pStr[MAX_STRING_SIZE];
-    char pError[] = "printf.c: increase MAX_STRING_SIZE\n\r";
-
-    /* Write formatted string in buffer */
-    if (vsprintf(pStr, pFormat, ap) >= MAX_STRING_SIZE) {
+    stream_sink_st stream_sink;
+    signed int result;
 
-        fputs(pError, stderr);
-        while (1); /* Increase MAX_STRING_SIZE */
+    if ((pStream != stdout) && (pStream != stderr))
+    {
+        result = EOF;
+        goto done;
     }
 
-    /* Display string */
-    return fputs(pStr, pStream);
+    stream_sink.sink.put = stream_sink_put;
+    stream_sink.used = 0;
+
+    result = format_stream(&stream_sink.sink, pFormat, ap);
+    stream_sink_flush(&stream_sink);
+
+done:
+    return result;
 }
 
 
@@ -656,7 +633,7 @@ signed int fputc(signed int c, FILE *pStream)
 {
     if ((pStream == stdout) || (pStream == stderr))
     {
-    	PrintChar(c);
+    	debug_put_char(c);
         return c;
     }
     else
@@ -678,19 +655,16 @@ signed int fputc(signed int c, FILE *pStream)
  */
 signed int fputs(const char *pStr, FILE *pStream)
 {
-    signed int num = 0;
-
-    while (*pStr != 0) {
+    size_t const len = strlen(pStr);
 
-        if (fputc(*pStr, pStream) == -1) {
-
-            return -1;
-        }
-        num++;
-        pStr++;
+    if ((pStream != stdout) && (pStream != stderr))
+    {
+        return EOF;
     }
 
-    return num;
+    debug_put_block((void *)pStr, len);
+
+    return len;
 }
 
 /* --------------------------------- End Of File ------------------------------ */
@@ -1,11 +1,19 @@
 #include "main_input_timer.h"
 
 #include "stm32f4_utils.h"
+#include "cpu_load.h"
 #include "utils.h"
 
 #include "stm32f4xx_tim.h"
 #include "stm32f4xx_rcc.h"
 
+#include "CoOS.h"
+#include "OsArch.h"
+
+#if CFG_TICKLESS_EN > 0 && TIMER_FREQUENCY != 1000000
+#error "CoOS tickless timing needs TIM2 to count microseconds"
+#endif
+
 #include <stdlib.h>
 #include <stdbool.h>
 
@@ -111,11 +119,25 @@ static void handle_input_capture(channel_config_st const * const channel_config,
 
 void TIM2_IRQHandler(void)
 {
+    cpu_load_isr_stamp_st const stamp = cpu_load_isr_enter();
+
     if (TIM_GetITStatus(TIM2, TIM_IT_CC1))
     {
+        cpu_load_isr_latency_record(cpu_load_isr_tim2, TIM_GetCounter(TIM2) - TIM_GetCapture1(TIM2));
         TIM_ClearITPendingBit(TIM2, TIM_IT_CC1);
         handle_input_capture(&channel_configs[CH1_IDX], &input_capture_contexts[CH1_IDX]);
     }
+#if CFG_TICKLESS_EN > 0
+    /* CoOS uses channel 2 to wake when a delay or timer ends. */
+    if (TIM_GetITStatus(TIM2, TIM_IT_CC2))
+    {
+        cpu_load_isr_latency_record(cpu_load_isr_tim2, TIM_GetCounter(TIM2) - TIM_GetCapture2(TIM2));
+        TIM_ClearITPendingBit(TIM2, TIM_IT_CC2);
+        TicklessCompareISR();
+    }
+#endif
+
+    cpu_load_isr_exit(cpu_load_isr_tim2, stamp);
 }
 
 uint32_t main_input_timer_count_get(void)
@@ -173,6 +195,9 @@ void register_crank_trigger_callback(void (* callback)(uint32_t const timestamp_
     register_input_trigger_callback(CRANK_INPUT_CAPTURE_INDEX, callback);
 }
 
+/* Must be called before CoInitOS(), as CoOS counts microseconds 
+ * with this timer. 
+ */
 void main_input_timer_init(uint32_t const frequency)
 {
     /* Enable peripheral clock for the timer. */
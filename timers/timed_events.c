@@ -2,6 +2,7 @@
 #include "queue.h"
 #include "utils.h"
 #include "stm32f4_utils.h"
+#include "cpu_load.h"
 
 #include "stm32f4xx_tim.h"
 
@@ -58,6 +59,7 @@ struct timer_st
     void (* RCC_APBPeriphClockCmd)(uint32_t RCC_APB1Periph, FunctionalState NewState);
     uint32_t RCC_APBPeriph;
     uint8_t IRQ_channel;
+    cpu_load_isr_t load_isr;
     bool use_PCLK2;
 
     size_t num_channels;
@@ -176,6 +178,7 @@ static timer_st const timers[] =
         .RCC_APBPeriphClockCmd = RCC_APB2PeriphClockCmd,
         .RCC_APBPeriph = RCC_APB2Periph_TIM1,
         .IRQ_channel = TIM1_CC_IRQn,
+        .load_isr = cpu_load_isr_tim1_cc,
         .num_channels = 4,
         .channels = tim1_timer_channel_contexts,
         .use_PCLK2 = true
@@ -186,6 +189,7 @@ static timer_st const timers[] =
         .RCC_APBPeriphClockCmd = RCC_APB1PeriphClockCmd,
         .RCC_APBPeriph = RCC_APB1Periph_TIM3,
         .IRQ_channel = TIM3_IRQn,
+        .load_isr = cpu_load_isr_tim3,
         .num_channels = 4,
         .channels = tim3_timer_channel_contexts,
         .use_PCLK2 = false
@@ -196,6 +200,7 @@ static timer_st const timers[] =
         .RCC_APBPeriphClockCmd = RCC_APB1PeriphClockCmd,
         .RCC_APBPeriph = RCC_APB1Periph_TIM4,
         .IRQ_channel = TIM4_IRQn,
+        .load_isr = cpu_load_isr_tim4,
         .num_channels = 4,
         .channels = tim4_timer_channel_contexts,
         .use_PCLK2 = false
@@ -206,6 +211,7 @@ static timer_st const timers[] =
         .RCC_APBPeriphClockCmd = RCC_APB2PeriphClockCmd,
         .RCC_APBPeriph = RCC_APB2Periph_TIM8,
         .IRQ_channel = TIM8_CC_IRQn,
+        .load_isr = cpu_load_isr_tim8_cc,
         .num_channels = 4,
         .channels = tim8_timer_channel_contexts,
         .use_PCLK2 = true
@@ -350,6 +356,10 @@ static void TIM_Handle_CC_IRQ(TIM_TypeDef * const TIMx, timer_channel_context_st
 
     if (TIM_GetITStatus(TIMx, capture_config->capture_compare_interrupt) != RESET)
     {
+        /* How long after the compare this was seen. */
+        uint16_t const latency = TIM_GetCounter(TIMx) - capture_config->TIM_GetCapture(TIMx);
+
+        cpu_load_isr_latency_record(channel->timer->load_isr, latency);
         TIM_ClearITPendingBit(TIMx, capture_config->capture_compare_interrupt);
         if (channel->handler != NULL)
         {
@@ -364,6 +374,7 @@ static void TIM_Handle_CC_IRQ(TIM_TypeDef * const TIMx, timer_channel_context_st
 static void TIM_IRQ_Handler(timer_st const * const timer)
 {
     TIM_TypeDef * const TIMx = timer->TIM;
+    cpu_load_isr_stamp_st const stamp = cpu_load_isr_enter();
     size_t index;
 
     for (index = 0; index < timer->num_channels; index++)
@@ -372,6 +383,8 @@ static void TIM_IRQ_Handler(timer_st const * const timer)
 
         TIM_Handle_CC_IRQ(TIMx, channel);
     }
+
+    cpu_load_isr_exit(timer->load_isr, stamp);
 }
 
 void TIM3_IRQHandler(void)
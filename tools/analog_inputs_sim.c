@@ -0,0 +1,278 @@
+/* Feeds simulated sensor waveforms to the analog input processing
+ * (app/analog_inputs.c) through a stand-in for the ADC scan driver
+ * (drivers/adc.h). Runs on the host.
+ *
+ * The stand-in fills the halves of the circular sample buffer in
+ * turn, as the DMA does, at the rate the target scans (6 inputs
+ * at ~23.4us a conversion), and calls the owner's samplesReady
+ * callback for each half. Checks that:
+ *   - steady inputs come out as the sum of a block of samples,
+ *     from the first block.
+ *   - a step on the throttle input follows the first order filter
+ *     with that input's time constant.
+ *   - alternator ripple on the battery input is filtered down.
+ *   - snapshots agree with the single values.
+ * Then measures the processing of a block, which runs in the DMA
+ * interrupt on the target. Host times are only good for
+ * comparison.
+ *
+ * e.g. analog_inputs_sim
+ */
+#include "analog_inputs.h"
+#include "adc.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#define SCANS_PER_BLOCK 16 /* ADC_SCANS_PER_BLOCK in app/analog_inputs.c */
+#define CONVERSION_SECONDS 23.4e-6
+#define SCAN_SECONDS (CONVERSION_SECONDS * analog_input_COUNT)
+
+#define TPS_FILTER_SHIFT 1
+#define STEP_BLOCKS 12
+#define SETTLE_BLOCKS 400
+#define RIPPLE_BLOCKS 200
+#define RIPPLE_HZ 1234.0
+#define RIPPLE_AMPLITUDE 200.0
+#define MAXIMUM_RIPPLE_FRACTION 0.1 /* Of the input ripple, after filtering. */
+#define BENCH_BLOCKS 10000000
+
+typedef struct waveform_st
+{
+    double dc[analog_input_COUNT];
+    double ripple_amplitude[analog_input_COUNT];
+    double ripple_hz;
+} waveform_st;
+
+typedef struct adc_sim_st
+{
+    adc_init_st cfg;
+    bool second_half;
+    double time_seconds;
+    unsigned int failures;
+} adc_sim_st;
+
+static adc_sim_st adc_sim;
+
+void const *stm32_adc_scan_init(adc_init_st const *cfg)
+{
+    adc_sim.cfg = *cfg;
+
+    return &adc_sim;
+}
+
+uint32_t main_input_timer_count_get(void)
+{
+    return adc_sim.time_seconds * 1.0e6;
+}
+
+static void failure(char const * const what, long const got, long const expected)
+{
+    if (adc_sim.failures++ < 20)
+    {
+        fprintf(stderr, "%s: got %ld expected %ld\n", what, got, expected);
+    }
+}
+
+/* Write the next block of scans as the DMA would and tell the
+ * owner, as the half or full transfer interrupt would.
+ */
+static void block_run(waveform_st const * const waveform)
+{
+    adc_init_st const * const cfg = &adc_sim.cfg;
+    size_t const block_samples = cfg->scans_per_block * cfg->num_channels;
+    uint16_t * const block = &cfg->sample_buffer[adc_sim.second_half ? block_samples : 0];
+    uint16_t * sample = block;
+    size_t scan;
+    size_t input;
+
+    for (scan = 0; scan < cfg->scans_per_block; scan++)
+    {
+        for (input = 0; input < cfg->num_channels; input++)
+        {
+            double const t = adc_sim.time_seconds + (input * CONVERSION_SECONDS);
+            long value = lrint(waveform->dc[input]
+                               + waveform->ripple_amplitude[input] * sin(2.0 * M_PI * waveform->ripple_hz * t));
+
+            if (value < 0)
+            {
+                value = 0;
+            }
+            else if (value > 4095)
+            {
+                value = 4095;
+            }
+            *sample++ = value;
+        }
+        adc_sim.time_seconds += SCAN_SECONDS;
+    }
+
+    cfg->callback.samplesReady(cfg->callback.pv, block, cfg->scans_per_block);
+    adc_sim.second_half = !adc_sim.second_half;
+}
+
+static void steady_check(void)
+{
+    waveform_st waveform = { .ripple_hz = 0.0 };
+    analog_inputs_snapshot_st snapshot;
+    size_t input;
+
+    for (input = 0; input < analog_input_COUNT; input++)
+    {
+        waveform.dc[input] = 500 + (input * 600);
+    }
+    block_run(&waveform);
+
+    analog_inputs_snapshot_get(&snapshot);
+    for (input = 0; input < analog_input_COUNT; input++)
+    {
+        long const expected = waveform.dc[input] * SCANS_PER_BLOCK;
+
+        if (analog_input_value_get(input) != expected)
+        {
+            failure("steady input", analog_input_value_get(input), expected);
+        }
+        if (snapshot.values[input] != analog_input_value_get(input))
+        {
+            failure("snapshot", snapshot.values[input], analog_input_value_get(input));
+        }
+    }
+}
+
+static void step_check(void)
+{
+    waveform_st waveform = { .ripple_hz = 0.0 };
+    double const from = 1000.0 * SCANS_PER_BLOCK;
+    double const to = 3000.0 * SCANS_PER_BLOCK;
+    double const retained = 1.0 - 1.0 / (1 << TPS_FILTER_SHIFT);
+    unsigned int block;
+    size_t input;
+
+    for (input = 0; input < analog_input_COUNT; input++)
+    {
+        waveform.dc[input] = 1000.0;
+    }
+    for (block = 0; block < SETTLE_BLOCKS; block++)
+    {
+        block_run(&waveform);
+    }
+
+    waveform.dc[analog_input_tps] = 3000.0;
+    for (block = 1; block <= STEP_BLOCKS; block++)
+    {
+        long const expected = lrint(to - (to - from) * pow(retained, block));
+
+        block_run(&waveform);
+        if (labs((long)analog_input_value_get(analog_input_tps) - expected) > 1)
+        {
+            failure("throttle step", analog_input_value_get(analog_input_tps), expected);
+        }
+        if (analog_input_value_get(analog_input_map) != from)
+        {
+            failure("other inputs move with the throttle", analog_input_value_get(analog_input_map), from);
+        }
+    }
+}
+
+/* Returns the ripple left on the battery input, as a fraction of
+ * the ripple on the samples.
+ */
+static double ripple_check(void)
+{
+    waveform_st waveform = { .ripple_hz = RIPPLE_HZ };
+    uint16_t minimum = UINT16_MAX;
+    uint16_t maximum = 0;
+    double ripple_fraction;
+    unsigned int block;
+    size_t input;
+
+    for (input = 0; input < analog_input_COUNT; input++)
+    {
+        waveform.dc[input] = 2000.0;
+    }
+    waveform.ripple_amplitude[analog_input_battery] = RIPPLE_AMPLITUDE;
+    for (block = 0; block < SETTLE_BLOCKS + RIPPLE_BLOCKS; block++)
+    {
+        block_run(&waveform);
+        if (block >= SETTLE_BLOCKS)
+        {
+            uint16_t const value = analog_input_value_get(analog_input_battery);
+
+            if (value < minimum)
+            {
+                minimum = value;
+            }
+            if (value > maximum)
+            {
+                maximum = value;
+            }
+        }
+    }
+
+    ripple_fraction = (maximum - minimum) / (2.0 * RIPPLE_AMPLITUDE * SCANS_PER_BLOCK);
+    if (ripple_fraction > MAXIMUM_RIPPLE_FRACTION)
+    {
+        failure("battery ripple after filtering (0.1%)", lrint(ripple_fraction * 1000.0), lrint(MAXIMUM_RIPPLE_FRACTION * 1000.0));
+    }
+
+    return ripple_fraction;
+}
+
+static double elapsed_ns(struct timespec const * const start, struct timespec const * const end)
+{
+    return (end->tv_sec - start->tv_sec) * 1.0e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* Process the same two blocks over and over, so only the
+ * processing is timed.
+ */
+static double block_bench(void)
+{
+    adc_init_st const * const cfg = &adc_sim.cfg;
+    size_t const block_samples = cfg->scans_per_block * cfg->num_channels;
+    struct timespec start;
+    struct timespec end;
+    unsigned int block;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (block = 0; block < BENCH_BLOCKS; block++)
+    {
+        cfg->callback.samplesReady(cfg->callback.pv,
+                                   &cfg->sample_buffer[(block & 1) ? block_samples : 0],
+                                   cfg->scans_per_block);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return elapsed_ns(&start, &end) / BENCH_BLOCKS;
+}
+
+int main(void)
+{
+    double ripple_fraction;
+    double block_ns;
+
+    analog_inputs_init();
+    if (adc_sim.cfg.num_channels != analog_input_COUNT || adc_sim.cfg.scans_per_block != SCANS_PER_BLOCK)
+    {
+        failure("scan configuration", adc_sim.cfg.scans_per_block, SCANS_PER_BLOCK);
+        goto done;
+    }
+
+    steady_check();
+    step_check();
+    ripple_fraction = ripple_check();
+    block_ns = block_bench();
+
+    printf("%.0f Hz battery ripple filtered to %.1f%%\n", RIPPLE_HZ, ripple_fraction * 100.0);
+    printf("%.1f ns per block of %u scans, a block every %.2f ms\n",
+           block_ns, SCANS_PER_BLOCK, SCANS_PER_BLOCK * SCAN_SECONDS * 1000.0);
+
+done:
+    printf("%u failures\n", adc_sim.failures);
+
+    return (adc_sim.failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
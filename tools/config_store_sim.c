@@ -0,0 +1,290 @@
+/* Runs the configuration store (app/config_store.c) on the host
+ * against simulated flash, cutting the power at every possible
+ * point in a sequence of saves. Runs on the host.
+ *
+ * The simulated flash behaves like the STM32F4 internal flash:
+ * erased bytes read as 0xff, programming can only clear bits and a
+ * word that is being programmed or erased when the power goes may
+ * be left with any mix of its old and new bits.
+ * After each power cut the store is loaded again and the image
+ * must be either the one from before the interrupted save or the
+ * one it was saving. The time taken to load is also measured.
+ *
+ * e.g. config_store_sim
+ */
+#include "config_store.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#define ARRAY_SIZE(a) (sizeof((a)) / sizeof((a)[0]))
+
+/* Small sectors, so that the journal fills and the sectors rotate
+ * many times during the test.
+ */
+#define SIM_SECTOR_SIZE 2048
+#define SIM_IMAGE_SIZE 700 /* About the size of tune_config_st. */
+#define SIM_LAYOUT_VERSION 1
+#define SIM_NUM_SAVES 60
+#define LOAD_TIMING_ITERATIONS 10000
+
+typedef struct sim_flash_st
+{
+    uint8_t sectors[2][SIM_SECTOR_SIZE];
+    /* The power is cut during this operation. Negative to never
+     * cut the power.
+     */
+    long fail_at_operation;
+    long operations;
+    bool powered;
+    unsigned long erases;
+} sim_flash_st;
+
+static sim_flash_st sim;
+
+static uint32_t random_state = 1;
+
+static uint32_t random_get(void)
+{
+    /* xorshift32 */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    return random_state;
+}
+
+/* Returns false if the power is cut during this operation. */
+static bool sim_operation_start(void)
+{
+    bool powered = sim.powered;
+
+    if (powered && sim.operations++ == sim.fail_at_operation)
+    {
+        sim.powered = false;
+        powered = false;
+    }
+
+    return powered;
+}
+
+static bool sim_erase(void * const ctx, unsigned int const sector)
+{
+    size_t x;
+
+    (void)ctx;
+
+    if (!sim_operation_start())
+    {
+        /* Part of the sector may have been erased. */
+        if (sim.operations - 1 == sim.fail_at_operation)
+        {
+            size_t const erased = random_get() % SIM_SECTOR_SIZE;
+
+            for (x = 0; x < erased; x++)
+            {
+                sim.sectors[sector][x] = 0xff;
+            }
+            sim.sectors[sector][erased] |= random_get();
+        }
+        return false;
+    }
+
+    memset(sim.sectors[sector], 0xff, SIM_SECTOR_SIZE);
+    sim.erases++;
+
+    return true;
+}
+
+static bool sim_program(void * const ctx, uint8_t const * const address, void const * const data, size_t const len)
+{
+    uint8_t * const destination = (uint8_t *)address;
+    uint8_t const * const source = data;
+    size_t x;
+
+    (void)ctx;
+
+    if ((uintptr_t)address % 4 != 0 || len % 4 != 0)
+    {
+        fprintf(stderr, "unaligned program\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Each word is a separate operation, as it is on the target. */
+    for (x = 0; x < len; x += 4)
+    {
+        size_t y;
+
+        if (!sim_operation_start())
+        {
+            if (sim.operations - 1 == sim.fail_at_operation)
+            {
+                /* The word may have been partly programmed. */
+                for (y = 0; y < 4; y++)
+                {
+                    destination[x + y] &= source[x + y] | random_get();
+                }
+            }
+            return false;
+        }
+        for (y = 0; y < 4; y++)
+        {
+            destination[x + y] &= source[x + y];
+        }
+    }
+
+    return true;
+}
+
+static config_flash_st const sim_flash =
+{
+    .sectors = { sim.sectors[0], sim.sectors[1] },
+    .sector_size = SIM_SECTOR_SIZE,
+    .erase = sim_erase,
+    .program = sim_program,
+    .ctx = &sim
+};
+
+/* The images saved in turn. Mostly small edits, with the odd
+ * bigger one that needs a fresh image.
+ */
+static void image_generate(uint8_t images[][SIM_IMAGE_SIZE], size_t const num_images)
+{
+    size_t image;
+    size_t x;
+
+    for (x = 0; x < SIM_IMAGE_SIZE; x++)
+    {
+        images[0][x] = random_get();
+    }
+    for (image = 1; image < num_images; image++)
+    {
+        size_t const num_edits = (image % 10 == 0) ? 300 : 1 + random_get() % 8;
+
+        memcpy(images[image], images[image - 1], SIM_IMAGE_SIZE);
+        for (x = 0; x < num_edits; x++)
+        {
+            images[image][random_get() % SIM_IMAGE_SIZE] = random_get();
+        }
+    }
+}
+
+static uint8_t images[SIM_NUM_SAVES][SIM_IMAGE_SIZE];
+static uint8_t loaded_image[SIM_IMAGE_SIZE];
+
+/* Saves the images in turn until the power is cut, then checks
+ * what is loaded at the next power up. Returns the number of
+ * flash operations if the power was never cut.
+ */
+static long power_cut_run(long const fail_at_operation, unsigned int * const failures)
+{
+    config_store_st store;
+    size_t image;
+    long operations = -1;
+    bool loaded;
+    size_t last_saved = SIZE_MAX;
+
+    memset(sim.sectors, 0xff, sizeof sim.sectors);
+    sim.fail_at_operation = fail_at_operation;
+    sim.operations = 0;
+    sim.powered = true;
+
+    config_store_load(&store, &sim_flash, loaded_image, SIM_IMAGE_SIZE, SIM_LAYOUT_VERSION);
+    for (image = 0; image < SIM_NUM_SAVES && sim.powered; image++)
+    {
+        if (config_store_save(&store, images[image], true))
+        {
+            last_saved = image;
+        }
+        else if (sim.powered)
+        {
+            fprintf(stderr, "save %zu failed with the power on\n", image);
+            (*failures)++;
+        }
+    }
+    if (sim.powered)
+    {
+        operations = sim.operations;
+    }
+
+    /* Power up again. */
+    sim.powered = true;
+    sim.fail_at_operation = -1;
+    loaded = config_store_load(&store, &sim_flash, loaded_image, SIM_IMAGE_SIZE, SIM_LAYOUT_VERSION);
+
+    if (last_saved == SIZE_MAX)
+    {
+        /* Cut before the first save finished. Either nothing or
+         * the first image.
+         */
+        if (loaded && memcmp(loaded_image, images[0], SIM_IMAGE_SIZE) != 0)
+        {
+            fprintf(stderr, "power cut at %ld: unexpected image before the first save\n", fail_at_operation);
+            (*failures)++;
+        }
+    }
+    else if (!loaded
+             || (memcmp(loaded_image, images[last_saved], SIM_IMAGE_SIZE) != 0
+                 && (last_saved + 1 >= SIM_NUM_SAVES
+                     || memcmp(loaded_image, images[last_saved + 1], SIM_IMAGE_SIZE) != 0)))
+    {
+        fprintf(stderr, "power cut at %ld: loaded image is neither save %zu nor the next one\n",
+                fail_at_operation, last_saved);
+        (*failures)++;
+    }
+    else if (!config_store_save(&store, images[SIM_NUM_SAVES - 1], true)
+             || !config_store_load(&store, &sim_flash, loaded_image, SIM_IMAGE_SIZE, SIM_LAYOUT_VERSION)
+             || memcmp(loaded_image, images[SIM_NUM_SAVES - 1], SIM_IMAGE_SIZE) != 0)
+    {
+        fprintf(stderr, "power cut at %ld: save after power up failed\n", fail_at_operation);
+        (*failures)++;
+    }
+
+    return operations;
+}
+
+static double load_time_us_measure(void)
+{
+    config_store_st store;
+    struct timespec start;
+    struct timespec end;
+    unsigned int x;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (x = 0; x < LOAD_TIMING_ITERATIONS; x++)
+    {
+        config_store_load(&store, &sim_flash, loaded_image, SIM_IMAGE_SIZE, SIM_LAYOUT_VERSION);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return ((end.tv_sec - start.tv_sec) * 1.0e6 + (end.tv_nsec - start.tv_nsec) / 1.0e3) / LOAD_TIMING_ITERATIONS;
+}
+
+int main(void)
+{
+    config_store_st store;
+    unsigned int failures = 0;
+    long total_operations;
+    long fail_at;
+
+    image_generate(images, ARRAY_SIZE(images));
+
+    total_operations = power_cut_run(-1, &failures);
+    printf("%d saves took %ld flash operations and %lu erases\n", SIM_NUM_SAVES, total_operations, sim.erases);
+
+    config_store_load(&store, &sim_flash, loaded_image, SIM_IMAGE_SIZE, SIM_LAYOUT_VERSION);
+    printf("load of a %d byte image with a %zu byte journal: %.2f us\n",
+           SIM_IMAGE_SIZE, store.journal_end, load_time_us_measure());
+
+    for (fail_at = 0; fail_at < total_operations; fail_at++)
+    {
+        power_cut_run(fail_at, &failures);
+    }
+    printf("%ld power cuts, %u failures\n", total_operations, failures);
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,230 @@
+/* Runs the fuel calculation (app/fuel_calculator.c) on the host
+ * with the default configuration and simulated sensors. Runs on
+ * the host.
+ *
+ * Checks that:
+ *   - each update publishes the buffer that wasn't published.
+ *   - once the wall film has settled, the pulse width from the
+ *     event path is the published fuel pulse width plus the small
+ *     pulse correction and dead time.
+ *   - the small pulse correction the event path takes from the
+ *     published table stays close to the configured table at every
+ *     pulse width.
+ *   - no fuel wanted means no pulse at all.
+ * Then measures an update of the published parameters, as the
+ * fuel task does every FUEL_CALCULATION_PERIOD_MS, and an
+ * injection event, as injector_pulse_callback() does, while the
+ * engine sweeps through the tables. Host times are only good for
+ * comparison.
+ *
+ * e.g. fuel_bench
+ */
+#include <time.h>
+
+/* Included so that the static update can be timed on its own. */
+#include "fuel_calculator.c"
+
+#include <stdlib.h>
+
+#define SETTLE_EVENTS 200
+#define BENCH_UPDATES 1000000
+#define BENCH_EVENTS 10000000
+#define PULSE_WIDTH_TOLERANCE_US 2
+#define SMALL_PULSE_TOLERANCE_US 5 /* The resampled table cuts the corners of the table. */
+
+typedef struct engine_st
+{
+    float rpm;
+    float map_kpa;
+    float coolant_temperature;
+    float battery_voltage;
+    unsigned int failures;
+} engine_st;
+
+static engine_st engine =
+{
+    .rpm = 3000.0,
+    .map_kpa = 60.0,
+    .coolant_temperature = 85.0,
+    .battery_voltage = 13.8
+};
+
+uint32_t main_input_timer_count_get(void)
+{
+    return 0;
+}
+
+float trigger_36_1_rpm_get(trigger_wheel_36_1_context_st * const context)
+{
+    (void)context;
+
+    return engine.rpm;
+}
+
+float engine_sensors_map_kpa_get(void)
+{
+    return engine.map_kpa;
+}
+
+float engine_sensors_cylinder_map_kpa_get(size_t const cylinder)
+{
+    (void)cylinder;
+
+    return engine.map_kpa;
+}
+
+float engine_sensors_intake_air_temperature_get(void)
+{
+    return 20.0;
+}
+
+float engine_sensors_coolant_temperature_get(void)
+{
+    return engine.coolant_temperature;
+}
+
+float engine_sensors_battery_voltage_get(void)
+{
+    return engine.battery_voltage;
+}
+
+void cpu_load_task_name_set(OS_TID const task_id, char const * const name)
+{
+    (void)task_id;
+    (void)name;
+}
+
+static void failure(char const * const what, long const detail)
+{
+    if (engine.failures++ < 20)
+    {
+        fprintf(stderr, "%s (%ld)\n", what, detail);
+    }
+}
+
+static double elapsed_ns(struct timespec const * const start, struct timespec const * const end)
+{
+    return (end->tv_sec - start->tv_sec) * 1.0e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* Run injection events on every cylinder until the wall films
+ * have settled. Returns the last pulse width on cylinder 0.
+ */
+static uint32_t events_settle(void)
+{
+    unsigned int const num_cylinders = num_cylinders_get();
+    uint32_t pulse_width_us = 0;
+    unsigned int event;
+    size_t cylinder;
+
+    for (event = 0; event < SETTLE_EVENTS; event++)
+    {
+        for (cylinder = 0; cylinder < num_cylinders; cylinder++)
+        {
+            uint32_t const cylinder_pulse_width_us = fuel_injector_pulse_width_us_get(cylinder);
+
+            fuel_injection_scheduled(cylinder);
+            if (cylinder == 0)
+            {
+                pulse_width_us = cylinder_pulse_width_us;
+            }
+        }
+    }
+
+    return pulse_width_us;
+}
+
+static void checks_run(void)
+{
+    fuel_calculator_st * const calculator = &fuel_calculator;
+    fuel_injection_parameters_st const * const before = calculator->published_parameters;
+    uint32_t pulse_width_us;
+    int32_t expected_us;
+
+    fuel_calculator_update(calculator);
+    if (calculator->published_parameters == before)
+    {
+        failure("update published over the buffer in use", 0);
+    }
+    fuel_calculator_update(calculator);
+    if (calculator->published_parameters != before)
+    {
+        failure("update didn't swap back to the first buffer", 0);
+    }
+
+    pulse_width_us = events_settle();
+    expected_us = calculator->published_parameters->fuel_pulse_width_us[0]
+                  + calculator->debug_small_pulse_correction_us
+                  + calculator->published_parameters->dead_time_us;
+    if (labs((long)pulse_width_us - expected_us) > PULSE_WIDTH_TOLERANCE_US)
+    {
+        failure("settled pulse width isn't fuel + small pulse correction + dead time", pulse_width_us);
+    }
+
+    for (pulse_width_us = 0; pulse_width_us <= MAXIMUM_PULSE_WIDTH_US; pulse_width_us++)
+    {
+        int32_t const table_us = map_2d_lookup(&calculator->small_pulse_correction_map, (int32_t)pulse_width_us);
+        int32_t const event_us = small_pulse_correction_us_get(calculator->published_parameters, pulse_width_us);
+
+        if (labs((long)event_us - table_us) > SMALL_PULSE_TOLERANCE_US)
+        {
+            failure("small pulse correction strays from the table at", pulse_width_us);
+            break;
+        }
+    }
+
+    engine.map_kpa = 0.0;
+    fuel_calculator_update(calculator);
+    pulse_width_us = events_settle();
+    if (pulse_width_us != 0)
+    {
+        failure("pulse with no fuel wanted", pulse_width_us);
+    }
+}
+
+int main(void)
+{
+    fuel_calculator_st * const calculator = &fuel_calculator;
+    unsigned int num_cylinders;
+    struct timespec start;
+    struct timespec end;
+    uint32_t pulse_width_sum = 0;
+    unsigned int index;
+    double update_ns;
+    double event_ns;
+
+    tune_config_init(NULL);
+    fuel_calculator_init(NULL);
+    num_cylinders = num_cylinders_get();
+
+    checks_run();
+
+    /* Sweep the engine across the whole VE table. */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_UPDATES; index++)
+    {
+        engine.rpm = 500 + (index % 6500);
+        engine.map_kpa = 20 + (index % 8000) / 100.0;
+        fuel_maps_update(calculator);
+        fuel_calculator_update(calculator);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    update_ns = elapsed_ns(&start, &end) / BENCH_UPDATES;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_EVENTS; index++)
+    {
+        size_t const cylinder = index % num_cylinders;
+
+        pulse_width_sum += fuel_injector_pulse_width_us_get(cylinder);
+        fuel_injection_scheduled(cylinder);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    event_ns = elapsed_ns(&start, &end) / BENCH_EVENTS;
+
+    printf("%.1f ns per update, %.1f ns per injection event (sum %"PRIu32")\n",
+           update_ns, event_ns, pulse_width_sum);
+    printf("%u failures\n", engine.failures);
+
+    return (engine.failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
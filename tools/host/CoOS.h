@@ -0,0 +1,70 @@
+#ifndef __HOST_COOS_H__
+#define __HOST_COOS_H__
+
+/* Just enough of CoOS for the host tools that run target code in a 
+ * single thread. Mutexes do nothing. Tasks are never started, so 
+ * the tools call the target code's task work directly. The flag, 
+ * ISR, scheduler lock and time calls are only declared. The tools 
+ * that use them define them to suit what they simulate. 
+ */
+
+#define CFG_MAX_USER_TASKS 14
+#define MSTOTICKS(ms) (ms)
+
+typedef unsigned char OS_MutexID;
+typedef unsigned char OS_TID;
+typedef unsigned int OS_STK;
+typedef unsigned char U8;
+typedef unsigned short U16;
+typedef unsigned int U32;
+typedef unsigned char BOOL;
+typedef unsigned char OS_FlagID;
+typedef unsigned char StatusType;
+
+#define Co_FALSE (0)
+#define Co_TRUE (1)
+
+#define E_OK (StatusType)0
+#define E_TIMEOUT (StatusType)5
+
+void CoEnterISR(void);
+void CoExitISR(void);
+void CoSchedLock(void);
+void CoSchedUnlock(void);
+U32 CoGetOSTime32(void);
+OS_FlagID CoCreateFlag(BOOL bAutoReset, BOOL bInitialState);
+StatusType isr_SetFlag(OS_FlagID id);
+StatusType CoWaitForSingleFlag(OS_FlagID id, U32 timeout);
+
+static inline OS_MutexID CoCreateMutex(void)
+{
+    return 0;
+}
+
+static inline void CoEnterMutexSection(OS_MutexID const mutex)
+{
+    (void)mutex;
+}
+
+static inline void CoLeaveMutexSection(OS_MutexID const mutex)
+{
+    (void)mutex;
+}
+
+static inline OS_TID CoCreateTask(void (* const task)(void *), void * const argv, U8 const priority, OS_STK * const stack, U16 const stack_size)
+{
+    (void)task;
+    (void)argv;
+    (void)priority;
+    (void)stack;
+    (void)stack_size;
+
+    return 0;
+}
+
+static inline void CoTickDelay(U32 const ticks)
+{
+    (void)ticks;
+}
+
+#endif /* __HOST_COOS_H__ */
@@ -0,0 +1,14 @@
+#ifndef __HOST_OSARCH_H__
+#define __HOST_OSARCH_H__
+
+/* Stands in for the CoOS port header in the host tools. There is 
+ * no cycle counter, so CPU statistics are left off. The interrupt 
+ * masking calls are defined by the tools that use them. 
+ */
+
+#define CpuCycles() (0)
+
+void IRQ_DISABLE_SAVE(void);
+void IRQ_ENABLE_RESTORE(void);
+
+#endif /* __HOST_OSARCH_H__ */
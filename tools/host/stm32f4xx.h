@@ -0,0 +1,55 @@
+#ifndef __HOST_STM32F4XX_H__
+#define __HOST_STM32F4XX_H__
+
+#include <stdint.h>
+
+/* Stands in for the CMSIS device header in the host tools, which 
+ * don't touch the hardware. The Cortex-M4 SIMD intrinsics are 
+ * done in C, with the same results as the instructions, so that 
+ * code built with __ARM_FEATURE_DSP can be checked on the host. 
+ */
+
+typedef enum {DISABLE = 0, ENABLE = !DISABLE} FunctionalState;
+
+/* Only ever passed to the stand-in peripheral library. */
+typedef struct USART_TypeDef USART_TypeDef;
+
+#define USART1 ((USART_TypeDef *)0x40011000)
+
+static inline void __disable_irq(void)
+{
+}
+
+static inline void __enable_irq(void)
+{
+}
+
+#define __PKHBT(ARG1, ARG2, ARG3) ((((uint32_t)(ARG1)) & 0x0000FFFFUL) | \
+                                   ((((uint32_t)(ARG2)) << (ARG3)) & 0xFFFF0000UL))
+
+/* The sum wraps, as the instruction's does. */
+static inline uint32_t __SMLAD(uint32_t const x, uint32_t const y, uint32_t const accumulator)
+{
+    uint32_t const low = (uint32_t)((int32_t)(int16_t)x * (int16_t)y);
+    uint32_t const high = (uint32_t)((int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16));
+
+    return accumulator + low + high;
+}
+
+static inline uint64_t __SMLALD(uint32_t const x, uint32_t const y, uint64_t const accumulator)
+{
+    int64_t const low = (int64_t)(int16_t)x * (int16_t)y;
+    int64_t const high = (int64_t)(int16_t)(x >> 16) * (int16_t)(y >> 16);
+
+    return accumulator + (uint64_t)low + (uint64_t)high;
+}
+
+static inline int32_t __SSAT(int32_t const value, uint32_t const bits)
+{
+    int32_t const maximum = (int32_t)((1UL << (bits - 1)) - 1);
+    int32_t const minimum = -maximum - 1;
+
+    return (value > maximum) ? maximum : ((value < minimum) ? minimum : value);
+}
+
+#endif /* __HOST_STM32F4XX_H__ */
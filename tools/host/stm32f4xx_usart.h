@@ -0,0 +1,31 @@
+#ifndef __HOST_STM32F4XX_USART_H__
+#define __HOST_STM32F4XX_USART_H__
+
+#include "stm32f4xx.h"
+
+/* Stands in for the peripheral library USART header in the host 
+ * tools. USART_Init() and USART_Cmd() are defined by the tools 
+ * that use them. 
+ */
+
+typedef struct
+{
+    uint32_t USART_BaudRate;
+    uint16_t USART_WordLength;
+    uint16_t USART_StopBits;
+    uint16_t USART_Parity;
+    uint16_t USART_Mode;
+    uint16_t USART_HardwareFlowControl;
+} USART_InitTypeDef;
+
+#define USART_WordLength_8b ((uint16_t)0x0000)
+#define USART_StopBits_1 ((uint16_t)0x0000)
+#define USART_Parity_No ((uint16_t)0x0000)
+#define USART_Mode_Rx ((uint16_t)0x0004)
+#define USART_Mode_Tx ((uint16_t)0x0008)
+#define USART_HardwareFlowControl_None ((uint16_t)0x0000)
+
+void USART_Init(USART_TypeDef * USARTx, USART_InitTypeDef * USART_InitStruct);
+void USART_Cmd(USART_TypeDef * USARTx, FunctionalState NewState);
+
+#endif /* __HOST_STM32F4XX_USART_H__ */
@@ -0,0 +1,318 @@
+/* Checks and benchmarks the knock band-pass filter and energy
+ * kernel, knock_filter_power() (app/knock.c). Runs on the host.
+ *
+ * The kernel is checked against a reference worked out in 64 bit
+ * integers, which must match exactly, for random, full scale,
+ * worst case and tone inputs. It is also checked against a float biquad at the
+ * knock frequency, and for how well it rejects tones away from it.
+ * Then a window is timed at 8000 RPM, the worst case for an 8
+ * cylinder engine, and compared with the time between sparks.
+ * Built twice, with __ARM_FEATURE_DSP set (knock_bench_dsp), so the
+ * Cortex-M4 SIMD path runs on the host's stand-in intrinsics, and
+ * clear (knock_bench) for the C fallback. Host times are only good
+ * for comparison.
+ *
+ * e.g. knock_bench
+ */
+#include "knock.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+/* As in app/knock.c and the ADC3 burst in drivers/adc.c. */
+#define SAMPLE_RATE_HZ 42683 /* 84MHz / (4 * (480 + 12)) */
+#define KNOCK_FREQUENCY_HZ 6800.0
+#define KNOCK_FILTER_Q 4.0
+#define SAMPLE_OFFSET 2048
+#define SAMPLE_SHIFT 3
+#define FILTER_FRACTION_BITS 14
+#define WINDOW_DEGREES 60.0
+#define MAXIMUM_WINDOW_SAMPLES 512
+
+#define BENCH_RPM 8000.0
+#define BENCH_CYLINDERS 8
+#define BENCH_WINDOWS 2000000
+#define RANDOM_WINDOWS 20000
+#define TONE_AMPLITUDE 1000.0 /* 12 bit counts */
+#define CENTRE_POWER_TOLERANCE 0.05
+#define MINIMUM_REJECTION 50.0 /* Power ratio, centre to off band tones. */
+
+static uint32_t random_state = 1;
+static unsigned int failures;
+
+static uint32_t random_get(void)
+{
+    /* xorshift32 */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    return random_state;
+}
+
+static void failure(char const * const what, double const got, double const expected)
+{
+    if (failures++ < 20)
+    {
+        fprintf(stderr, "%s: got %.1f expected %.1f\n", what, got, expected);
+    }
+}
+
+static int32_t saturate16(int64_t const value)
+{
+    return (value > INT16_MAX) ? INT16_MAX : ((value < INT16_MIN) ? INT16_MIN : (int32_t)value);
+}
+
+static int16_t pair_bottom(uint32_t const pair)
+{
+    return (int16_t)pair;
+}
+
+static int16_t pair_top(uint32_t const pair)
+{
+    return (int16_t)(pair >> 16);
+}
+
+/* y[n] = sat16((b0.x[n] - b0.x[n-2] - a1.y[n-1] - a2.y[n-2] + 0.5) >> 14)
+ * with the history starting at the first sample. The power is the
+ * mean of y^2 over an even number of samples.
+ */
+static uint32_t reference_power(knock_filter_st const * const filter,
+                                uint16_t const * const samples,
+                                size_t const num_samples)
+{
+    size_t const num_used = num_samples & ~(size_t)1;
+    int64_t const b0 = pair_bottom(filter->b_pair);
+    int64_t const b2 = pair_top(filter->b_pair);
+    int64_t const minus_a1 = pair_bottom(filter->a_pair);
+    int64_t const minus_a2 = pair_top(filter->a_pair);
+    int64_t x1;
+    int64_t x2;
+    int64_t y1 = 0;
+    int64_t y2 = 0;
+    uint64_t energy = 0;
+    size_t index;
+
+    if (num_used == 0)
+    {
+        return 0;
+    }
+    x1 = x2 = ((int64_t)samples[0] - SAMPLE_OFFSET) * (1 << SAMPLE_SHIFT);
+
+    for (index = 0; index < num_used; index++)
+    {
+        int64_t const x0 = ((int64_t)samples[index] - SAMPLE_OFFSET) * (1 << SAMPLE_SHIFT);
+        int64_t const sum = (b0 * x0) + (b2 * x2) + (minus_a1 * y1) + (minus_a2 * y2) + (1 << (FILTER_FRACTION_BITS - 1));
+        int64_t const y0 = saturate16(sum >> FILTER_FRACTION_BITS);
+
+        energy += y0 * y0;
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
+    }
+
+    return energy / num_used;
+}
+
+/* The same filter in float, with unquantised coefficients. */
+static double float_power(double const frequency_hz, double const amplitude, size_t const num_samples)
+{
+    double const w0 = 2.0 * M_PI * KNOCK_FREQUENCY_HZ / SAMPLE_RATE_HZ;
+    double const alpha = sin(w0) / (2.0 * KNOCK_FILTER_Q);
+    double const a0 = 1.0 + alpha;
+    double x1 = 0.0;
+    double x2 = 0.0;
+    double y1 = 0.0;
+    double y2 = 0.0;
+    double energy = 0.0;
+    size_t index;
+
+    for (index = 0; index < num_samples; index++)
+    {
+        double const x0 = amplitude * (1 << SAMPLE_SHIFT) * sin(2.0 * M_PI * frequency_hz * index / SAMPLE_RATE_HZ);
+        double const y0 = ((alpha * x0) - (alpha * x2) + (2.0 * cos(w0) * y1) - ((1.0 - alpha) * y2)) / a0;
+
+        energy += y0 * y0;
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
+    }
+
+    return energy / num_samples;
+}
+
+static void tone_make(uint16_t * const samples, size_t const num_samples, double const frequency_hz, double const amplitude)
+{
+    size_t index;
+
+    for (index = 0; index < num_samples; index++)
+    {
+        samples[index] = lrint(SAMPLE_OFFSET + amplitude * sin(2.0 * M_PI * frequency_hz * index / SAMPLE_RATE_HZ));
+    }
+}
+
+static void exact_check(knock_filter_st const * const filter, uint16_t const * const samples, size_t const num_samples, char const * const what)
+{
+    uint32_t const power = knock_filter_power(filter, samples, num_samples);
+    uint32_t const expected = reference_power(filter, samples, num_samples);
+
+    if (power != expected)
+    {
+        failure(what, power, expected);
+    }
+}
+
+static void filter_check(knock_filter_st const * const filter)
+{
+    static uint16_t samples[MAXIMUM_WINDOW_SAMPLES];
+    static double const off_band_hz[] = { 1000.0, 2500.0, 15000.0 };
+    unsigned int window;
+    size_t index;
+    uint32_t centre_power;
+    double expected_power;
+
+    for (window = 0; window < RANDOM_WINDOWS; window++)
+    {
+        size_t const num_samples = 1 + random_get() % MAXIMUM_WINDOW_SAMPLES;
+
+        for (index = 0; index < num_samples; index++)
+        {
+            samples[index] = random_get() & 0xfff;
+        }
+        exact_check(filter, samples, num_samples, "random window");
+    }
+
+    /* Full scale at the knock frequency. */
+    for (index = 0; index < MAXIMUM_WINDOW_SAMPLES; index++)
+    {
+        samples[index] = (sin(2.0 * M_PI * KNOCK_FREQUENCY_HZ * index / SAMPLE_RATE_HZ) >= 0.0) ? 0xfff : 0;
+    }
+    exact_check(filter, samples, MAXIMUM_WINDOW_SAMPLES, "full scale square wave");
+
+    /* Full scale with the signs of the impulse response reversed
+     * in time, the largest output the filter can give. That is
+     * ~1.3 times the scaled input, so 12 bit samples never reach
+     * the saturation.
+     */
+    {
+        double h1 = 0.0;
+        double h2 = 0.0;
+        double x1 = 0.0;
+        double x2 = 0.0;
+        double impulse[MAXIMUM_WINDOW_SAMPLES / 4];
+        size_t const length = sizeof impulse / sizeof impulse[0];
+        double const b0 = pair_bottom(filter->b_pair) / (double)(1 << FILTER_FRACTION_BITS);
+        double const minus_a1 = pair_bottom(filter->a_pair) / (double)(1 << FILTER_FRACTION_BITS);
+        double const minus_a2 = pair_top(filter->a_pair) / (double)(1 << FILTER_FRACTION_BITS);
+
+        for (index = 0; index < length; index++)
+        {
+            double const x0 = (index == 0) ? 1.0 : 0.0;
+
+            impulse[index] = (b0 * (x0 - x2)) + (minus_a1 * h1) + (minus_a2 * h2);
+            h2 = h1;
+            h1 = impulse[index];
+            x2 = x1;
+            x1 = x0;
+        }
+        for (window = 0; window < 4; window++)
+        {
+            for (index = 0; index < length; index++)
+            {
+                samples[(window * length) + index] = (impulse[length - 1 - index] >= 0.0) ? 0xfff : 0;
+            }
+        }
+        exact_check(filter, samples, MAXIMUM_WINDOW_SAMPLES, "saturating window");
+    }
+
+    tone_make(samples, MAXIMUM_WINDOW_SAMPLES, KNOCK_FREQUENCY_HZ, TONE_AMPLITUDE);
+    exact_check(filter, samples, MAXIMUM_WINDOW_SAMPLES, "knock tone");
+    centre_power = knock_filter_power(filter, samples, MAXIMUM_WINDOW_SAMPLES);
+    expected_power = float_power(KNOCK_FREQUENCY_HZ, TONE_AMPLITUDE, MAXIMUM_WINDOW_SAMPLES);
+    if (fabs(centre_power - expected_power) > CENTRE_POWER_TOLERANCE * expected_power)
+    {
+        failure("knock tone power against float", centre_power, expected_power);
+    }
+
+    for (index = 0; index < sizeof off_band_hz / sizeof off_band_hz[0]; index++)
+    {
+        uint32_t power;
+
+        tone_make(samples, MAXIMUM_WINDOW_SAMPLES, off_band_hz[index], TONE_AMPLITUDE);
+        exact_check(filter, samples, MAXIMUM_WINDOW_SAMPLES, "off band tone");
+        power = knock_filter_power(filter, samples, MAXIMUM_WINDOW_SAMPLES);
+        if (power * MINIMUM_REJECTION > centre_power)
+        {
+            failure("off band tone power", power, centre_power / MINIMUM_REJECTION);
+        }
+        printf("%5.0f Hz tone: power %lu, %.0f times below the knock frequency\n",
+               off_band_hz[index], (unsigned long)power, (double)centre_power / (power ? power : 1));
+    }
+}
+
+static double elapsed_ns(struct timespec const * const start, struct timespec const * const end)
+{
+    return (end->tv_sec - start->tv_sec) * 1.0e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static double window_bench(knock_filter_st const * const filter, size_t const num_samples)
+{
+    static uint16_t samples[MAXIMUM_WINDOW_SAMPLES];
+    struct timespec start;
+    struct timespec end;
+    uint32_t sum = 0;
+    unsigned int window;
+    size_t index;
+
+    for (index = 0; index < num_samples; index++)
+    {
+        samples[index] = SAMPLE_OFFSET + (random_get() % 401) - 200;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (window = 0; window < BENCH_WINDOWS; window++)
+    {
+        samples[window % num_samples] ^= 1;
+        sum += knock_filter_power(filter, samples, num_samples);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("(sum %lu) ", (unsigned long)sum);
+
+    return elapsed_ns(&start, &end) / BENCH_WINDOWS;
+}
+
+int main(void)
+{
+    knock_filter_st filter;
+    double const us_per_degree = 1.0e6 / (BENCH_RPM / 60.0 * 360.0);
+    double const budget_us = (720.0 / BENCH_CYLINDERS) * us_per_degree;
+    size_t const window_samples = (size_t)(WINDOW_DEGREES * us_per_degree * SAMPLE_RATE_HZ / 1.0e6);
+    double window_ns;
+    double maximum_window_ns;
+
+#if defined(__ARM_FEATURE_DSP)
+    printf("SIMD filter\n");
+#else
+    printf("C filter\n");
+#endif
+
+    knock_filter_init(&filter, KNOCK_FREQUENCY_HZ, KNOCK_FILTER_Q, SAMPLE_RATE_HZ);
+    filter_check(&filter);
+
+    window_ns = window_bench(&filter, window_samples);
+    printf("%.0f ns for a %u sample window at %.0f RPM, %.2f%% of the %.0f us between sparks on %u cylinders\n",
+           window_ns, (unsigned)window_samples, BENCH_RPM,
+           100.0 * window_ns / (budget_us * 1000.0), budget_us, BENCH_CYLINDERS);
+    maximum_window_ns = window_bench(&filter, MAXIMUM_WINDOW_SAMPLES);
+    printf("%.0f ns for the largest window, %u samples\n", maximum_window_ns, MAXIMUM_WINDOW_SAMPLES);
+
+    printf("%u failures\n", failures);
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,378 @@
+/* Runs the crank angle synchronous MAP sampler (app/map_sampler.c)
+ * against a synthetic pulsating MAP signal. Runs on the host.
+ *
+ * The engine turns at a steady speed and the window events the
+ * sampler registers are called at their angles, as the trigger
+ * wheel task calls them. A stand-in for the ADC burst driver
+ * samples the signal at the burst rate between each start and
+ * stop. MAP dips during each cylinder's intake stroke, one
+ * cylinder dipping deeper than the rest as it would with a
+ * different runner or a leaking valve. Checks that, at a range of
+ * engine speeds:
+ *   - each cylinder's window average and minimum match the
+ *     signal over its window.
+ *   - the deeper cylinder stands out from the others, where the
+ *     time averaged MAP can't tell them apart.
+ *   - an empty window gives no result.
+ * Then measures map_window_reduce() on a full window. Host times
+ * are only good for comparison.
+ *
+ * e.g. map_sampler_sim
+ */
+#include "map_sampler.h"
+#include "tune_config.h"
+#include "adc.h"
+#include "main.h"
+#include "utils.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#define MAP_SAMPLE_SCALE 16 /* 12 bit samples to the 16 bit scale. */
+#define SAMPLE_RATE_HZ 10000 /* MAP_SAMPLE_RATE_HZ in app/map_sampler.c */
+#define WINDOW_START_DEGREES 380.0
+#define WINDOW_DEGREES 160.0
+#define INTAKE_START_DEGREES 360.0
+#define INTAKE_DEGREES 180.0
+
+#define MAP_MEAN 2500.0 /* 12 bit counts */
+#define DIP_DEPTH 600.0
+#define DEEP_CYLINDER 2
+#define DEEP_DIP_DEPTH 900.0
+#define SIM_CYCLES 10
+#define MAXIMUM_EVENTS 32
+#define MAXIMUM_BURST_SAMPLES 256
+#define AVERAGE_TOLERANCE 0.01 /* Of the dip depth. */
+#define MINIMUM_TOLERANCE 0.005
+#define BENCH_WINDOWS 1000000
+
+typedef struct sim_event_st
+{
+    float angle;
+    trigger_event_callback callback;
+    void * arg;
+} sim_event_st;
+
+typedef struct sim_st
+{
+    sim_event_st events[MAXIMUM_EVENTS];
+    size_t num_events;
+    unsigned int num_cylinders;
+
+    double now_us;
+    double us_per_degree;
+    double cycle_start_us;
+
+    bool burst_running;
+    double burst_start_us;
+    uint16_t * burst_buffer;
+    size_t burst_max_samples;
+
+    unsigned int failures;
+} sim_st;
+
+static sim_st sim;
+static double const rpms[] = { 1500.0, 2500.0, 4000.0, 6500.0 }; /* Windows below ~1100 RPM are truncated. */
+
+static void failure(char const * const what, double const rpm, size_t const cylinder, long const got, long const expected)
+{
+    if (sim.failures++ < 20)
+    {
+        fprintf(stderr, "%.0f RPM cylinder %u: %s: got %ld expected %ld\n",
+                rpm, (unsigned)cylinder, what, got, expected);
+    }
+}
+
+static double dip_depth_get(size_t const cylinder)
+{
+    return (cylinder == DEEP_CYLINDER) ? DEEP_DIP_DEPTH : DIP_DEPTH;
+}
+
+/* MAP, in 12 bit counts, at an engine cycle angle. */
+static double map_signal(double const angle)
+{
+    double map = MAP_MEAN;
+    size_t cylinder;
+
+    for (cylinder = 0; cylinder < sim.num_cylinders; cylinder++)
+    {
+        double const tdc_angle = (720.0 * cylinder) / sim.num_cylinders;
+        double const into_intake = fmod(angle - (tdc_angle + INTAKE_START_DEGREES) + 1440.0, 720.0);
+
+        if (into_intake < INTAKE_DEGREES)
+        {
+            double const s = sin(M_PI * into_intake / INTAKE_DEGREES);
+
+            map -= dip_depth_get(cylinder) * s * s;
+        }
+    }
+
+    return map;
+}
+
+/* What the target provides. */
+
+unsigned int get_engine_cycle_degrees(void)
+{
+    return 720;
+}
+
+uint32_t main_input_timer_count_get(void)
+{
+    return (uint32_t)sim.now_us;
+}
+
+void trigger_36_1_register_callback(trigger_wheel_36_1_context_st * const context,
+                                    float const engine_degrees,
+                                    trigger_event_callback callback,
+                                    void * const user_arg)
+{
+    (void)context;
+
+    if (sim.num_events < MAXIMUM_EVENTS)
+    {
+        sim_event_st * const event = &sim.events[sim.num_events++];
+
+        event->angle = engine_degrees;
+        event->callback = callback;
+        event->arg = user_arg;
+    }
+}
+
+void const *stm32_adc_burst_init(adc_burst_init_st const *cfg)
+{
+    if (cfg->trigger != adc_burst_trigger_timer || cfg->sample_rate_hz != SAMPLE_RATE_HZ)
+    {
+        failure("burst configuration", 0.0, 0, cfg->sample_rate_hz, SAMPLE_RATE_HZ);
+    }
+
+    return &sim;
+}
+
+void stm32_adc_burst_start(void const *burst, uint16_t *buffer, size_t max_samples)
+{
+    (void)burst;
+
+    sim.burst_running = true;
+    sim.burst_start_us = sim.now_us;
+    sim.burst_buffer = buffer;
+    sim.burst_max_samples = max_samples;
+}
+
+/* The samples are written as the DMA would have written them
+ * while the burst ran.
+ */
+size_t stm32_adc_burst_stop(void const *burst)
+{
+    size_t num_samples = 0;
+    size_t index;
+
+    (void)burst;
+
+    if (!sim.burst_running)
+    {
+        goto done;
+    }
+    sim.burst_running = false;
+
+    num_samples = (size_t)((sim.now_us - sim.burst_start_us) * SAMPLE_RATE_HZ / 1.0e6);
+    if (num_samples > sim.burst_max_samples)
+    {
+        num_samples = sim.burst_max_samples;
+    }
+    for (index = 0; index < num_samples; index++)
+    {
+        double const sample_us = sim.burst_start_us + (index * 1.0e6 / SAMPLE_RATE_HZ);
+
+        sim.burst_buffer[index] = lrint(map_signal((sample_us - sim.cycle_start_us) / sim.us_per_degree));
+    }
+
+done:
+    return num_samples;
+}
+
+static int event_compare(void const * const a, void const * const b)
+{
+    sim_event_st const * const event_a = a;
+    sim_event_st const * const event_b = b;
+
+    return (event_a->angle > event_b->angle) - (event_a->angle < event_b->angle);
+}
+
+static void engine_run(double const rpm)
+{
+    unsigned int cycle;
+    size_t index;
+
+    sim.us_per_degree = 1.0e6 / (rpm / 60.0 * 360.0);
+    for (cycle = 0; cycle < SIM_CYCLES; cycle++)
+    {
+        for (index = 0; index < sim.num_events; index++)
+        {
+            sim_event_st const * const event = &sim.events[index];
+
+            sim.now_us = sim.cycle_start_us + (event->angle * sim.us_per_degree);
+            event->callback(event->angle, (uint32_t)sim.now_us, event->arg);
+        }
+        sim.cycle_start_us += 720.0 * sim.us_per_degree;
+    }
+    sim.now_us = sim.cycle_start_us;
+}
+
+/* Average and minimum of the signal over a cylinder's window,
+ * worked out finely in angle rather than at the sample times.
+ */
+static void window_expected_get(size_t const cylinder, double * const average, double * const minimum)
+{
+    double const start = ((720.0 * cylinder) / sim.num_cylinders) + WINDOW_START_DEGREES;
+    double sum = 0.0;
+    unsigned int step;
+
+    *minimum = MAP_MEAN;
+    for (step = 0; step < 16000; step++)
+    {
+        double const map = map_signal(fmod(start + (step * WINDOW_DEGREES / 16000.0), 720.0));
+
+        sum += map;
+        if (map < *minimum)
+        {
+            *minimum = map;
+        }
+    }
+    *average = sum / 16000.0;
+}
+
+static void results_check(double const rpm)
+{
+    size_t cylinder;
+    double deep_average = 0.0;
+    double shallow_average = 0.0;
+
+    for (cylinder = 0; cylinder < sim.num_cylinders; cylinder++)
+    {
+        map_window_result_st result;
+        double average;
+        double minimum;
+
+        window_expected_get(cylinder, &average, &minimum);
+        if (!map_sampler_cylinder_result_get(cylinder, &result))
+        {
+            failure("no result", rpm, cylinder, 0, 1);
+            continue;
+        }
+        if (fabs(result.average - average * MAP_SAMPLE_SCALE) > AVERAGE_TOLERANCE * dip_depth_get(cylinder) * MAP_SAMPLE_SCALE)
+        {
+            failure("window average", rpm, cylinder, result.average, lrint(average * MAP_SAMPLE_SCALE));
+        }
+        if (fabs(result.minimum - minimum * MAP_SAMPLE_SCALE) > MINIMUM_TOLERANCE * dip_depth_get(cylinder) * MAP_SAMPLE_SCALE)
+        {
+            failure("window minimum", rpm, cylinder, result.minimum, lrint(minimum * MAP_SAMPLE_SCALE));
+        }
+
+        if (cylinder == DEEP_CYLINDER)
+        {
+            deep_average = result.average;
+        }
+        else if (cylinder == (DEEP_CYLINDER + 1) % sim.num_cylinders)
+        {
+            shallow_average = result.average;
+        }
+    }
+
+    /* Half of the extra depth should show in the window average. */
+    if (shallow_average - deep_average < 0.5 * (DEEP_DIP_DEPTH - DIP_DEPTH) * MAP_SAMPLE_SCALE)
+    {
+        failure("deep cylinder doesn't stand out", rpm, DEEP_CYLINDER, deep_average, shallow_average);
+    }
+
+    printf("%5.0f RPM: window averages", rpm);
+    for (cylinder = 0; cylinder < sim.num_cylinders; cylinder++)
+    {
+        map_window_result_st result;
+
+        if (map_sampler_cylinder_result_get(cylinder, &result))
+        {
+            printf(" %u", (unsigned)result.average);
+        }
+    }
+    printf("\n");
+}
+
+static double elapsed_ns(struct timespec const * const start, struct timespec const * const end)
+{
+    return (end->tv_sec - start->tv_sec) * 1.0e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static double reduce_bench(void)
+{
+    static uint16_t samples[MAXIMUM_BURST_SAMPLES];
+    map_window_result_st result;
+    struct timespec start;
+    struct timespec end;
+    uint32_t sum = 0;
+    unsigned int window;
+    size_t index;
+
+    for (index = 0; index < MAXIMUM_BURST_SAMPLES; index++)
+    {
+        samples[index] = lrint(map_signal(index * (720.0 / MAXIMUM_BURST_SAMPLES)));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (window = 0; window < BENCH_WINDOWS; window++)
+    {
+        samples[window % MAXIMUM_BURST_SAMPLES]++;
+        map_window_reduce(samples, MAXIMUM_BURST_SAMPLES, &result);
+        sum += result.average + result.minimum;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("(sum %lu) ", (unsigned long)sum);
+
+    return elapsed_ns(&start, &end) / BENCH_WINDOWS;
+}
+
+int main(void)
+{
+    map_window_result_st result;
+    double cycle_sum = 0.0;
+    double reduce_ns;
+    unsigned int step;
+    size_t index;
+
+    tune_config_init(NULL);
+    sim.num_cylinders = tune_config_engine_get()->num_cylinders;
+    map_sampler_init(NULL);
+    if (sim.num_events != 2 * sim.num_cylinders)
+    {
+        failure("window events", 0.0, 0, sim.num_events, 2 * sim.num_cylinders);
+    }
+    qsort(sim.events, sim.num_events, sizeof sim.events[0], event_compare);
+
+    for (index = 0; index < sizeof rpms / sizeof rpms[0]; index++)
+    {
+        engine_run(rpms[index]);
+        results_check(rpms[index]);
+    }
+
+    for (step = 0; step < 72000; step++)
+    {
+        cycle_sum += map_signal(step / 100.0);
+    }
+    printf("time averaged MAP %ld, the same for every cylinder\n", lrint(cycle_sum / 72000.0 * MAP_SAMPLE_SCALE));
+
+    if (map_window_reduce(NULL, 0, &result))
+    {
+        failure("result from an empty window", 0.0, 0, 1, 0);
+    }
+
+    reduce_ns = reduce_bench();
+    printf("%.1f ns to reduce a window of %u samples\n", reduce_ns, MAXIMUM_BURST_SAMPLES);
+    printf("%u failures\n", sim.failures);
+
+    return (sim.failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,402 @@
+/* Checks the map lookups (app/maps.c) against an exact reference
+ * and against floating point interpolation, then compares their
+ * speed with float lookups of the same maps. Runs on the host.
+ *
+ * The reference works out every interpolation in 64 bit integers:
+ * the fraction of the way through a bin is rounded down to
+ * MAP_FRACTION_BITS, and each interpolated value is rounded to
+ * nearest, halves up. Lookups are checked for random maps with
+ * random axes and cells that use the whole int16_t range, at
+ * random points and on every bin edge and both ends of each axis.
+ * Built twice, with __ARM_FEATURE_DSP set (maps_test_dsp), so the
+ * Cortex-M4 SIMD path runs on the host's stand-in intrinsics, and
+ * clear (maps_test) for the C fallback. Both must match the
+ * reference exactly. Host times are only good for comparison.
+ *
+ * e.g. maps_test
+ */
+#include "maps.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#define MAXIMUM_BINS 16
+#define RANDOM_MAPS 2000
+#define RANDOM_LOOKUPS 500
+#define BENCH_LOOKUPS 10000000
+#define BENCH_X_BINS 8
+#define BENCH_Y_BINS 8
+
+typedef struct test_map_st
+{
+    int32_t x_bins[MAXIMUM_BINS];
+    size_t num_x_bins;
+    int32_t y_bins[MAXIMUM_BINS];
+    size_t num_y_bins;
+    int16_t cells[MAXIMUM_BINS * MAXIMUM_BINS];
+    map_3d_st map;
+} test_map_st;
+
+/* The same map in float, looked up the same way. */
+typedef struct float_map_st
+{
+    float x_bins[MAXIMUM_BINS];
+    size_t num_x_bins;
+    size_t last_x_bin;
+    float y_bins[MAXIMUM_BINS];
+    size_t num_y_bins;
+    size_t last_y_bin;
+    float cells[MAXIMUM_BINS * MAXIMUM_BINS];
+} float_map_st;
+
+static uint32_t random_state = 1;
+static unsigned int failures;
+
+static uint32_t random_get(void)
+{
+    /* xorshift32 */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    return random_state;
+}
+
+static int32_t random_range_get(int32_t const minimum, int32_t const maximum)
+{
+    return minimum + (int32_t)(random_get() % (uint32_t)(maximum - minimum + 1));
+}
+
+static void failure(char const * const what, int32_t const x, int32_t const y, long const got, long const expected)
+{
+    if (failures++ < 20)
+    {
+        fprintf(stderr, "%s at (%ld, %ld): got %ld expected %ld\n", what, (long)x, (long)y, got, expected);
+    }
+}
+
+/* Ascending bins, no more than 131071 apart. */
+static void random_axis_make(int32_t * const bins, size_t const num_bins)
+{
+    size_t index;
+
+    bins[0] = random_range_get(-100000, 100000);
+    for (index = 1; index < num_bins; index++)
+    {
+        bins[index] = bins[index - 1] + random_range_get(1, 131071);
+    }
+}
+
+static void test_map_make(test_map_st * const test_map)
+{
+    size_t index;
+
+    test_map->num_x_bins = random_range_get(2, MAXIMUM_BINS);
+    test_map->num_y_bins = random_range_get(2, MAXIMUM_BINS);
+    random_axis_make(test_map->x_bins, test_map->num_x_bins);
+    random_axis_make(test_map->y_bins, test_map->num_y_bins);
+    for (index = 0; index < test_map->num_x_bins * test_map->num_y_bins; index++)
+    {
+        /* Some maps are mostly the extremes, to push the sums. */
+        test_map->cells[index] = (random_get() & 1)
+            ? (int16_t)random_get()
+            : ((random_get() & 1) ? INT16_MIN : INT16_MAX);
+    }
+    map_3d_init(&test_map->map,
+                test_map->x_bins, test_map->num_x_bins,
+                test_map->y_bins, test_map->num_y_bins,
+                test_map->cells);
+}
+
+static size_t reference_bin_find(int32_t const * const bins, size_t const num_bins, int32_t const value, int64_t * const fraction)
+{
+    size_t bin = 0;
+
+    if (value <= bins[0])
+    {
+        *fraction = 0;
+    }
+    else if (value >= bins[num_bins - 1])
+    {
+        bin = num_bins - 2;
+        *fraction = MAP_FRACTION_ONE;
+    }
+    else
+    {
+        while (value >= bins[bin + 1])
+        {
+            bin++;
+        }
+        *fraction = ((int64_t)(value - bins[bin]) * MAP_FRACTION_ONE) / (bins[bin + 1] - bins[bin]);
+    }
+
+    return bin;
+}
+
+static int64_t reference_interpolate(int64_t const a, int64_t const b, int64_t const fraction)
+{
+    int64_t const sum = (a * (MAP_FRACTION_ONE - fraction)) + (b * fraction) + (MAP_FRACTION_ONE / 2);
+
+    /* Round down, whatever the sign. */
+    return (sum >= 0) ? (sum / MAP_FRACTION_ONE) : -((-sum + MAP_FRACTION_ONE - 1) / MAP_FRACTION_ONE);
+}
+
+static int16_t reference_lookup(test_map_st const * const test_map, int32_t const x, int32_t const y)
+{
+    int64_t x_fraction;
+    int64_t y_fraction;
+    size_t const x_bin = reference_bin_find(test_map->x_bins, test_map->num_x_bins, x, &x_fraction);
+    size_t const y_bin = reference_bin_find(test_map->y_bins, test_map->num_y_bins, y, &y_fraction);
+    int16_t const * const low_row = &test_map->cells[(y_bin * test_map->num_x_bins) + x_bin];
+    int16_t const * const high_row = low_row + test_map->num_x_bins;
+    int64_t const low = reference_interpolate(low_row[0], low_row[1], x_fraction);
+    int64_t const high = reference_interpolate(high_row[0], high_row[1], x_fraction);
+
+    return (int16_t)reference_interpolate(low, high, y_fraction);
+}
+
+static size_t float_bin_find(float const * const bins, size_t const num_bins, size_t * const last_bin, float const value, float * const fraction)
+{
+    size_t bin;
+
+    if (value <= bins[0])
+    {
+        bin = 0;
+        *fraction = 0.0f;
+    }
+    else if (value >= bins[num_bins - 1])
+    {
+        bin = num_bins - 2;
+        *fraction = 1.0f;
+    }
+    else
+    {
+        bin = *last_bin;
+        while (value < bins[bin])
+        {
+            bin--;
+        }
+        while (value >= bins[bin + 1])
+        {
+            bin++;
+        }
+        *fraction = (value - bins[bin]) / (bins[bin + 1] - bins[bin]);
+    }
+    *last_bin = bin;
+
+    return bin;
+}
+
+static float float_lookup(float_map_st * const float_map, float const x, float const y)
+{
+    float x_fraction;
+    float y_fraction;
+    size_t const x_bin = float_bin_find(float_map->x_bins, float_map->num_x_bins, &float_map->last_x_bin, x, &x_fraction);
+    size_t const y_bin = float_bin_find(float_map->y_bins, float_map->num_y_bins, &float_map->last_y_bin, y, &y_fraction);
+    float const * const low_row = &float_map->cells[(y_bin * float_map->num_x_bins) + x_bin];
+    float const * const high_row = low_row + float_map->num_x_bins;
+    float const low = low_row[0] + (low_row[1] - low_row[0]) * x_fraction;
+    float const high = high_row[0] + (high_row[1] - high_row[0]) * x_fraction;
+
+    return low + (high - low) * y_fraction;
+}
+
+static void float_map_make(float_map_st * const float_map, test_map_st const * const test_map)
+{
+    size_t index;
+
+    float_map->num_x_bins = test_map->num_x_bins;
+    float_map->num_y_bins = test_map->num_y_bins;
+    float_map->last_x_bin = 0;
+    float_map->last_y_bin = 0;
+    for (index = 0; index < test_map->num_x_bins; index++)
+    {
+        float_map->x_bins[index] = test_map->x_bins[index];
+    }
+    for (index = 0; index < test_map->num_y_bins; index++)
+    {
+        float_map->y_bins[index] = test_map->y_bins[index];
+    }
+    for (index = 0; index < test_map->num_x_bins * test_map->num_y_bins; index++)
+    {
+        float_map->cells[index] = test_map->cells[index];
+    }
+}
+
+static void lookup_check(test_map_st * const test_map, float_map_st * const float_map, int32_t const x, int32_t const y)
+{
+    int16_t const got = map_3d_lookup(&test_map->map, x, y);
+    int16_t const expected = reference_lookup(test_map, x, y);
+    /* Rounding the fractions down can take up to a step of the
+     * fraction across the full cell range off each axis, and each
+     * interpolation is rounded.
+     */
+    double const tolerance = 1.0 + (2.0 * 65536.0) / MAP_FRACTION_ONE;
+    double const float_expected = float_lookup(float_map, x, y);
+
+    if (got != expected)
+    {
+        failure("3D lookup isn't exact", x, y, got, expected);
+    }
+    if (fabs(got - float_expected) > tolerance)
+    {
+        failure("3D lookup too far from float", x, y, got, lrint(float_expected));
+    }
+}
+
+static void maps_check(void)
+{
+    static test_map_st test_map;
+    static float_map_st float_map;
+    unsigned int map_count;
+    unsigned int lookup;
+    size_t x_index;
+    size_t y_index;
+
+    for (map_count = 0; map_count < RANDOM_MAPS; map_count++)
+    {
+        int32_t x_low;
+        int32_t x_high;
+        int32_t y_low;
+        int32_t y_high;
+
+        test_map_make(&test_map);
+        float_map_make(&float_map, &test_map);
+        x_low = test_map.x_bins[0] - 1000;
+        x_high = test_map.x_bins[test_map.num_x_bins - 1] + 1000;
+        y_low = test_map.y_bins[0] - 1000;
+        y_high = test_map.y_bins[test_map.num_y_bins - 1] + 1000;
+
+        for (lookup = 0; lookup < RANDOM_LOOKUPS; lookup++)
+        {
+            lookup_check(&test_map, &float_map, random_range_get(x_low, x_high), random_range_get(y_low, y_high));
+        }
+
+        /* Every bin edge, and either side of it. */
+        for (y_index = 0; y_index < test_map.num_y_bins; y_index++)
+        {
+            for (x_index = 0; x_index < test_map.num_x_bins; x_index++)
+            {
+                int32_t const x = test_map.x_bins[x_index];
+                int32_t const y = test_map.y_bins[y_index];
+
+                lookup_check(&test_map, &float_map, x, y);
+                lookup_check(&test_map, &float_map, x - 1, y + 1);
+                lookup_check(&test_map, &float_map, x + 1, y - 1);
+            }
+        }
+        lookup_check(&test_map, &float_map, INT32_MIN, INT32_MIN);
+        lookup_check(&test_map, &float_map, INT32_MAX, INT32_MAX);
+
+        /* A 2D map is the first row. */
+        {
+            map_2d_st map_2d;
+            int32_t const x = random_range_get(x_low, x_high);
+            int16_t const expected = reference_lookup(&test_map, x, test_map.y_bins[0]);
+            int16_t got;
+
+            map_2d_init(&map_2d, test_map.x_bins, test_map.num_x_bins, test_map.cells);
+            got = map_2d_lookup(&map_2d, x);
+            if (got != expected)
+            {
+                failure("2D lookup isn't exact", x, 0, got, expected);
+            }
+        }
+    }
+}
+
+static double elapsed_ns(struct timespec const * const start, struct timespec const * const end)
+{
+    return (end->tv_sec - start->tv_sec) * 1.0e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* Lookups of a VE table sized map as the engine wanders around
+ * it, in the same order for both.
+ */
+static void maps_bench(void)
+{
+    static test_map_st test_map;
+    static float_map_st float_map;
+    static int32_t xs[BENCH_LOOKUPS / 100];
+    static int32_t ys[BENCH_LOOKUPS / 100];
+    struct timespec start;
+    struct timespec end;
+    int32_t integer_sum = 0;
+    float float_sum = 0.0f;
+    int32_t x;
+    int32_t y;
+    unsigned int index;
+    size_t bin;
+    double integer_ns;
+    double float_ns;
+
+    test_map.num_x_bins = BENCH_X_BINS;
+    test_map.num_y_bins = BENCH_Y_BINS;
+    for (bin = 0; bin < BENCH_X_BINS; bin++)
+    {
+        test_map.x_bins[bin] = 500 + (1000 * bin);
+        test_map.y_bins[bin] = 20 + (12 * bin);
+    }
+    for (index = 0; index < BENCH_X_BINS * BENCH_Y_BINS; index++)
+    {
+        test_map.cells[index] = random_range_get(4000, 10000);
+    }
+    map_3d_init(&test_map.map,
+                test_map.x_bins, test_map.num_x_bins,
+                test_map.y_bins, test_map.num_y_bins,
+                test_map.cells);
+    float_map_make(&float_map, &test_map);
+
+    x = 3000;
+    y = 60;
+    for (index = 0; index < BENCH_LOOKUPS / 100; index++)
+    {
+        x += random_range_get(-50, 50);
+        y += random_range_get(-1, 1);
+        xs[index] = x;
+        ys[index] = y;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_LOOKUPS; index++)
+    {
+        size_t const point = index % (BENCH_LOOKUPS / 100);
+
+        integer_sum += map_3d_lookup(&test_map.map, xs[point], ys[point]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    integer_ns = elapsed_ns(&start, &end) / BENCH_LOOKUPS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_LOOKUPS; index++)
+    {
+        size_t const point = index % (BENCH_LOOKUPS / 100);
+
+        float_sum += float_lookup(&float_map, xs[point], ys[point]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    float_ns = elapsed_ns(&start, &end) / BENCH_LOOKUPS;
+
+    printf("3D lookup: %.1f ns map_3d_lookup(), %.1f ns float (sums %ld %.0f)\n",
+           integer_ns, float_ns, (long)integer_sum, float_sum);
+}
+
+int main(void)
+{
+#if defined(__ARM_FEATURE_DSP)
+    printf("SIMD interpolation\n");
+#else
+    printf("C interpolation\n");
+#endif
+
+    maps_check();
+    maps_bench();
+
+    printf("%u failures\n", failures);
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,491 @@
+/* Compares waking the pulser task from a timer interrupt with a
+ * task notification (CoOS/kernel/notify.c) against a flag per
+ * pulser (CoOS/kernel/flag.c), as pulser.c used to. Runs on the
+ * host, with the CoOS kernel built for the host and a minimal
+ * context switch.
+ *
+ * A background task runs while the pulser task waits. Each
+ * interrupt times out one of NUM_PULSERS pulsers in turn and wakes
+ * the pulser task, which handles the pulser and waits again, before
+ * the background task carries on. That is timed:
+ *   - with the scheduler unlocked, the usual case. The flag is set
+ *     straight away, searching the flag's waiting list.
+ *   - with the scheduler locked by the background task, as when the
+ *     interrupt comes while it is in the kernel. The flag goes
+ *     through the service request queue.
+ * Every pulser timeout must be handled exactly once. A burst of
+ * timeouts while the scheduler is locked must be handled with a
+ * single wakeup with notifications.
+ * A bare wakeup, where the interrupt puts the pulser task straight
+ * on the ready list and the task handles nothing, is timed and
+ * taken off, leaving what the flag or notification adds. Host
+ * times are only good for comparison.
+ *
+ * e.g. notify_bench
+ */
+/* Before coocox.h, as OsTime.h uses the same include guard as the
+ * C library's time.h.
+ */
+#include <time.h>
+#include <ucontext.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <coocox.h>
+
+#define NUM_PULSERS 16
+#define WAKEUPS 1000000
+#define WAKEUPS_PER_BATCH 1000
+#define BURST_SIZE 4
+#define BURSTS 100000
+#define PULSER_TASK_STACK_SIZE (64 * 1024)
+
+#define IDLE_TASK_ID 0
+#define PULSER_TASK_ID 1
+#define BACKGROUND_TASK_ID 2
+
+typedef enum wake_method_t
+{
+    wake_method_none,
+    wake_method_flag,
+    wake_method_notify
+} wake_method_t;
+
+typedef struct bench_st
+{
+#if defined(__x86_64__)
+    void * stack_pointers[CFG_MAX_USER_TASKS + SYS_TASK_NUM];
+#else
+    ucontext_t contexts[CFG_MAX_USER_TASKS + SYS_TASK_NUM];
+#endif
+    wake_method_t method;
+    OS_FlagID flags[NUM_PULSERS];
+    U32 all_flags;
+
+    unsigned long handled[NUM_PULSERS];
+    unsigned long wakeups;
+    unsigned int failures;
+
+    bool in_interrupt;
+    bool switch_pending;
+} bench_st;
+
+static bench_st bench;
+
+/* What the port provides. */
+U8 Inc8(volatile U8 * data)
+{
+    return (*data)++;
+}
+
+U8 Dec8(volatile U8 * data)
+{
+    return (*data)--;
+}
+
+#if defined(__x86_64__)
+/* swapcontext() makes a system call, which would swamp what is
+ * timed. This only swaps the registers a function call has to keep.
+ */
+void stack_switch(void * * save_stack_pointer, void * stack_pointer);
+
+__asm__(".text\n"
+        ".type stack_switch, @function\n"
+        "stack_switch:\n"
+        "    pushq %rbp\n"
+        "    pushq %rbx\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        "    movq %rsp, (%rdi)\n"
+        "    movq %rsi, %rsp\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbx\n"
+        "    popq %rbp\n"
+        "    ret\n");
+
+static void task_context_make(OS_TID const task_id, void (* const entry)(void), char * const stack, size_t const stack_size)
+{
+    /* As stack_switch() leaves it, returning into entry as if
+     * entry had been called.
+     */
+    uintptr_t * stack_pointer = (uintptr_t *)(((uintptr_t)stack + stack_size) & ~(uintptr_t)15);
+
+    *--stack_pointer = 0;
+    *--stack_pointer = (uintptr_t)entry;
+    stack_pointer -= 6;
+    memset(stack_pointer, 0, 6 * sizeof *stack_pointer);
+    bench.stack_pointers[task_id] = stack_pointer;
+}
+
+static void task_context_switch(OS_TID const from, OS_TID const to)
+{
+    stack_switch(&bench.stack_pointers[from], bench.stack_pointers[to]);
+}
+#else
+static void task_context_make(OS_TID const task_id, void (* const entry)(void), char * const stack, size_t const stack_size)
+{
+    ucontext_t * const context = &bench.contexts[task_id];
+
+    getcontext(context);
+    context->uc_stack.ss_sp = stack;
+    context->uc_stack.ss_size = stack_size;
+    context->uc_link = NULL;
+    makecontext(context, entry, 0);
+}
+
+static void task_context_switch(OS_TID const from, OS_TID const to)
+{
+    swapcontext(&bench.contexts[from], &bench.contexts[to]);
+}
+#endif
+
+/* PendSV. It unlocks the scheduler too. */
+static void pend_sv_handler(void)
+{
+    P_OSTCB const from = TCBRunning;
+
+    bench.switch_pending = false;
+    TCBRunning = TCBNext;
+    OSSchedLock = 0;
+    task_context_switch(from->taskID, TCBNext->taskID);
+}
+
+/* PendSV is taken straight away from a task, and once the
+ * interrupt is over from an interrupt.
+ */
+void SwitchContext(void)
+{
+    bench.switch_pending = true;
+    if (!bench.in_interrupt)
+    {
+        pend_sv_handler();
+    }
+}
+
+void CoStkOverflowHook(OS_TID taskID)
+{
+    (void)taskID;
+}
+
+/* Only needed for the parts of the kernel not used here. */
+void TimeDispose(void)
+{
+}
+
+void TmrDispose(void)
+{
+}
+
+void InsertDelayList(P_OSTCB ptcb, U32 ticks)
+{
+    (void)ptcb;
+    (void)ticks;
+}
+
+void RemoveDelayList(P_OSTCB ptcb)
+{
+    (void)ptcb;
+}
+
+StatusType CoPostSem(OS_EventID id)
+{
+    (void)id;
+    return E_OK;
+}
+
+StatusType CoPostMail(OS_EventID id, void * pmail)
+{
+    (void)id;
+    (void)pmail;
+    return E_OK;
+}
+
+void QueueDispose(void)
+{
+}
+
+static void failure(char const * const what, unsigned long const detail)
+{
+    if (bench.failures++ < 10)
+    {
+        fprintf(stderr, "%s (%lu)\n", what, detail);
+    }
+}
+
+/* As the pulser task did before and after notifications. */
+static void pulser_task(void)
+{
+    while (1)
+    {
+        bench.wakeups++;
+
+        if (bench.method == wake_method_flag)
+        {
+            StatusType err;
+            U32 const ready_flags = CoWaitForMultipleFlags(bench.all_flags, OPT_WAIT_ANY, 0, &err);
+            size_t index;
+
+            for (index = 0; index < NUM_PULSERS; index++)
+            {
+                if ((ready_flags & ((U32)1 << bench.flags[index])) != 0)
+                {
+                    bench.handled[index]++;
+                }
+            }
+        }
+        else if (bench.method == wake_method_notify)
+        {
+            uint32_t ready_pulsers = CoWaitNotify();
+
+            while (ready_pulsers != 0)
+            {
+                bench.handled[__builtin_ctz(ready_pulsers)]++;
+                ready_pulsers &= ready_pulsers - 1;
+            }
+        }
+        else
+        {
+            TCBRunning->state = TASK_WAITING;
+            TaskSchedReq = Co_TRUE;
+            OsSchedLock();
+            OsSchedUnlock();
+        }
+    }
+}
+
+static void task_init(OS_TID const task_id, U8 const prio)
+{
+    /* For Schedule()'s stack check. */
+    static OS_STK stacks[CFG_MAX_USER_TASKS + SYS_TASK_NUM][2];
+    P_OSTCB const ptcb = &TCBTbl[task_id];
+
+    ptcb->taskID = task_id;
+    ptcb->prio = prio;
+    ptcb->state = TASK_WAITING;
+    ptcb->TCBnext = Co_NULL;
+    ptcb->TCBprev = Co_NULL;
+    ptcb->delayTick = INVALID_VALUE;
+    ptcb->pnode = Co_NULL;
+    ptcb->eventID = INVALID_ID;
+    ptcb->mutexID = INVALID_ID;
+    ptcb->notifyBits = 0;
+    ptcb->notifyWait = Co_FALSE;
+#if CFG_STK_CHECKOUT_EN > 0
+    stacks[task_id][0] = MAGIC_WORD;
+    ptcb->stack = &stacks[task_id][0];
+    ptcb->stkPtr = &stacks[task_id][1];
+#endif
+}
+
+/* Starts the pulser task, which runs until it waits. */
+static void tasks_start(wake_method_t const method)
+{
+    static char pulser_stack[PULSER_TASK_STACK_SIZE];
+    size_t index;
+
+    while (TCBRdy != Co_NULL)
+    {
+        RemoveFromTCBRdyList(TCBRdy);
+    }
+    task_init(IDLE_TASK_ID, CFG_LOWEST_PRIO);
+    task_init(PULSER_TASK_ID, 2);
+    task_init(BACKGROUND_TASK_ID, 5);
+    InsertToTCBRdyList(&TCBTbl[IDLE_TASK_ID]);
+
+    TCBTbl[BACKGROUND_TASK_ID].state = TASK_RUNNING;
+    TCBRunning = &TCBTbl[BACKGROUND_TASK_ID];
+    TCBNext = TCBRunning;
+
+    bench.method = method;
+    bench.wakeups = 0;
+    for (index = 0; index < NUM_PULSERS; index++)
+    {
+        bench.handled[index] = 0;
+    }
+
+    task_context_make(PULSER_TASK_ID, pulser_task, pulser_stack, sizeof pulser_stack);
+
+    OsSchedLock();
+    InsertToTCBRdyList(&TCBTbl[PULSER_TASK_ID]);
+    OsSchedUnlock();
+
+    if (TCBRunning != &TCBTbl[BACKGROUND_TASK_ID] || TCBTbl[PULSER_TASK_ID].state != TASK_WAITING)
+    {
+        failure("pulser task didn't wait", method);
+    }
+}
+
+/* Pulser index times out. As the timer interrupt does it. */
+static void pulser_interrupt(size_t const index)
+{
+    bench.in_interrupt = true;
+    CoEnterISR();
+
+    if (bench.method == wake_method_flag)
+    {
+        isr_SetFlag(bench.flags[index]);
+    }
+    else if (bench.method == wake_method_notify)
+    {
+        isr_NotifyTask(PULSER_TASK_ID, (U32)1 << index);
+    }
+    else
+    {
+        InsertToTCBRdyList(&TCBTbl[PULSER_TASK_ID]);
+    }
+
+    CoExitISR();
+    bench.in_interrupt = false;
+
+    if (bench.switch_pending)
+    {
+        pend_sv_handler();
+    }
+}
+
+static void handled_check(wake_method_t const method, unsigned long const expected_wakeups)
+{
+    size_t index;
+
+    for (index = 0; index < NUM_PULSERS; index++)
+    {
+        if (bench.handled[index] != (method == wake_method_none ? 0 : WAKEUPS / NUM_PULSERS))
+        {
+            failure("pulser timeouts weren't all handled once", index);
+        }
+    }
+    /* Plus the first run, up to the first wait. */
+    if (bench.wakeups != expected_wakeups + 1)
+    {
+        failure("wrong number of pulser task wakeups", bench.wakeups);
+    }
+}
+
+static double elapsed_ns_get(struct timespec const * const start, struct timespec const * const end)
+{
+    return (end->tv_sec - start->tv_sec) * 1.0e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* Each wakeup in a separate interrupt. The fastest batch is taken,
+ * as the least disturbed by the host.
+ */
+static double wakeup_ns_measure(wake_method_t const method, bool const scheduler_locked)
+{
+    double fastest_ns = 0;
+    unsigned long wakeup = 0;
+
+    tasks_start(method);
+
+    while (wakeup < WAKEUPS)
+    {
+        struct timespec start;
+        struct timespec end;
+        unsigned long const batch_end = wakeup + WAKEUPS_PER_BATCH;
+        double batch_ns;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (; wakeup < batch_end; wakeup++)
+        {
+            if (scheduler_locked)
+            {
+                OsSchedLock();
+                pulser_interrupt(wakeup % NUM_PULSERS);
+                OsSchedUnlock();
+            }
+            else
+            {
+                pulser_interrupt(wakeup % NUM_PULSERS);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        batch_ns = elapsed_ns_get(&start, &end) / WAKEUPS_PER_BATCH;
+        if (fastest_ns == 0 || batch_ns < fastest_ns)
+        {
+            fastest_ns = batch_ns;
+        }
+    }
+
+    handled_check(method, WAKEUPS);
+
+    return fastest_ns;
+}
+
+/* Several pulsers time out while the scheduler is locked. */
+static void burst_check(void)
+{
+    unsigned long burst;
+    size_t index;
+
+    tasks_start(wake_method_notify);
+
+    for (burst = 0; burst < BURSTS; burst++)
+    {
+        OsSchedLock();
+        for (index = 0; index < BURST_SIZE; index++)
+        {
+            pulser_interrupt((burst * BURST_SIZE + index) % NUM_PULSERS);
+        }
+        OsSchedUnlock();
+    }
+
+    for (index = 0; index < NUM_PULSERS; index++)
+    {
+        if (bench.handled[index] != BURSTS * BURST_SIZE / NUM_PULSERS)
+        {
+            failure("pulser timeouts in a burst weren't all handled once", index);
+        }
+    }
+    if (bench.wakeups != BURSTS + 1)
+    {
+        failure("burst didn't wake the pulser task once", bench.wakeups);
+    }
+}
+
+int main(void)
+{
+    static struct
+    {
+        wake_method_t method;
+        char const * name;
+    } const methods[] =
+    {
+        { wake_method_flag, "flag per pulser" },
+        { wake_method_notify, "notification" }
+    };
+    double bare_ns[2];
+    size_t index;
+
+    for (index = 0; index < NUM_PULSERS; index++)
+    {
+        bench.flags[index] = CoCreateFlag(Co_TRUE, Co_FALSE);
+        bench.all_flags |= (U32)1 << bench.flags[index];
+    }
+
+    bare_ns[0] = wakeup_ns_measure(wake_method_none, false);
+    bare_ns[1] = wakeup_ns_measure(wake_method_none, true);
+    printf("bare wakeup          %6.1f ns per wakeup, %6.1f ns with the scheduler locked, taken off below\n",
+           bare_ns[0], bare_ns[1]);
+
+    for (index = 0; index < sizeof methods / sizeof methods[0]; index++)
+    {
+        double const unlocked_ns = wakeup_ns_measure(methods[index].method, false);
+        double const locked_ns = wakeup_ns_measure(methods[index].method, true);
+
+        printf("%-20s %6.1f ns per wakeup, %6.1f ns with the scheduler locked\n",
+               methods[index].name, unlocked_ns - bare_ns[0], locked_ns - bare_ns[1]);
+    }
+
+    burst_check();
+    printf("%u failures\n", bench.failures);
+
+    return (bench.failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,427 @@
+/* Checks the streaming printf formatter (stdio/printf.c) and
+ * compares it with the one it replaced (tools/printf_old.c). Runs on
+ * the host.
+ *
+ * Output to the debug port goes to a stand-in for debug_put_block()
+ * and debug_put_char(), which keeps it for checking or throws it
+ * away when timing. Checks that:
+ *   - integer, hex, char, string and '%' conversions, with widths
+ *     and zero fill, give the same text as the C library, for
+ *     random values and the extremes.
+ *   - %f gives the requested number of decimal places, within
+ *     rounding of the float value, and honours the width.
+ *   - output to the debug port is the same as to a string, with
+ *     the right count, however long it is.
+ *   - vsnprintf() output is cut short and NUL terminated, and an
+ *     unsupported conversion gives -1.
+ * Then measures the lines print_injector_debug() prints, a line of
+ * integers, and a %f conversion, old against new. Host times are
+ * only good for comparison.
+ *
+ * e.g. printf_bench
+ */
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <math.h>
+
+/* Included so that the float conversion can be timed on its own.
+ * The methods are renamed so they don't clash with the C library's.
+ */
+#define vsnprintf ecu_vsnprintf
+#define snprintf ecu_snprintf
+#define vsprintf ecu_vsprintf
+#define vfprintf ecu_vfprintf
+#define vprintf ecu_vprintf
+#define fprintf ecu_fprintf
+#define printf ecu_printf
+#define sprintf ecu_sprintf
+#define puts ecu_puts
+#define fputc ecu_fputc
+#define fputs ecu_fputs
+/* On the target these are declared by stdio.h. */
+signed int fputc(signed int c, FILE *pStream);
+signed int fputs(const char *pStr, FILE *pStream);
+#include "printf.c"
+#undef vsnprintf
+#undef snprintf
+#undef vsprintf
+#undef vfprintf
+#undef vprintf
+#undef fprintf
+#undef printf
+#undef sprintf
+#undef puts
+#undef fputc
+#undef fputs
+
+#define RANDOM_VALUES 200000
+#define MAXIMUM_OUTPUT 4096
+#define BENCH_LINES 1000000
+#define BENCH_FLOATS 10000000
+
+/* tools/printf_old.c */
+signed int old_printf(const char *pFormat, ...);
+int old_ftoa(float n, char *res, int afterpoint);
+
+typedef struct debug_port_st
+{
+    bool keep;
+    char output[MAXIMUM_OUTPUT];
+    size_t len;
+    unsigned long discarded;
+} debug_port_st;
+
+static debug_port_st debug_port;
+static unsigned int failures;
+static uint32_t random_state = 0x2545f491;
+
+static void failure(char const * const what, char const * const got, char const * const expected)
+{
+    if (failures++ < 20)
+    {
+        fprintf(stderr, "%s: got \"%s\" expected \"%s\"\n", what, got, expected);
+    }
+}
+
+static uint32_t random_get(void)
+{
+    /* xorshift32 */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    return random_state;
+}
+
+/* What the target provides. */
+
+int debug_put_block(void * data, size_t len)
+{
+    if (!debug_port.keep)
+    {
+        debug_port.discarded += len;
+    }
+    else if (debug_port.len + len <= MAXIMUM_OUTPUT)
+    {
+        memcpy(&debug_port.output[debug_port.len], data, len);
+        debug_port.len += len;
+    }
+
+    return len;
+}
+
+void debug_put_char(char ch)
+{
+    debug_put_block(&ch, 1);
+}
+
+/* Formats a value with both. long is 32 bits on the target, so the
+ * C library is given the format without the 'l'.
+ */
+static void integer_check(char const * const format, uint32_t const value)
+{
+    char host_format[32];
+    char got[64];
+    char expected[64];
+    int got_len;
+    int expected_len;
+    size_t index;
+    size_t len = 0;
+
+    for (index = 0; format[index] != '\0' && len < sizeof host_format - 1; index++)
+    {
+        if (format[index] != 'l')
+        {
+            host_format[len++] = format[index];
+        }
+    }
+    host_format[len] = '\0';
+
+    got_len = ecu_snprintf(got, sizeof got, format, value);
+    expected_len = snprintf(expected, sizeof expected, host_format, value);
+    if (got_len != expected_len || strcmp(got, expected) != 0)
+    {
+        failure(format, got, expected);
+    }
+}
+
+static void integers_check(void)
+{
+    static char const * const formats[] =
+    {
+        "%d", "%i", "%u", "%x", "%X", "%ld", "%lu", "%lx",
+        "%5d", "%05d", "%012d", "%3u", "%010u", "%8x", "%08X", "%2X",
+        "pw %uus", "[%4d]", "%c", "100%% %d"
+    };
+    static uint32_t const extremes[] =
+    {
+        0, 1, 9, 10, 99, 100, 101, 999, 1000, 65535, 65536,
+        INT32_MAX, (uint32_t)INT32_MIN, (uint32_t)INT32_MIN + 1, UINT32_MAX, UINT32_MAX - 1
+    };
+    char got[64];
+    size_t format;
+    size_t index;
+
+    for (format = 0; format < sizeof formats / sizeof formats[0]; format++)
+    {
+        bool const is_char = strcmp(formats[format], "%c") == 0;
+
+        for (index = 0; index < sizeof extremes / sizeof extremes[0]; index++)
+        {
+            integer_check(formats[format], is_char ? 'A' + (extremes[index] % 26) : extremes[index]);
+        }
+        for (index = 0; index < RANDOM_VALUES / (sizeof formats / sizeof formats[0]); index++)
+        {
+            uint32_t const value = random_get() >> (random_get() % 32);
+
+            integer_check(formats[format], is_char ? ' ' + (value % 95) : value);
+        }
+    }
+
+    ecu_snprintf(got, sizeof got, "%s=%s.", "map", "");
+    if (strcmp(got, "map=.") != 0)
+    {
+        failure("strings", got, "map=.");
+    }
+}
+
+static void float_check(char const * const format, unsigned int const precision, unsigned int const width, float const value)
+{
+    char got[64];
+    char const * point;
+    double const tolerance = (0.5 * pow(10.0, -(double)precision)) + ldexp(fabs(value) < 1.0f ? 1.0 : fabs(value), -22);
+    int len;
+
+    len = ecu_snprintf(got, sizeof got, format, value);
+    point = strchr(got, '.');
+
+    if (fabs(strtod(got, NULL) - value) > tolerance)
+    {
+        char expected[64];
+
+        snprintf(expected, sizeof expected, format, value);
+        failure("float value", got, expected);
+    }
+    if ((precision == 0) ? (point != NULL) : (point == NULL || strlen(point + 1) != precision))
+    {
+        failure("decimal places", got, format);
+    }
+    if (len != (int)strlen(got) || (width > 0 && len < (int)width) || (width > 0 && len > (int)width && got[0] == ' '))
+    {
+        failure("float width", got, format);
+    }
+    if ((got[strspn(got, " ")] == '-') != (value < 0.0f))
+    {
+        failure("float sign", got, format);
+    }
+}
+
+static void floats_check(void)
+{
+    static float const specials[] =
+    {
+        0.0f, 1.0f, -1.0f, 0.5f, 0.999999f, 9.999995f, 99.99999f, 0.000001f, -0.000001f,
+        123.456f, -720.0f, 3250.0f, 16777216.0f, 4294967040.0f
+    };
+    static struct
+    {
+        char const * format;
+        unsigned int precision;
+        unsigned int width;
+    } const formats[] =
+    {
+        { "%f", 5, 0 }, { "%.0f", 0, 0 }, { "%.1f", 1, 0 }, { "%.2f", 2, 0 }, { "%.3f", 3, 0 },
+        { "%.6f", 6, 0 }, { "%10.2f", 2, 10 }, { "%8.3f", 3, 8 }, { "%3.1f", 1, 3 }
+    };
+    char got[64];
+    size_t format;
+    size_t index;
+
+    for (format = 0; format < sizeof formats / sizeof formats[0]; format++)
+    {
+        for (index = 0; index < sizeof specials / sizeof specials[0]; index++)
+        {
+            float_check(formats[format].format, formats[format].precision, formats[format].width, specials[index]);
+        }
+        for (index = 0; index < RANDOM_VALUES / (sizeof formats / sizeof formats[0]); index++)
+        {
+            /* Up to a few million, with down to a millionth. */
+            float const magnitude = (float)(random_get() % 1000000) / (float)(1U << (random_get() % 20));
+            float const value = (random_get() & 1) ? -magnitude : magnitude;
+
+            float_check(formats[format].format, formats[format].precision, formats[format].width, value);
+        }
+    }
+
+    ecu_snprintf(got, sizeof got, "%f", NAN);
+    if (strcmp(got, "nan") != 0)
+    {
+        failure("not a number", got, "nan");
+    }
+    ecu_snprintf(got, sizeof got, "%.2f", 1.0e12f);
+    if (strcmp(got, "4294967295.00") != 0)
+    {
+        failure("float beyond 32 bits", got, "4294967295.00");
+    }
+}
+
+static void stream_check(void)
+{
+    static char const pattern[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    char expected[MAXIMUM_OUTPUT];
+    char long_string[1000];
+    char got[16];
+    int expected_len;
+    int len;
+    size_t index;
+
+    for (index = 0; index < sizeof long_string - 1; index++)
+    {
+        long_string[index] = pattern[index % (sizeof pattern - 1)];
+    }
+    long_string[sizeof long_string - 1] = '\0';
+
+    debug_port.keep = true;
+    debug_port.len = 0;
+    len = ecu_printf("head %d %s tail %08x %f %s\r\n", -42, long_string, 0xbeefu, 3.25f, long_string + 900);
+    expected_len = ecu_snprintf(expected, sizeof expected, "head %d %s tail %08x %f %s\r\n", -42, long_string, 0xbeefu, 3.25f, long_string + 900);
+    debug_port.output[debug_port.len < MAXIMUM_OUTPUT ? debug_port.len : MAXIMUM_OUTPUT - 1] = '\0';
+    if (len != expected_len || debug_port.len != (size_t)len || strcmp(debug_port.output, expected) != 0)
+    {
+        failure("long line on the debug port", debug_port.output, expected);
+    }
+
+    debug_port.len = 0;
+    if (ecu_printf("") != 0 || ecu_puts("puts") == EOF || debug_port.len != 5 || memcmp(debug_port.output, "puts\n", 5) != 0)
+    {
+        failure("empty line and puts", "", "puts\\n");
+    }
+    debug_port.keep = false;
+
+    len = ecu_snprintf(got, sizeof got, "%s", long_string);
+    if (len != sizeof got - 1 || strlen(got) != sizeof got - 1 || memcmp(got, long_string, sizeof got - 1) != 0)
+    {
+        failure("string cut short", got, "0123456789abcde");
+    }
+    if (ecu_snprintf(got, sizeof got, "%d %q", 1) != -1)
+    {
+        failure("unsupported conversion", got, "-1");
+    }
+}
+
+static double elapsed_ns(struct timespec const * const start, struct timespec const * const end)
+{
+    return (end->tv_sec - start->tv_sec) * 1.0e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* The lines print_injector_debug() prints, with typical values. */
+#define INJECTOR_DEBUG_LINES(print, index) do \
+{ \
+    print("inj %d time %"PRIu32" scheduling_angle %f desired %f actual close %f error %f\r\n", \
+          (int)((index) & 7), (uint32_t)(123456789 + (index)), 412.5f, 430.0f, 430.25f, 0.25f); \
+    print("\r\ntime between scheduled and closing %"PRId32"\r\n", (int32_t)(4215 + ((index) & 63))); \
+    print("delay %"PRIu32" width %"PRIu32"\r\n", (uint32_t)(1250 + ((index) & 255)), (uint32_t)3125); \
+    print("time until closing %f degrees %f\r\n", 4215.0f, 76.5f); \
+    print("latency %"PRIu32" base %"PRIu32"\r\n\r\n", (uint32_t)12, (uint32_t)(987654321 + (index))); \
+    print("pulse width %"PRIu32"\r\n", (uint32_t)3125); \
+} while (0)
+
+#define INTEGER_LINE(print, index) \
+    print("delay %"PRIu32" width %"PRIu32" latency %"PRIu32" base %"PRIu32"\r\n", \
+          (uint32_t)(1250 + ((index) & 255)), (uint32_t)3125, (uint32_t)12, (uint32_t)(987654321 + (index)))
+
+static void printf_bench(void)
+{
+    struct timespec start;
+    struct timespec end;
+    unsigned int index;
+    double old_debug_ns;
+    double new_debug_ns;
+    double old_integer_ns;
+    double new_integer_ns;
+    double old_float_ns;
+    double new_float_ns;
+    unsigned long sum = 0;
+
+    debug_port.keep = false;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_LINES; index++)
+    {
+        INJECTOR_DEBUG_LINES(old_printf, index);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    old_debug_ns = elapsed_ns(&start, &end) / BENCH_LINES;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_LINES; index++)
+    {
+        INJECTOR_DEBUG_LINES(ecu_printf, index);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    new_debug_ns = elapsed_ns(&start, &end) / BENCH_LINES;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_LINES; index++)
+    {
+        INTEGER_LINE(old_printf, index);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    old_integer_ns = elapsed_ns(&start, &end) / BENCH_LINES;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_LINES; index++)
+    {
+        INTEGER_LINE(ecu_printf, index);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    new_integer_ns = elapsed_ns(&start, &end) / BENCH_LINES;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_FLOATS; index++)
+    {
+        char buf[32];
+
+        sum += old_ftoa(index * 0.37f, buf, 5) + buf[0];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    old_float_ns = elapsed_ns(&start, &end) / BENCH_FLOATS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_FLOATS; index++)
+    {
+        string_sink_st string_sink;
+        char buf[32];
+
+        string_sink.sink.put = string_sink_put;
+        string_sink.sink.count = 0;
+        string_sink.pStr = buf;
+        string_sink.space = sizeof buf - 1;
+        put_float(&string_sink.sink, ' ', 0, DEFAULT_FLOAT_PRECISION, index * 0.37f);
+        sum += string_sink.sink.count + buf[0];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    new_float_ns = elapsed_ns(&start, &end) / BENCH_FLOATS;
+
+    printf("print_injector_debug lines: old %.1f ns, new %.1f ns\n", old_debug_ns, new_debug_ns);
+    printf("line of 4 integers: old %.1f ns, new %.1f ns\n", old_integer_ns, new_integer_ns);
+    printf("%%f: old %.1f ns, new %.1f ns (sum %lu, %lu chars output)\n", old_float_ns, new_float_ns, sum, debug_port.discarded);
+}
+
+int main(void)
+{
+    integers_check();
+    floats_check();
+    stream_check();
+    printf_bench();
+
+    printf("%u failures\n", failures);
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,610 @@
+/* The printf internals as they were before the streaming formatter
+ * in stdio/printf.c, kept for printf_bench to compare against.
+ * Everything is prefixed with old_ so it doesn't clash with the C
+ * library on the host, and only old_printf() and old_ftoa() are
+ * left public.
+ *
+ * %f now takes its argument with va_arg(ap, double). The word
+ * counting it did before only works with the ARM calling
+ * convention.
+ */
+#include "utils.h"
+#include "serial_task.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+
+/**
+ * @brief  Transmit a char, if you want to use printf(),
+ *         you need implement this function
+ *
+ * @param  pStr	Storage string.
+ * @param  c    Character to write.
+ */
+static void old_PrintChar(char c)
+{
+    debug_put_char(c);
+}
+
+static signed int old_fputs(const char *pStr, FILE *pStream);
+
+/** Maximum string size allowed (in bytes). */
+#define MAX_STRING_SIZE       255
+
+
+/** Required for proper compilation. */
+//struct _reent r = {0, (FILE *) 0, (FILE *) 1, (FILE *) 0, 0};
+//struct _reent r = {._inc = 0};
+//struct _reent *_impure_ptr = &r;
+
+/**
+ * @brief  Writes a character inside the given string. Returns 1.
+ *
+ * @param  pStr	Storage string.
+ * @param  c    Character to write.
+ */
+static signed int old_PutChar(char *pStr, char c)
+{
+    *pStr = c;
+    return 1;
+}
+
+
+/**
+ * @brief  Writes a string inside the given string.
+ *
+ * @param  pStr     Storage string.
+ * @param  pSource  Source string.
+ * @return  The size of the written
+ */
+static signed int old_PutString(char *pStr, const char *pSource)
+{
+    signed int num = 0;
+
+    while (*pSource != 0) {
+
+        *pStr++ = *pSource++;
+        num++;
+    }
+
+    return num;
+}
+
+
+/**
+ * @brief  Writes an unsigned int inside the given string, using the provided fill &
+ *         width parameters.
+ *
+ * @param  pStr  Storage string.
+ * @param  fill  Fill character.
+ * @param  width  Minimum integer width.
+ * @param  value  Integer value.
+ */
+static signed int old_PutUnsignedInt(
+    char *pStr,
+    char fill,
+    signed int width,
+    unsigned int value)
+{
+    signed int num = 0;
+
+    /* Take current digit into account when calculating width */
+    width--;
+
+    /* Recursively write upper digits */
+    if ((value / 10) > 0) {
+
+        num = old_PutUnsignedInt(pStr, fill, width, value / 10);
+        pStr += num;
+    }
+
+    /* Write filler characters */
+    else {
+
+        while (width > 0) {
+
+            old_PutChar(pStr, fill);
+            pStr++;
+            num++;
+            width--;
+        }
+    }
+
+    /* Write lower digit */
+    num += old_PutChar(pStr, (value % 10) + '0');
+
+    return num;
+}
+
+
+/**
+ * @brief  Writes a signed int inside the given string, using the provided fill & width
+ *         parameters.
+ *
+ * @param pStr   Storage string.
+ * @param fill   Fill character.
+ * @param width  Minimum integer width.
+ * @param value  Signed integer value.
+ */
+static signed int old_PutSignedInt(
+    char *pStr,
+    char fill,
+    signed int width,
+    signed int value)
+{
+    signed int num = 0;
+    unsigned int absolute;
+
+    /* Compute absolute value */
+    if (value < 0) {
+
+        absolute = -value;
+    }
+    else {
+
+        absolute = value;
+    }
+
+    /* Take current digit into account when calculating width */
+    width--;
+
+    /* Recursively write upper digits */
+    if ((absolute / 10) > 0) {
+
+        if (value < 0) {
+
+            num = old_PutSignedInt(pStr, fill, width, -(absolute / 10));
+        }
+        else {
+
+            num = old_PutSignedInt(pStr, fill, width, absolute / 10);
+        }
+        pStr += num;
+    }
+    else {
+
+        /* Reserve space for sign */
+        if (value < 0) {
+
+            width--;
+        }
+
+        /* Write filler characters */
+        while (width > 0) {
+
+            old_PutChar(pStr, fill);
+            pStr++;
+            num++;
+            width--;
+        }
+
+        /* Write sign */
+        if (value < 0) {
+
+            num += old_PutChar(pStr, '-');
+            pStr++;
+        }
+    }
+
+    /* Write lower digit */
+    num += old_PutChar(pStr, (absolute % 10) + '0');
+
+    return num;
+}
+
+// reverses a string 'str' of length 'len'
+static void old_reverse(char *str, int len)
+{
+    int i=0, j=len-1, temp;
+    while (i<j)
+    {
+        temp = str[i];
+        str[i] = str[j];
+        str[j] = temp;
+        i++; j--;
+    }
+}
+ 
+ // Converts a given integer x to string str[].  d is the number
+ // of digits required in output. If d is more than the number
+ // of digits in x, then 0s are added at the beginning.
+static int old_intToStr(unsigned int x, char str[], int d)
+{
+    int i = 0;
+    while (x)
+    {
+        char ch = (x % 10) + '0'; 
+        str[i++] = ch;
+        x = x/10;
+    }
+    // If number of digits required is more, then
+    // add 0s at the beginning
+    while (i < d)
+        str[i++] = '0';
+    str[i] = '\0'; 
+    old_reverse(str, i);
+    return i;
+}
+ 
+// Converts a floating point number to string.
+int old_ftoa(float n, char *res, int afterpoint)
+{
+    int i = 0;
+    // Extract integer part
+    unsigned int ipart;
+    float fpart; 
+
+ 
+    if (n < 0.0)
+    {
+        n = -n;
+        res[i] = '-';
+        i++;
+    }
+    ipart = (unsigned int)n; 
+    // Extract floating part
+    fpart = n - (float)ipart; 
+
+    // convert integer part to string
+    i += old_intToStr(ipart, res + i, 1);
+ 
+    // check for display option after point
+    if (afterpoint != 0)
+    {
+        res[i] = '.';  // add dot
+        i++;
+        // Get the value of fraction part up to given no.
+        // of points after dot. The third parameter is needed
+        // to handle cases like 233.007
+        fpart = fpart * pow(10, afterpoint);
+ 
+        i += old_intToStr((unsigned int)fpart, res + i, afterpoint);
+    }
+
+    return i;
+}
+
+static signed int old_PutFloat(
+    char * pStr,
+    char fill,
+    signed int width,
+    float value)
+{
+    UNUSED(fill);
+    UNUSED(width);
+
+    return old_ftoa(value, pStr, 5);
+}
+
+/**
+ * @brief  Writes an hexadecimal value into a string, using the given fill, width &
+ *         capital parameters.
+ *
+ * @param pStr   Storage string.
+ * @param fill   Fill character.
+ * @param width  Minimum integer width.
+ * @param maj    Indicates if the letters must be printed in lower- or upper-case.
+ * @param value  Hexadecimal value.
+ *
+ * @return  The number of char written
+ */
+static signed int old_PutHexa(
+    char *pStr,
+    char fill,
+    signed int width,
+    unsigned char maj,
+    unsigned int value)
+{
+    signed int num = 0;
+
+    /* Decrement width */
+    width--;
+
+    /* Recursively output upper digits */
+    if ((value >> 4) > 0) {
+
+        num += old_PutHexa(pStr, fill, width, maj, value >> 4);
+        pStr += num;
+    }
+    /* Write filler chars */
+    else {
+
+        while (width > 0) {
+
+            old_PutChar(pStr, fill);
+            pStr++;
+            num++;
+            width--;
+        }
+    }
+
+    /* Write current digit */
+    if ((value & 0xF) < 10) {
+
+        old_PutChar(pStr, (value & 0xF) + '0');
+    }
+    else if (maj) {
+
+        old_PutChar(pStr, (value & 0xF) - 10 + 'A');
+    }
+    else {
+
+        old_PutChar(pStr, (value & 0xF) - 10 + 'a');
+    }
+    num++;
+
+    return num;
+}
+
+
+
+/* Global Functions ----------------------------------------------------------- */
+
+#define IS_DOUBLE_WORD_ALIGNED(x) ((x) & 1)
+
+static signed int old_local_vsnprintf(int isDoubleWordAligned, char * pStr, size_t length, const char * pFormat, va_list ap)
+{
+    char          fill;
+    unsigned char width;
+    signed int    num = 0;
+    size_t    size = 0;
+
+    /* Clear the string */
+    if (pStr)
+    {
+
+        *pStr = 0;
+    }
+
+    /* Phase string */
+    while (*pFormat != 0 && size < length)
+    {
+
+        /* Normal character */
+        if (*pFormat != '%')
+        {
+
+            *pStr++ = *pFormat++;
+            size++;
+        }
+        /* Escaped '%' */
+        else if (*(pFormat + 1) == '%')
+        {
+
+            *pStr++ = '%';
+            pFormat += 2;
+            size++;
+        }
+        /* Token delimiter */
+        else
+        {
+
+            fill = ' ';
+            width = 0;
+            pFormat++;
+
+            /* Parse filler */
+            if (*pFormat == '0')
+            {
+
+                fill = '0';
+                pFormat++;
+            }
+
+            /* Parse width */
+            while ((*pFormat >= '0') && (*pFormat <= '9'))
+            {
+
+                width = (width * 10) + *pFormat - '0';
+                pFormat++;
+            }
+
+            /* Check if there is enough space */
+            if (size + width > length)
+            {
+
+                width = length - size;
+            }
+
+            if (*pFormat == 'l')
+            {
+                pFormat++;
+            }
+
+            /* Parse type */
+            switch (*pFormat)
+            {
+                case 'd':
+                case 'i':
+                    num = old_PutSignedInt(pStr, fill, width, va_arg(ap, signed int)); isDoubleWordAligned++; break;
+                case 'u':
+                    num = old_PutUnsignedInt(pStr, fill, width, va_arg(ap, unsigned int)); isDoubleWordAligned++; break;
+                case 'p':
+                case 'x':
+                    num = old_PutHexa(pStr, fill, width, 0, va_arg(ap, unsigned int)); isDoubleWordAligned++; break;
+                case 'X':
+                    num = old_PutHexa(pStr, fill, width, 1, va_arg(ap, unsigned int)); isDoubleWordAligned++; break;
+                case 's':
+                    num = old_PutString(pStr, va_arg(ap, char *)); isDoubleWordAligned++; break;
+                case 'c':
+                    num = old_PutChar(pStr, va_arg(ap, unsigned int)); isDoubleWordAligned++; break;
+                case 'f':
+                    num = old_PutFloat(pStr, 0, 0, va_arg(ap, double)); isDoubleWordAligned++; break;
+#if 0
+                case 'g':
+                {
+                    float *pf = (float *)va_arg(ap, long);
+                    isDoubleWordAligned++;
+                    num = old_PutFloat(pStr, *pf);
+                    break;
+                }
+#endif
+                default:
+                    return -1;
+            }
+
+            pFormat++;
+            pStr += num;
+            size += num;
+        }
+    }
+
+    /* NUL terminated (final '\0' is not counted) */
+    if (size < length)
+    {
+
+        *pStr = '\0';
+    }
+    else
+    {
+
+        *(--pStr) = '\0';
+        size--;
+    }
+
+    return size;
+}
+
+/**
+ * @brief  Stores the result of a formatted string into another string. Format
+ *         arguments are given in a va_list instance.
+ *
+ * @param pStr    Destination string.
+ * @param length  Length of Destination string.
+ * @param pFormat Format string.
+ * @param ap      Argument list.
+ *
+ * @return  The number of characters written.
+ */
+static signed int old_vsnprintf(char *pStr, size_t length, const char *pFormat, va_list ap)
+{
+    return old_local_vsnprintf(0, pStr, length, pFormat, ap);
+}
+
+
+/**
+ * @brief  Stores the result of a formatted string into another string. Format
+ *         arguments are given in a va_list instance.
+ *
+ * @param pString  Destination string.
+ * @param length   Length of Destination string.
+ * @param pFormat  Format string.
+ * @param ap       Argument list.
+ *
+ * @return  The number of characters written.
+ */
+static signed int old_vsprintf(char *pString, const char *pFormat, va_list ap)
+{
+   return old_vsnprintf(pString, MAX_STRING_SIZE, pFormat, ap);
+}
+
+/**
+ * @brief  Outputs a formatted string on the given stream. Format arguments are given
+ *         in a va_list instance.
+ *
+ * @param pStream  Output stream.
+ * @param pFormat  Format string
+ * @param ap       Argument list.
+ */
+static signed int old_vfprintf(FILE *pStream, const char *pFormat, va_list ap)
+{
+    char pStr[MAX_STRING_SIZE];
+    char pError[] = "printf.c: increase MAX_STRING_SIZE\n\r";
+
+    /* Write formatted string in buffer */
+    if (old_vsprintf(pStr, pFormat, ap) >= MAX_STRING_SIZE) {
+
+        old_fputs(pError, stderr);
+        while (1); /* Increase MAX_STRING_SIZE */
+    }
+
+    /* Display string */
+    return old_fputs(pStr, pStream);
+}
+
+
+/**
+ * @brief  Outputs a formatted string on the DBGU stream. Format arguments are given
+ *         in a va_list instance.
+ *
+ * @param pFormat  Format string.
+ * @param ap  Argument list.
+ */
+static signed int old_vprintf(const char *pFormat, va_list ap)
+{
+    return old_vfprintf(stdout, pFormat, ap);
+}
+
+
+/**
+ * @brief  Outputs a formatted string on the DBGU stream, using a variable number of
+ *         arguments.
+ *
+ * @param  pFormat  Format string.
+ */
+signed int old_printf(const char *pFormat, ...)
+{
+    va_list ap;
+    signed int result;
+
+    /* Forward call to vprintf */
+    va_start(ap, pFormat);
+    result = old_vprintf(pFormat, ap);
+    va_end(ap);
+
+    return result;
+}
+
+
+/**
+ * @brief  Implementation of fputc using the DBGU as the standard output. Required
+ *         for printf().
+ *
+ * @param c        Character to write.
+ * @param pStream  Output stream.
+ * @param The character written if successful, or -1 if the output stream is
+ *        not stdout or stderr.
+ */
+static signed int old_fputc(signed int c, FILE *pStream)
+{
+    if ((pStream == stdout) || (pStream == stderr))
+    {
+    	old_PrintChar(c);
+        return c;
+    }
+    else
+    {
+        return EOF;
+    }
+}
+
+
+/**
+ * @brief  Implementation of fputs using the DBGU as the standard output. Required
+ *         for printf().
+ *
+ * @param pStr     String to write.
+ * @param pStream  Output stream.
+ *
+ * @return  Number of characters written if successful, or -1 if the output
+ *          stream is not stdout or stderr.
+ */
+static signed int old_fputs(const char *pStr, FILE *pStream)
+{
+    signed int num = 0;
+
+    while (*pStr != 0) {
+
+        if (old_fputc(*pStr, pStream) == -1) {
+
+            return -1;
+        }
+        num++;
+        pStr++;
+    }
+
+    return num;
+}
+
+/* --------------------------------- End Of File ------------------------------ */
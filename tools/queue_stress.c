@@ -0,0 +1,403 @@
+/* Stress test and benchmark for CoOS message queues
+ * (CoOS/kernel/queue.c). Runs on the host.
+ *
+ * The process stands in for a single core. The main thread is a
+ * task receiving mail in batches with CoPendQueueMailN(). Two timer
+ * signals are ISRs posting to the queue with isr_PostQueueMail(), a
+ * low priority one and a high priority one that can interrupt it,
+ * as a trigger tooth can interrupt a serial interrupt. The signals
+ * land anywhere, including part way through the task taking mail
+ * with the scheduler locked or the low priority ISR posting. The
+ * ISRs post in rounds. Checks that:
+ *   - every mail posted is received once, in the order each ISR
+ *     posted them.
+ *   - the task never waits with mail in the queue. At the end of
+ *     each round the ISRs stop posting, so a lost wakeup would
+ *     leave the task waiting.
+ * Then the time to post and receive a mail is measured, one at a
+ * time and in batches. Host times are only good for comparison.
+ *
+ * e.g. queue_stress [rounds]
+ */
+/* Before coocox.h, as OsTime.h uses the same include guard as the
+ * C library's time.h.
+ */
+#include <time.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <coocox.h>
+
+#define QUEUE_SIZE 16
+#define BATCH_SIZE 8
+#define DEFAULT_ROUNDS 2000
+#define ROUND_POSTS 64 /* By both ISRs together. */
+#define LOW_PERIOD_NS 23000
+#define HIGH_PERIOD_NS 9000
+#define LOST_WAKEUP_SECONDS 1
+#define THROUGHPUT_MAILS 4000000
+
+typedef enum interrupt_t
+{
+    interrupt_low,
+    interrupt_high,
+    interrupt_COUNT
+} interrupt_t;
+
+typedef struct source_st
+{
+    unsigned long posted;
+    unsigned long full;
+    unsigned long received;
+} source_st;
+
+typedef struct stress_st
+{
+    OS_EventID queue_id;
+    void * queue_buffer[QUEUE_SIZE];
+    source_st sources[interrupt_COUNT];
+    volatile sig_atomic_t in_interrupt;
+    volatile unsigned int round_posts;
+    unsigned long batches[BATCH_SIZE + 1]; /* By the number of mails. */
+    unsigned int failures;
+} stress_st;
+
+static stress_st stress;
+static OSTCB task;
+
+/* What the rest of the kernel provides. */
+P_OSTCB TCBRunning = &task;
+
+U8 Inc8(volatile U8 * data)
+{
+    return ++*data;
+}
+
+U8 Dec8(volatile U8 * data)
+{
+    return --*data;
+}
+
+void InsertToTCBRdyList(P_OSTCB ptcb)
+{
+    ptcb->state = TASK_READY;
+}
+
+void InsertDelayList(P_OSTCB ptcb, U32 ticks)
+{
+    (void)ptcb;
+    (void)ticks;
+}
+
+void RemoveDelayList(P_OSTCB ptcb)
+{
+    (void)ptcb;
+}
+
+void TimeDispose(void)
+{
+}
+
+void TmrDispose(void)
+{
+}
+
+void NotifyDispose(void)
+{
+}
+
+StatusType CoSetFlag(OS_FlagID id)
+{
+    (void)id;
+    return E_OK;
+}
+
+StatusType CoPostSem(OS_EventID id)
+{
+    (void)id;
+    return E_OK;
+}
+
+StatusType CoPostMail(OS_EventID id, void * pmail)
+{
+    (void)id;
+    (void)pmail;
+    return E_OK;
+}
+
+static void failure(char const * const what, unsigned long const detail)
+{
+    if (stress.failures++ < 10)
+    {
+        fprintf(stderr, "%s (%lu)\n", what, detail);
+    }
+}
+
+static unsigned long posted_get(void)
+{
+    return stress.sources[interrupt_low].posted + stress.sources[interrupt_high].posted;
+}
+
+static unsigned long received_get(void)
+{
+    return stress.sources[interrupt_low].received + stress.sources[interrupt_high].received;
+}
+
+static double elapsed_ns_get(struct timespec const * const start, struct timespec const * const end)
+{
+    return (end->tv_sec - start->tv_sec) * 1.0e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* The idle task, until an interrupt makes the task ready again. */
+static void idle(void)
+{
+    struct timespec mail_since;
+    bool mail_waiting = false;
+
+    while (__atomic_load_n(&task.state, __ATOMIC_RELAXED) == TASK_WAITING)
+    {
+        struct timespec now;
+
+        /* The signals can't come while this looks. */
+        sigset_t all;
+        sigset_t previous;
+
+        sigfillset(&all);
+        sigprocmask(SIG_BLOCK, &all, &previous);
+        if (posted_get() == received_get())
+        {
+            mail_waiting = false;
+        }
+        else if (!mail_waiting)
+        {
+            mail_waiting = true;
+            clock_gettime(CLOCK_MONOTONIC, &mail_since);
+        }
+        else
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (elapsed_ns_get(&mail_since, &now) > LOST_WAKEUP_SECONDS * 1.0e9)
+            {
+                failure("task left waiting with mail in the queue", posted_get() - received_get());
+                fprintf(stderr, "%u failures\n", stress.failures);
+                exit(EXIT_FAILURE);
+            }
+        }
+        sigprocmask(SIG_SETMASK, &previous, NULL);
+    }
+}
+
+void Schedule(void)
+{
+    /* As the real one, which leaves the switch to the task that
+     * unlocks the scheduler.
+     */
+    if (OSSchedLock > 1 || OSIntNesting > 0)
+    {
+        return;
+    }
+    TaskSchedReq = Co_FALSE;
+
+    /* The task only stops running when it waits. PendSV would switch
+     * to the idle task, with the scheduler unlocked. An ISR that
+     * finds the task waiting makes it ready again.
+     */
+    if (stress.in_interrupt == 0 && task.state == TASK_WAITING)
+    {
+        OSSchedLock = 0;
+        idle();
+    }
+}
+
+static void interrupt_handler(int const signal_number)
+{
+    interrupt_t const interrupt = (signal_number == SIGRTMIN) ? interrupt_low : interrupt_high;
+    source_st * const source = &stress.sources[interrupt];
+
+    stress.in_interrupt++;
+    CoEnterISR();
+
+    if (stress.round_posts < ROUND_POSTS)
+    {
+        uintptr_t const mail = ((uintptr_t)interrupt << 24) | (source->posted & 0xFFFFFF);
+
+        if (isr_PostQueueMail(stress.queue_id, (void *)mail) == E_OK)
+        {
+            source->posted++;
+            stress.round_posts++;
+        }
+        else
+        {
+            source->full++;
+        }
+    }
+
+    CoExitISR();
+    stress.in_interrupt--;
+}
+
+static timer_t interrupt_timer_start(int const signal_number, long const period_ns, sigset_t const * const mask)
+{
+    struct sigaction action = { .sa_handler = interrupt_handler, .sa_flags = SA_RESTART };
+    struct sigevent event = { .sigev_notify = SIGEV_SIGNAL, .sigev_signo = signal_number };
+    struct itimerspec period = { .it_interval = { 0, period_ns }, .it_value = { 0, period_ns } };
+    timer_t timer;
+
+    action.sa_mask = *mask;
+    sigaction(signal_number, &action, NULL);
+    timer_create(CLOCK_MONOTONIC, &event, &timer);
+    timer_settime(timer, 0, &period, NULL);
+
+    return timer;
+}
+
+static void mail_check(void * const pmail)
+{
+    uintptr_t const mail = (uintptr_t)pmail;
+    size_t const interrupt = mail >> 24;
+
+    if (interrupt >= interrupt_COUNT)
+    {
+        failure("mail nobody posted", mail);
+    }
+    else
+    {
+        source_st * const source = &stress.sources[interrupt];
+
+        if ((mail & 0xFFFFFF) != (source->received & 0xFFFFFF))
+        {
+            failure("mail lost, repeated or out of order", interrupt);
+        }
+        source->received++;
+    }
+}
+
+static void ordering_check(unsigned long const rounds)
+{
+    sigset_t low_mask;
+    sigset_t high_mask;
+    sigset_t interrupts_mask;
+    timer_t low_timer;
+    timer_t high_timer;
+    unsigned long round = 0;
+
+    /* The high priority ISR can interrupt the low priority one, but
+     * not the other way round.
+     */
+    sigemptyset(&low_mask);
+    sigemptyset(&high_mask);
+    sigaddset(&high_mask, SIGRTMIN);
+    sigemptyset(&interrupts_mask);
+    sigaddset(&interrupts_mask, SIGRTMIN);
+    sigaddset(&interrupts_mask, SIGRTMIN + 1);
+    low_timer = interrupt_timer_start(SIGRTMIN, LOW_PERIOD_NS, &low_mask);
+    high_timer = interrupt_timer_start(SIGRTMIN + 1, HIGH_PERIOD_NS, &high_mask);
+
+    while (stress.failures == 0)
+    {
+        void * mails[BATCH_SIZE];
+        StatusType err;
+        U16 count;
+        U16 index;
+
+        /* Start the next round once everything has been received. An
+         * ISR can't run while the task looks.
+         */
+        sigprocmask(SIG_BLOCK, &interrupts_mask, NULL);
+        if (stress.round_posts >= ROUND_POSTS && received_get() == posted_get())
+        {
+            if (++round == rounds)
+            {
+                break;
+            }
+            stress.round_posts = 0;
+        }
+        sigprocmask(SIG_UNBLOCK, &interrupts_mask, NULL);
+
+        count = CoPendQueueMailN(stress.queue_id, mails, BATCH_SIZE, 0, &err);
+        if (err != E_OK || count == 0 || count > BATCH_SIZE)
+        {
+            failure("pend failed", err);
+            continue;
+        }
+        stress.batches[count]++;
+        for (index = 0; index < count; index++)
+        {
+            mail_check(mails[index]);
+        }
+    }
+
+    /* No more interrupts. */
+    sigprocmask(SIG_BLOCK, &interrupts_mask, NULL);
+    timer_delete(low_timer);
+    timer_delete(high_timer);
+}
+
+/* Posts and receives mails_per_batch at a time. */
+static double mail_ns_measure(U16 const mails_per_batch)
+{
+    struct timespec start;
+    struct timespec end;
+    unsigned long mail;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (mail = 0; mail < THROUGHPUT_MAILS; mail += mails_per_batch)
+    {
+        void * mails[BATCH_SIZE];
+        StatusType err;
+        U16 index;
+
+        for (index = 0; index < mails_per_batch; index++)
+        {
+            isr_PostQueueMail(stress.queue_id, (void *)(uintptr_t)(mail + index));
+        }
+        if (mails_per_batch == 1)
+        {
+            mails[0] = CoPendQueueMail(stress.queue_id, 0, &err);
+        }
+        else if (CoPendQueueMailN(stress.queue_id, mails, mails_per_batch, 0, &err) != mails_per_batch)
+        {
+            failure("batch not received whole", mail);
+        }
+        if (err != E_OK || (uintptr_t)mails[mails_per_batch - 1] != mail + mails_per_batch - 1)
+        {
+            failure("wrong mail received", mail);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return elapsed_ns_get(&start, &end) / THROUGHPUT_MAILS;
+}
+
+int main(int argc, char * * argv)
+{
+    unsigned long const rounds = (argc > 1) ? strtoul(argv[1], NULL, 0) : DEFAULT_ROUNDS;
+    size_t index;
+
+    CreateEventList();
+    task.state = TASK_RUNNING;
+    task.eventID = INVALID_ID;
+    task.delayTick = INVALID_VALUE;
+    stress.queue_id = CoCreateQueue(stress.queue_buffer, QUEUE_SIZE, EVENT_SORT_TYPE_FIFO);
+
+    ordering_check(rounds);
+
+    printf("%lu rounds, %lu mails received, %lu posts found the queue full\n",
+           rounds, received_get(),
+           stress.sources[interrupt_low].full + stress.sources[interrupt_high].full);
+    printf("mails per batch:");
+    for (index = 1; index <= BATCH_SIZE; index++)
+    {
+        printf(" %zu:%lu", index, stress.batches[index]);
+    }
+    printf("\n");
+
+    printf("%6.1f ns per mail one at a time, %6.1f ns per mail in batches of %d\n",
+           mail_ns_measure(1), mail_ns_measure(BATCH_SIZE), BATCH_SIZE);
+    printf("%u failures\n", stress.failures);
+
+    return (stress.failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
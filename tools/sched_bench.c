@@ -0,0 +1,355 @@
+/* Runs the CoOS ready list and Schedule() (CoOS/kernel/task.c) on
+ * the host. Runs on the host.
+ *
+ * First a random sequence of ready list inserts, removals, priority
+ * changes and calls to Schedule(), which puts the running task back
+ * in the ready list when it is preempted or takes the head when it
+ * waits, is checked against a simple model: the ready list must
+ * always hold the ready tasks in order of priority, and those of the
+ * same priority in the order they were made ready.
+ * Then the scheduling part of the context switch latency is
+ * measured, with a varying number of other tasks ready:
+ *   - an interrupt wakes the highest priority task, as a trigger
+ *     tooth does, which runs and waits again. Two Schedule() calls.
+ *   - an interrupt wakes a task below all the ready tasks. The
+ *     sorted list has to be walked to insert it.
+ * The context switch itself (PendSV) is left out, as it is the
+ * same for both schedulers.
+ * Built twice with the same number of tasks, with
+ * CFG_BITMAP_SCHEDULE_EN set (sched_bench) and clear
+ * (sched_bench_list), to compare the bitmap scheduler with the
+ * sorted list it replaced. The sorted list is only used with fewer
+ * than 15 tasks. Host times are only good for comparison.
+ *
+ * e.g. sched_bench
+ */
+/* Before coocox.h, as OsTime.h uses the same include guard as the
+ * C library's time.h.
+ */
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <coocox.h>
+
+#define BENCH_TASKS (CFG_MAX_USER_TASKS + SYS_TASK_NUM)
+#define RANDOM_OPERATIONS 200000
+#define ROUND_TRIPS 2000000
+
+/* What the rest of the kernel provides. */
+volatile U8 OSIntNesting = 0;
+volatile U8 OSSchedLock = 0;
+volatile BOOL TaskSchedReq = Co_FALSE;
+U64 OSTickCnt = 0;
+
+static unsigned long switches;
+static unsigned int failures;
+
+/* PendSV would do this. */
+void SwitchContext(void)
+{
+    TCBRunning = TCBNext;
+    switches++;
+}
+
+void CoStkOverflowHook(OS_TID taskID)
+{
+    (void)taskID;
+}
+
+static uint32_t random_state = 1;
+
+static uint32_t random_get(void)
+{
+    /* xorshift32 */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    return random_state;
+}
+
+static void failure(char const * const what, unsigned long const detail)
+{
+    if (failures++ < 10)
+    {
+        fprintf(stderr, "%s (%lu)\n", what, detail);
+    }
+}
+
+static void tasks_reset(void)
+{
+    /* For Schedule()'s stack check. */
+    static OS_STK stacks[BENCH_TASKS][2];
+    size_t index;
+
+    while (TCBRdy != Co_NULL)
+    {
+        RemoveFromTCBRdyList(TCBRdy);
+    }
+    for (index = 0; index < BENCH_TASKS; index++)
+    {
+        TCBTbl[index].taskID = (OS_TID)index;
+        TCBTbl[index].state = TASK_WAITING;
+        TCBTbl[index].TCBnext = Co_NULL;
+        TCBTbl[index].TCBprev = Co_NULL;
+#if CFG_STK_CHECKOUT_EN > 0
+        stacks[index][0] = MAGIC_WORD;
+        TCBTbl[index].stack = &stacks[index][0];
+        TCBTbl[index].stkPtr = &stacks[index][1];
+#endif
+    }
+}
+
+/* The model. When each ready task was made ready. */
+static unsigned long ready_since[BENCH_TASKS];
+
+static int ready_order_compare(P_OSTCB const a, P_OSTCB const b)
+{
+    int order;
+
+    if (a->prio != b->prio)
+    {
+        order = (a->prio < b->prio) ? -1 : 1;
+    }
+    else
+    {
+        order = (ready_since[a->taskID] < ready_since[b->taskID]) ? -1 : 1;
+    }
+
+    return order;
+}
+
+static void ready_list_compare(unsigned long const operation)
+{
+    unsigned int num_ready = 0;
+    unsigned int num_listed = 0;
+    P_OSTCB previous = Co_NULL;
+    P_OSTCB ptcb;
+    size_t index;
+
+    for (index = 0; index < BENCH_TASKS; index++)
+    {
+        if (TCBTbl[index].state == TASK_READY)
+        {
+            num_ready++;
+        }
+    }
+
+    for (ptcb = TCBRdy; ptcb != Co_NULL && num_listed <= num_ready; ptcb = ptcb->TCBnext)
+    {
+        if (ptcb->state != TASK_READY
+            || ptcb->TCBprev != previous
+            || (previous != Co_NULL && ready_order_compare(previous, ptcb) > 0))
+        {
+            failure("ready list out of order after operation", operation);
+            break;
+        }
+        previous = ptcb;
+        num_listed++;
+    }
+    if (num_listed != num_ready)
+    {
+        failure("ready list doesn't hold every ready task after operation", operation);
+    }
+}
+
+static void ready_list_check(void)
+{
+    unsigned long operation;
+
+    tasks_reset();
+    TCBTbl[0].prio = CFG_LOWEST_PRIO / 2;
+    TCBTbl[0].state = TASK_RUNNING;
+    TCBRunning = &TCBTbl[0];
+    TCBNext = &TCBTbl[0];
+
+    for (operation = 0; operation < RANDOM_OPERATIONS && failures == 0; operation++)
+    {
+        P_OSTCB const ptcb = &TCBTbl[random_get() % BENCH_TASKS];
+        /* Few priorities, so that they are shared. */
+        U8 const prio = (U8)(random_get() % 4) * (CFG_LOWEST_PRIO / 4);
+        unsigned int const action = random_get() % 8;
+
+        if (action == 0)
+        {
+            /* The running task is preempted by the head of the list,
+             * if it has a higher priority, and goes to the back of
+             * the list for its priority.
+             */
+            P_OSTCB const running = TCBRunning;
+            P_OSTCB const head = TCBRdy;
+
+            ready_since[running->taskID] = operation;
+            Schedule();
+            if (head != Co_NULL && head->prio < running->prio && TCBRunning != head)
+            {
+                failure("running task not preempted after operation", operation);
+            }
+        }
+        else if (action == 1)
+        {
+            /* The running task waits and the head of the list runs. */
+            P_OSTCB const head = TCBRdy;
+
+            if (head != Co_NULL)
+            {
+                TCBRunning->state = TASK_WAITING;
+                Schedule();
+                if (TCBRunning != head)
+                {
+                    failure("head of the ready list didn't run after operation", operation);
+                }
+            }
+        }
+        else if (ptcb == TCBRunning)
+        {
+            /* Leave the running task alone. */
+        }
+        else if (ptcb->state != TASK_READY)
+        {
+            ptcb->prio = prio;
+            ready_since[ptcb->taskID] = operation;
+            InsertToTCBRdyList(ptcb);
+        }
+        else if (action % 2 == 0)
+        {
+            RemoveFromTCBRdyList(ptcb);
+            ptcb->state = TASK_WAITING;
+        }
+        else
+        {
+            /* As CoSetPriority() does it. The task goes to the back
+             * of the list for its new priority.
+             */
+            ptcb->prio = prio;
+            RemoveFromTCBRdyList(ptcb);
+            ready_since[ptcb->taskID] = operation;
+            InsertToTCBRdyList(ptcb);
+        }
+
+        ready_list_compare(operation);
+    }
+    switches = 0;
+}
+
+/* Idle, the background task running and num_ready tasks that it
+ * preempted.
+ */
+static void tasks_ready(unsigned int const num_ready)
+{
+    P_OSTCB const background_task = &TCBTbl[2];
+    unsigned int index;
+
+    tasks_reset();
+
+    TCBTbl[0].prio = CFG_LOWEST_PRIO;
+    InsertToTCBRdyList(&TCBTbl[0]);
+    for (index = 0; index < num_ready; index++)
+    {
+        TCBTbl[3 + index].prio = (U8)(10 + index);
+        InsertToTCBRdyList(&TCBTbl[3 + index]);
+    }
+    background_task->prio = 5;
+    background_task->state = TASK_RUNNING;
+    TCBRunning = background_task;
+    TCBNext = background_task;
+}
+
+static double elapsed_ns_get(struct timespec const * const start, struct timespec const * const end)
+{
+    return (end->tv_sec - start->tv_sec) * 1.0e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* The interrupt wakes the highest priority task, which runs and
+ * waits again.
+ */
+static double round_trip_ns_measure(unsigned int const num_ready)
+{
+    P_OSTCB const event_task = &TCBTbl[1];
+    struct timespec start;
+    struct timespec end;
+    unsigned long trip;
+
+    tasks_ready(num_ready);
+    event_task->prio = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (trip = 0; trip < ROUND_TRIPS; trip++)
+    {
+        InsertToTCBRdyList(event_task);
+        Schedule();
+        event_task->state = TASK_WAITING;
+        Schedule();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (TCBRunning != &TCBTbl[2] || switches != 2 * ROUND_TRIPS)
+    {
+        failure("wrong task switched to", num_ready);
+    }
+    switches = 0;
+
+    return elapsed_ns_get(&start, &end) / ROUND_TRIPS;
+}
+
+/* The interrupt wakes a task below all the ready tasks, which is
+ * then made to wait again before it gets to run, as when a delay
+ * ends and the task is suspended.
+ */
+static double low_priority_wake_ns_measure(unsigned int const num_ready)
+{
+    P_OSTCB const low_task = &TCBTbl[1];
+    struct timespec start;
+    struct timespec end;
+    unsigned long trip;
+
+    tasks_ready(num_ready);
+    low_task->prio = CFG_LOWEST_PRIO - 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (trip = 0; trip < ROUND_TRIPS; trip++)
+    {
+        InsertToTCBRdyList(low_task);
+        Schedule();
+        RemoveFromTCBRdyList(low_task);
+        low_task->state = TASK_WAITING;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (TCBRunning != &TCBTbl[2] || switches != 0)
+    {
+        failure("low priority task was switched to", num_ready);
+    }
+
+    return elapsed_ns_get(&start, &end) / ROUND_TRIPS;
+}
+
+int main(void)
+{
+    static unsigned int const ready_counts[] = { 0, 2, 8, 12 };
+    size_t index;
+
+    printf("%s scheduler, %d tasks\n",
+           (CFG_BITMAP_SCHEDULE_EN > 0) ? "bitmap" : (CFG_ORDER_LIST_SCHEDULE_EN > 0) ? "sorted list" : "binary",
+           BENCH_TASKS);
+
+    ready_list_check();
+    printf("%d ready list operations checked\n", RANDOM_OPERATIONS);
+
+    for (index = 0; index < sizeof ready_counts / sizeof ready_counts[0]; index++)
+    {
+        if (3 + ready_counts[index] <= BENCH_TASKS)
+        {
+            printf("%2u other tasks ready: %6.1f ns to wake and switch to a task and back,"
+                   " %6.1f ns to wake a low priority task\n",
+                   ready_counts[index],
+                   round_trip_ns_measure(ready_counts[index]),
+                   low_priority_wake_ns_measure(ready_counts[index]));
+        }
+    }
+    printf("%u failures\n", failures);
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,44 @@
+#ifndef __SENSOR_CALIBRATION_H__
+#define __SENSOR_CALIBRATION_H__
+
+/* Sensor calibration parameters, used by the table generator 
+ * running on the build host. A calibration file provides a 
+ * sensor_calibrations[] array with an entry for every analog 
+ * input. 
+ */
+
+typedef enum sensor_type_t
+{
+    /* Engineering value is a polynomial in the sensor voltage. */
+    sensor_type_polynomial,
+    /* NTC thermistor with a pull-up resistor to the ADC reference 
+     * voltage. Temperature from the Steinhart-Hart equation. 
+     */
+    sensor_type_thermistor
+} sensor_type_t;
+
+#define SENSOR_POLYNOMIAL_ORDER 3
+
+typedef struct sensor_calibration_st
+{
+    int input; /* analog_input_t */
+    char const * input_name;
+    sensor_type_t type;
+
+    double scale; /* Table units per engineering unit. */
+    double minimum; /* Results are clamped to this range. */
+    double maximum;
+    double tolerance; /* Maximum allowable table error, in engineering units. */
+
+    /* sensor_type_polynomial */
+    double divider_ratio; /* Sensor voltage / ADC pin voltage. */
+    double coefficients[SENSOR_POLYNOMIAL_ORDER + 1]; /* c0 + c1 * v + c2 * v^2 + c3 * v^3 */
+
+    /* sensor_type_thermistor */
+    double pullup_ohms;
+    double steinhart_hart[3]; /* A, B, C */
+} sensor_calibration_st;
+
+#define SENSOR_INPUT(analog_input) .input = analog_input, .input_name = #analog_input
+
+#endif /* __SENSOR_CALIBRATION_H__ */
@@ -0,0 +1,239 @@
+/* Generates the sensor conversion tables from a sensor 
+ * calibration. Runs on the build host, writing C source to 
+ * stdout. 
+ * Each table is checked against the reference formula at every 
+ * possible input value using the same interpolation as the 
+ * target. Generation fails if the error exceeds the tolerance 
+ * given in the calibration. 
+ *  
+ * Build with -DSENSOR_CALIBRATION_FILE='"<calibration file>"'. 
+ */
+#include "sensor_conversion.h"
+#include "sensor_calibration.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include SENSOR_CALIBRATION_FILE
+
+#define ARRAY_SIZE(a) (sizeof((a)) / sizeof((a)[0]))
+
+#define KELVIN_OFFSET 273.15
+
+static double pin_volts_from_value(double const value)
+{
+    return (value * (ANALOG_INPUT_REFERENCE_MV / 1000.0)) / ANALOG_INPUT_FULL_SCALE;
+}
+
+static double thermistor_temperature(sensor_calibration_st const * const calibration, double const pin_volts)
+{
+    double const reference_volts = ANALOG_INPUT_REFERENCE_MV / 1000.0;
+    double temperature;
+
+    /* Open and short circuit sensors. */
+    if (pin_volts >= reference_volts)
+    {
+        temperature = calibration->minimum;
+    }
+    else if (pin_volts <= 0.0)
+    {
+        temperature = calibration->maximum;
+    }
+    else
+    {
+        double const ohms = calibration->pullup_ohms * pin_volts / (reference_volts - pin_volts);
+        double const ln_ohms = log(ohms);
+
+        temperature = 1.0 / (calibration->steinhart_hart[0]
+                             + calibration->steinhart_hart[1] * ln_ohms
+                             + calibration->steinhart_hart[2] * ln_ohms * ln_ohms * ln_ohms)
+                      - KELVIN_OFFSET;
+    }
+
+    return temperature;
+}
+
+static double polynomial_value(sensor_calibration_st const * const calibration, double const pin_volts)
+{
+    double const sensor_volts = pin_volts * calibration->divider_ratio;
+    double result = 0.0;
+    int index;
+
+    for (index = SENSOR_POLYNOMIAL_ORDER; index >= 0; index--)
+    {
+        result = result * sensor_volts + calibration->coefficients[index];
+    }
+
+    return result;
+}
+
+/* The reference value for an input value. */
+static double reference_value(sensor_calibration_st const * const calibration, double const value)
+{
+    double const pin_volts = pin_volts_from_value(value);
+    double result;
+
+    switch (calibration->type)
+    {
+        case sensor_type_thermistor:
+            result = thermistor_temperature(calibration, pin_volts);
+            break;
+        case sensor_type_polynomial:
+        default:
+            result = polynomial_value(calibration, pin_volts);
+            break;
+    }
+
+    if (result < calibration->minimum)
+    {
+        result = calibration->minimum;
+    }
+    else if (result > calibration->maximum)
+    {
+        result = calibration->maximum;
+    }
+
+    return result;
+}
+
+static bool table_generate(sensor_calibration_st const * const calibration, sensor_table_st * const table)
+{
+    bool generated;
+    size_t index;
+
+    if (calibration->input < 0 || calibration->input >= analog_input_COUNT)
+    {
+        fprintf(stderr, "%s: invalid input\n", calibration->input_name);
+        generated = false;
+        goto done;
+    }
+
+    if (calibration->scale < 1.0 
+        || lrint(calibration->scale) > INT16_MAX
+        || fabs(calibration->minimum * calibration->scale) > INT16_MAX
+        || fabs(calibration->maximum * calibration->scale) > INT16_MAX)
+    {
+        fprintf(stderr, "%s: scaled range doesn't fit in 16 bits\n", calibration->input_name);
+        generated = false;
+        goto done;
+    }
+
+    table->scale = lrint(calibration->scale);
+    for (index = 0; index < SENSOR_TABLE_ENTRIES; index++)
+    {
+        double const value = (double)index * (1UL << SENSOR_TABLE_FRACTION_BITS);
+
+        table->values[index] = lrint(reference_value(calibration, value) * table->scale);
+    }
+    generated = true;
+
+done:
+    return generated;
+}
+
+static bool table_check(sensor_calibration_st const * const calibration, sensor_table_st const * const table)
+{
+    double maximum_error = 0.0;
+    unsigned int worst_value = 0;
+    unsigned int value;
+    bool within_tolerance;
+
+    for (value = 0; value <= ANALOG_INPUT_FULL_SCALE; value++)
+    {
+        double const result = (double)sensor_table_interpolate(table, value) / table->scale;
+        double const error = fabs(result - reference_value(calibration, value));
+
+        if (error > maximum_error)
+        {
+            maximum_error = error;
+            worst_value = value;
+        }
+    }
+
+    within_tolerance = maximum_error <= calibration->tolerance;
+    fprintf(stderr, "%s: maximum error %g at %u%s\n",
+            calibration->input_name,
+            maximum_error,
+            worst_value,
+            within_tolerance ? "" : " exceeds tolerance");
+
+    return within_tolerance;
+}
+
+static void table_print(sensor_calibration_st const * const calibration, sensor_table_st const * const table)
+{
+    size_t index;
+
+    printf("    [%s] =\n", calibration->input_name);
+    printf("    {\n");
+    printf("        .scale = %d,\n", table->scale);
+    printf("        .values =\n");
+    printf("        {");
+    for (index = 0; index < SENSOR_TABLE_ENTRIES; index++)
+    {
+        printf("%s%d%s",
+               ((index % 8) == 0) ? "\n            " : " ",
+               table->values[index],
+               (index < SENSOR_TABLE_ENTRIES - 1) ? "," : "");
+    }
+    printf("\n        }\n");
+    printf("    },\n");
+}
+
+int main(void)
+{
+    static sensor_table_st tables[ARRAY_SIZE(sensor_calibrations)];
+    bool have_input[analog_input_COUNT] = { false };
+    int result = EXIT_SUCCESS;
+    size_t index;
+
+    for (index = 0; index < ARRAY_SIZE(sensor_calibrations); index++)
+    {
+        sensor_calibration_st const * const calibration = &sensor_calibrations[index];
+
+        if (!table_generate(calibration, &tables[index]))
+        {
+            result = EXIT_FAILURE;
+            continue;
+        }
+        if (!table_check(calibration, &tables[index]))
+        {
+            result = EXIT_FAILURE;
+        }
+        if (have_input[calibration->input])
+        {
+            fprintf(stderr, "%s: calibrated more than once\n", calibration->input_name);
+            result = EXIT_FAILURE;
+        }
+        have_input[calibration->input] = true;
+    }
+
+    for (index = 0; index < analog_input_COUNT; index++)
+    {
+        if (!have_input[index])
+        {
+            fprintf(stderr, "analog input %u has no calibration\n", (unsigned int)index);
+            result = EXIT_FAILURE;
+        }
+    }
+
+    if (result != EXIT_SUCCESS)
+    {
+        goto done;
+    }
+
+    printf("/* Generated by tools/sensor_table_gen.c from %s. Do not edit. */\n", SENSOR_CALIBRATION_FILE);
+    printf("#include \"sensor_conversion.h\"\n\n");
+    printf("sensor_table_st const sensor_tables[analog_input_COUNT] =\n");
+    printf("{\n");
+    for (index = 0; index < ARRAY_SIZE(sensor_calibrations); index++)
+    {
+        table_print(&sensor_calibrations[index], &tables[index]);
+    }
+    printf("};\n");
+
+done:
+    return result;
+}
@@ -0,0 +1,315 @@
+/* Stress test for the CoOS service request queue
+ * (CoOS/kernel/serviceReq.c). Runs on the host.
+ *
+ * Producer threads stand in for ISRs that find the scheduler
+ * locked. Each keeps posting mail through the queue, numbered in
+ * sequence, and setting its own flag. A consumer thread stands in
+ * for the scheduler being unlocked, calling RespondSRQ() whenever
+ * IsrReq is set. The queue is built
+ * small, so it overflows. Checks that:
+ *   - every post that was queued is handled once, in the order
+ *     each producer made them.
+ *   - every post that didn't fit was counted as an overflow.
+ *   - the last time each producer set its flag was handled, so
+ *     coalescing never loses a flag.
+ *   - nothing is left behind with IsrReq clear. After each burst of
+ *     requests a producer waits for them all to be handled.
+ * Threads can be interrupted anywhere, which is harsher than the
+ * target, where the consumer never runs while an ISR is part way
+ * through a request.
+ *
+ * e.g. srq_stress [rounds]
+ */
+/* Before coocox.h, as OsTime.h uses the same include guard as the
+ * C library's time.h.
+ */
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <coocox.h>
+
+#define NUM_PRODUCERS 4
+#define DEFAULT_ROUNDS 20000
+#define FLAG_SETS_PER_POST 4
+#define BURST_LENGTH 50
+#define HANDLING_TIMEOUT_SECONDS 1
+#define HANDLINGS_PER_INTERRUPT 7
+
+typedef struct producer_st
+{
+    OS_EventID id;
+    unsigned long queued;
+    unsigned long overflows;
+    unsigned long flag_sets;
+    uint32_t flag_generation; /* Changed before each flag set. */
+    unsigned long rounds;
+} producer_st;
+
+typedef struct consumer_st
+{
+    unsigned long handled[NUM_PRODUCERS];
+    uint32_t handled_flag_generation[NUM_PRODUCERS];
+    unsigned long responses;
+    unsigned long handlings;
+} consumer_st;
+
+static producer_st producers[NUM_PRODUCERS];
+static consumer_st consumer;
+static pthread_barrier_t round_barrier;
+static volatile bool producing = true;
+static volatile bool left_behind = false;
+static unsigned long failures;
+
+/* What the rest of the kernel provides. */
+volatile U8 OSSchedLock = 1;
+
+static void failure(char const * const what, unsigned long const detail)
+{
+    if (__atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED) < 10)
+    {
+        fprintf(stderr, "%s (%lu)\n", what, detail);
+    }
+}
+
+/* Lets the producers in part way through RespondSRQ(), as an
+ * interrupt would, even with only one CPU.
+ */
+static void handling_interrupt(void)
+{
+    if (++consumer.handlings % HANDLINGS_PER_INTERRUPT == 0)
+    {
+        sched_yield();
+    }
+}
+
+StatusType CoPostSem(OS_EventID id)
+{
+    failure("unexpected semaphore post", id);
+    return E_OK;
+}
+
+StatusType CoPostMail(OS_EventID id, void * pmail)
+{
+    unsigned long const sequence = (unsigned long)(uintptr_t)pmail;
+
+    if (id >= NUM_PRODUCERS)
+    {
+        failure("post from an unknown producer", id);
+    }
+    else
+    {
+        if (sequence != consumer.handled[id])
+        {
+            failure("post lost, repeated or out of order", id);
+        }
+        __atomic_store_n(&consumer.handled[id], sequence + 1, __ATOMIC_RELEASE);
+    }
+    handling_interrupt();
+    return E_OK;
+}
+
+StatusType CoSetFlag(OS_FlagID id)
+{
+    if (id >= NUM_PRODUCERS)
+    {
+        failure("flag from an unknown producer", id);
+    }
+    else
+    {
+        __atomic_store_n(&consumer.handled_flag_generation[id],
+                         __atomic_load_n(&producers[id].flag_generation, __ATOMIC_ACQUIRE),
+                         __ATOMIC_RELEASE);
+    }
+    handling_interrupt();
+    return E_OK;
+}
+
+void TimeDispose(void)
+{
+}
+
+void TmrDispose(void)
+{
+}
+
+void NotifyDispose(void)
+{
+}
+
+void QueueDispose(void)
+{
+}
+
+/* Waits for the consumer to handle everything the producer has
+ * requested. It only responds while IsrReq is set, so anything left
+ * behind with IsrReq clear would never be handled. The flag's
+ * generation can be handled before the last request to set it is
+ * made, so the request itself is waited for too.
+ */
+static bool producer_handled_wait(producer_st const * const producer)
+{
+    time_t const start = time(NULL);
+    size_t const index = producer->id;
+
+    while (__atomic_load_n(&consumer.handled[index], __ATOMIC_ACQUIRE) != producer->queued
+           || (__atomic_load_n(&ServiceReq.flagReq, __ATOMIC_ACQUIRE) & (1UL << index)) != 0
+           || __atomic_load_n(&consumer.handled_flag_generation[index], __ATOMIC_ACQUIRE) != producer->flag_generation)
+    {
+        if (time(NULL) - start > HANDLING_TIMEOUT_SECONDS)
+        {
+            return false;
+        }
+        sched_yield();
+    }
+
+    return true;
+}
+
+static void request_make(producer_st * const producer, unsigned int const step)
+{
+    if (step % (FLAG_SETS_PER_POST + 1) == 0)
+    {
+        if (InsertInSRQ(MBOX_REQ, producer->id, (void *)(uintptr_t)producer->queued))
+        {
+            producer->queued++;
+        }
+        else
+        {
+            producer->overflows++;
+            /* Give the consumer a chance. */
+            sched_yield();
+        }
+    }
+    else
+    {
+        __atomic_store_n(&producer->flag_generation, producer->flag_generation + 1, __ATOMIC_RELEASE);
+        InsertFlagInSRQ(producer->id);
+        producer->flag_sets++;
+    }
+}
+
+static void * producer_thread(void * arg)
+{
+    producer_st * const producer = arg;
+    unsigned long round;
+
+    for (round = 0; round < producer->rounds; round++)
+    {
+        unsigned int step;
+
+        for (step = 0; step < BURST_LENGTH; step++)
+        {
+            request_make(producer, step);
+        }
+
+        /* All the producers stop, as if the interrupts went quiet, so
+         * nothing sets IsrReq again for any requests left behind.
+         */
+        pthread_barrier_wait(&round_barrier);
+        if (!producer_handled_wait(producer))
+        {
+            failure("requests left behind with IsrReq clear", producer->id);
+            left_behind = true;
+        }
+        /* Every round after would only time out too. */
+        pthread_barrier_wait(&round_barrier);
+        if (left_behind)
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void * consumer_thread(void * arg)
+{
+    (void)arg;
+
+    while (producing)
+    {
+        if (__atomic_load_n(&IsrReq, __ATOMIC_SEQ_CST) == Co_TRUE)
+        {
+            RespondSRQ();
+            consumer.responses++;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char * * argv)
+{
+    unsigned long const rounds = (argc > 1) ? strtoul(argv[1], NULL, 0) : DEFAULT_ROUNDS;
+    pthread_t producer_threads[NUM_PRODUCERS];
+    pthread_t consumer_thread_id;
+    unsigned long queued = 0;
+    unsigned long overflows = 0;
+    unsigned long flag_sets = 0;
+    size_t index;
+
+    pthread_barrier_init(&round_barrier, NULL, NUM_PRODUCERS);
+    for (index = 0; index < NUM_PRODUCERS; index++)
+    {
+        producers[index].id = (OS_EventID)index;
+        producers[index].rounds = rounds;
+        pthread_create(&producer_threads[index], NULL, producer_thread, &producers[index]);
+    }
+    pthread_create(&consumer_thread_id, NULL, consumer_thread, NULL);
+
+    for (index = 0; index < NUM_PRODUCERS; index++)
+    {
+        pthread_join(producer_threads[index], NULL);
+    }
+    producing = false;
+    pthread_join(consumer_thread_id, NULL);
+
+    /* As the next time the scheduler is unlocked would. */
+    if (IsrReq == Co_TRUE)
+    {
+        RespondSRQ();
+    }
+    if (ServiceReq.head != ServiceReq.tail || ServiceReq.flagReq != 0 || IsrReq == Co_TRUE)
+    {
+        failure("requests left behind", ServiceReq.tail - ServiceReq.head);
+    }
+
+    for (index = 0; index < NUM_PRODUCERS; index++)
+    {
+        if (consumer.handled[index] != producers[index].queued)
+        {
+            failure("queued posts not all handled", index);
+        }
+        if (consumer.handled_flag_generation[index] != producers[index].flag_generation)
+        {
+            failure("last flag set not handled", index);
+        }
+        queued += producers[index].queued;
+        overflows += producers[index].overflows;
+        flag_sets += producers[index].flag_sets;
+    }
+    if (CoGetSRQOverflows() != overflows)
+    {
+        failure("overflows miscounted", CoGetSRQOverflows());
+    }
+    if (CoGetSRQHighWater() > CFG_MAX_SERVICE_REQUEST)
+    {
+        failure("high-water mark beyond the queue size", CoGetSRQHighWater());
+    }
+
+    printf("%lu posts queued, %lu overflowed, %lu flag sets, %lu responses\n",
+           queued, overflows, flag_sets, consumer.responses);
+    printf("high-water mark %u of %u\n", (unsigned)CoGetSRQHighWater(), (unsigned)CFG_MAX_SERVICE_REQUEST);
+    printf("%lu failures\n", failures);
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
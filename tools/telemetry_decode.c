@@ -0,0 +1,179 @@
+/* Decodes the binary telemetry frames sent by the target (see 
+ * app/telemetry_frame.h) into CSV. Runs on the host. 
+ * Reads the raw serial stream from stdin and writes one CSV line 
+ * per valid frame to stdout. Text debug output mixed in with the 
+ * frames is skipped. Frames with a bad CRC and gaps in the 
+ * sequence numbers are reported on stderr. 
+ *  
+ * e.g. telemetry_decode < capture.bin > capture.csv 
+ */
+#include "telemetry_frame.h"
+#include "crc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ARRAY_SIZE(a) (sizeof((a)) / sizeof((a)[0]))
+
+typedef struct field_desc_st
+{
+    char const * name;
+    telemetry_field_type_t type;
+    int scale;
+} field_desc_st;
+
+#define TELEMETRY_FIELD_DESCRIPTOR(field_name, field_type, field_scale, field_value_get, field_index) \
+    { .name = #field_name, .type = telemetry_field_##field_type, .scale = field_scale },
+
+static field_desc_st const fields[] =
+{
+    TELEMETRY_FIELDS(TELEMETRY_FIELD_DESCRIPTOR)
+};
+
+typedef struct decode_stats_st
+{
+    unsigned long frames;
+    unsigned long crc_errors;
+    unsigned long length_errors;
+    unsigned long frames_missed;
+} decode_stats_st;
+
+static uint32_t get_le(uint8_t const * const p, size_t const len)
+{
+    uint32_t value = 0;
+    size_t x;
+
+    for (x = len; x > 0; x--)
+    {
+        value = (value << 8) | p[x - 1];
+    }
+
+    return value;
+}
+
+static void print_header(void)
+{
+    size_t x;
+
+    printf("sequence,timestamp_us");
+    for (x = 0; x < ARRAY_SIZE(fields); x++)
+    {
+        printf(",%s", fields[x].name);
+    }
+    printf("\n");
+}
+
+static void print_frame(uint8_t const * const frame)
+{
+    uint8_t const * p = &frame[TELEMETRY_HEADER_SIZE];
+    size_t x;
+
+    printf("%u,%u", (unsigned)get_le(&frame[3], 2), (unsigned)get_le(&frame[5], 4));
+
+    for (x = 0; x < ARRAY_SIZE(fields); x++)
+    {
+        field_desc_st const * const field = &fields[x];
+        long value;
+
+        switch (field->type)
+        {
+            case telemetry_field_u8:
+                value = get_le(p, 1);
+                p += 1;
+                break;
+            case telemetry_field_u16:
+                value = get_le(p, 2);
+                p += 2;
+                break;
+            case telemetry_field_s16:
+                value = (int16_t)get_le(p, 2);
+                p += 2;
+                break;
+            case telemetry_field_u32:
+            default:
+                value = get_le(p, 4);
+                p += 4;
+                break;
+        }
+
+        if (field->scale == 1)
+        {
+            printf(",%ld", value);
+        }
+        else
+        {
+            printf(",%g", (double)value / field->scale);
+        }
+    }
+    printf("\n");
+}
+
+int main(void)
+{
+    uint8_t frame[TELEMETRY_FRAME_SIZE];
+    size_t frame_len = 0;
+    decode_stats_st stats = { 0 };
+    bool have_sequence = false;
+    uint16_t next_sequence = 0;
+    int ch;
+
+    print_header();
+
+    while ((ch = getchar()) != EOF)
+    {
+        frame[frame_len++] = ch;
+
+        /* Hunt for the sync bytes. */
+        if (frame_len == 1 && frame[0] != TELEMETRY_SYNC_0)
+        {
+            frame_len = 0;
+        }
+        else if (frame_len == 2 && frame[1] != TELEMETRY_SYNC_1)
+        {
+            frame_len = (frame[1] == TELEMETRY_SYNC_0) ? 1 : 0;
+            frame[0] = frame[1];
+        }
+        else if (frame_len == 3 && frame[2] != TELEMETRY_PAYLOAD_SIZE)
+        {
+            /* Either a false sync or a frame from firmware with a 
+             * different field list. 
+             */
+            stats.length_errors++;
+            frame_len = 0;
+        }
+        else if (frame_len == TELEMETRY_FRAME_SIZE)
+        {
+            size_t const crc_offset = TELEMETRY_FRAME_SIZE - TELEMETRY_CRC_SIZE;
+            uint16_t const crc = crc16_ccitt_update(CRC16_CCITT_INITIAL, &frame[2], crc_offset - 2);
+
+            if (crc != get_le(&frame[crc_offset], TELEMETRY_CRC_SIZE))
+            {
+                /* XXX - Could rescan the discarded bytes for a sync 
+                 * that was hidden inside the bad frame. 
+                 */
+                stats.crc_errors++;
+            }
+            else
+            {
+                uint16_t const sequence = get_le(&frame[3], 2);
+
+                if (have_sequence && sequence != next_sequence)
+                {
+                    stats.frames_missed += (uint16_t)(sequence - next_sequence);
+                }
+                have_sequence = true;
+                next_sequence = sequence + 1;
+                stats.frames++;
+                print_frame(frame);
+            }
+            frame_len = 0;
+        }
+    }
+
+    fprintf(stderr, "frames %lu missed %lu crc errors %lu length errors %lu\n",
+            stats.frames, stats.frames_missed, stats.crc_errors, stats.length_errors);
+
+    return (stats.frames > 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,466 @@
+/* Test for CoOS tickless timing (CoOS/kernel/time.c and timer.c
+ * with CFG_TICKLESS_EN). Runs on the host.
+ *
+ * The microsecond count and the compare on it are simulated. Time
+ * jumps from one compare to the next, plus a random interrupt
+ * latency, and SysTick_Handler() is run as arch.c does. Sometimes a
+ * task holds the scheduler lock when it runs, so the lists are
+ * handled when the task unlocks. The count starts just before it
+ * wraps. Tasks delay for random times, and are sometimes woken
+ * early as by an event. Periodic and one-shot timers run. Checks
+ * that:
+ *   - no task wakes or timer ends before it is due, nor later than
+ *     the latency allows, so the compare is always set for the next
+ *     one to end.
+ *   - periodic timers don't drift. The nth end of a timer is n
+ *     periods after it was started, or a whole number of periods
+ *     later if the handling was so late that some were skipped.
+ *   - CoGetOSTime() keeps counting ticks through wraps of the count.
+ * Then counts the interrupts needed, against a periodic tick fast
+ * enough for the same resolution.
+ *
+ * e.g. tickless_test [seconds]
+ */
+/* Without the C library's time.h, which uses the same include guard
+ * as OsTime.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <coocox.h>
+
+#if CFG_TICKLESS_EN == 0
+#error "tickless_test needs CFG_TICKLESS_EN"
+#endif
+
+#define NUM_TASKS CFG_MAX_USER_TASKS
+#define NUM_PERIODIC_TIMERS 3
+#define ONE_SHOT_TIMER_INDEX NUM_PERIODIC_TIMERS
+#define NUM_TIMERS (NUM_PERIODIC_TIMERS + 1)
+#define DEFAULT_SECONDS 120
+#define START_COUNT (0xFFFFFFFFu - 30000000u) /* Wraps after 30 s. */
+#define MAX_LATENCY_US 30
+#define MAX_LOCK_US 20
+#define LATE_HANDLING_US 5000 /* Now and then, to skip periods. */
+#define MAX_TASK_DELAY_US 50000
+#define IDLE_HOURS 3
+
+typedef struct task_st
+{
+    U32 due;
+    bool waiting;
+} task_st;
+
+typedef struct timer_st
+{
+    OS_TCID id;
+    U32 period;
+    U32 first_due;
+    unsigned long ends;
+    bool running;
+} timer_st;
+
+typedef struct sim_st
+{
+    uint64_t now; /* Microseconds since the start. */
+    U32 compare;
+    bool pended;
+    unsigned long interrupts;
+    unsigned long late_handlings;
+    unsigned long skipped_periods;
+    unsigned long wakes;
+    unsigned long early_wakes;
+    unsigned int failures;
+} sim_st;
+
+static sim_st sim;
+static task_st tasks[NUM_TASKS];
+static timer_st timers[NUM_TIMERS];
+
+/* What the rest of the kernel provides. */
+volatile U8 OSSchedLock = 0;
+volatile U8 OSIntNesting = 0;
+volatile BOOL TaskSchedReq = Co_FALSE;
+BOOL IsrReq = Co_FALSE;
+BOOL TimeReq = Co_FALSE;
+BOOL TimerReq = Co_FALSE;
+OSTCB TCBTbl[CFG_MAX_USER_TASKS + SYS_TASK_NUM];
+P_OSTCB TCBRunning;
+U64 OSTickCnt = 0;
+volatile U32 OSTickCnt2;
+volatile U32 OSTimeHigh = 0;
+volatile U32 OSTimeLast = 0;
+
+static uint32_t random_state = 1;
+
+static uint32_t random_get(void)
+{
+    /* xorshift32 */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    return random_state;
+}
+
+static void failure(char const * const what, unsigned long const detail)
+{
+    if (sim.failures++ < 10)
+    {
+        fprintf(stderr, "%s (%lu)\n", what, detail);
+    }
+}
+
+static U32 count_get(void)
+{
+    return (U32)(START_COUNT + sim.now);
+}
+
+U32 TicklessNow(void)
+{
+    return count_get();
+}
+
+void TicklessCompareSet(U32 due)
+{
+    sim.compare = due;
+    if ((S32)(due - count_get()) <= 0)
+    {
+        sim.pended = true;
+    }
+}
+
+/* As RespondSRQ() would. */
+void OsSchedUnlock(void)
+{
+    if (OSSchedLock == 1 && IsrReq == Co_TRUE)
+    {
+        IsrReq = Co_FALSE;
+        if (TimeReq == Co_TRUE)
+        {
+            TimeReq = Co_FALSE;
+            TimeDispose();
+        }
+        if (TimerReq == Co_TRUE)
+        {
+            TimerReq = Co_FALSE;
+            TmrDispose();
+        }
+    }
+    OSSchedLock--;
+}
+
+void InsertToTCBRdyList(P_OSTCB ptcb)
+{
+    task_st * const task = &tasks[ptcb->taskID];
+    U32 const late = count_get() - task->due;
+
+    ptcb->state = TASK_READY;
+    if (!task->waiting)
+    {
+        failure("task woken that wasn't waiting", ptcb->taskID);
+    }
+    else if ((S32)late < 0)
+    {
+        failure("task woken early", ptcb->taskID);
+    }
+    else if (late > MAX_LATENCY_US + MAX_LOCK_US && sim.late_handlings == 0)
+    {
+        failure("task woken late", late);
+    }
+    task->waiting = false;
+    sim.wakes++;
+}
+
+void RemoveEventWaittingList(P_OSTCB ptcb)
+{
+    failure("task removed from an event", ptcb->taskID);
+}
+
+void RemoveLinkNode(P_FLAG_NODE pnode)
+{
+    (void)pnode;
+    failure("task removed from a flag", 0);
+}
+
+static void timer_end(size_t const index)
+{
+    timer_st * const timer = &timers[index];
+    U32 const since_first = count_get() - timer->first_due;
+
+    if (!timer->running)
+    {
+        failure("timer ended that wasn't running", index);
+    }
+    else if (timer->period == 0)
+    {
+        if (since_first > MAX_LATENCY_US + MAX_LOCK_US && sim.late_handlings == 0)
+        {
+            failure("one-shot timer ended early or late", since_first);
+        }
+        timer->running = false;
+    }
+    else
+    {
+        /* Which end this is. Skipped periods are counted. */
+        unsigned long const end = since_first / timer->period;
+        U32 const late = since_first % timer->period;
+
+        if ((S32)since_first < 0 || end < timer->ends)
+        {
+            failure("periodic timer ended early", index);
+        }
+        else if (late > MAX_LATENCY_US + MAX_LOCK_US && sim.late_handlings == 0)
+        {
+            failure("periodic timer drifted", late);
+        }
+        sim.skipped_periods += end - timer->ends;
+        timer->ends = end + 1;
+    }
+}
+
+static void timer_0_callback(void)
+{
+    timer_end(0);
+}
+
+static void timer_1_callback(void)
+{
+    timer_end(1);
+}
+
+static void timer_2_callback(void)
+{
+    timer_end(2);
+}
+
+static void one_shot_callback(void)
+{
+    timer_end(ONE_SHOT_TIMER_INDEX);
+}
+
+static vFUNCPtr const timer_callbacks[NUM_TIMERS] =
+{
+    timer_0_callback, timer_1_callback, timer_2_callback, one_shot_callback
+};
+
+/* Periods from 100us, for a 10kHz loop, to a few ticks. */
+static U32 const periods[NUM_PERIODIC_TIMERS] = { 100, 1000, 23456 };
+
+static void timer_start(size_t const index, U32 const first_us, U32 const period_us)
+{
+    timer_st * const timer = &timers[index];
+
+    timer->period = period_us;
+    timer->first_due = count_get() + first_us;
+    timer->ends = 0;
+    timer->running = true;
+    CoSetTmrCntUs(timer->id, first_us, period_us);
+    CoStartTmr(timer->id);
+}
+
+static void task_delay(size_t const index, U32 const us)
+{
+    task_st * const task = &tasks[index];
+
+    TCBRunning = &TCBTbl[index];
+    TCBRunning->state = TASK_RUNNING;
+    task->due = count_get() + us;
+    task->waiting = true;
+    if (CoUsDelay(us) != E_OK)
+    {
+        failure("delay failed", index);
+    }
+}
+
+/* As SysTick_Handler() in arch.c. */
+static void systick_handle(void)
+{
+    U32 const now = TicklessNow();
+
+    sim.interrupts++;
+    OSSchedLock++;
+    if (now < OSTimeLast)
+    {
+        OSTimeHigh++;
+    }
+    OSTimeLast = now;
+    isr_TimeDispose();
+    isr_TmrDispose();
+    TaskSchedReq = Co_TRUE;
+    OsSchedUnlock();
+}
+
+/* Runs to the next compare and handles it. */
+static void interrupt_run(void)
+{
+    bool const task_holds_lock = (random_get() % 4) == 0;
+    U32 latency = random_get() % (MAX_LATENCY_US + 1);
+
+    if (!sim.pended)
+    {
+        sim.now += (U32)(sim.compare - count_get());
+    }
+    sim.pended = false;
+    if (random_get() % 10000 == 0)
+    {
+        /* Interrupts off for a long time. */
+        latency = LATE_HANDLING_US;
+        sim.late_handlings++;
+    }
+    sim.now += latency;
+
+    if (task_holds_lock)
+    {
+        OSSchedLock = 1;
+    }
+    systick_handle();
+    if (task_holds_lock)
+    {
+        sim.now += random_get() % (MAX_LOCK_US + 1);
+        OsSchedUnlock();
+    }
+    if (latency == LATE_HANDLING_US)
+    {
+        sim.late_handlings--;
+    }
+}
+
+static void os_time_check(void)
+{
+    U64 const ticks = (START_COUNT + sim.now) / US_PER_TICK;
+
+    if (CoGetOSTime() != ticks)
+    {
+        failure("wrong OS time", (unsigned long)sim.now);
+    }
+}
+
+static void random_check(unsigned long const seconds)
+{
+    size_t index;
+
+    for (index = 0; index < NUM_TASKS; index++)
+    {
+        TCBTbl[index].taskID = (OS_TID)index;
+        TCBTbl[index].eventID = INVALID_ID;
+        TCBTbl[index].delayTick = INVALID_VALUE;
+        task_delay(index, 1 + random_get() % MAX_TASK_DELAY_US);
+    }
+    for (index = 0; index < NUM_TIMERS; index++)
+    {
+        U8 const type = (index == ONE_SHOT_TIMER_INDEX) ? TMR_TYPE_ONE_SHOT : TMR_TYPE_PERIODIC;
+
+        timers[index].id = CoCreateTmr(type, 0, 0, timer_callbacks[index]);
+    }
+    for (index = 0; index < NUM_PERIODIC_TIMERS; index++)
+    {
+        timer_start(index, periods[index], periods[index]);
+    }
+
+    while (sim.now < seconds * 1000000ull)
+    {
+        interrupt_run();
+
+        /* The tasks woken run and delay again. */
+        for (index = 0; index < NUM_TASKS; index++)
+        {
+            if (!tasks[index].waiting)
+            {
+                task_delay(index, 1 + random_get() % MAX_TASK_DELAY_US);
+            }
+        }
+
+        /* Now and then an event wakes a task before its delay ends. */
+        if (random_get() % 256 == 0)
+        {
+            index = random_get() % NUM_TASKS;
+            OSSchedLock++;
+            RemoveDelayList(&TCBTbl[index]);
+            tasks[index].waiting = false;
+            sim.early_wakes++;
+            OsSchedUnlock();
+            task_delay(index, 1 + random_get() % MAX_TASK_DELAY_US);
+        }
+
+        if (!timers[ONE_SHOT_TIMER_INDEX].running)
+        {
+            U32 const first_us = 1 + random_get() % MAX_TASK_DELAY_US;
+
+            timer_start(ONE_SHOT_TIMER_INDEX, first_us, 0);
+        }
+        else if (random_get() % 64 == 0)
+        {
+            CoStopTmr(timers[ONE_SHOT_TIMER_INDEX].id);
+            timers[ONE_SHOT_TIMER_INDEX].running = false;
+        }
+
+        os_time_check();
+    }
+
+    /* Everything stops, leaving one task delaying for ever. */
+    for (index = 0; index < NUM_TIMERS; index++)
+    {
+        CoStopTmr(timers[index].id);
+        timers[index].running = false;
+    }
+    for (index = 0; index < NUM_TASKS; index++)
+    {
+        if (tasks[index].waiting)
+        {
+            OSSchedLock++;
+            RemoveDelayList(&TCBTbl[index]);
+            tasks[index].waiting = false;
+            OsSchedUnlock();
+        }
+    }
+}
+
+/* With only a very long delay the count wraps more than once. */
+static void idle_check(void)
+{
+    uint64_t const end = sim.now + IDLE_HOURS * 3600ull * 1000000ull;
+    unsigned long const interrupts = sim.interrupts;
+
+    task_delay(0, 0xFFFFFFFF);
+    tasks[0].due = count_get() + MAX_DELAY_US;
+    while (sim.now < end)
+    {
+        interrupt_run();
+        if (!tasks[0].waiting)
+        {
+            task_delay(0, 0xFFFFFFFF);
+            tasks[0].due = count_get() + MAX_DELAY_US;
+        }
+        os_time_check();
+    }
+    printf("%lu interrupts idle for %d hours\n", sim.interrupts - interrupts, IDLE_HOURS);
+}
+
+int main(int argc, char * * argv)
+{
+    unsigned long const seconds = (argc > 1) ? strtoul(argv[1], NULL, 0) : DEFAULT_SECONDS;
+    size_t index;
+
+    OSTimeLast = count_get();
+    TicklessCompareSet(count_get() + MAX_DELAY_US);
+
+    random_check(seconds);
+
+    printf("%lu s, %lu task wakes (%lu early), periodic timer ends:", seconds, sim.wakes, sim.early_wakes);
+    for (index = 0; index < NUM_PERIODIC_TIMERS; index++)
+    {
+        printf(" %lu", timers[index].ends);
+    }
+    printf(", %lu periods skipped\n", sim.skipped_periods);
+    printf("%lu interrupts, a %u us periodic tick would take %llu\n",
+           sim.interrupts, (unsigned)periods[0], (unsigned long long)(sim.now / periods[0]));
+
+    idle_check();
+
+    printf("%u failures\n", sim.failures);
+
+    return (sim.failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,375 @@
+/* Replays a 36-1 crank and cam signal through the trigger decoder
+ * (app/trigger_wheel_36_1.c) while the tooth #1 crank angle and cam
+ * phase are changed, as they would be by a tuner timing the engine
+ * with a strobe. Runs on the host.
+ *
+ * The engine turns at a steady speed. Tooth #1 is really at
+ * TRUE_TOOTH_1_ANGLE, but the configuration starts out wrong, is
+ * corrected, is moved a revolution out with the cam phase, and is
+ * then corrected again with two burns in quick succession. The
+ * changes are made from the replay loop between teeth, as the
+ * serial task would make them.
+ * For every engine cycle after the decoder first synchronises it
+ * checks that:
+ *   - the decoder never loses sync, and numbers the teeth as they
+ *     really are.
+ *   - every event fires exactly once.
+ *   - every event in the cycle is made from the same schedule, one
+ *     of the configured ones, and the events fire at the last tooth
+ *     before their angle according to that schedule.
+ *   - once a change is made, its schedule is made live within two
+ *     cycles.
+ *
+ * e.g. trigger_replay
+ */
+#include "trigger_wheel_36_1.h"
+#include "tune_config.h"
+#include "main_input_timer.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+
+#define NUM_TEETH 35
+#define TOOTH_ANGLE 10.0
+#define REPLAY_RPM 3000.0
+#define TRUE_TOOTH_1_ANGLE -60.0 /* Crank degrees ATDC. */
+#define NUM_EVENTS 12
+#define CYCLES_PER_STEP 8
+#define MAXIMUM_CYCLES 100 /* In case the changes are never made live. */
+#define ANGLE_TOLERANCE 0.01
+
+typedef struct config_step_st
+{
+    int32_t tooth_1_crank_angle; /* 0.1 degrees. */
+    uint8_t cam_phase;
+    int32_t extra_tooth_1_crank_angle; /* Burnt and replaced before it can be made live, if non zero. */
+} config_step_st;
+
+/* The first step is the default configuration. */
+static config_step_st const config_steps[] =
+{
+    { 0, 0, 0 },
+    { -600, 0, 0 },
+    { -600, 1, 0 },
+    { -600, 0, -550 }
+};
+
+#define NUM_CONFIG_STEPS (sizeof config_steps / sizeof config_steps[0])
+
+typedef struct replay_st
+{
+    trigger_wheel_36_1_context_st * trigger_context;
+    uint32_t now;
+
+    /* Where the engine really is. */
+    unsigned int tooth_number;
+    bool second_revolution;
+
+    bool counting; /* Set from the first cycle start after sync. */
+    unsigned int cycle;
+    unsigned int event_counts[NUM_EVENTS];
+    float cycle_offset; /* Decoder angle - true angle for the cycle. NAN until the first event. */
+    size_t step; /* Configuration step in effect. */
+    size_t latest_step; /* Configuration step last burnt. */
+    unsigned int step_burnt_cycle;
+
+    unsigned long events;
+    unsigned int failures;
+} replay_st;
+
+static replay_st replay;
+
+static float const event_angles[NUM_EVENTS] =
+{
+    0.0, 55.0, 118.5, 180.0, 247.0, 300.0, 359.0, 360.0, 425.0, 540.0, 655.0, 715.0
+};
+
+uint32_t main_input_timer_count_get(void)
+{
+    return replay.now;
+}
+
+void event_log_record(char const * const format, uint32_t const a, uint32_t const b, uint32_t const c)
+{
+    (void)format;
+    (void)a;
+    (void)b;
+    (void)c;
+}
+
+static void failure(char const * const what, unsigned int const detail)
+{
+    if (replay.failures++ < 20)
+    {
+        fprintf(stderr, "cycle %u: %s (%u)\n", replay.cycle, what, detail);
+    }
+}
+
+static float true_engine_cycle_angle_get(void)
+{
+    return normalise_engine_cycle_angle(TRUE_TOOTH_1_ANGLE
+                                        + (replay.tooth_number - 1) * TOOTH_ANGLE
+                                        + (replay.second_revolution ? 360.0 : 0.0));
+}
+
+static float step_offset_get(size_t const step)
+{
+    float const configured = config_steps[step].tooth_1_crank_angle / 10.0
+                             + (config_steps[step].cam_phase ? 360.0 : 0.0);
+
+    return normalise_engine_cycle_angle(configured - TRUE_TOOTH_1_ANGLE);
+}
+
+static bool angles_match(float const a, float const b)
+{
+    float const difference = normalise_engine_cycle_angle(a - b);
+
+    return difference < ANGLE_TOLERANCE || difference > 720.0 - ANGLE_TOLERANCE;
+}
+
+static void event_callback(float const crank_angle, uint32_t const timestamp, void * const arg)
+{
+    size_t const event = (size_t)arg;
+    float const decoder_angle = trigger_36_1_engine_cycle_angle_get(replay.trigger_context);
+    float const offset = normalise_engine_cycle_angle(decoder_angle - true_engine_cycle_angle_get());
+    float const before_event = normalise_engine_cycle_angle(event_angles[event] - decoder_angle);
+
+    if (!replay.counting)
+    {
+        return;
+    }
+
+    replay.events++;
+    replay.event_counts[event]++;
+
+    if (timestamp != replay.now || !angles_match(crank_angle, normalise_crank_angle(decoder_angle)))
+    {
+        failure("event got the wrong tooth", event);
+    }
+    /* The last tooth at or before the event. The missing tooth
+     * makes one gap twice as long.
+     */
+    if (before_event >= 2 * TOOTH_ANGLE - ANGLE_TOLERANCE && before_event < 720.0 - ANGLE_TOLERANCE)
+    {
+        failure("event fired at the wrong tooth", event);
+    }
+    if (isnan(replay.cycle_offset))
+    {
+        replay.cycle_offset = offset;
+    }
+    else if (!angles_match(offset, replay.cycle_offset))
+    {
+        failure("events in one cycle were made from different schedules", event);
+    }
+}
+
+static void tooth_callback(unsigned int const tooth_number,
+                           unsigned int const tooth_angle,
+                           uint32_t const tooth_period,
+                           void * const arg)
+{
+    (void)tooth_angle;
+    (void)tooth_period;
+    (void)arg;
+
+    if (tooth_number != replay.tooth_number)
+    {
+        failure("decoder has the wrong tooth number", tooth_number);
+    }
+}
+
+static void config_burn(int32_t const tooth_1_crank_angle, uint8_t const cam_phase)
+{
+    /* As the tuning server does it. */
+    tune_config_page_write(tune_page_engine,
+                           offsetof(tune_engine_page_st, tooth_1_crank_angle),
+                           &tooth_1_crank_angle,
+                           sizeof tooth_1_crank_angle);
+    tune_config_page_write(tune_page_engine,
+                           offsetof(tune_engine_page_st, cam_phase),
+                           &cam_phase,
+                           sizeof cam_phase);
+    tune_config_retire();
+    if (!tune_config_burn())
+    {
+        failure("burn rejected", (unsigned int)tooth_1_crank_angle);
+    }
+}
+
+/* The serial task's periodic work. */
+static void periodic_work(void)
+{
+    tune_config_retire();
+    trigger_36_1_schedule_update(replay.trigger_context);
+}
+
+/* Called at the end of each engine cycle, once counting. */
+static void cycle_check(void)
+{
+    size_t event;
+    size_t step;
+
+    for (event = 0; event < NUM_EVENTS; event++)
+    {
+        if (replay.event_counts[event] != 1)
+        {
+            failure("event didn't fire once", replay.event_counts[event]);
+        }
+        replay.event_counts[event] = 0;
+    }
+
+    /* Which step's schedule did the cycle use? It may only move
+     * forward to the step burnt last.
+     */
+    for (step = replay.step; step <= replay.latest_step; step++)
+    {
+        if (angles_match(replay.cycle_offset, step_offset_get(step)))
+        {
+            break;
+        }
+    }
+    if (step > replay.latest_step)
+    {
+        failure("cycle used an unexpected schedule", (unsigned int)lroundf(replay.cycle_offset));
+    }
+    else
+    {
+        replay.step = step;
+    }
+    if (replay.step != replay.latest_step && replay.cycle - replay.step_burnt_cycle >= 2)
+    {
+        failure("change wasn't made live", (unsigned int)replay.latest_step);
+    }
+    replay.cycle_offset = NAN;
+    replay.cycle++;
+
+    /* The next change. */
+    if (replay.step == replay.latest_step
+        && replay.cycle - replay.step_burnt_cycle >= CYCLES_PER_STEP
+        && replay.latest_step + 1 < NUM_CONFIG_STEPS)
+    {
+        replay.latest_step++;
+        replay.step_burnt_cycle = replay.cycle;
+    }
+}
+
+static void change_make(void)
+{
+    config_step_st const * const config_step = &config_steps[replay.latest_step];
+
+    if (config_step->extra_tooth_1_crank_angle != 0)
+    {
+        /* Burnt and its schedule built, but replaced before the
+         * cycle starts.
+         */
+        config_burn(config_step->extra_tooth_1_crank_angle, config_step->cam_phase);
+        periodic_work();
+    }
+    config_burn(config_step->tooth_1_crank_angle, config_step->cam_phase);
+}
+
+int main(void)
+{
+    double const us_per_degree = 1.0e6 / (REPLAY_RPM / 60.0 * 360.0);
+    double time_us = 1000.0;
+    size_t made_step = 0;
+    size_t event;
+    unsigned int teeth = 0;
+    bool synched = false;
+
+    tune_config_init(NULL);
+    replay.trigger_context = trigger_36_1_init();
+    for (event = 0; event < NUM_EVENTS; event++)
+    {
+        trigger_36_1_register_callback(replay.trigger_context, event_angles[event], event_callback, (void *)event);
+    }
+    trigger_36_1_register_tooth_callback(replay.trigger_context, tooth_callback, NULL);
+    replay.cycle_offset = NAN;
+
+    /* Start part way round the first revolution. */
+    replay.tooth_number = 20;
+    replay.second_revolution = false;
+
+    while ((replay.latest_step + 1 < NUM_CONFIG_STEPS
+            || replay.cycle - replay.step_burnt_cycle < CYCLES_PER_STEP)
+           && replay.cycle < MAXIMUM_CYCLES)
+    {
+        unsigned int next_tooth = replay.tooth_number + 1;
+        bool next_second_revolution = replay.second_revolution;
+
+        if (next_tooth > NUM_TEETH)
+        {
+            next_tooth = 1;
+            next_second_revolution = !replay.second_revolution;
+            time_us += 2 * TOOTH_ANGLE * us_per_degree;
+
+            if (!next_second_revolution)
+            {
+                /* The cam signal comes just before tooth #1 at the
+                 * start of the cycle.
+                 */
+                replay.now = (uint32_t)(time_us - TOOTH_ANGLE * us_per_degree);
+                trigger_36_1_handle_cam_pulse(replay.trigger_context, replay.now);
+
+                if (replay.counting)
+                {
+                    cycle_check();
+                }
+                else if (synched)
+                {
+                    replay.counting = true;
+                    replay.step_burnt_cycle = 0;
+                }
+            }
+        }
+        else
+        {
+            time_us += TOOTH_ANGLE * us_per_degree;
+        }
+
+        replay.tooth_number = next_tooth;
+        replay.second_revolution = next_second_revolution;
+        replay.now = (uint32_t)time_us;
+        trigger_36_1_handle_crank_pulse(replay.trigger_context, replay.now);
+        teeth++;
+
+        if (trigger_36_1_synched_get(replay.trigger_context))
+        {
+            synched = true;
+        }
+        else if (synched)
+        {
+            failure("lost sync", replay.tooth_number);
+            synched = false;
+        }
+
+        /* The serial task gets to run between teeth. Change the
+         * configuration part way through a cycle.
+         */
+        if (replay.tooth_number == 17 && replay.second_revolution && made_step != replay.latest_step)
+        {
+            change_make();
+            made_step = replay.latest_step;
+        }
+        if (replay.tooth_number % 5 == 0)
+        {
+            periodic_work();
+        }
+    }
+
+    if (replay.step != NUM_CONFIG_STEPS - 1)
+    {
+        failure("last change wasn't made live", (unsigned int)replay.step);
+    }
+
+    printf("%u teeth, %u cycles, %lu events, %zu configuration changes\n",
+           teeth, replay.cycle, replay.events, (size_t)NUM_CONFIG_STEPS - 1);
+    printf("%u failures\n", replay.failures);
+
+    return (replay.failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,774 @@
+/* Host client for the binary tuning protocol (see
+ * app/tune_protocol.h). Runs on the host.
+ *
+ * Talks to the target over a serial device, or with --loopback to
+ * a copy of the target's tuning server (serial/tune_server.c and
+ * app/tune_config.c) built into this program. The loopback runs
+ * through a set of protocol checks and exits non-zero if any fail.
+ *
+ * e.g. tune_client /dev/ttyUSB0 info 0
+ *      tune_client /dev/ttyUSB0 read 0 fuel.bin
+ *      tune_client /dev/ttyUSB0 write 0 fuel.bin
+ *      tune_client /dev/ttyUSB0 burn
+ *      tune_client --loopback
+ */
+#include "tune_protocol.h"
+#include "tune_server.h"
+#include "tune_config.h"
+#include "telemetry_frame.h"
+#include "crc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+
+#define BAUD_RATE 115200
+#define BITS_PER_BYTE_ON_WIRE 10
+#define RESPONSE_TIMEOUT_MS 1000
+#define MAXIMUM_PAGE_SIZE 0xffff
+
+typedef struct transport_st
+{
+    void (*write)(struct transport_st * const transport, uint8_t const * const data, size_t const len);
+    /* Returns the number of bytes read, which is less than len on
+     * a timeout.
+     */
+    size_t (*read)(struct transport_st * const transport, uint8_t * const data, size_t const len);
+    int fd;
+} transport_st;
+
+typedef struct response_st
+{
+    uint8_t command;
+    tune_status_t status;
+    size_t length;
+    uint8_t data[MAXIMUM_PAGE_SIZE];
+} response_st;
+
+static uint16_t get_le16(uint8_t const * const p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_le32(uint8_t const * const p)
+{
+    return get_le16(&p[0]) | ((uint32_t)get_le16(&p[2]) << 16);
+}
+
+static void put_le16(uint8_t * const p, uint16_t const value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static double time_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1.0e9;
+}
+
+/* Serial device transport. */
+
+static void device_write(transport_st * const transport, uint8_t const * const data, size_t const len)
+{
+    size_t written = 0;
+
+    while (written < len)
+    {
+        ssize_t const result = write(transport->fd, &data[written], len - written);
+
+        if (result <= 0)
+        {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        written += result;
+    }
+}
+
+static size_t device_read(transport_st * const transport, uint8_t * const data, size_t const len)
+{
+    double const deadline = time_now() + RESPONSE_TIMEOUT_MS / 1000.0;
+    size_t received = 0;
+
+    while (received < len)
+    {
+        struct pollfd pfd = { .fd = transport->fd, .events = POLLIN };
+        int const timeout_ms = (deadline - time_now()) * 1000.0;
+        ssize_t result;
+
+        if (timeout_ms <= 0 || poll(&pfd, 1, timeout_ms) <= 0)
+        {
+            break;
+        }
+        result = read(transport->fd, &data[received], len - received);
+        if (result <= 0)
+        {
+            break;
+        }
+        received += result;
+    }
+
+    return received;
+}
+
+static bool device_open(transport_st * const transport, char const * const path)
+{
+    struct termios tio;
+    bool opened = false;
+
+    transport->fd = open(path, O_RDWR | O_NOCTTY);
+    if (transport->fd < 0)
+    {
+        perror(path);
+        goto done;
+    }
+    if (tcgetattr(transport->fd, &tio) != 0)
+    {
+        perror("tcgetattr");
+        goto done;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B115200);
+    cfsetospeed(&tio, B115200);
+    if (tcsetattr(transport->fd, TCSANOW, &tio) != 0)
+    {
+        perror("tcsetattr");
+        goto done;
+    }
+    tcflush(transport->fd, TCIOFLUSH);
+
+    transport->write = device_write;
+    transport->read = device_read;
+    opened = true;
+
+done:
+    return opened;
+}
+
+/* Loopback transport. Requests are fed straight into the
+ * target's tuning server and its responses are collected in
+ * loopback.rx.
+ */
+
+typedef struct loopback_st
+{
+    uint8_t rx[2 * MAXIMUM_PAGE_SIZE];
+    size_t rx_head;
+    size_t rx_tail;
+    size_t cli_chars; /* Chars the server passed on to the CLI. */
+    uint32_t now_us; /* Receive time given to the server. */
+    tune_server_st server;
+    serial_port_st port;
+} loopback_st;
+
+static loopback_st loopback;
+
+static int loopback_bulk_write(void * serialPortCtx, uint8_t const * buf, unsigned int buflen, uint_fast16_t const max_millisecs_to_wait)
+{
+    loopback_st * const lb = serialPortCtx;
+
+    (void)max_millisecs_to_wait;
+
+    if (lb->rx_head + buflen > sizeof lb->rx)
+    {
+        memmove(lb->rx, &lb->rx[lb->rx_tail], lb->rx_head - lb->rx_tail);
+        lb->rx_head -= lb->rx_tail;
+        lb->rx_tail = 0;
+    }
+    memcpy(&lb->rx[lb->rx_head], buf, buflen);
+    lb->rx_head += buflen;
+
+    return 0;
+}
+
+static serial_port_methods_st const loopback_methods =
+{
+    .writeBulkBlockingWithTimeout = loopback_bulk_write
+};
+
+static void loopback_write(transport_st * const transport, uint8_t const * const data, size_t const len)
+{
+    size_t x;
+
+    (void)transport;
+
+    for (x = 0; x < len; x++)
+    {
+        if (!tune_server_char_handle(&loopback.server, data[x], loopback.now_us))
+        {
+            loopback.cli_chars++;
+        }
+    }
+}
+
+static size_t loopback_read(transport_st * const transport, uint8_t * const data, size_t len)
+{
+    size_t const available = loopback.rx_head - loopback.rx_tail;
+
+    (void)transport;
+
+    if (len > available)
+    {
+        len = available;
+    }
+    memcpy(data, &loopback.rx[loopback.rx_tail], len);
+    loopback.rx_tail += len;
+
+    return len;
+}
+
+static void loopback_open(transport_st * const transport)
+{
+    loopback.port.methods = &loopback_methods;
+    loopback.port.serialCtx = &loopback;
+    tune_config_init(NULL);
+    tune_server_init(&loopback.server, &loopback.port);
+
+    transport->write = loopback_write;
+    transport->read = loopback_read;
+}
+
+/* Stand-in for the target's telemetry when the server is built
+ * into this program.
+ */
+size_t telemetry_frame_build(uint8_t * const frame, size_t const max_len)
+{
+    size_t frame_len = 0;
+
+    if (max_len >= TELEMETRY_FRAME_SIZE)
+    {
+        memset(frame, 0, TELEMETRY_FRAME_SIZE);
+        frame[0] = TELEMETRY_SYNC_0;
+        frame[1] = TELEMETRY_SYNC_1;
+        frame[2] = TELEMETRY_PAYLOAD_SIZE;
+        put_le16(&frame[TELEMETRY_FRAME_SIZE - TELEMETRY_CRC_SIZE],
+                 crc16_ccitt_update(CRC16_CCITT_INITIAL, &frame[2], TELEMETRY_FRAME_SIZE - TELEMETRY_CRC_SIZE - 2));
+        frame_len = TELEMETRY_FRAME_SIZE;
+    }
+
+    return frame_len;
+}
+
+/* Requests */
+
+static void request_send(transport_st * const transport,
+                         tune_command_t const command,
+                         unsigned int const page,
+                         size_t const offset,
+                         size_t const len,
+                         uint8_t const * const data)
+{
+    uint8_t request[TUNE_REQUEST_HEADER_SIZE + TUNE_MAXIMUM_WRITE_CHUNK_SIZE + TUNE_CRC_SIZE];
+    size_t const data_len = (data != NULL) ? len : 0;
+    size_t request_len = TUNE_REQUEST_HEADER_SIZE;
+
+    request[0] = TUNE_REQUEST_SYNC_0;
+    request[1] = TUNE_REQUEST_SYNC_1;
+    request[2] = command;
+    request[3] = page;
+    put_le16(&request[4], offset);
+    put_le16(&request[6], len);
+    if (data_len > 0)
+    {
+        memcpy(&request[request_len], data, data_len);
+        request_len += data_len;
+    }
+    put_le16(&request[request_len], crc16_ccitt_update(CRC16_CCITT_INITIAL, &request[2], request_len - 2));
+    request_len += TUNE_CRC_SIZE;
+
+    transport->write(transport, request, request_len);
+}
+
+/* Waits for the next response, skipping anything else on the port
+ * (CLI output, telemetry frames).
+ */
+static bool response_receive(transport_st * const transport, response_st * const response)
+{
+    uint8_t header[TUNE_RESPONSE_HEADER_SIZE];
+    uint8_t crc_bytes[TUNE_CRC_SIZE];
+    uint16_t crc;
+    bool received = false;
+
+    header[0] = 0;
+    do
+    {
+        header[1] = header[0];
+        if (transport->read(transport, &header[0], 1) != 1)
+        {
+            fprintf(stderr, "timed out waiting for a response\n");
+            goto done;
+        }
+    } while (header[1] != TUNE_RESPONSE_SYNC_0 || header[0] != TUNE_RESPONSE_SYNC_1);
+
+    header[0] = TUNE_RESPONSE_SYNC_0;
+    header[1] = TUNE_RESPONSE_SYNC_1;
+    if (transport->read(transport, &header[2], sizeof header - 2) != sizeof header - 2)
+    {
+        fprintf(stderr, "short response header\n");
+        goto done;
+    }
+    response->command = header[2];
+    response->status = header[3];
+    response->length = get_le16(&header[4]);
+    if (transport->read(transport, response->data, response->length) != response->length
+        || transport->read(transport, crc_bytes, sizeof crc_bytes) != sizeof crc_bytes)
+    {
+        fprintf(stderr, "short response\n");
+        goto done;
+    }
+
+    crc = crc16_ccitt_update(CRC16_CCITT_INITIAL, &header[2], sizeof header - 2);
+    crc = crc16_ccitt_update(crc, response->data, response->length);
+    if (crc != get_le16(crc_bytes))
+    {
+        fprintf(stderr, "response CRC error\n");
+        goto done;
+    }
+    received = true;
+
+done:
+    return received;
+}
+
+static bool transact(transport_st * const transport,
+                     response_st * const response,
+                     tune_command_t const command,
+                     unsigned int const page,
+                     size_t const offset,
+                     size_t const len,
+                     uint8_t const * const data)
+{
+    request_send(transport, command, page, offset, len, data);
+
+    return response_receive(transport, response) && response->command == command;
+}
+
+static bool page_size_get(transport_st * const transport, unsigned int const page, size_t * const page_size)
+{
+    static response_st response;
+    bool got_size = false;
+
+    if (transact(transport, &response, tune_command_page_info, page, 0, 0, NULL)
+        && response.status == tune_status_ok
+        && response.length == TUNE_PAGE_INFO_SIZE)
+    {
+        *page_size = get_le16(&response.data[0]);
+        got_size = true;
+    }
+
+    return got_size;
+}
+
+/* The whole page comes back as a single response. */
+static bool page_read(transport_st * const transport,
+                      unsigned int const page,
+                      uint8_t * const data,
+                      size_t * const page_size)
+{
+    static response_st response;
+    bool page_was_read = false;
+
+    if (page_size_get(transport, page, page_size)
+        && transact(transport, &response, tune_command_page_read, page, 0, *page_size, NULL)
+        && response.status == tune_status_ok
+        && response.length == *page_size)
+    {
+        memcpy(data, response.data, *page_size);
+        page_was_read = true;
+    }
+
+    return page_was_read;
+}
+
+/* Chunks are sent back to back. The responses are only checked
+ * once all the chunks have gone, so the link is never left idle
+ * waiting for an acknowledgement.
+ */
+static bool page_write(transport_st * const transport,
+                       unsigned int const page,
+                       uint8_t const * const data,
+                       size_t const len)
+{
+    static response_st response;
+    size_t offset;
+    size_t num_chunks = 0;
+    bool page_written = true;
+
+    for (offset = 0; offset < len; offset += TUNE_MAXIMUM_WRITE_CHUNK_SIZE)
+    {
+        size_t const chunk_len = (len - offset < TUNE_MAXIMUM_WRITE_CHUNK_SIZE)
+            ? len - offset
+            : TUNE_MAXIMUM_WRITE_CHUNK_SIZE;
+
+        request_send(transport, tune_command_chunk_write, page, offset, chunk_len, &data[offset]);
+        num_chunks++;
+    }
+    for (; num_chunks > 0; num_chunks--)
+    {
+        if (!response_receive(transport, &response) || response.status != tune_status_ok)
+        {
+            page_written = false;
+        }
+    }
+
+    return page_written;
+}
+
+static bool burn(transport_st * const transport, uint32_t * const generation, bool * const saved)
+{
+    static response_st response;
+    bool burnt = false;
+
+    if (transact(transport, &response, tune_command_burn, 0, 0, 0, NULL)
+        && response.status == tune_status_ok
+        && response.length == TUNE_BURN_RESULT_SIZE)
+    {
+        *generation = get_le32(&response.data[0]);
+        *saved = response.data[4] != 0;
+        burnt = true;
+    }
+
+    return burnt;
+}
+
+static bool page_crc_get(transport_st * const transport, unsigned int const page, uint16_t * const crc)
+{
+    static response_st response;
+    bool got_crc = false;
+
+    if (transact(transport, &response, tune_command_page_crc, page, 0, 0, NULL)
+        && response.status == tune_status_ok
+        && response.length == TUNE_CRC_SIZE)
+    {
+        *crc = get_le16(response.data);
+        got_crc = true;
+    }
+
+    return got_crc;
+}
+
+/* Loopback checks */
+
+static unsigned int checks_failed;
+
+static void check(bool const passed, char const * const description)
+{
+    printf("%s: %s\n", passed ? "pass" : "FAIL", description);
+    if (!passed)
+    {
+        checks_failed++;
+    }
+}
+
+static int loopback_checks_run(transport_st * const transport)
+{
+    static uint8_t page_data[MAXIMUM_PAGE_SIZE];
+    static uint8_t new_page_data[MAXIMUM_PAGE_SIZE];
+    static response_st response;
+    tune_fuel_page_st fuel;
+    size_t page_size;
+    uint16_t crc;
+    uint32_t generation = 0;
+    bool saved;
+    unsigned int page;
+
+    for (page = 0; page < tune_page_count; page++)
+    {
+        bool const read_ok = page_read(transport, page, page_data, &page_size);
+
+        check(read_ok && page_size == tune_config_page_size(page)
+              && memcmp(page_data, tune_config_page_get(page), page_size) == 0,
+              "page read matches the live page");
+        check(page_crc_get(transport, page, &crc)
+              && crc == crc16_ccitt_update(CRC16_CCITT_INITIAL, page_data, page_size),
+              "page CRC matches the page read");
+    }
+
+    check(transact(transport, &response, tune_command_page_read, tune_page_count, 0, 1, NULL)
+          && response.status == tune_status_bad_page,
+          "read of a page that doesn't exist is rejected");
+    check(transact(transport, &response, tune_command_page_read, tune_page_fuel, 1, sizeof fuel, NULL)
+          && response.status == tune_status_bad_range,
+          "read past the end of a page is rejected");
+
+    /* Change a VE cell. */
+    page_read(transport, tune_page_fuel, page_data, &page_size);
+    memcpy(&fuel, page_data, sizeof fuel);
+    fuel.ve_table[3][4] += 123;
+    memcpy(new_page_data, &fuel, sizeof fuel);
+    check(page_write(transport, tune_page_fuel, new_page_data, page_size), "chunked page write");
+    page_read(transport, tune_page_fuel, page_data, &page_size);
+    check(memcmp(page_data, new_page_data, page_size) != 0, "writes don't change the live page before a burn");
+    check(burn(transport, &generation, &saved) && generation == 1, "burn");
+    page_read(transport, tune_page_fuel, page_data, &page_size);
+    check(memcmp(page_data, new_page_data, page_size) == 0, "live page has the new data after a burn");
+    check(tune_config_get()->fuel.ve_table[3][4] == fuel.ve_table[3][4], "calculators see the new table");
+
+    /* Axes out of order must not go live. */
+    fuel.ve_table_rpm_bins[2] = fuel.ve_table_rpm_bins[1] - 1;
+    page_write(transport, tune_page_fuel, (uint8_t const *)&fuel, sizeof fuel);
+    check(transact(transport, &response, tune_command_burn, 0, 0, 0, NULL)
+          && response.status == tune_status_rejected,
+          "burn of an invalid configuration is rejected");
+    page_read(transport, tune_page_fuel, page_data, &page_size);
+    check(memcmp(page_data, new_page_data, page_size) == 0, "live page unchanged after a rejected burn");
+
+    /* A corrupted request. */
+    {
+        uint8_t request[TUNE_REQUEST_HEADER_SIZE + TUNE_CRC_SIZE] =
+        {
+            TUNE_REQUEST_SYNC_0, TUNE_REQUEST_SYNC_1, tune_command_page_crc, 0, 0, 0, 0, 0, 0x12, 0x34
+        };
+
+        transport->write(transport, request, sizeof request);
+        check(response_receive(transport, &response) && response.status == tune_status_bad_crc,
+              "request with a bad CRC is rejected");
+    }
+
+    /* CLI text is passed through untouched. */
+    {
+        static char const text[] = "rpm\r\xa5" "x";
+        size_t const cli_chars = loopback.cli_chars;
+
+        transport->write(transport, (uint8_t const *)text, sizeof text - 1);
+        check(loopback.cli_chars - cli_chars == sizeof text - 2, "CLI text isn't taken by the server");
+    }
+
+    /* A truncated request doesn't swallow the CLI text after it. */
+    {
+        static uint8_t const request[] =
+        {
+            TUNE_REQUEST_SYNC_0, TUNE_REQUEST_SYNC_1, tune_command_page_crc, 0
+        };
+        static char const text[] = "rpm\r";
+        size_t const cli_chars = loopback.cli_chars;
+
+        transport->write(transport, request, sizeof request);
+        loopback.now_us += TUNE_REQUEST_CHAR_TIMEOUT_US + 1;
+        transport->write(transport, (uint8_t const *)text, sizeof text - 1);
+        check(loopback.cli_chars - cli_chars == sizeof text - 1, "CLI text after a truncated request");
+    }
+
+    check(transact(transport, &response, tune_command_realtime, 0, 0, 0, NULL)
+          && response.status == tune_status_ok
+          && response.length == TELEMETRY_FRAME_SIZE
+          && response.data[0] == TELEMETRY_SYNC_0,
+          "realtime data");
+
+    printf("%u checks failed\n", checks_failed);
+
+    return (checks_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Commands against a real target */
+
+static int info_command(transport_st * const transport, unsigned int const page)
+{
+    static response_st response;
+    int result = EXIT_FAILURE;
+
+    if (transact(transport, &response, tune_command_page_info, page, 0, 0, NULL)
+        && response.status == tune_status_ok
+        && response.length == TUNE_PAGE_INFO_SIZE)
+    {
+        printf("page %u size %u pages %u generation %lu\n",
+               page,
+               get_le16(&response.data[0]),
+               response.data[2],
+               (unsigned long)get_le32(&response.data[3]));
+        result = EXIT_SUCCESS;
+    }
+
+    return result;
+}
+
+static int read_command(transport_st * const transport, unsigned int const page, char const * const path)
+{
+    static uint8_t page_data[MAXIMUM_PAGE_SIZE];
+    size_t page_size;
+    double start;
+    double elapsed;
+    double wire_time;
+    FILE * output;
+    int result = EXIT_FAILURE;
+
+    /* The info request isn't included in the timing. */
+    if (!page_size_get(transport, page, &page_size))
+    {
+        fprintf(stderr, "page %u info failed\n", page);
+        goto done;
+    }
+
+    start = time_now();
+    if (!page_read(transport, page, page_data, &page_size))
+    {
+        fprintf(stderr, "page %u read failed\n", page);
+        goto done;
+    }
+    elapsed = time_now() - start;
+    /* page_read() also does an info request. */
+    wire_time = (double)(2 * (TUNE_REQUEST_HEADER_SIZE + TUNE_CRC_SIZE)
+                         + 2 * (TUNE_RESPONSE_HEADER_SIZE + TUNE_CRC_SIZE)
+                         + TUNE_PAGE_INFO_SIZE + page_size)
+                * BITS_PER_BYTE_ON_WIRE / BAUD_RATE;
+    fprintf(stderr, "read %zu bytes in %.1f ms (%.1f ms on the wire)\n",
+            page_size, elapsed * 1000.0, wire_time * 1000.0);
+
+    output = (path != NULL) ? fopen(path, "wb") : stdout;
+    if (output == NULL || fwrite(page_data, 1, page_size, output) != page_size)
+    {
+        perror("write");
+        goto done;
+    }
+    if (output != stdout)
+    {
+        fclose(output);
+    }
+    result = EXIT_SUCCESS;
+
+done:
+    return result;
+}
+
+static int write_command(transport_st * const transport, unsigned int const page, char const * const path)
+{
+    static uint8_t page_data[MAXIMUM_PAGE_SIZE];
+    size_t page_size;
+    size_t len;
+    FILE * input = fopen(path, "rb");
+    int result = EXIT_FAILURE;
+
+    if (input == NULL)
+    {
+        perror(path);
+        goto done;
+    }
+    len = fread(page_data, 1, sizeof page_data, input);
+    fclose(input);
+
+    if (!page_size_get(transport, page, &page_size) || len != page_size)
+    {
+        fprintf(stderr, "%s is %zu bytes, page %u is %zu bytes\n", path, len, page, page_size);
+        goto done;
+    }
+    if (!page_write(transport, page, page_data, len))
+    {
+        fprintf(stderr, "page %u write failed\n", page);
+        goto done;
+    }
+    result = EXIT_SUCCESS;
+
+done:
+    return result;
+}
+
+static int burn_command(transport_st * const transport)
+{
+    uint32_t generation;
+    bool saved;
+    int result = EXIT_FAILURE;
+
+    if (burn(transport, &generation, &saved))
+    {
+        printf("generation %lu%s\n", (unsigned long)generation, saved ? "" : " (not saved, use the save command)");
+        result = EXIT_SUCCESS;
+    }
+    else
+    {
+        fprintf(stderr, "burn failed\n");
+    }
+
+    return result;
+}
+
+static int crc_command(transport_st * const transport, unsigned int const page)
+{
+    uint16_t crc;
+    int result = EXIT_FAILURE;
+
+    if (page_crc_get(transport, page, &crc))
+    {
+        printf("page %u crc %04x\n", page, crc);
+        result = EXIT_SUCCESS;
+    }
+
+    return result;
+}
+
+static void usage(char const * const name)
+{
+    fprintf(stderr, "usage: %s <device> info <page>\n"
+                    "       %s <device> read <page> [file]\n"
+                    "       %s <device> write <page> <file>\n"
+                    "       %s <device> burn\n"
+                    "       %s <device> crc <page>\n"
+                    "       %s --loopback\n",
+            name, name, name, name, name, name);
+}
+
+int main(int argc, char * argv[])
+{
+    transport_st transport;
+    char const * command;
+    unsigned int page;
+    int result = EXIT_FAILURE;
+
+    if (argc == 2 && strcmp(argv[1], "--loopback") == 0)
+    {
+        loopback_open(&transport);
+        result = loopback_checks_run(&transport);
+        goto done;
+    }
+
+    if (argc < 3)
+    {
+        usage(argv[0]);
+        goto done;
+    }
+    if (!device_open(&transport, argv[1]))
+    {
+        goto done;
+    }
+
+    command = argv[2];
+    page = (argc > 3) ? strtoul(argv[3], NULL, 0) : 0;
+
+    if (strcmp(command, "info") == 0 && argc == 4)
+    {
+        result = info_command(&transport, page);
+    }
+    else if (strcmp(command, "read") == 0 && (argc == 4 || argc == 5))
+    {
+        result = read_command(&transport, page, (argc == 5) ? argv[4] : NULL);
+    }
+    else if (strcmp(command, "write") == 0 && argc == 5)
+    {
+        result = write_command(&transport, page, argv[4]);
+    }
+    else if (strcmp(command, "burn") == 0 && argc == 3)
+    {
+        result = burn_command(&transport);
+    }
+    else if (strcmp(command, "crc") == 0 && argc == 4)
+    {
+        result = crc_command(&transport, page);
+    }
+    else
+    {
+        usage(argv[0]);
+    }
+
+done:
+    return result;
+}
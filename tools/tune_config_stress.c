@@ -0,0 +1,356 @@
+/* Stress test for the live configuration publishing in
+ * app/tune_config.c. Runs on the host.
+ *
+ * A writer thread keeps writing pages and burning them, as the
+ * tuning server does, while reader threads use the live
+ * configuration:
+ *   - an event path thread, which starts engine cycles (making
+ *     pending burns live) and reads the configuration on every
+ *     event, every so often losing sync for a while.
+ *   - calculator threads, which fetch the live configuration once
+ *     per calculation.
+ * Every burnt configuration has all of its cells set from a single
+ * stamp, so a reader that sees a torn or reused copy sees cells
+ * that disagree. The event path also checks that the
+ * configuration doesn't change part way through an engine cycle.
+ *
+ * On the target the writer runs in the lowest priority task, so it
+ * never runs while a reader is part way through using the
+ * configuration. That is modelled here with a rwlock that the
+ * readers hold while they use the configuration and the writer
+ * only holds while it retires replaced copies. Burns and page
+ * writes happen while the readers are running, as they can be
+ * preempted by them on the target.
+ *
+ * e.g. tune_config_stress [seconds]
+ */
+#define _GNU_SOURCE
+#include "tune_config.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ARRAY_SIZE(a) (sizeof((a)) / sizeof((a)[0]))
+
+#define NUM_CALCULATORS 2
+#define EVENTS_PER_CYCLE 24
+#define CYCLES_BETWEEN_SYNC_LOSSES 100
+#define DEFAULT_RUN_SECONDS 3
+#define WRITE_CHUNK_SIZE 128 /* As TUNE_MAXIMUM_WRITE_CHUNK_SIZE. */
+
+typedef struct stress_stats_st
+{
+    unsigned long burns;
+    unsigned long rejected_burns;
+    unsigned long cycles;
+    unsigned long publishes;
+    unsigned long events;
+    unsigned long calculations;
+    unsigned long sync_losses;
+    unsigned long failures;
+} stress_stats_st;
+
+static stress_stats_st stats;
+static pthread_rwlock_t cpu_lock;
+static volatile bool running = true;
+static uint16_t last_burnt_stamp;
+
+static void failure(char const * const what)
+{
+    if (__atomic_fetch_add(&stats.failures, 1, __ATOMIC_RELAXED) < 10)
+    {
+        fprintf(stderr, "%s\n", what);
+    }
+}
+
+static uint16_t stamp_rpm_smoothing_factor(uint16_t const stamp)
+{
+    return 1 + (stamp % 1000);
+}
+
+static void stamp_apply(tune_config_st * const config, uint16_t const stamp)
+{
+    size_t row;
+    size_t column;
+
+    for (row = 0; row < VE_TABLE_MAP_BINS; row++)
+    {
+        for (column = 0; column < VE_TABLE_RPM_BINS; column++)
+        {
+            config->fuel.ve_table[row][column] = (int16_t)stamp;
+            config->fuel.afr_target_table[row][column] = (int16_t)(stamp >> 1);
+        }
+    }
+    for (row = 0; row < ADVANCE_TABLE_LOAD_BINS; row++)
+    {
+        for (column = 0; column < ADVANCE_TABLE_RPM_BINS; column++)
+        {
+            config->ignition.advance_table[row][column] = (int16_t)stamp;
+        }
+    }
+    for (column = 0; column < DWELL_TABLE_BINS; column++)
+    {
+        config->ignition.dwell_table[column] = (int16_t)(stamp >> 2);
+    }
+    config->engine.rpm_smoothing_factor = stamp_rpm_smoothing_factor(stamp);
+}
+
+/* Returns false if the cells don't all come from the same stamp. */
+static bool stamp_check(tune_config_st const * const config)
+{
+    int16_t const stamp = config->fuel.ve_table[0][0];
+    size_t row;
+    size_t column;
+    bool consistent = true;
+
+    for (row = 0; row < VE_TABLE_MAP_BINS; row++)
+    {
+        for (column = 0; column < VE_TABLE_RPM_BINS; column++)
+        {
+            consistent &= config->fuel.ve_table[row][column] == stamp;
+            consistent &= config->fuel.afr_target_table[row][column] == (int16_t)((uint16_t)stamp >> 1);
+        }
+    }
+    for (row = 0; row < ADVANCE_TABLE_LOAD_BINS; row++)
+    {
+        for (column = 0; column < ADVANCE_TABLE_RPM_BINS; column++)
+        {
+            consistent &= config->ignition.advance_table[row][column] == stamp;
+        }
+    }
+    for (column = 0; column < DWELL_TABLE_BINS; column++)
+    {
+        consistent &= config->ignition.dwell_table[column] == (int16_t)((uint16_t)stamp >> 2);
+    }
+    consistent &= config->engine.rpm_smoothing_factor == stamp_rpm_smoothing_factor((uint16_t)stamp);
+
+    return consistent;
+}
+
+/* Writes the configuration in chunks, as the tuning server does. */
+static void config_write(tune_config_st const * const config)
+{
+    static struct
+    {
+        tune_page_t page;
+        size_t offset;
+    } const pages[] =
+    {
+        { tune_page_fuel, offsetof(tune_config_st, fuel) },
+        { tune_page_injector, offsetof(tune_config_st, injector) },
+        { tune_page_ignition, offsetof(tune_config_st, ignition) },
+        { tune_page_engine, offsetof(tune_config_st, engine) }
+    };
+    size_t index;
+
+    for (index = 0; index < ARRAY_SIZE(pages); index++)
+    {
+        size_t const page_size = tune_config_page_size(pages[index].page);
+        uint8_t const * const page_data = (uint8_t const *)config + pages[index].offset;
+        size_t offset;
+
+        for (offset = 0; offset < page_size; offset += WRITE_CHUNK_SIZE)
+        {
+            size_t const len = (page_size - offset < WRITE_CHUNK_SIZE) ? page_size - offset : WRITE_CHUNK_SIZE;
+
+            tune_config_page_write(pages[index].page, offset, &page_data[offset], len);
+        }
+    }
+}
+
+static void * writer_thread(void * arg)
+{
+    tune_config_st config = *tune_config_get();
+    uint16_t stamp = 1;
+
+    (void)arg;
+
+    while (running)
+    {
+        stamp_apply(&config, ++stamp);
+        config_write(&config);
+
+        pthread_rwlock_wrlock(&cpu_lock);
+        tune_config_retire();
+        pthread_rwlock_unlock(&cpu_lock);
+
+        if (tune_config_burn())
+        {
+            stats.burns++;
+            last_burnt_stamp = stamp;
+        }
+        else
+        {
+            stats.rejected_burns++;
+        }
+    }
+
+    return NULL;
+}
+
+static void * event_path_thread(void * arg)
+{
+    tune_config_st const * cycle_config = NULL;
+    bool first_cycle = true;
+
+    (void)arg;
+
+    while (running)
+    {
+        size_t event;
+
+        if (stats.cycles % CYCLES_BETWEEN_SYNC_LOSSES == CYCLES_BETWEEN_SYNC_LOSSES - 1)
+        {
+            /* Lose sync, so burns are made live straight away for a
+             * while.
+             */
+            tune_config_cycle_publishing_set(false);
+            stats.sync_losses++;
+            sched_yield();
+            tune_config_cycle_publishing_set(true);
+            first_cycle = true;
+        }
+
+        pthread_rwlock_rdlock(&cpu_lock);
+
+        if (tune_config_cycle_start())
+        {
+            stats.publishes++;
+        }
+        stats.cycles++;
+        cycle_config = tune_config_get();
+
+        for (event = 0; event < EVENTS_PER_CYCLE; event++)
+        {
+            tune_config_st const * const config = tune_config_get();
+            tune_derived_st const * const derived = tune_config_derived_get();
+
+            /* A burn made just as sync is gained may be made live
+             * during the first cycle instead of at its start.
+             */
+            if (config != cycle_config && !first_cycle)
+            {
+                failure("configuration changed part way through an engine cycle");
+            }
+            cycle_config = config;
+            if (!stamp_check(config))
+            {
+                failure("event saw an inconsistent configuration");
+            }
+            if (derived->rpm_smoothing_factor != config->engine.rpm_smoothing_factor / 1000.0f)
+            {
+                failure("derived data doesn't match the configuration");
+            }
+            stats.events++;
+            /* The time between teeth. */
+            sched_yield();
+        }
+        first_cycle = false;
+
+        pthread_rwlock_unlock(&cpu_lock);
+        sched_yield();
+    }
+
+    return NULL;
+}
+
+static void * calculator_thread(void * arg)
+{
+    unsigned long * const calculations = arg;
+
+    while (running)
+    {
+        tune_config_st const * config;
+        tune_config_st before;
+
+        pthread_rwlock_rdlock(&cpu_lock);
+
+        config = tune_config_get();
+        before = *config;
+        /* Give the writer a chance to reuse the copy too early. */
+        sched_yield();
+        if (!stamp_check(&before) || memcmp(&before, config, sizeof before) != 0)
+        {
+            failure("calculation saw the configuration change under it");
+        }
+        (*calculations)++;
+
+        pthread_rwlock_unlock(&cpu_lock);
+        sched_yield();
+    }
+
+    return NULL;
+}
+
+int main(int argc, char * * argv)
+{
+    unsigned int const run_seconds = (argc > 1) ? strtoul(argv[1], NULL, 0) : DEFAULT_RUN_SECONDS;
+    pthread_rwlockattr_t lock_attr;
+    pthread_t writer;
+    pthread_t event_path;
+    pthread_t calculators[NUM_CALCULATORS];
+    unsigned long calculations[NUM_CALCULATORS] = { 0 };
+    tune_config_st config;
+    uint32_t generation;
+    size_t index;
+
+    /* So the writer isn't starved by the readers. */
+    pthread_rwlockattr_init(&lock_attr);
+    pthread_rwlockattr_setkind_np(&lock_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&cpu_lock, &lock_attr);
+
+    tune_config_init(NULL);
+    config = *tune_config_get();
+    stamp_apply(&config, 0);
+    config_write(&config);
+    tune_config_burn();
+    tune_config_retire();
+    tune_config_cycle_publishing_set(true);
+    generation = tune_config_generation_get();
+
+    pthread_create(&writer, NULL, writer_thread, NULL);
+    pthread_create(&event_path, NULL, event_path_thread, NULL);
+    for (index = 0; index < NUM_CALCULATORS; index++)
+    {
+        pthread_create(&calculators[index], NULL, calculator_thread, &calculations[index]);
+    }
+
+    sleep(run_seconds);
+    running = false;
+
+    pthread_join(writer, NULL);
+    pthread_join(event_path, NULL);
+    for (index = 0; index < NUM_CALCULATORS; index++)
+    {
+        pthread_join(calculators[index], NULL);
+        stats.calculations += calculations[index];
+    }
+
+    /* With the engine stopped, the last burn must be made live. */
+    tune_config_cycle_publishing_set(false);
+    tune_config_retire();
+    if (tune_config_publish_pending()
+        || !stamp_check(tune_config_get())
+        || tune_config_get()->fuel.ve_table[0][0] != (int16_t)last_burnt_stamp)
+    {
+        failure("last burn wasn't made live");
+    }
+    if (tune_config_generation_get() - generation > stats.burns)
+    {
+        failure("more generations than burns");
+    }
+
+    printf("%lu burns (%lu rejected), %lu made live at a cycle start\n",
+           stats.burns, stats.rejected_burns, stats.publishes);
+    printf("%lu cycles, %lu events, %lu calculations, %lu sync losses\n",
+           stats.cycles, stats.events, stats.calculations, stats.sync_losses);
+    printf("%lu failures\n", stats.failures);
+
+    return (stats.failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,885 @@
+/* Runs the DMA UART driver (drivers/uart.c) against a stand-in for
+ * the USART and its DMA streams. Runs on the host.
+ *
+ * The stand-in sends each TX DMA transfer down a simulated line at
+ * 115200 baud and calls the driver's completion callback, as the
+ * DMA interrupt does. Interrupts and the scheduler lock are
+ * tracked, and a pending transfer can finish whenever interrupts
+ * are enabled again, as the interrupt would be taken then. A task
+ * waiting for TX space sleeps until the transfer in progress
+ * finishes, or until its timeout if the line is stalled. Checks
+ * that:
+ *   - what comes out of the line is exactly what was written, for
+ *     a random mix of bulk, blocking and single char writes, while
+ *     transfers finish at random.
+ *   - a non-blocking bulk write that doesn't fit queues nothing,
+ *     even when it is only one byte too long.
+ *   - no more than TX_COPY_CHUNK_SIZE bytes are copied with
+ *     interrupts disabled, and each call leaves interrupts enabled
+ *     and the scheduler unlocked.
+ *   - each DMA transfer lies within the TX buffer.
+ *   - a blocking write to a stalled line gives up after its
+ *     timeout, and straight away with no timeout.
+ *
+ * On the RX side the stand-in writes received chars into the
+ * circular DMA buffer, with an event at each half and full buffer
+ * and when the line goes idle, as the DMA and idle line interrupts
+ * give. The line can be looped back, so that what is sent is
+ * received. A reader task reads everything ready each time it is
+ * woken. Checks that:
+ *   - what is received is exactly what was sent, looped back or
+ *     sent by the other end, in bursts of all lengths.
+ *   - the reader is woken once a burst, plus once each half
+ *     buffer in long bursts, and not by events with nothing new.
+ *   - falling behind by a full buffer or more drops what was in
+ *     the buffer and counts an overrun and the chars lost, even
+ *     when the DMA has gone round exactly once, and reading goes
+ *     on from the newest chars.
+ *   - the count of chars received wrapping doesn't upset reading.
+ *   - hardware overruns are counted.
+ * Then measures writing a typical debug line, in bulk and a char
+ * at a time, and reading received chars. Host times are only good
+ * for comparison.
+ *
+ * e.g. uart_loopback
+ */
+#include <time.h>
+
+/* Included so that the driver's buffers and statistics can be
+ * checked.
+ */
+#include "uart.c"
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#define BAUD_RATE 115200
+#define BITS_PER_BYTE_ON_WIRE 10
+#define MAXIMUM_SENT (1 << 20)
+#define RANDOM_WRITES 5000
+#define MAXIMUM_WRITE 1500
+#define WRITE_TIMEOUT_MS 1000
+#define STALL_TIMEOUT_MS 20
+#define BENCH_LINES 1000000
+#define MAXIMUM_RECEIVED 8192
+#define BENCH_RX_BLOCKS 1000000
+
+typedef struct line_st
+{
+    usart_init_st cfg;
+    bool enabled;
+
+    uint8_t const * tx_dma_buffer;
+    uint_fast16_t tx_dma_length; /* 0 if idle. */
+    bool stalled; /* Transfers never finish. */
+    bool finish_on_enable; /* Transfers finish when interrupts are enabled. */
+    bool logging;
+    uint8_t sent[MAXIMUM_SENT];
+    size_t num_sent;
+
+    bool irq_disabled;
+    unsigned int isr_depth;
+    unsigned int sched_lock_depth;
+    uint_fast16_t irq_disabled_tx_head;
+    unsigned int most_copied_irq_disabled;
+    bool flag_set;
+
+    bool loopback;
+    uint32_t rx_count; /* Free running, as the DMA driver counts. */
+    bool reader_enabled;
+    bool wakeup_pending;
+    unsigned int wakeups;
+    uint8_t received[MAXIMUM_RECEIVED];
+    size_t num_received;
+    double time_us;
+
+    unsigned int failures;
+} line_st;
+
+static line_st line;
+static uint32_t random_state = 0x2545f491;
+static uint8_t written[MAXIMUM_SENT];
+static size_t num_written;
+
+static void failure(char const * const what, long const got, long const expected)
+{
+    if (line.failures++ < 20)
+    {
+        fprintf(stderr, "%s: got %ld expected %ld\n", what, got, expected);
+    }
+}
+
+static uint32_t random_get(void)
+{
+    /* xorshift32 */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    return random_state;
+}
+
+static uart_ctx_st * uart_ctx_get(void)
+{
+    return &uart_ctxs[0];
+}
+
+/* The reader task, woken by the driver. Reads everything ready. */
+static void reader_run(void)
+{
+    serial_port_st * const port = &uart_ctx_get()->serialPort;
+
+    line.wakeup_pending = false;
+    while (port->methods->rxReady(port->serialCtx) > 0)
+    {
+        uint8_t const ch = port->methods->readChar(port->serialCtx);
+
+        if (line.num_received < MAXIMUM_RECEIVED)
+        {
+            line.received[line.num_received] = ch;
+        }
+        line.num_received++;
+    }
+}
+
+static void reader_wakeup(void *pv)
+{
+    if (pv != uart_ctx_get() || line.isr_depth == 0)
+    {
+        failure("reader woken from outside the RX interrupt", line.isr_depth, 1);
+    }
+    line.wakeups++;
+    line.wakeup_pending = true;
+}
+
+/* Takes the RX DMA or idle line interrupt, and then runs the
+ * reader if it was woken.
+ */
+static void line_rx_event(void)
+{
+    line.isr_depth++;
+    line.cfg.callback.rxDmaEvent(line.cfg.callback.pv);
+    line.isr_depth--;
+
+    if (line.wakeup_pending && line.reader_enabled)
+    {
+        reader_run();
+    }
+}
+
+static void line_rx_chars(uint8_t const * const data, size_t const len)
+{
+    uint_fast16_t const size = line.cfg.rxDmaBufferSize;
+    size_t index;
+
+    for (index = 0; index < len; index++)
+    {
+        line.cfg.rxDmaBuffer[line.rx_count & (size - 1)] = data[index];
+        line.rx_count++;
+        if ((line.rx_count & ((size / 2) - 1)) == 0)
+        {
+            line_rx_event();
+        }
+    }
+}
+
+/* A burst from the other end, followed by the line going idle. */
+static void line_receive(uint8_t const * const data, size_t const len)
+{
+    line_rx_chars(data, len);
+    line_rx_event();
+}
+
+/* Sends the transfer in progress down the line and takes the DMA
+ * interrupt. When looped back, the line goes idle if no transfer
+ * follows.
+ */
+static void line_transfer_finish(void)
+{
+    uint_fast16_t const length = line.tx_dma_length;
+
+    if (length == 0 || line.stalled)
+    {
+        goto done;
+    }
+
+    if (line.logging)
+    {
+        if (line.num_sent + length > MAXIMUM_SENT)
+        {
+            failure("too much sent", line.num_sent + length, MAXIMUM_SENT);
+            goto done;
+        }
+        memcpy(&line.sent[line.num_sent], line.tx_dma_buffer, length);
+        line.num_sent += length;
+    }
+    if (line.loopback)
+    {
+        line_rx_chars(line.tx_dma_buffer, length);
+    }
+    line.time_us += length * BITS_PER_BYTE_ON_WIRE * 1.0e6 / BAUD_RATE;
+    line.tx_dma_length = 0;
+
+    line.isr_depth++;
+    line.cfg.callback.txDmaComplete(line.cfg.callback.pv);
+    line.isr_depth--;
+
+    if (line.loopback && line.tx_dma_length == 0)
+    {
+        line_rx_event();
+    }
+
+done:
+    return;
+}
+
+static void line_drain(void)
+{
+    while (line.tx_dma_length != 0 && !line.stalled)
+    {
+        line_transfer_finish();
+    }
+}
+
+/* What the target provides. */
+
+void const *stm32_usart_init(usart_init_st *cfg)
+{
+    line.cfg = *cfg;
+
+    return &line;
+}
+
+void stm32_usart_tx_dma_start(void const *ll_info, uint8_t const *buf, uint_fast16_t len)
+{
+    uart_ctx_st const * const pctx = uart_ctx_get();
+
+    (void)ll_info;
+
+    if (!line.irq_disabled && line.isr_depth == 0)
+    {
+        failure("DMA started with interrupts enabled", 0, 1);
+    }
+    if (line.tx_dma_length != 0)
+    {
+        failure("DMA started while busy", line.tx_dma_length, 0);
+    }
+    if (len == 0 || buf < pctx->txBuffer || buf + len > pctx->txBuffer + pctx->txBufferSize)
+    {
+        failure("DMA transfer outside the TX buffer", buf - pctx->txBuffer, len);
+    }
+
+    line.tx_dma_buffer = buf;
+    line.tx_dma_length = len;
+}
+
+uint32_t stm32_usart_rx_dma_count_get(void const *ll_info, uint_fast16_t const buffer_size)
+{
+    (void)ll_info;
+
+    if (buffer_size != line.cfg.rxDmaBufferSize || line.isr_depth == 0)
+    {
+        failure("RX DMA count", buffer_size, line.cfg.rxDmaBufferSize);
+    }
+
+    return line.rx_count;
+}
+
+void USART_Init(USART_TypeDef * USARTx, USART_InitTypeDef * USART_InitStruct)
+{
+    if (USARTx != USART1 || USART_InitStruct->USART_BaudRate != BAUD_RATE
+        || USART_InitStruct->USART_Mode != (USART_Mode_Rx | USART_Mode_Tx))
+    {
+        failure("USART configuration", USART_InitStruct->USART_BaudRate, BAUD_RATE);
+    }
+}
+
+void USART_Cmd(USART_TypeDef * USARTx, FunctionalState NewState)
+{
+    (void)USARTx;
+
+    line.enabled = (NewState == ENABLE);
+}
+
+void IRQ_DISABLE_SAVE(void)
+{
+    if (line.irq_disabled)
+    {
+        failure("interrupts disabled twice", 1, 0);
+    }
+    line.irq_disabled = true;
+    line.irq_disabled_tx_head = uart_ctx_get()->txBufferHead;
+}
+
+/* A transfer that finished while interrupts were disabled has its
+ * interrupt taken now.
+ */
+void IRQ_ENABLE_RESTORE(void)
+{
+    uart_ctx_st const * const pctx = uart_ctx_get();
+    unsigned int const copied = (pctx->txBufferHead - line.irq_disabled_tx_head) & (pctx->txBufferSize - 1);
+
+    if (copied > line.most_copied_irq_disabled)
+    {
+        line.most_copied_irq_disabled = copied;
+    }
+    line.irq_disabled = false;
+
+    if (line.finish_on_enable)
+    {
+        line_transfer_finish();
+    }
+}
+
+void CoEnterISR(void)
+{
+    if (line.isr_depth == 0)
+    {
+        failure("CoEnterISR() outside an interrupt", 0, 1);
+    }
+}
+
+void CoExitISR(void)
+{
+}
+
+void CoSchedLock(void)
+{
+    line.sched_lock_depth++;
+}
+
+void CoSchedUnlock(void)
+{
+    line.sched_lock_depth--;
+}
+
+U32 CoGetOSTime32(void)
+{
+    return (U32)(line.time_us / 1000.0);
+}
+
+OS_FlagID CoCreateFlag(BOOL bAutoReset, BOOL bInitialState)
+{
+    if (bAutoReset != Co_TRUE || bInitialState != Co_FALSE)
+    {
+        failure("TX space flag", bAutoReset, Co_TRUE);
+    }
+
+    return 0;
+}
+
+StatusType isr_SetFlag(OS_FlagID id)
+{
+    (void)id;
+
+    if (line.isr_depth == 0)
+    {
+        failure("isr_SetFlag() outside an interrupt", 0, 1);
+    }
+    line.flag_set = true;
+
+    return E_OK;
+}
+
+/* The task sleeps until the transfer in progress finishes. */
+StatusType CoWaitForSingleFlag(OS_FlagID id, U32 timeout)
+{
+    StatusType result = E_OK;
+
+    (void)id;
+
+    if (line.irq_disabled || line.sched_lock_depth != 0)
+    {
+        failure("waiting with interrupts disabled or the scheduler locked", 1, 0);
+    }
+    if (!line.flag_set)
+    {
+        line_transfer_finish();
+    }
+    if (!line.flag_set)
+    {
+        line.time_us += timeout * 1000.0;
+        result = E_TIMEOUT;
+        goto done;
+    }
+    line.flag_set = false;
+
+done:
+    return result;
+}
+
+static void call_check(char const * const what)
+{
+    if (line.irq_disabled || line.sched_lock_depth != 0)
+    {
+        failure(what, line.irq_disabled, 0);
+    }
+}
+
+static void written_add(uint8_t const * const data, size_t const len)
+{
+    if (num_written + len <= MAXIMUM_SENT)
+    {
+        memcpy(&written[num_written], data, len);
+    }
+    num_written += len;
+}
+
+static void random_write(serial_port_st * const port)
+{
+    uart_ctx_st const * const pctx = uart_ctx_get();
+    uint8_t data[MAXIMUM_WRITE];
+    size_t len;
+    size_t index;
+
+    len = 1 + (random_get() % ((random_get() & 1) ? 100 : MAXIMUM_WRITE));
+    for (index = 0; index < len; index++)
+    {
+        data[index] = random_get();
+    }
+
+    switch (random_get() % 4)
+    {
+    case 0:
+    {
+        uint_fast16_t const head = pctx->txBufferHead;
+        unsigned int const space = (pctx->txBufferTail - head - 1) & (pctx->txBufferSize - 1);
+        int const result = port->methods->writeBulk(port->serialCtx, data, len);
+        bool const fits = len <= space;
+
+        if (result != (fits ? 0 : -1))
+        {
+            failure("non-blocking bulk write", result, fits ? 0 : -1);
+        }
+        if (result == 0)
+        {
+            written_add(data, len);
+        }
+        else if (pctx->txBufferHead != head)
+        {
+            failure("partial non-blocking bulk write", (pctx->txBufferHead - head) & (pctx->txBufferSize - 1), 0);
+        }
+        call_check("interrupts or scheduler left off by writeBulk");
+        break;
+    }
+
+    case 1:
+    {
+        int const result = port->methods->writeBulkBlockingWithTimeout(port->serialCtx, data, len, WRITE_TIMEOUT_MS);
+
+        if (result != 0)
+        {
+            failure("blocking bulk write", result, 0);
+        }
+        written_add(data, len);
+        call_check("interrupts or scheduler left off by writeBulkBlockingWithTimeout");
+        break;
+    }
+
+    case 2:
+    {
+        bool const fits = ((pctx->txBufferTail - pctx->txBufferHead - 1) & (pctx->txBufferSize - 1)) > 0;
+
+        /* Dropped if the buffer is full. */
+        port->methods->writeChar(port->serialCtx, data[0]);
+        if (fits)
+        {
+            written_add(data, 1);
+        }
+        call_check("interrupts or scheduler left off by writeChar");
+        break;
+    }
+
+    default:
+        if (port->methods->writeCharBlockingWithTimeout(port->serialCtx, data[0], WRITE_TIMEOUT_MS) != 0)
+        {
+            failure("blocking char write", -1, 0);
+        }
+        written_add(data, 1);
+        call_check("interrupts or scheduler left off by writeCharBlockingWithTimeout");
+        break;
+    }
+
+    /* Sometimes the line catches up. */
+    if ((random_get() % 8) == 0)
+    {
+        line_drain();
+    }
+}
+
+static void stream_check(serial_port_st * const port)
+{
+    unsigned int write;
+    size_t index;
+
+    for (write = 0; write < RANDOM_WRITES && num_written < MAXIMUM_SENT - MAXIMUM_WRITE; write++)
+    {
+        line.finish_on_enable = (random_get() & 1) != 0;
+        random_write(port);
+    }
+    line.finish_on_enable = false;
+    line_drain();
+
+    if (line.num_sent != num_written)
+    {
+        failure("bytes sent", line.num_sent, num_written);
+    }
+    for (index = 0; index < line.num_sent && index < num_written; index++)
+    {
+        if (line.sent[index] != written[index])
+        {
+            failure("byte sent", line.sent[index], written[index]);
+            break;
+        }
+    }
+    if (line.most_copied_irq_disabled > TX_COPY_CHUNK_SIZE)
+    {
+        failure("bytes copied with interrupts disabled", line.most_copied_irq_disabled, TX_COPY_CHUNK_SIZE);
+    }
+}
+
+static void stall_check(serial_port_st * const port)
+{
+    uart_ctx_st const * const pctx = uart_ctx_get();
+    uint8_t data[USART1_TX_BUFFER_SIZE] = { 0 };
+    uint32_t const timeouts = serial_uart_statistics.txTimeout;
+    uint32_t const overflows = serial_uart_statistics.txOverflow;
+    unsigned int space;
+    U32 start;
+    U32 waited;
+
+    line.stalled = true;
+    space = (pctx->txBufferTail - pctx->txBufferHead - 1) & (pctx->txBufferSize - 1);
+
+    /* One byte too many. */
+    if (port->methods->writeBulk(port->serialCtx, data, space + 1) != -1)
+    {
+        failure("non-blocking write of one byte more than fits", 0, -1);
+    }
+
+    /* Fills the buffer and then waits. What fitted is queued. */
+    start = CoGetOSTime32();
+    if (port->methods->writeBulkBlockingWithTimeout(port->serialCtx, data, sizeof data, STALL_TIMEOUT_MS) != -1)
+    {
+        failure("blocking write to a stalled line", 0, -1);
+    }
+    waited = CoGetOSTime32() - start;
+    if (waited < STALL_TIMEOUT_MS || waited > STALL_TIMEOUT_MS + 1)
+    {
+        failure("ms waited for a stalled line", waited, STALL_TIMEOUT_MS);
+    }
+    written_add(data, space);
+    if (port->methods->writeBulk(port->serialCtx, data, 1) != -1)
+    {
+        failure("non-blocking write to a full buffer", 0, -1);
+    }
+
+    start = CoGetOSTime32();
+    if (port->methods->writeCharBlockingWithTimeout(port->serialCtx, 0, 0) != -1)
+    {
+        failure("write with no timeout to a full buffer", 0, -1);
+    }
+    if (CoGetOSTime32() != start)
+    {
+        failure("ms waited with no timeout", CoGetOSTime32() - start, 0);
+    }
+    if (serial_uart_statistics.txTimeout != timeouts + 2)
+    {
+        failure("TX timeouts", serial_uart_statistics.txTimeout - timeouts, 2);
+    }
+    if (serial_uart_statistics.txOverflow != overflows + 2)
+    {
+        failure("TX overflows", serial_uart_statistics.txOverflow - overflows, 2);
+    }
+    call_check("interrupts or scheduler left off after a timeout");
+
+    line.stalled = false;
+    line_drain();
+    if (line.num_sent != num_written || memcmp(line.sent, written, num_written) != 0)
+    {
+        failure("bytes sent after a stall", line.num_sent, num_written);
+    }
+}
+
+static void received_check(char const * const what, uint8_t const * const data, size_t const len)
+{
+    if (line.num_received != len)
+    {
+        failure(what, line.num_received, len);
+    }
+    else if (memcmp(line.received, data, len) != 0)
+    {
+        failure(what, 0, 1);
+    }
+    line.num_received = 0;
+}
+
+static void random_fill(uint8_t * const data, size_t const len)
+{
+    size_t index;
+
+    for (index = 0; index < len; index++)
+    {
+        data[index] = random_get();
+    }
+}
+
+static void loopback_check(serial_port_st * const port)
+{
+    static char const debug_line[] = "inj 1: pw 3125us dead 850us corr 12us film 2875us @ 3250 rpm\r\n";
+    uint8_t page[1000];
+    unsigned int wakeups;
+
+    line.loopback = true;
+    line.reader_enabled = true;
+    line.num_received = 0;
+
+    wakeups = line.wakeups;
+    if (port->methods->writeBulk(port->serialCtx, (uint8_t const *)debug_line, sizeof debug_line - 1) != 0)
+    {
+        failure("looped back debug line write", -1, 0);
+    }
+    line_drain();
+    received_check("looped back debug line", (uint8_t const *)debug_line, sizeof debug_line - 1);
+    if (line.wakeups - wakeups != 1)
+    {
+        failure("wakeups for a looped back debug line", line.wakeups - wakeups, 1);
+    }
+
+    random_fill(page, sizeof page);
+    wakeups = line.wakeups;
+    if (port->methods->writeBulkBlockingWithTimeout(port->serialCtx, page, sizeof page, WRITE_TIMEOUT_MS) != 0)
+    {
+        failure("looped back page write", -1, 0);
+    }
+    line_drain();
+    received_check("looped back page", page, sizeof page);
+    if (line.wakeups - wakeups > (sizeof page / (USART1_RX_BUFFER_SIZE / 2)) + 2)
+    {
+        failure("wakeups for a looped back page", line.wakeups - wakeups, (sizeof page / (USART1_RX_BUFFER_SIZE / 2)) + 2);
+    }
+
+    line.loopback = false;
+}
+
+/* Bursts from the other end, of lengths around the event points. */
+static void burst_check(void)
+{
+    static size_t const lengths[] = { 1, 2, 63, 64, 65, 127, 128, 129, 255, 256, 257, 1000, 4096 };
+    uint8_t data[4096];
+    size_t index;
+
+    line.reader_enabled = true;
+    line.num_received = 0;
+    for (index = 0; index < ARRAY_SIZE(lengths); index++)
+    {
+        uint32_t const half = USART1_RX_BUFFER_SIZE / 2;
+        uint32_t const start = line.rx_count;
+        unsigned int const wakeups = line.wakeups;
+        unsigned int expected;
+
+        random_fill(data, lengths[index]);
+        line_receive(data, lengths[index]);
+        received_check("burst", data, lengths[index]);
+
+        /* One each half buffer, and one when the line goes idle
+         * unless the burst ended on a half buffer.
+         */
+        expected = ((start + lengths[index]) / half) - (start / half);
+        if (((start + lengths[index]) % half) != 0)
+        {
+            expected++;
+        }
+        if (line.wakeups - wakeups != expected)
+        {
+            failure("wakeups for a burst", line.wakeups - wakeups, expected);
+        }
+    }
+
+    /* An event with nothing new. */
+    index = line.wakeups;
+    line_rx_event();
+    if (line.wakeups != index)
+    {
+        failure("wakeup with nothing received", line.wakeups - index, 0);
+    }
+}
+
+/* The reader falls behind by bursts of these lengths. */
+static void overrun_check(void)
+{
+    static size_t const lengths[] = { USART1_RX_BUFFER_SIZE - 1, USART1_RX_BUFFER_SIZE, USART1_RX_BUFFER_SIZE + 1, 3 * USART1_RX_BUFFER_SIZE + 5 };
+    uint8_t data[4 * USART1_RX_BUFFER_SIZE];
+    size_t index;
+
+    line.num_received = 0;
+    for (index = 0; index < ARRAY_SIZE(lengths); index++)
+    {
+        uint32_t const overruns = serial_uart_statistics.rxBufferOverrun;
+        uint32_t const lost = serial_uart_statistics.rxCharsLost;
+        bool const overrun = lengths[index] >= USART1_RX_BUFFER_SIZE;
+
+        line.reader_enabled = false;
+        random_fill(data, lengths[index]);
+        line_receive(data, lengths[index]);
+        reader_run();
+        received_check(overrun ? "read after an overrun" : "read after falling behind", data, overrun ? 0 : lengths[index]);
+        if (serial_uart_statistics.rxBufferOverrun - overruns != overrun)
+        {
+            failure("overruns", serial_uart_statistics.rxBufferOverrun - overruns, overrun);
+        }
+        if (serial_uart_statistics.rxCharsLost - lost != (overrun ? lengths[index] : 0))
+        {
+            failure("chars lost", serial_uart_statistics.rxCharsLost - lost, overrun ? lengths[index] : 0);
+        }
+
+        /* Reading goes on from the newest chars. */
+        line.reader_enabled = true;
+        random_fill(data, 10);
+        line_receive(data, 10);
+        received_check("read after catching up", data, 10);
+    }
+
+    index = serial_uart_statistics.rxHardwareOverrun;
+    line.isr_depth++;
+    line.cfg.callback.rxOverrun(line.cfg.callback.pv);
+    line.isr_depth--;
+    if (serial_uart_statistics.rxHardwareOverrun != index + 1)
+    {
+        failure("hardware overruns", serial_uart_statistics.rxHardwareOverrun - index, 1);
+    }
+}
+
+/* Moves the count of chars received up to just short of wrapping,
+ * as if the port had been running for a long time, and checks
+ * bursts across the wrap.
+ */
+static void rx_count_wrap_check(void)
+{
+    uart_ctx_st * const pctx = uart_ctx_get();
+    uint8_t data[1000];
+    uint32_t const count = (uint32_t)-512 + (line.rx_count & (USART1_RX_BUFFER_SIZE - 1));
+
+    line.rx_count = count;
+    pctx->rxCharsReceived = count;
+    pctx->rxCharsConsumed = count;
+
+    line.reader_enabled = true;
+    line.num_received = 0;
+    random_fill(data, sizeof data);
+    line_receive(data, sizeof data);
+    received_check("burst across the count wrapping", data, sizeof data);
+    if (line.rx_count > count)
+    {
+        failure("count of chars received didn't wrap", line.rx_count, count);
+    }
+}
+
+static double elapsed_ns(struct timespec const * const start, struct timespec const * const end)
+{
+    return (end->tv_sec - start->tv_sec) * 1.0e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* Writes the same line over and over, with the line keeping up,
+ * so the time is mostly the driver's.
+ */
+static void write_bench(serial_port_st * const port)
+{
+    static char const debug_line[] = "inj 1: pw 3125us dead 850us corr 12us film 2875us @ 3250 rpm\r\n";
+    size_t const len = sizeof debug_line - 1;
+    struct timespec start;
+    struct timespec end;
+    unsigned int index;
+    size_t ch;
+    double bulk_ns;
+    double char_ns;
+
+    line.logging = false;
+    line.finish_on_enable = true;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_LINES; index++)
+    {
+        port->methods->writeBulkBlockingWithTimeout(port->serialCtx, (uint8_t const *)debug_line, len, WRITE_TIMEOUT_MS);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bulk_ns = elapsed_ns(&start, &end) / BENCH_LINES;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_LINES; index++)
+    {
+        for (ch = 0; ch < len; ch++)
+        {
+            port->methods->writeCharBlockingWithTimeout(port->serialCtx, debug_line[ch], WRITE_TIMEOUT_MS);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    char_ns = elapsed_ns(&start, &end) / BENCH_LINES;
+
+    line_drain();
+    printf("%.1f ns per %u byte line in bulk, %.1f ns a char at a time\n", bulk_ns, (unsigned)len, char_ns);
+}
+
+/* Half a buffer at a time is received and read, as in a long
+ * burst, without filling the buffer so only the event and the
+ * reading are timed.
+ */
+static void read_bench(void)
+{
+    uint_fast16_t const half = USART1_RX_BUFFER_SIZE / 2;
+    struct timespec start;
+    struct timespec end;
+    unsigned int block;
+    size_t const received = line.num_received;
+
+    line.reader_enabled = true;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (block = 0; block < BENCH_RX_BLOCKS; block++)
+    {
+        line.rx_count += half;
+        line_rx_event();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (line.num_received - received != (size_t)BENCH_RX_BLOCKS * half)
+    {
+        failure("chars read", line.num_received - received, (long)BENCH_RX_BLOCKS * half);
+    }
+    printf("%.2f ns per char read, in blocks of %u\n", elapsed_ns(&start, &end) / ((double)BENCH_RX_BLOCKS * half), (unsigned)half);
+}
+
+int main(void)
+{
+    serial_port_st * port;
+
+    line.logging = true;
+    port = uartOpen(SERIAL_UART_1, BAUD_RATE, uart_mode_rx | uart_mode_tx, reader_wakeup);
+    if (port == NULL || !line.enabled)
+    {
+        failure("port open", 0, 1);
+        goto done;
+    }
+
+    stream_check(port);
+    stall_check(port);
+    printf("%lu bytes sent in %lu DMA transfers, at most %u copied with interrupts disabled, %lu bulk writes didn't fit\n",
+           (unsigned long)line.num_sent, (unsigned long)serial_uart_statistics.txDmaTransfers,
+           line.most_copied_irq_disabled, (unsigned long)serial_uart_statistics.txOverflow);
+
+    loopback_check(port);
+    burst_check();
+    overrun_check();
+    printf("%lu chars received with %u wakeups, %lu overruns lost %lu chars\n",
+           (unsigned long)line.rx_count, line.wakeups,
+           (unsigned long)serial_uart_statistics.rxBufferOverrun, (unsigned long)serial_uart_statistics.rxCharsLost);
+    rx_count_wrap_check();
+
+    write_bench(port);
+    read_bench();
+
+done:
+    printf("%u failures\n", line.failures);
+
+    return (line.failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
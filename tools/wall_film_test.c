@@ -0,0 +1,262 @@
+/* Step response test and benchmark of the wall film model
+ * (app/wall_film.c). Runs on the host.
+ *
+ * An intake port is simulated in float with the same X-tau model,
+ * using the exact X and beta at the operating point, and the fuel
+ * that reaches the cylinder is worked out for each injection.
+ * Checks that:
+ *   - the precomputed beta matches exp(-(time per cycle) / tau) at
+ *     every table point.
+ *   - with compensation, the fuel reaching the cylinder follows a
+ *     step up in the fuel wanted from the first injection.
+ *   - after a step down, where the walls give up more than is
+ *     wanted, nothing is injected until the film has dried off,
+ *     and then the cylinder gets what is wanted again.
+ *   - without compensation, the same step up runs noticeably lean,
+ *     so the test shows the model matters.
+ * Then measures the injection event path, wall_film_compensate()
+ * and wall_film_injection_scheduled(), and the coefficient lookup
+ * done by the background calculation. Host times are only good
+ * for comparison.
+ *
+ * e.g. wall_film_test
+ */
+#include "wall_film.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#define Q15_ONE 32768.0
+#define SETTLE_EVENTS 500
+#define STEP_EVENTS 50
+#define BENCH_EVENTS 50000000
+#define BENCH_COEFFICIENTS 10000000
+
+#define STEP_RPM 2000
+#define STEP_COOLANT_TEMPERATURE 20
+#define STEP_LOW_US 2000
+#define STEP_HIGH_US 4000
+#define TRACKING_TOLERANCE_US 3.0 /* Rounding of the fixed point model. */
+#define MINIMUM_UNCOMPENSATED_LEAN 0.1 /* Fraction of the step. */
+
+/* The wall film fields of the default fuel page
+ * (app/tune_config.c).
+ */
+static tune_fuel_page_st const fuel_page =
+{
+    .wall_film_rpm_bins = { 500, 1000, 2000, 3000, 4000, 5000, 6000, 7000 },
+    .wall_film_clt_bins = { -20, 0, 20, 40, 60, 80 },
+    .wall_film_evaporation_time_table = { 800, 500, 350, 250, 180, 150 },
+    .wall_film_deposit_fraction_table = { 16384, 13107, 9830, 7864, 6554, 5898 }
+};
+
+typedef struct port_st
+{
+    double x; /* Deposited fraction. */
+    double beta; /* Retained fraction. */
+    double film_us;
+} port_st;
+
+static unsigned int failures;
+
+static void failure(char const * const what, double const got, double const expected)
+{
+    if (failures++ < 20)
+    {
+        fprintf(stderr, "%s: got %.2f expected %.2f\n", what, got, expected);
+    }
+}
+
+/* Returns the fuel that reaches the cylinder. */
+static double port_inject(port_st * const port, double const injection_us)
+{
+    double const evaporated_us = (1.0 - port->beta) * port->film_us;
+
+    port->film_us = (port->beta * port->film_us) + (port->x * injection_us);
+
+    return ((1.0 - port->x) * injection_us) + evaporated_us;
+}
+
+static double event_run(wall_film_st * const wall_film,
+                        wall_film_coefficients_st const * const coefficients,
+                        port_st * const port,
+                        uint32_t const desired_us,
+                        bool const compensate,
+                        uint32_t * const injection_us)
+{
+    *injection_us = wall_film_compensate(wall_film, coefficients, desired_us);
+    if (!compensate)
+    {
+        *injection_us = desired_us;
+        wall_film->pending_injection_us = desired_us;
+    }
+    wall_film_injection_scheduled(wall_film, coefficients);
+
+    return port_inject(port, *injection_us);
+}
+
+static void coefficients_check(void)
+{
+    size_t rpm_index;
+    size_t clt_index;
+
+    for (clt_index = 0; clt_index < WALL_FILM_CLT_BINS; clt_index++)
+    {
+        for (rpm_index = 0; rpm_index < WALL_FILM_RPM_BINS; rpm_index++)
+        {
+            wall_film_coefficients_st coefficients;
+            double const cycle_ms = 120000.0 / fuel_page.wall_film_rpm_bins[rpm_index];
+            double expected = exp(-cycle_ms / fuel_page.wall_film_evaporation_time_table[clt_index]) * Q15_ONE;
+
+            if (expected > 0.95 * Q15_ONE)
+            {
+                expected = 0.95 * Q15_ONE;
+            }
+            wall_film_coefficients_get(&coefficients,
+                                       fuel_page.wall_film_rpm_bins[rpm_index],
+                                       fuel_page.wall_film_clt_bins[clt_index]);
+            if (fabs(coefficients.retained_fraction - expected) > 1.0)
+            {
+                failure("beta at a table point", coefficients.retained_fraction, expected);
+            }
+        }
+    }
+}
+
+/* Returns the worst shortfall in the fuel reaching the cylinder
+ * after a step up.
+ */
+static double step_run(bool const compensate)
+{
+    wall_film_st wall_film;
+    wall_film_coefficients_st coefficients;
+    port_st port;
+    uint32_t injection_us;
+    double worst_shortfall_us = 0.0;
+    unsigned int event;
+
+    wall_film_reset(&wall_film);
+    wall_film_coefficients_get(&coefficients, STEP_RPM, STEP_COOLANT_TEMPERATURE);
+    port.x = coefficients.deposit_fraction / Q15_ONE;
+    port.beta = coefficients.retained_fraction / Q15_ONE;
+    port.film_us = 0.0;
+
+    for (event = 0; event < SETTLE_EVENTS; event++)
+    {
+        event_run(&wall_film, &coefficients, &port, STEP_LOW_US, compensate, &injection_us);
+    }
+
+    for (event = 0; event < STEP_EVENTS; event++)
+    {
+        double const delivered_us = event_run(&wall_film, &coefficients, &port, STEP_HIGH_US, compensate, &injection_us);
+
+        if (STEP_HIGH_US - delivered_us > worst_shortfall_us)
+        {
+            worst_shortfall_us = STEP_HIGH_US - delivered_us;
+        }
+        if (compensate && fabs(delivered_us - STEP_HIGH_US) > TRACKING_TOLERANCE_US)
+        {
+            failure("compensated step up", delivered_us, STEP_HIGH_US);
+        }
+    }
+
+    if (compensate)
+    {
+        bool drying = true;
+
+        /* Down again, and the walls give up more than is wanted. */
+        for (event = 0; event < SETTLE_EVENTS; event++)
+        {
+            double const delivered_us = event_run(&wall_film, &coefficients, &port, STEP_LOW_US / 4, true, &injection_us);
+
+            if (drying && injection_us > 0)
+            {
+                drying = false;
+            }
+            if (drying && delivered_us < STEP_LOW_US / 4)
+            {
+                failure("lean while the film dries", delivered_us, STEP_LOW_US / 4);
+            }
+            if (!drying && fabs(delivered_us - STEP_LOW_US / 4) > TRACKING_TOLERANCE_US)
+            {
+                failure("compensated step down once the film is dry", delivered_us, STEP_LOW_US / 4);
+            }
+        }
+        if (drying)
+        {
+            failure("film never dried", port.film_us, 0.0);
+        }
+    }
+
+    return worst_shortfall_us;
+}
+
+static double elapsed_ns(struct timespec const * const start, struct timespec const * const end)
+{
+    return (end->tv_sec - start->tv_sec) * 1.0e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void wall_film_bench(void)
+{
+    wall_film_st wall_film;
+    wall_film_coefficients_st coefficients;
+    struct timespec start;
+    struct timespec end;
+    uint32_t sum = 0;
+    unsigned int index;
+    double event_ns;
+    double coefficients_ns;
+
+    wall_film_reset(&wall_film);
+    wall_film_coefficients_get(&coefficients, STEP_RPM, STEP_COOLANT_TEMPERATURE);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_EVENTS; index++)
+    {
+        sum += wall_film_compensate(&wall_film, &coefficients, STEP_LOW_US + (index & 0x3ff));
+        wall_film_injection_scheduled(&wall_film, &coefficients);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    event_ns = elapsed_ns(&start, &end) / BENCH_EVENTS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (index = 0; index < BENCH_COEFFICIENTS; index++)
+    {
+        wall_film_coefficients_get(&coefficients, 500 + (index % 6500), (int32_t)(index % 100) - 20);
+        sum += coefficients.retained_fraction;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    coefficients_ns = elapsed_ns(&start, &end) / BENCH_COEFFICIENTS;
+
+    printf("%.1f ns per injection event, %.1f ns per coefficient lookup (sum %lu)\n",
+           event_ns, coefficients_ns, (unsigned long)sum);
+}
+
+int main(void)
+{
+    double compensated_shortfall_us;
+    double uncompensated_shortfall_us;
+
+    wall_film_init(&fuel_page);
+
+    coefficients_check();
+    compensated_shortfall_us = step_run(true);
+    uncompensated_shortfall_us = step_run(false);
+    if (uncompensated_shortfall_us < MINIMUM_UNCOMPENSATED_LEAN * (STEP_HIGH_US - STEP_LOW_US))
+    {
+        failure("uncompensated step up isn't lean", uncompensated_shortfall_us,
+                MINIMUM_UNCOMPENSATED_LEAN * (STEP_HIGH_US - STEP_LOW_US));
+    }
+    printf("step up %u to %u us: worst shortfall %.1f us compensated, %.1f us uncompensated\n",
+           STEP_LOW_US, STEP_HIGH_US, compensated_shortfall_us, uncompensated_shortfall_us);
+
+    wall_film_bench();
+
+    printf("%u failures\n", failures);
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}